@@ -0,0 +1,182 @@
+#include "Allocator.h"
+#include <stdexcept>
+#include <algorithm>
+
+const char* MemoryBudgetExceeded::what() const noexcept
+{
+	return "Memory budget of the image is exceeded";
+}
+
+Allocator::Allocator(Kind kind_, std::size_t budget_)
+	: _upstream(std::pmr::new_delete_resource())
+	, _kind(kind_)
+	, _budget(budget_)
+	, _current(0)
+	, _peak(0)
+	, _retained(0)
+	, _live(0)
+	, _arena_bytes(0)
+{
+	if (kind_ == Kind::Arena)
+	{
+		_owned_upstream.reset(new std::pmr::monotonic_buffer_resource(std::pmr::new_delete_resource()));
+		_upstream = _owned_upstream.get();
+	}
+	else if (kind_ == Kind::Pool)
+	{
+		_owned_upstream.reset(new std::pmr::unsynchronized_pool_resource(std::pmr::new_delete_resource()));
+		_upstream = _owned_upstream.get();
+	}
+}
+
+Allocator::Allocator(std::pmr::memory_resource* upstream_, std::size_t budget_)
+	: _upstream(upstream_)
+	, _kind(Kind::Default)
+	, _budget(budget_)
+	, _current(0)
+	, _peak(0)
+	, _retained(0)
+	, _live(0)
+	, _arena_bytes(0)
+{
+}
+
+void* Allocator::do_allocate(std::size_t bytes_, std::size_t alignment_)
+{
+	this->Charge(bytes_);
+	void* pointer;
+	try
+	{
+		pointer = _upstream->allocate(bytes_, alignment_);
+	}
+	catch (...)
+	{
+		this->Uncharge(bytes_);
+		throw;
+	}
+	_live += bytes_;
+	if (_kind == Kind::Arena)
+	{
+		_arena_bytes += bytes_;
+	}
+	return pointer;
+}
+
+void Allocator::do_deallocate(void* pointer_, std::size_t bytes_, std::size_t alignment_)
+{
+	_upstream->deallocate(pointer_, bytes_, alignment_);
+	_live -= std::min(_live, bytes_);
+	if (_kind != Kind::Arena)
+	{
+		this->Uncharge(bytes_);
+	}
+}
+
+bool Allocator::do_is_equal(const std::pmr::memory_resource& other_) const noexcept
+{
+	return this == &other_;
+}
+
+std::size_t Allocator::image_bytes() const
+{
+	return _current - std::min(_retained, _current);
+}
+
+void Allocator::Charge(std::size_t bytes_)
+{
+	if (_budget && bytes_ > _budget - std::min(this->image_bytes(), _budget))
+	{
+		throw MemoryBudgetExceeded();
+	}
+	_current += bytes_;
+	_peak = std::max(_peak, this->image_bytes());
+}
+
+void Allocator::Uncharge(std::size_t bytes_)
+{
+	_current -= std::min(_current, bytes_);
+}
+
+void Allocator::StartImage()
+{
+	if (_kind == Kind::Arena && !_live)
+	{
+		static_cast<std::pmr::monotonic_buffer_resource*>(_owned_upstream.get())->release();
+		_current -= std::min(_current, _arena_bytes);
+		_arena_bytes = 0;
+	}
+	_retained = _current;
+	_peak = 0;
+}
+
+void Allocator::Reuse(std::size_t bytes_)
+{
+	bytes_ = std::min(bytes_, _retained);
+	if (_budget && bytes_ > _budget - std::min(this->image_bytes(), _budget))
+	{
+		throw MemoryBudgetExceeded();
+	}
+	_retained -= bytes_;
+	_peak = std::max(_peak, this->image_bytes());
+}
+
+void Allocator::Forget(std::size_t bytes_)
+{
+	// an arena keeps the bytes after deallocation too, they stay out of the image
+	if (_kind != Kind::Arena)
+	{
+		_retained -= std::min(_retained, bytes_);
+	}
+}
+
+Allocator::Kind Allocator::GetKind() const
+{
+	return _kind;
+}
+
+std::size_t Allocator::Budget() const
+{
+	return _budget;
+}
+
+std::size_t Allocator::Current() const
+{
+	return this->image_bytes();
+}
+
+std::size_t Allocator::Peak() const
+{
+	return _peak;
+}
+
+std::size_t Allocator::Retained() const
+{
+	return _retained;
+}
+
+Allocator::Kind Allocator::ParseKind(const std::string& name_)
+{
+	if (name_ == "default")
+	{
+		return Kind::Default;
+	}
+	if (name_ == "arena")
+	{
+		return Kind::Arena;
+	}
+	if (name_ == "pool")
+	{
+		return Kind::Pool;
+	}
+	throw std::invalid_argument("Unknown allocator " + name_);
+}
+
+const char* Allocator::KindName(Kind kind_)
+{
+	switch (kind_)
+	{
+	case Kind::Arena: return "arena";
+	case Kind::Pool: return "pool";
+	default: return "default";
+	}
+}
\ No newline at end of file
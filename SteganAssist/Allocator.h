@@ -0,0 +1,84 @@
+#pragma once
+#include<memory_resource>
+#include<memory>
+#include<new>
+#include<string>
+#include<cstddef>
+
+/// Thrown, when the allocation would take the image over its budget, decoding reports it instead of getting OOM-killed
+class MemoryBudgetExceeded : public std::bad_alloc
+{
+public:
+
+	const char* what() const noexcept override;
+};
+
+/// Allocator class, that is the memory of one image: every structure of the decoder takes its memory from here,
+/// so the image knows its current and peak bytes and may be bounded by a hard budget.
+/// Any std::pmr::memory_resource may be plugged as the source, the built-in ones are:
+/// * Default - global operator new, memory is returned as soon as it is freed
+/// * Arena - bump allocation in growing chunks, nothing is returned before the image is gone
+/// * Pool - blocks of the same size are reused without going back to operator new
+/// Not thread-safe, one image is decoded by one thread.
+class Allocator : public std::pmr::memory_resource
+{
+public:
+
+	enum class Kind
+	{
+		Default,
+		Arena,
+		Pool,
+	};
+
+private:
+
+	std::unique_ptr<std::pmr::memory_resource> _owned_upstream;
+	std::pmr::memory_resource* _upstream;
+	Kind _kind;
+	std::size_t _budget;
+	std::size_t _current;
+	std::size_t _peak;
+	std::size_t _retained; // part of _current kept from the images decoded before, not charged to this one
+	std::size_t _live;     // allocated and not deallocated yet, an arena is released once it is zero
+	std::size_t _arena_bytes; // taken from the arena since it was released, they stay in _current
+
+	/// Bytes of the image alone, the budget and the peak are about them
+	std::size_t image_bytes() const;
+
+	void* do_allocate(std::size_t bytes_, std::size_t alignment_) override;
+	void do_deallocate(void* pointer_, std::size_t bytes_, std::size_t alignment_) override;
+	bool do_is_equal(const std::pmr::memory_resource& other_) const noexcept override;
+
+public:
+
+	/// budget_ of 0 means no limit
+	explicit Allocator(Kind kind_ = Kind::Default, std::size_t budget_ = 0);
+	/// Tracks the plugged resource, which must outlive the allocator
+	Allocator(std::pmr::memory_resource* upstream_, std::size_t budget_ = 0);
+	Allocator(const Allocator&) = delete;
+	Allocator& operator=(const Allocator&) = delete;
+
+	/// Memory used by the image, but owned elsewhere, as the file buffer given by the loader
+	void Charge(std::size_t bytes_);
+	void Uncharge(std::size_t bytes_);
+	/// Next image decoded by the same context: storage held now is kept from the images before,
+	/// it is not charged to the new one, the peak is measured again from zero.
+	/// An arena, which holds nothing alive, gives its memory back first, so a reused context does not grow.
+	void StartImage();
+	/// Kept storage of bytes_ is used by the image again, it is charged as if allocated now
+	void Reuse(std::size_t bytes_);
+	/// Kept storage of bytes_ is about to be freed without being used by the image
+	void Forget(std::size_t bytes_);
+
+	Kind GetKind() const;
+	std::size_t Budget() const;
+	/// Bytes taken by the image and not returned, an arena returns nothing before it is destroyed
+	std::size_t Current() const;
+	std::size_t Peak() const;
+	/// Bytes kept from the images before and not used by this one
+	std::size_t Retained() const;
+
+	static Kind ParseKind(const std::string& name_);
+	static const char* KindName(Kind kind_);
+};
\ No newline at end of file
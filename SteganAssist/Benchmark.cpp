@@ -0,0 +1,247 @@
+#include "Benchmark.h"
+#include "SyntheticJpeg.h"
+#include "ImageFileBuffer.h"
+#include "Jpeg.h"
+#include "JpegDecoder.h"
+#include "JpegWriter.h"
+#include "Bmp.h"
+#include "Payload.h"
+#include "Kernels.h"
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <filesystem>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	/// The best time of work_, which is repeated at least 3 times and for at least min_time_ seconds
+	double best_time(const std::function<void()>& work_, double min_time_)
+	{
+		typedef std::chrono::steady_clock clock;
+		double best = 1e300, total = 0;
+		for (int repetition = 0; repetition < 3 || total < min_time_; repetition++)
+		{
+			clock::time_point start = clock::now();
+			work_();
+			double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+			best = std::min(best, elapsed);
+			total += elapsed;
+		}
+		return best;
+	}
+}
+
+double Benchmark::Result::MegabytesPerSecond() const
+{
+	return _seconds > 0 ? _bytes / _seconds / 1e6 : 0;
+}
+
+double Benchmark::Result::MegapixelsPerSecond() const
+{
+	return _seconds > 0 ? _pixels / _seconds / 1e6 : 0;
+}
+
+std::vector<std::string> Benchmark::WriteCorpus(const std::string& directory_)
+{
+	std::filesystem::create_directories(directory_);
+	std::vector<SyntheticJpeg::Parameters> corpus = SyntheticJpeg::Corpus();
+	std::vector<std::string> files;
+	for (int i = 0; i < corpus.size(); i++)
+	{
+		std::string path = (std::filesystem::path(directory_) / corpus[i].Name()).string();
+		std::vector<byte> content = SyntheticJpeg::Generate(corpus[i]);
+		std::ofstream file(path.c_str(), std::ios::binary);
+		file.write(reinterpret_cast<const char*>(content.data()), content.size());
+		if (!file)
+		{
+			throw std::runtime_error("Can't write " + path);
+		}
+		files.push_back(path);
+	}
+	return files;
+}
+
+std::vector<Benchmark::Result> Benchmark::Run(const std::string& directory_, double min_time_per_stage_)
+{
+	const char* stages[] = { "load", "parse", "huffman", "dequant", "idct", "color", "embed", "extract", "bmp_embed", "bmp_extract" };
+	const int number_of_stages = sizeof(stages) / sizeof(stages[0]);
+	std::vector<Result> results(number_of_stages);
+	for (int s = 0; s < number_of_stages; s++)
+	{
+		results[s] = Result{ stages[s], 0, 0, 0 };
+	}
+	auto add = [&results](int stage_, double seconds_, unsigned long long bytes_, unsigned long long pixels_)
+	{
+		results[stage_]._seconds += seconds_;
+		results[stage_]._bytes += bytes_;
+		results[stage_]._pixels += pixels_;
+	};
+
+	std::vector<std::string> files = WriteCorpus(directory_);
+	for (int f = 0; f < files.size(); f++)
+	{
+		std::vector<byte> content = ImageFileBuffer(files[f]).Get();
+		Jpeg decoded{ std::vector<byte>(content) };
+		unsigned long long bytes = content.size();
+		unsigned long long pixels = (unsigned long long)decoded.GetWidth() * decoded.GetHeight();
+		int components = decoded.GetComponentsCount();
+
+		add(0, best_time([&]()
+		{
+			ImageFileBuffer buffer(files[f], std::move(content));
+			content = std::move(buffer).Get();
+		}, min_time_per_stage_), bytes, pixels);
+
+		// the same decoder for every run, as in batch workers, where setup is paid once
+		JpegDecoder decoder;
+		add(1, best_time([&]()
+		{
+			Jpeg& jpeg = decoder.Decode(std::move(content), [](const Jpeg::BlockPosition&, const short*) { return false; });
+			content = jpeg.ReleaseFileContent();
+		}, min_time_per_stage_), bytes, pixels);
+
+		add(2, best_time([&]()
+		{
+			Jpeg& jpeg = decoder.Decode(std::move(content));
+			content = jpeg.ReleaseFileContent();
+		}, min_time_per_stage_), bytes, pixels);
+
+		std::vector<std::vector<float>> dequantized(components);
+		std::vector<std::vector<int>> tables(components, std::vector<int>(64));
+		for (int c = 0; c < components; c++)
+		{
+			dequantized[c].resize(decoded.GetCoefficients(c).size());
+			for (int i = 0; i < 64; i++)
+			{
+				tables[c][i] = decoded.GetQuantizationTable(c)[i / 8][i % 8];
+			}
+		}
+		add(3, best_time([&]()
+		{
+			for (int c = 0; c < components; c++)
+			{
+				const std::pmr::vector<short>& coefficients = decoded.GetCoefficients(c);
+				Kernels::Get()._dequantize(coefficients.data(), tables[c].data(), dequantized[c].data(), coefficients.size() / 64);
+			}
+		}, min_time_per_stage_), bytes, pixels);
+
+		std::vector<std::vector<float>> transformed(components);
+		for (int c = 0; c < components; c++)
+		{
+			transformed[c].resize(dequantized[c].size());
+		}
+		add(4, best_time([&]()
+		{
+			for (int c = 0; c < components; c++)
+			{
+				for (size_t i = 0; i < dequantized[c].size(); i += 64)
+				{
+					Kernels::Get()._inverse_dct(dequantized[c].data() + i, transformed[c].data() + i);
+				}
+			}
+		}, min_time_per_stage_), bytes, pixels);
+
+		std::vector<std::vector<byte>> samples;
+		for (int c = 0; c < components; c++)
+		{
+			samples.push_back(decoded.GetSamples(c));
+		}
+		std::vector<byte> rgb;
+		add(5, best_time([&]()
+		{
+			rgb = decoded.ConvertToRgb(samples);
+		}, min_time_per_stage_), bytes, pixels);
+
+		// the decoded image as a lossless carrier, filled up to its capacity
+		Bmp bitmap(Bmp::WriteRgb(rgb, decoded.GetWidth(), decoded.GetHeight()));
+		unsigned long long bitmap_bytes = bitmap.GetStride() * bitmap.GetHeight();
+		std::vector<byte> bitmap_message(PayloadEmbedder::Capacity(bitmap));
+		for (int i = 0; i < bitmap_message.size(); i++)
+		{
+			bitmap_message[i] = byte(i * 131 + f);
+		}
+		add(8, best_time([&]()
+		{
+			PayloadEmbedder::Embed(bitmap, bitmap_message);
+		}, min_time_per_stage_), bitmap_bytes, pixels);
+
+		add(9, best_time([&]()
+		{
+			if (PayloadExtractor::Extract(bitmap) != bitmap_message)
+			{
+				throw std::runtime_error("Extracted message differs from the embedded one in the bitmap of " + files[f]);
+			}
+		}, min_time_per_stage_), bitmap_bytes, pixels);
+
+		// half of the capacity, but not more than 4 KB, so big images are not dominated by the message
+		unsigned long long capacity = 0;
+		decoded.ForEachBlockInScanOrder([&capacity](const Jpeg::BlockPosition&, const short* coefficients_)
+		{
+			capacity += CountSetBits(Kernels::Get()._usable_mask(coefficients_));
+		});
+		if (capacity < 32 + 8)
+		{
+			continue; // too small to carry even one byte
+		}
+		std::vector<byte> message(std::min<unsigned long long>((capacity - 32) / 16, 4096));
+		for (int i = 0; i < message.size(); i++)
+		{
+			message[i] = byte(i * 131 + f);
+		}
+		std::vector<byte> embedded;
+		add(6, best_time([&]()
+		{
+			PayloadEmbedder::Embed(decoded, message);
+			JpegWriter writer(decoded, std::move(embedded));
+			embedded = writer.Release();
+		}, min_time_per_stage_), bytes, pixels);
+
+		add(7, best_time([&]()
+		{
+			if (PayloadExtractor::Extract(embedded) != message)
+			{
+				throw std::runtime_error("Extracted message differs from the embedded one in " + files[f]);
+			}
+		}, min_time_per_stage_), bytes, pixels);
+	}
+	return results;
+}
+
+std::map<std::string, double> Benchmark::LoadBaseline(const std::string& file_path_)
+{
+	std::ifstream file(file_path_.c_str());
+	if (!file)
+	{
+		throw std::runtime_error("Can't open baseline " + file_path_);
+	}
+	std::map<std::string, double> baseline;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream stream(line);
+		std::string stage;
+		double megapixels_per_second;
+		if (stream >> stage >> megapixels_per_second && stage[0] != '#')
+		{
+			baseline[stage] = megapixels_per_second;
+		}
+	}
+	return baseline;
+}
+
+void Benchmark::SaveBaseline(const std::string& file_path_, const std::vector<Result>& results_)
+{
+	std::ofstream file(file_path_.c_str());
+	file << "# stage megapixels_per_second\n";
+	for (int i = 0; i < results_.size(); i++)
+	{
+		file << results_[i]._stage << " " << results_[i].MegapixelsPerSecond() << "\n";
+	}
+	if (!file)
+	{
+		throw std::runtime_error("Can't write baseline " + file_path_);
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include<map>
+#include<string>
+#include<vector>
+
+/// Benchmark class, that times every stage of the decoder and of the payload path separately
+/// over the synthetic corpus. Every stage is repeated until it runs long enough and the best time
+/// is taken, so short stages on small images are not lost in timer resolution.
+class Benchmark
+{
+public:
+
+	struct Result
+	{
+		std::string _stage;
+		double _seconds;               // sum of the best times over the corpus
+		unsigned long long _bytes;     // compressed size of the images the stage ran over
+		unsigned long long _pixels;
+
+		double MegabytesPerSecond() const;
+		double MegapixelsPerSecond() const;
+	};
+
+	/// Stages: load, parse (headers up to the first block), huffman (entropy decoding of all blocks),
+	/// dequant, idct, color, embed (payload and re-encoding), extract, and bmp_embed and bmp_extract
+	/// of spatial payload in the decoded image written as a 24-bit bitmap, which sizes count pixel data.
+	/// The corpus is written into directory_ first, so loading is measured on real files.
+	static std::vector<Result> Run(const std::string& directory_, double min_time_per_stage_ = 0.05);
+
+	/// Writes the synthetic corpus, returns paths of the files
+	static std::vector<std::string> WriteCorpus(const std::string& directory_);
+
+	/// Baseline file has a line "stage megapixels_per_second" for every stage
+	static std::map<std::string, double> LoadBaseline(const std::string& file_path_);
+	static void SaveBaseline(const std::string& file_path_, const std::vector<Result>& results_);
+};
\ No newline at end of file
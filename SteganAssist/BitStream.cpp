@@ -1,4 +1,5 @@
 #include"BitStream.h"
+#include"Instrumentation.h"
 
 
 InputBitStream::InputBitStream(const std::vector<unsigned char>& buffer_)
@@ -6,6 +7,18 @@ InputBitStream::InputBitStream(const std::vector<unsigned char>& buffer_)
 	, _index(0)
 	, _bit_number(7)
 	, _stream_end(false)
+	, _byte_stuffing(false)
+	, _marker_reached(false)
+{
+}
+
+InputBitStream::InputBitStream(std::vector<unsigned char>&& buffer_)
+	: _buffer(std::move(buffer_))
+	, _index(0)
+	, _bit_number(7)
+	, _stream_end(false)
+	, _byte_stuffing(false)
+	, _marker_reached(false)
 {
 }
 
@@ -14,12 +27,24 @@ InputBitStream::InputBitStream(const std::string & buffer_)
 	, _index(0)
 	, _bit_number(7)
 	, _stream_end(false)
+	, _byte_stuffing(false)
+	, _marker_reached(false)
 {
 }
 
+bool InputBitStream::is_marker_at(int index_) const
+{
+	return index_ + 1 < _buffer.size() && _buffer[index_] == 0xFF && _buffer[index_ + 1] != 0x00;
+}
+
 InputBitStream & InputBitStream::operator>>(bit& value_)
 {
 	value_ = 0;
+	if (_byte_stuffing && _bit_number == 7 && is_marker_at(_index))
+	{
+		_marker_reached = true;
+		return *this;
+	}
 	if (_index < _buffer.size())
 	{
 		value_ = bool(_buffer[_index] & (1 << _bit_number));
@@ -27,6 +52,11 @@ InputBitStream & InputBitStream::operator>>(bit& value_)
 		if (_bit_number == -1)
 		{
 			_bit_number = 7;
+			if (_byte_stuffing && _buffer[_index] == 0xFF)
+			{
+				_index++; // stuffed 0x00
+				INSTRUMENT(DecodeCounters::Current()._stuffed_bytes++);
+			}
 			_index++;
 		}
 	}
@@ -80,3 +110,215 @@ unsigned int InputBitStream::Size() const
 {
 	return _buffer.size() - _index;
 }
+
+std::vector<unsigned char> InputBitStream::Release()
+{
+	std::vector<unsigned char> buffer = std::move(_buffer);
+	_buffer.clear();
+	_index = 0;
+	_bit_number = 7;
+	return buffer;
+}
+
+const unsigned char* InputBitStream::Data() const
+{
+	return _buffer.data();
+}
+
+int InputBitStream::Position() const
+{
+	return _index;
+}
+
+int InputBitStream::BitPosition() const
+{
+	return 7 - _bit_number;
+}
+
+void InputBitStream::Seek(int position_, int bit_position_)
+{
+	_index = position_;
+	_bit_number = 7 - bit_position_;
+	_stream_end = false;
+	_marker_reached = false;
+}
+
+void InputBitStream::SetByteStuffing(bool enabled_)
+{
+	_byte_stuffing = enabled_;
+	_marker_reached = false;
+}
+
+bool InputBitStream::MarkerReached() const
+{
+	return _marker_reached;
+}
+
+void InputBitStream::AlignToByte()
+{
+	if (_bit_number != 7)
+	{
+		if (_byte_stuffing && _buffer[_index] == 0xFF)
+		{
+			_index++; // stuffed 0x00
+		}
+		_bit_number = 7;
+		_index++;
+	}
+}
+
+int InputBitStream::ReadBits(int number_of_bits_)
+{
+	int value = int(this->PeekBits(number_of_bits_));
+	this->SkipBits(number_of_bits_);
+	return value;
+}
+
+unsigned int InputBitStream::PeekBits(int number_of_bits_) const
+{
+	// gathers whole bytes starting from the current one, bits of the current byte,
+	// which are already read, stay in the high part of the window
+	unsigned int window = 0;
+	int window_bits = 0;
+	int read_bits = 7 - _bit_number;
+	int index = _index;
+	while (window_bits - read_bits < number_of_bits_)
+	{
+		unsigned char next = 0;
+		if (index < _buffer.size() && !(_byte_stuffing && is_marker_at(index)))
+		{
+			next = _buffer[index];
+			index += (_byte_stuffing && next == 0xFF) ? 2 : 1;
+		}
+		else
+		{
+			index = int(_buffer.size()) + 1; // zeros up to the end
+		}
+		window = (window << 8) | next;
+		window_bits += 8;
+	}
+	return (window >> (window_bits - read_bits - number_of_bits_)) & ((1u << number_of_bits_) - 1);
+}
+
+void InputBitStream::SkipBits(int number_of_bits_)
+{
+	while (number_of_bits_ > 0)
+	{
+		if (_byte_stuffing && _bit_number == 7 && is_marker_at(_index))
+		{
+			_marker_reached = true;
+			return;
+		}
+		if (_index >= _buffer.size())
+		{
+			_stream_end = true;
+			return;
+		}
+		int skipped = std::min(number_of_bits_, _bit_number + 1);
+		_bit_number -= skipped;
+		number_of_bits_ -= skipped;
+		if (_bit_number == -1)
+		{
+			_bit_number = 7;
+			if (_byte_stuffing && _buffer[_index] == 0xFF)
+			{
+				_index++; // stuffed 0x00
+				INSTRUMENT(DecodeCounters::Current()._stuffed_bytes++);
+			}
+			_index++;
+		}
+	}
+}
+
+OutputBitStream::OutputBitStream()
+	: _current_byte(0)
+	, _bit_number(7)
+	, _byte_stuffing(false)
+{
+}
+
+OutputBitStream::OutputBitStream(std::vector<unsigned char>&& buffer_)
+	: _buffer(std::move(buffer_))
+	, _current_byte(0)
+	, _bit_number(7)
+	, _byte_stuffing(false)
+{
+	_buffer.clear();
+}
+
+void OutputBitStream::push_byte(unsigned char value_)
+{
+	_buffer.push_back(value_);
+	if (_byte_stuffing && value_ == 0xFF)
+	{
+		_buffer.push_back(0x00);
+	}
+}
+
+void OutputBitStream::SetByteStuffing(bool enabled_)
+{
+	_byte_stuffing = enabled_;
+}
+
+void OutputBitStream::AlignToByte()
+{
+	while (_bit_number != 7)
+	{
+		*this << bit(1);
+	}
+}
+
+void OutputBitStream::WriteBits(unsigned int value_, int number_of_bits_)
+{
+	for (int i = number_of_bits_ - 1; i >= 0; i--)
+	{
+		*this << bit((value_ >> i) & 1);
+	}
+}
+
+void OutputBitStream::WriteBytes(const unsigned char* data_, std::size_t size_)
+{
+	_buffer.insert(_buffer.end(), data_, data_ + size_);
+}
+
+unsigned int OutputBitStream::Size() const
+{
+	return _buffer.size();
+}
+
+const std::vector<unsigned char>& OutputBitStream::Get() const
+{
+	return _buffer;
+}
+
+std::vector<unsigned char>& OutputBitStream::Get()
+{
+	return _buffer;
+}
+
+std::vector<unsigned char> OutputBitStream::Release()
+{
+	std::vector<unsigned char> buffer = std::move(_buffer);
+	_buffer.clear();
+	return buffer;
+}
+
+OutputBitStream & OutputBitStream::operator<<(bit value_)
+{
+	_current_byte |= value_ << _bit_number;
+	_bit_number--;
+	if (_bit_number == -1)
+	{
+		push_byte(_current_byte);
+		_current_byte = 0;
+		_bit_number = 7;
+	}
+	return *this;
+}
+
+OutputBitStream & OutputBitStream::operator<<(byte value_)
+{
+	// whole bytes are written only between entropy-coded segments
+	push_byte(value_);
+	return *this;
+}
@@ -25,10 +25,15 @@ private:
 	int _index;
 	int _bit_number;
 	bool _stream_end;
+	bool _byte_stuffing;
+	bool _marker_reached;
+
+	bool is_marker_at(int index_) const;
 
 public:
 
 	InputBitStream(const std::vector<unsigned char>& buffer_);
+	InputBitStream(std::vector<unsigned char>&& buffer_);
 	InputBitStream(const std::string& buffer_);
 	explicit operator bool() const;
 
@@ -36,6 +41,30 @@ public:
 	void BytesBack(int number_of_chars_to_revert_);
 
 	unsigned int Size() const;
+	/// The whole buffer, Position indexes into it
+	const unsigned char* Data() const;
+	/// Gives the buffer away for reuse, the stream is empty afterwards
+	std::vector<unsigned char> Release();
+	/// Index of the byte, which will be read next
+	int Position() const;
+	/// Bits of the byte at Position, which are already read, 0-7
+	int BitPosition() const;
+	/// Moves to bit bit_position_ of byte position_, as returned by Position and BitPosition.
+	/// Markers and the end met before are forgotten, byte stuffing stays as it is.
+	void Seek(int position_, int bit_position_);
+
+	/// [F.1.2.3] Inside of entropy-coded segment every 0xFF byte is followed by stuffed 0x00 byte,
+	/// which must be skipped, and 0xFF followed by anything else is a marker, which ends the segment.
+	/// While stuffing is enabled, reaching the marker makes bit reads return zeros.
+	void SetByteStuffing(bool enabled_);
+	bool MarkerReached() const;
+	/// Skips remaining bits of current byte, used before restart markers and at the end of scan
+	void AlignToByte();
+	/// Reads number_of_bits_ bits, most significant first, up to 16 bits
+	int ReadBits(int number_of_bits_);
+	/// Next number_of_bits_ bits (up to 16) without moving the position, bits past the marker or the end are zeros
+	unsigned int PeekBits(int number_of_bits_) const;
+	void SkipBits(int number_of_bits_);
 
 	InputBitStream& operator>> (bit& value);
 	InputBitStream& operator>> (byte& value);
@@ -62,10 +91,40 @@ public:
 //	return ibs_;
 //}
 
-/// InputBitStream class, that allows write to buffer bit by bit
+/// OutputBitStream class, that allows write to buffer bit by bit
 class OutputBitStream
 {
-	// TODO
+private:
+
+	std::vector<unsigned char> _buffer;
+	unsigned char _current_byte;
+	int _bit_number;
+	bool _byte_stuffing;
+
+	void push_byte(unsigned char value_);
+
+public:
+
+	OutputBitStream();
+	/// Writes into the recycled buffer, its old content is dropped but the storage is kept
+	OutputBitStream(std::vector<unsigned char>&& buffer_);
+
+	/// [F.1.2.3] While stuffing is enabled, 0x00 is written after every 0xFF byte of entropy-coded data
+	void SetByteStuffing(bool enabled_);
+	/// Pads the current byte with 1-bits, as required before markers
+	void AlignToByte();
+	/// Writes number_of_bits_ lowest bits of value_, most significant first
+	void WriteBits(unsigned int value_, int number_of_bits_);
+	/// Appends bytes as they are, without stuffing, the stream must be aligned to a byte
+	void WriteBytes(const unsigned char* data_, std::size_t size_);
+
+	unsigned int Size() const;
+	const std::vector<unsigned char>& Get() const;
+	std::vector<unsigned char>& Get();
+	std::vector<unsigned char> Release();
+
+	OutputBitStream& operator<< (bit value);
+	OutputBitStream& operator<< (byte value);
 };
 
 
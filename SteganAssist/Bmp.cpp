@@ -0,0 +1,498 @@
+#include "Bmp.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	const unsigned int embedded_profile = 0x4D424544; // 'MBED', linked 'LINK' profiles name a file and are not read
+
+	void put_u16(std::vector<byte>& output_, std::size_t offset_, unsigned int value_)
+	{
+		output_[offset_] = byte(value_);
+		output_[offset_ + 1] = byte(value_ >> 8);
+	}
+
+	void put_u32(std::vector<byte>& output_, std::size_t offset_, unsigned int value_)
+	{
+		put_u16(output_, offset_, value_ & 0xFFFF);
+		put_u16(output_, offset_ + 2, value_ >> 16);
+	}
+
+	/// Channel of a 32-bit pixel scaled to 8 bits, whatever width its mask has
+	byte masked_channel(unsigned int pixel_, unsigned int mask_)
+	{
+		if (!mask_)
+		{
+			return 0;
+		}
+		int shift = 0;
+		while (!(mask_ >> shift & 1))
+		{
+			shift++;
+		}
+		unsigned long long maximum = mask_ >> shift;
+		return byte(((pixel_ & mask_) >> shift) * 255 / maximum);
+	}
+}
+
+Bmp::Bmp(std::vector<byte>&& file_content_)
+	: _file_content(std::move(file_content_))
+	, _width(0)
+	, _height(0)
+	, _bits_per_pixel(0)
+	, _top_down(false)
+	, _pixel_offset(0)
+	, _stride(0)
+	, _masks{ 0, 0, 0, 0 }
+	, _profile_offset(0)
+	, _profile_size(0)
+{
+	DecodeStatus status = this->parse();
+	if (!status.Ok())
+	{
+		throw DecodeException(status);
+	}
+}
+
+Bmp::Bmp(std::vector<byte>&& file_content_, DecodeStatus& status_)
+	: _file_content(std::move(file_content_))
+	, _width(0)
+	, _height(0)
+	, _bits_per_pixel(0)
+	, _top_down(false)
+	, _pixel_offset(0)
+	, _stride(0)
+	, _masks{ 0, 0, 0, 0 }
+	, _profile_offset(0)
+	, _profile_size(0)
+{
+	status_ = this->parse();
+}
+
+unsigned int Bmp::read_u16(std::size_t offset_) const
+{
+	return _file_content[offset_] | _file_content[offset_ + 1] << 8;
+}
+
+unsigned int Bmp::read_u32(std::size_t offset_) const
+{
+	return this->read_u16(offset_) | this->read_u16(offset_ + 2) << 16;
+}
+
+DecodeStatus Bmp::parse()
+{
+	std::size_t size = _file_content.size();
+	if (!IsBmp(_file_content))
+	{
+		return DecodeStatus(DecodeError::InvalidBitmapHeader, 0, "file header");
+	}
+	if (size < file_header_size + 4)
+	{
+		return DecodeStatus(DecodeError::TruncatedData, int(size), "file header");
+	}
+	_pixel_offset = this->read_u32(10);
+
+	const std::size_t header = file_header_size;
+	std::size_t header_size = this->read_u32(header);
+	bool core = header_size == 12;
+	// V2 and V3 add color masks, OS/2 2.x its own fields, V4 color space and V5 the profile
+	if (!core && header_size != 16 && header_size != 40 && header_size != 52 && header_size != 56 &&
+		header_size != 64 && header_size != 108 && header_size != 124)
+	{
+		return DecodeStatus(DecodeError::InvalidBitmapHeader, int(header), "info header");
+	}
+	if (header + header_size > size)
+	{
+		return DecodeStatus(DecodeError::TruncatedData, int(size), "info header");
+	}
+
+	long long width, height;
+	unsigned int planes, compression = BI_RGB, colors_used = 0;
+	if (core)
+	{
+		width = this->read_u16(header + 4);
+		height = this->read_u16(header + 6);
+		planes = this->read_u16(header + 8);
+		_bits_per_pixel = this->read_u16(header + 10);
+	}
+	else
+	{
+		width = int(this->read_u32(header + 4));
+		height = int(this->read_u32(header + 8));
+		planes = this->read_u16(header + 12);
+		_bits_per_pixel = this->read_u16(header + 14);
+		if (header_size >= info_header_size)
+		{
+			compression = this->read_u32(header + 16);
+			colors_used = this->read_u32(header + 32);
+		}
+	}
+	_top_down = height < 0;
+	height = _top_down ? -height : height;
+	if (planes != 1 || width <= 0 || height <= 0 || height > 0x7FFFFFFF)
+	{
+		return DecodeStatus(DecodeError::InvalidBitmapHeader, int(header), "info header");
+	}
+	_width = int(width);
+	_height = int(height);
+
+	bool bit_fields = compression == BI_BITFIELDS || compression == BI_ALPHABITFIELDS;
+	if ((compression != BI_RGB && !(bit_fields && _bits_per_pixel == 32)) ||
+		(_bits_per_pixel != 1 && _bits_per_pixel != 4 && _bits_per_pixel != 8 && _bits_per_pixel != 24 && _bits_per_pixel != 32))
+	{
+		return DecodeStatus(DecodeError::UnsupportedBitmap, int(header), "info header");
+	}
+
+	// masks and palette follow the header
+	std::size_t table = header + header_size;
+	if (!bit_fields)
+	{
+		_masks[0] = 0x00FF0000;
+		_masks[1] = 0x0000FF00;
+		_masks[2] = 0x000000FF;
+	}
+	else
+	{
+		// V2 and later headers contain the masks, BITMAPINFOHEADER is followed by them
+		int masks = compression == BI_ALPHABITFIELDS ? 4 : 3;
+		std::size_t offset = header + info_header_size;
+		if (header_size == info_header_size)
+		{
+			table += 4 * masks;
+			if (table > size)
+			{
+				return DecodeStatus(DecodeError::TruncatedData, int(size), "color masks");
+			}
+		}
+		else if (header_size == 56 || header_size >= 108)
+		{
+			masks = 4;
+		}
+		else if (header_size != 52)
+		{
+			// compression 3 of OS/2 2.x headers is Huffman coding
+			return DecodeStatus(DecodeError::UnsupportedBitmap, int(header), "info header");
+		}
+		for (int m = 0; m < masks; m++)
+		{
+			_masks[m] = this->read_u32(offset + 4 * m);
+		}
+		if (!_masks[0] || !_masks[1] || !_masks[2])
+		{
+			return DecodeStatus(DecodeError::InvalidBitmapHeader, int(offset), "color masks");
+		}
+	}
+
+	if (_bits_per_pixel <= 8)
+	{
+		std::size_t colors = colors_used ? colors_used : std::size_t(1) << _bits_per_pixel;
+		int entry = core ? 3 : 4;
+		if (colors > std::size_t(1) << _bits_per_pixel)
+		{
+			return DecodeStatus(DecodeError::InvalidBitmapHeader, int(header), "palette");
+		}
+		if (table + colors * entry > size)
+		{
+			return DecodeStatus(DecodeError::TruncatedData, int(size), "palette");
+		}
+		_palette.resize(colors);
+		for (std::size_t i = 0; i < colors; i++)
+		{
+			const byte* color = _file_content.data() + table + i * entry;
+			_palette[i] = Color{ color[0], color[1], color[2], 0 };
+		}
+	}
+
+	// [BITMAPV5HEADER] profile offset is counted from the start of the header, a profile outside of the file is ignored
+	if (header_size >= 124 && this->read_u32(header + 56) == embedded_profile)
+	{
+		std::size_t offset = header + this->read_u32(header + 112);
+		std::size_t profile_size = this->read_u32(header + 116);
+		if (profile_size && offset < size && profile_size <= size - offset)
+		{
+			_profile_offset = offset;
+			_profile_size = profile_size;
+		}
+	}
+
+	_stride = (std::size_t(_width) * _bits_per_pixel + 31) / 32 * 4;
+	if (_pixel_offset < header + header_size || _pixel_offset > size)
+	{
+		return DecodeStatus(DecodeError::InvalidBitmapHeader, 10, "file header");
+	}
+	// the stride is checked first, so the product does not overflow
+	std::size_t available = size - _pixel_offset;
+	if (_stride > available || std::size_t(_height) > available / _stride)
+	{
+		return DecodeStatus(DecodeError::TruncatedData, int(size), "pixels");
+	}
+	return DecodeStatus();
+}
+
+bool Bmp::IsBmp(const std::vector<byte>& file_content_)
+{
+	return file_content_.size() >= 2 && file_content_[0] == 'B' && file_content_[1] == 'M';
+}
+
+std::vector<byte> Bmp::ReleaseFileContent()
+{
+	return std::move(_file_content);
+}
+
+int Bmp::GetWidth() const
+{
+	return _width;
+}
+
+int Bmp::GetHeight() const
+{
+	return _height;
+}
+
+int Bmp::GetBitsPerPixel() const
+{
+	return _bits_per_pixel;
+}
+
+bool Bmp::IsPalettized() const
+{
+	return _bits_per_pixel <= 8;
+}
+
+bool Bmp::IsGrayscale() const
+{
+	if (_bits_per_pixel != 8 || _palette.size() != 256)
+	{
+		return false;
+	}
+	for (int i = 0; i < 256; i++)
+	{
+		if (_palette[i]._blue != i || _palette[i]._green != i || _palette[i]._red != i)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+const std::vector<Bmp::Color>& Bmp::GetPalette() const
+{
+	return _palette;
+}
+
+int Bmp::GetBytesPerPixel() const
+{
+	return _bits_per_pixel / 8;
+}
+
+std::size_t Bmp::GetStride() const
+{
+	return _stride;
+}
+
+const byte* Bmp::Row(int y_) const
+{
+	return _file_content.data() + _pixel_offset + std::size_t(_top_down ? y_ : _height - 1 - y_) * _stride;
+}
+
+byte* Bmp::Row(int y_)
+{
+	return _file_content.data() + _pixel_offset + std::size_t(_top_down ? y_ : _height - 1 - y_) * _stride;
+}
+
+const byte* Bmp::GetProfileData() const
+{
+	return _profile_size ? _file_content.data() + _profile_offset : nullptr;
+}
+
+std::size_t Bmp::GetProfileSize() const
+{
+	return _profile_size;
+}
+
+IccProfile Bmp::GetIccProfile() const
+{
+	return IccProfile(this->GetProfileData(), _profile_size);
+}
+
+void Bmp::read_rgb(const byte* row_, int x_, byte* rgb_) const
+{
+	if (_bits_per_pixel == 24)
+	{
+		const byte* pixel = row_ + x_ * 3;
+		rgb_[0] = pixel[2];
+		rgb_[1] = pixel[1];
+		rgb_[2] = pixel[0];
+	}
+	else if (_bits_per_pixel == 32)
+	{
+		unsigned int pixel = row_[x_ * 4] | row_[x_ * 4 + 1] << 8 | row_[x_ * 4 + 2] << 16 | unsigned(row_[x_ * 4 + 3]) << 24;
+		for (int c = 0; c < 3; c++)
+		{
+			rgb_[c] = masked_channel(pixel, _masks[c]);
+		}
+	}
+	else
+	{
+		// indices are packed from the most significant bits, ones outside of the palette are black
+		int per_byte = 8 / _bits_per_pixel;
+		int shift = 8 - _bits_per_pixel * (x_ % per_byte + 1);
+		std::size_t index = row_[x_ / per_byte] >> shift & ((1 << _bits_per_pixel) - 1);
+		Color color = index < _palette.size() ? _palette[index] : Color{ 0, 0, 0, 0 };
+		rgb_[0] = color._red;
+		rgb_[1] = color._green;
+		rgb_[2] = color._blue;
+	}
+}
+
+int Bmp::component_offset(int component_) const
+{
+	if (_bits_per_pixel == 24)
+	{
+		return 2 - component_;
+	}
+	if (_bits_per_pixel == 32)
+	{
+		for (int offset = 0; offset < 4; offset++)
+		{
+			if (_masks[component_] == 0xFFu << offset * 8)
+			{
+				return offset;
+			}
+		}
+		return -1;
+	}
+	// palette indices are the samples only for the gray ramp
+	return this->IsGrayscale() ? 0 : -1;
+}
+
+int Bmp::GetComponentsCount() const
+{
+	return this->IsGrayscale() ? 1 : 3;
+}
+
+int Bmp::GetComponentWidth(int component_) const
+{
+	return _width;
+}
+
+int Bmp::GetComponentHeight(int component_) const
+{
+	return _height;
+}
+
+PlaneView<const byte> Bmp::GetSampleTile(int component_, int x_, int y_, int width_, int height_, std::vector<byte>& scratch_) const
+{
+	PlaneView<byte> view = const_cast<Bmp*>(this)->GetWritableSampleTile(component_, x_, y_, width_, height_);
+	if (view)
+	{
+		return PlaneView<const byte>(view._data, view._width, view._height, view._stride, view._step);
+	}
+	scratch_.resize(std::size_t(width_) * height_);
+	for (int y = 0; y < height_; y++)
+	{
+		const byte* row = this->Row(y_ + y);
+		for (int x = 0; x < width_; x++)
+		{
+			byte rgb[3];
+			this->read_rgb(row, x_ + x, rgb);
+			scratch_[std::size_t(y) * width_ + x] = rgb[component_];
+		}
+	}
+	return PlaneView<const byte>(scratch_.data(), width_, height_, width_);
+}
+
+PlaneView<byte> Bmp::GetWritableSampleTile(int component_, int x_, int y_, int width_, int height_)
+{
+	int offset = this->component_offset(component_);
+	if (offset < 0)
+	{
+		return PlaneView<byte>();
+	}
+	int step = _bits_per_pixel / 8;
+	std::ptrdiff_t stride = _top_down ? std::ptrdiff_t(_stride) : -std::ptrdiff_t(_stride);
+	return PlaneView<byte>(this->Row(y_) + std::ptrdiff_t(x_) * step + offset, width_, height_, stride, step);
+}
+
+std::vector<byte> Bmp::ConvertToRgb() const
+{
+	std::vector<byte> rgb(std::size_t(_width) * _height * 3);
+	for (int y = 0; y < _height; y++)
+	{
+		const byte* row = this->Row(y);
+		byte* output = rgb.data() + std::size_t(y) * _width * 3;
+		for (int x = 0; x < _width; x++, output += 3)
+		{
+			this->read_rgb(row, x, output);
+		}
+	}
+	return rgb;
+}
+
+std::vector<byte> Bmp::Write(const byte* pixels_, int width_, int height_, int bits_per_pixel_,
+	const std::vector<Color>& palette_, bool top_down_)
+{
+	if (bits_per_pixel_ != 1 && bits_per_pixel_ != 4 && bits_per_pixel_ != 8 && bits_per_pixel_ != 24 && bits_per_pixel_ != 32)
+	{
+		throw std::invalid_argument("Unsupported bits per pixel " + std::to_string(bits_per_pixel_));
+	}
+	if (width_ <= 0 || height_ <= 0)
+	{
+		throw std::invalid_argument("Bitmap must have at least one pixel");
+	}
+	if ((bits_per_pixel_ <= 8) != !palette_.empty() || (bits_per_pixel_ <= 8 && palette_.size() > std::size_t(1) << bits_per_pixel_))
+	{
+		throw std::invalid_argument("Palette must be given for 1, 4 and 8 bits per pixel only, with at most 2^bits colors");
+	}
+	std::size_t row_bytes = (std::size_t(width_) * bits_per_pixel_ + 7) / 8;
+	std::size_t stride = (std::size_t(width_) * bits_per_pixel_ + 31) / 32 * 4;
+	std::size_t pixel_offset = file_header_size + info_header_size + palette_.size() * 4;
+	std::vector<byte> output(pixel_offset + stride * height_);
+
+	output[0] = 'B';
+	output[1] = 'M';
+	put_u32(output, 2, unsigned(output.size()));
+	put_u32(output, 10, unsigned(pixel_offset));
+
+	const std::size_t header = file_header_size;
+	put_u32(output, header, info_header_size);
+	put_u32(output, header + 4, unsigned(width_));
+	put_u32(output, header + 8, unsigned(top_down_ ? -height_ : height_));
+	put_u16(output, header + 12, 1);
+	put_u16(output, header + 14, unsigned(bits_per_pixel_));
+	put_u32(output, header + 16, BI_RGB);
+	put_u32(output, header + 20, unsigned(stride * height_));
+	put_u32(output, header + 24, 2835); // 72 dpi
+	put_u32(output, header + 28, 2835);
+	put_u32(output, header + 32, unsigned(palette_.size()));
+
+	for (std::size_t i = 0; i < palette_.size(); i++)
+	{
+		byte* color = output.data() + header + info_header_size + i * 4;
+		color[0] = palette_[i]._blue;
+		color[1] = palette_[i]._green;
+		color[2] = palette_[i]._red;
+	}
+	for (int y = 0; y < height_; y++)
+	{
+		std::size_t stored = top_down_ ? y : height_ - 1 - y;
+		std::memcpy(output.data() + pixel_offset + stored * stride, pixels_ + y * row_bytes, row_bytes);
+	}
+	return output;
+}
+
+std::vector<byte> Bmp::WriteRgb(const std::vector<byte>& rgb_, int width_, int height_)
+{
+	if (rgb_.size() != std::size_t(width_) * height_ * 3)
+	{
+		throw std::invalid_argument("RGB buffer does not match the dimensions");
+	}
+	std::vector<byte> bgr(rgb_.size());
+	for (std::size_t i = 0; i < rgb_.size(); i += 3)
+	{
+		bgr[i] = rgb_[i + 2];
+		bgr[i + 1] = rgb_[i + 1];
+		bgr[i + 2] = rgb_[i];
+	}
+	return Write(bgr.data(), width_, height_, 24);
+}
\ No newline at end of file
@@ -1,36 +1,120 @@
 #pragma once
+#include<vector>
+#include<string>
 #include"BitStream.h"
 #include"ImageFileBuffer.h"
 #include"Image.h"
+#include"DecodeStatus.h"
+#include"Icc.h"
 
-// [ICC.1:2010]
+// [Windows GDI : Bitmap Storage] BITMAPFILEHEADER, then BITMAPCOREHEADER, BITMAPINFOHEADER, BITMAPV4HEADER
+// or BITMAPV5HEADER, optional color masks and palette, and rows of pixels padded to 4 bytes.
+// Pixels are never copied out of the file buffer, rows are read and changed right inside of it.
 class Bmp : public Image
 {
-	InputBitStream _image_content;
-	enum class types
+public:
+
+	/// RGBQUAD, in the order the palette stores it
+	struct Color
 	{
-		dateTimeNumber,
-		float32Number,
-		positionNumber,
-		response16Number,
-		s15Fixed16Number,
-		u16Fixed16Number,
-		u1Fixed15Number,
-		u8Fixed8Number,
-		uInt8Number,
-		uInt16Number,
-		uInt32Number,
-		uInt64Number,
-		XYZNumber,
+		byte _blue;
+		byte _green;
+		byte _red;
+		byte _reserved;
+	};
+
+private:
 
+	static const int file_header_size = 14;
+	static const int info_header_size = 40;
+
+	enum compressions
+	{
+		BI_RGB = 0,
+		BI_RLE8 = 1,
+		BI_RLE4 = 2,
+		BI_BITFIELDS = 3,
+		BI_JPEG = 4,
+		BI_PNG = 5,
+		BI_ALPHABITFIELDS = 6,
 	};
 
+	std::vector<byte> _file_content;
+	int _width;
+	int _height;
+	int _bits_per_pixel;
+	bool _top_down;            // first stored row is the top one, negative height in the header
+	std::size_t _pixel_offset; // of the first stored row
+	std::size_t _stride;       // bytes per stored row, padding included
+	std::vector<Color> _palette;
+	unsigned int _masks[4];    // red, green, blue and alpha of 32-bit pixels
+	std::size_t _profile_offset; // [BITMAPV5HEADER] embedded ICC profile, 0 when there is none
+	std::size_t _profile_size;
 
+	DecodeStatus parse();
+	/// Red, green and blue of pixel x_ of the row, whatever the pixel format is
+	void read_rgb(const byte* row_, int x_, byte* rgb_) const;
+	/// Byte of the component in the pixel, when pixels store it as a byte, -1 otherwise
+	int component_offset(int component_) const;
+	unsigned int read_u16(std::size_t offset_) const;
+	unsigned int read_u32(std::size_t offset_) const;
 
 public:
+
 	Bmp(const std::string& file_path_)
-		: _image_content(ImageFileBuffer(file_path_).Get())
+		: Bmp(ImageFileBuffer(file_path_).Get())
 	{
-		
 	}
+
+	/// Throws DecodeException for malformed and unsupported files.
+	/// The buffer may be taken back with ReleaseFileContent, changed pixels included.
+	explicit Bmp(std::vector<byte>&& file_content_);
+	/// Non-throwing, malformed and unsupported files are reported by status_, only the file content is usable then
+	Bmp(std::vector<byte>&& file_content_, DecodeStatus& status_);
+
+	/// "BM" signature, the file is not parsed
+	static bool IsBmp(const std::vector<byte>& file_content_);
+
+	/// The file with every change made through Row, so writing a carrier back is writing this buffer
+	std::vector<byte> ReleaseFileContent();
+
+	int GetWidth() const override;
+	int GetHeight() const override;
+	/// 1 for grayscale images, red, green and blue otherwise
+	int GetComponentsCount() const override;
+	int GetComponentWidth(int component_) const override;
+	int GetComponentHeight(int component_) const override;
+	/// Views into the file buffer for gray, 24-bit and byte aligned 32-bit pixels,
+	/// color palettes and other masks are converted into scratch_
+	PlaneView<const byte> GetSampleTile(int component_, int x_, int y_, int width_, int height_, std::vector<byte>& scratch_) const override;
+	PlaneView<byte> GetWritableSampleTile(int component_, int x_, int y_, int width_, int height_) override;
+	int GetBitsPerPixel() const;
+	bool IsPalettized() const;
+	/// 8-bit image, which palette is the gray ramp, so indices are the gray levels themselves
+	bool IsGrayscale() const;
+	const std::vector<Color>& GetPalette() const;
+	/// Bytes of pixel data per pixel, 0 for 1 and 4 bits per pixel
+	int GetBytesPerPixel() const;
+	std::size_t GetStride() const;
+
+	/// Row y_ counted from the top of the image, whichever order the rows are stored in
+	const byte* Row(int y_) const;
+	byte* Row(int y_);
+
+	/// Embedded ICC profile right inside of the file buffer, nullptr when there is none
+	const byte* GetProfileData() const;
+	std::size_t GetProfileSize() const;
+	/// The embedded profile viewed in place, valid until ReleaseFileContent
+	IccProfile GetIccProfile() const;
+
+	/// Interleaved RGB, rows top-down, as Jpeg::ConvertToRgb
+	std::vector<byte> ConvertToRgb() const;
+
+	/// Writes a BITMAPINFOHEADER file, pixels_ are rows top-down without padding, in the order of the file:
+	/// blue, green, red (and alpha) or palette indices packed most significant bits first.
+	/// Rows are stored bottom-up unless top_down_ is set.
+	static std::vector<byte> Write(const byte* pixels_, int width_, int height_, int bits_per_pixel_,
+		const std::vector<Color>& palette_ = std::vector<Color>(), bool top_down_ = false);
+	/// 24-bit file from interleaved RGB
+	static std::vector<byte> WriteRgb(const std::vector<byte>& rgb_, int width_, int height_);
 };
\ No newline at end of file
@@ -0,0 +1,155 @@
+#pragma once
+#include<atomic>
+#include<memory>
+#include<thread>
+#include<chrono>
+#include<cstddef>
+
+/// BoundedQueue class, that is Dmitry Vyukov's bounded multi-producer multi-consumer queue.
+/// Every cell carries a sequence number, which tells producers and consumers whose turn it is,
+/// so push and pop are a single compare-and-swap of the position without any lock.
+/// Push waits while the queue is full, which gives backpressure to the previous pipeline stage.
+template<class T>
+class BoundedQueue
+{
+	struct Cell
+	{
+		std::atomic<size_t> _sequence;
+		T _value;
+	};
+
+	static const size_t cache_line = 64;
+
+	std::unique_ptr<Cell[]> _cells;
+	size_t _mask;
+	alignas(cache_line) std::atomic<size_t> _enqueue_position;
+	alignas(cache_line) std::atomic<size_t> _dequeue_position;
+	alignas(cache_line) std::atomic<bool> _closed;
+
+	/// Spins first, then yields, then sleeps, so a stalled stage does not burn the core
+	static void back_off(int& attempt_)
+	{
+		attempt_++;
+		if (attempt_ < 16)
+		{
+			return;
+		}
+		if (attempt_ < 64)
+		{
+			std::this_thread::yield();
+			return;
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+
+public:
+
+	/// Capacity is rounded up to the power of 2
+	explicit BoundedQueue(size_t capacity_)
+		: _enqueue_position(0)
+		, _dequeue_position(0)
+		, _closed(false)
+	{
+		size_t capacity = 2;
+		while (capacity < capacity_)
+		{
+			capacity <<= 1;
+		}
+		_cells.reset(new Cell[capacity]);
+		_mask = capacity - 1;
+		for (size_t i = 0; i < capacity; i++)
+		{
+			_cells[i]._sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	/// Moves value_ into the queue, returns false without touching it when the queue is full
+	bool TryPush(T& value_)
+	{
+		size_t position = _enqueue_position.load(std::memory_order_relaxed);
+		while (true)
+		{
+			Cell& cell = _cells[position & _mask];
+			size_t sequence = cell._sequence.load(std::memory_order_acquire);
+			std::ptrdiff_t difference = std::ptrdiff_t(sequence) - std::ptrdiff_t(position);
+			if (difference == 0)
+			{
+				if (_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					cell._value = std::move(value_);
+					cell._sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0)
+			{
+				return false; // full
+			}
+			else
+			{
+				position = _enqueue_position.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool TryPop(T& value_)
+	{
+		size_t position = _dequeue_position.load(std::memory_order_relaxed);
+		while (true)
+		{
+			Cell& cell = _cells[position & _mask];
+			size_t sequence = cell._sequence.load(std::memory_order_acquire);
+			std::ptrdiff_t difference = std::ptrdiff_t(sequence) - std::ptrdiff_t(position + 1);
+			if (difference == 0)
+			{
+				if (_dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					value_ = std::move(cell._value);
+					cell._sequence.store(position + _mask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0)
+			{
+				return false; // empty
+			}
+			else
+			{
+				position = _dequeue_position.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/// Waits for the free cell
+	void Push(T value_)
+	{
+		for (int attempt = 0; !this->TryPush(value_); )
+		{
+			back_off(attempt);
+		}
+	}
+
+	/// Waits for the value, returns false when the queue is closed and drained
+	bool Pop(T& value_)
+	{
+		for (int attempt = 0; !this->TryPop(value_); )
+		{
+			if (_closed.load(std::memory_order_acquire))
+			{
+				// everything pushed before closing is visible now
+				return this->TryPop(value_);
+			}
+			back_off(attempt);
+		}
+		return true;
+	}
+
+	/// Called by the last producer, after its last push
+	void Close()
+	{
+		_closed.store(true, std::memory_order_release);
+	}
+};
\ No newline at end of file
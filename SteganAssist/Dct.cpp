@@ -0,0 +1,143 @@
+#include "Dct.h"
+#include <cmath>
+
+Dct::Dct()
+{
+	const double pi = std::acos(-1.0);
+	for (int x = 0; x < 8; x++)
+	{
+		for (int u = 0; u < 8; u++)
+		{
+			double c = u == 0 ? 1.0 / std::sqrt(2.0) : 1.0;
+			_cosines[x][u] = float(c / 2 * std::cos((2 * x + 1) * u * pi / 16));
+		}
+	}
+	// averaging 2^k neighbouring samples of cosine u multiplies it by cos(u * pi / 16) ... cos(2^(k - 1) * u * pi / 16)
+	for (int r = 0; r < 2; r++)
+	{
+		int size = 4 >> r;
+		for (int u = 0; u < size; u++)
+		{
+			double attenuation = 1;
+			for (int step = 1; step < 8 / size; step *= 2)
+			{
+				attenuation *= std::cos(step * u * pi / 16);
+			}
+			double c = u == 0 ? 1.0 / std::sqrt(2.0) : 1.0;
+			for (int x = 0; x < size; x++)
+			{
+				_reduced_cosines[r][x][u] = float(c / 2 * std::cos((2 * x + 1) * u * pi / (2 * size)) * attenuation);
+			}
+		}
+	}
+}
+
+const Dct& Dct::instance()
+{
+	static Dct dct;
+	return dct;
+}
+
+const float* Dct::Cosines()
+{
+	return &instance()._cosines[0][0];
+}
+
+void Dct::Inverse(const float* coefficients_, float* samples_)
+{
+	const Dct& dct = instance();
+
+	// rows first, then columns, the transform is separable
+	float temp[64];
+	for (int v = 0; v < 8; v++)
+	{
+		for (int x = 0; x < 8; x++)
+		{
+			float sum = 0;
+			for (int u = 0; u < 8; u++)
+			{
+				sum += dct._cosines[x][u] * coefficients_[v * 8 + u];
+			}
+			temp[v * 8 + x] = sum;
+		}
+	}
+	for (int y = 0; y < 8; y++)
+	{
+		for (int x = 0; x < 8; x++)
+		{
+			float sum = 0;
+			for (int v = 0; v < 8; v++)
+			{
+				sum += dct._cosines[y][v] * temp[v * 8 + x];
+			}
+			samples_[y * 8 + x] = sum;
+		}
+	}
+}
+
+void Dct::InverseReduced(const float* coefficients_, int size_, float* samples_)
+{
+	if (size_ == 1)
+	{
+		samples_[0] = coefficients_[0] / 8;
+		return;
+	}
+	const float (&cosines)[4][4] = instance()._reduced_cosines[size_ == 4 ? 0 : 1];
+	float temp[16];
+	for (int v = 0; v < size_; v++)
+	{
+		for (int x = 0; x < size_; x++)
+		{
+			float sum = 0;
+			for (int u = 0; u < size_; u++)
+			{
+				sum += cosines[x][u] * coefficients_[v * 8 + u];
+			}
+			temp[v * 4 + x] = sum;
+		}
+	}
+	for (int y = 0; y < size_; y++)
+	{
+		for (int x = 0; x < size_; x++)
+		{
+			float sum = 0;
+			for (int v = 0; v < size_; v++)
+			{
+				sum += cosines[y][v] * temp[v * 4 + x];
+			}
+			samples_[y * size_ + x] = sum;
+		}
+	}
+}
+
+void Dct::Forward(const float* samples_, float* coefficients_)
+{
+	const Dct& dct = instance();
+
+	// the transposed matrix of the inverse transform, rows first, then columns
+	float temp[64];
+	for (int y = 0; y < 8; y++)
+	{
+		for (int u = 0; u < 8; u++)
+		{
+			float sum = 0;
+			for (int x = 0; x < 8; x++)
+			{
+				sum += dct._cosines[x][u] * samples_[y * 8 + x];
+			}
+			temp[y * 8 + u] = sum;
+		}
+	}
+	for (int v = 0; v < 8; v++)
+	{
+		for (int u = 0; u < 8; u++)
+		{
+			float sum = 0;
+			for (int y = 0; y < 8; y++)
+			{
+				sum += dct._cosines[y][v] * temp[y * 8 + u];
+			}
+			coefficients_[v * 8 + u] = sum;
+		}
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+/// Dct class, that transforms 8x8 blocks between samples and DCT coefficients, both in natural (row-major) order
+class Dct
+{
+	float _cosines[8][8]; // [x][u] = C(u) / 2 * cos((2x + 1) * u * pi / 16)
+	float _reduced_cosines[2][4][4]; // the same for 4 and 2 points, [x][u] = C(u) / 2 * cos((2x + 1) * u * pi / 2N) * attenuation(u)
+
+	Dct();
+	static const Dct& instance();
+
+public:
+
+	/// [A.3.3] Inverse DCT, output samples are not level shifted
+	static void Inverse(const float* coefficients_, float* samples_);
+	/// Reduced inverse DCT of the size_ x size_ (4, 2 or 1) lowest coefficients into size_ x size_ samples, not level shifted.
+	/// Each sample is the mean of the 8 / size_ x 8 / size_ full samples it stands for, except for the frequencies dropped.
+	static void InverseReduced(const float* coefficients_, int size_, float* samples_);
+	/// [A.3.3] Forward DCT, input samples must be level shifted already
+	static void Forward(const float* samples_, float* coefficients_);
+	/// 64 values of the basis, [x * 8 + u], for the vector kernels to compute exactly the same sums
+	static const float* Cosines();
+};
\ No newline at end of file
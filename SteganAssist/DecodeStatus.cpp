@@ -0,0 +1,111 @@
+#include "DecodeStatus.h"
+
+DecodeStatus::DecodeStatus() noexcept
+	: _error(DecodeError::None)
+	, _offset(0)
+	, _segment("")
+{
+}
+
+DecodeStatus::DecodeStatus(DecodeError error_, int offset_, const char* segment_) noexcept
+	: _error(error_)
+	, _offset(offset_)
+	, _segment(segment_)
+{
+}
+
+bool DecodeStatus::Ok() const noexcept
+{
+	return _error == DecodeError::None;
+}
+
+const char* DecodeStatus::Name() const noexcept
+{
+	switch (_error)
+	{
+	case DecodeError::None: return "none";
+	case DecodeError::NotJpeg: return "not_jpeg";
+	case DecodeError::TruncatedData: return "truncated_data";
+	case DecodeError::MissingMarkerPrefix: return "missing_marker_prefix";
+	case DecodeError::UnsupportedMarker: return "unsupported_marker";
+	case DecodeError::UnsupportedProcess: return "unsupported_process";
+	case DecodeError::InvalidFrame: return "invalid_frame";
+	case DecodeError::InvalidHuffmanTable: return "invalid_huffman_table";
+	case DecodeError::InvalidQuantizationTable: return "invalid_quantization_table";
+	case DecodeError::InvalidScan: return "invalid_scan";
+	case DecodeError::UndefinedHuffmanTable: return "undefined_huffman_table";
+	case DecodeError::InvalidHuffmanCode: return "invalid_huffman_code";
+	case DecodeError::CoefficientOutOfBlock: return "coefficient_out_of_block";
+	case DecodeError::InvalidCategory: return "invalid_category";
+	case DecodeError::MissingRestartMarker: return "missing_restart_marker";
+	case DecodeError::OutOfMemory: return "out_of_memory";
+	case DecodeError::MemoryBudgetExceeded: return "memory_budget_exceeded";
+	case DecodeError::HandlerFailed: return "handler_failed";
+	case DecodeError::InvalidBitmapHeader: return "invalid_bitmap_header";
+	case DecodeError::UnsupportedBitmap: return "unsupported_bitmap";
+	case DecodeError::InvalidPngChunk: return "invalid_png_chunk";
+	case DecodeError::ChecksumMismatch: return "checksum_mismatch";
+	case DecodeError::InvalidDeflateStream: return "invalid_deflate_stream";
+	case DecodeError::InvalidIndex: return "invalid_index";
+	case DecodeError::NotStreamable: return "not_streamable";
+	}
+	return "unknown";
+}
+
+const char* DecodeStatus::Message() const noexcept
+{
+	switch (_error)
+	{
+	case DecodeError::None: return "No error";
+	case DecodeError::NotJpeg: return "File does not start with SOI marker";
+	case DecodeError::TruncatedData: return "Data ends too early";
+	case DecodeError::MissingMarkerPrefix: return "There must be 0xFF byte";
+	case DecodeError::UnsupportedMarker: return "Found not supported yet marker";
+	case DecodeError::UnsupportedProcess: return "Only baseline DCT with known number of lines is supported";
+	case DecodeError::InvalidFrame: return "Frame header is invalid";
+	case DecodeError::InvalidHuffmanTable: return "Huffman table is invalid";
+	case DecodeError::InvalidQuantizationTable: return "Quantization table is invalid";
+	case DecodeError::InvalidScan: return "Scan header is invalid";
+	case DecodeError::UndefinedHuffmanTable: return "Scan refers to undefined Huffman table";
+	case DecodeError::InvalidHuffmanCode: return "Bits do not form any Huffman code of the table";
+	case DecodeError::CoefficientOutOfBlock: return "AC coefficients run out of block";
+	case DecodeError::InvalidCategory: return "Coefficient category is out of range";
+	case DecodeError::MissingRestartMarker: return "There must be RST marker";
+	case DecodeError::OutOfMemory: return "Out of memory";
+	case DecodeError::MemoryBudgetExceeded: return "Memory budget of the image is exceeded";
+	case DecodeError::HandlerFailed: return "Block handler has thrown";
+	case DecodeError::InvalidBitmapHeader: return "Bitmap header is invalid";
+	case DecodeError::UnsupportedBitmap: return "Only uncompressed bitmaps of 1, 4, 8, 24 and 32 bits are supported";
+	case DecodeError::InvalidPngChunk: return "PNG chunk is invalid";
+	case DecodeError::ChecksumMismatch: return "Checksum does not match the data";
+	case DecodeError::InvalidDeflateStream: return "Compressed data is invalid";
+	case DecodeError::InvalidIndex: return "Decoder index does not match the image";
+	case DecodeError::NotStreamable: return "Only images of a single interleaved scan are streamed";
+	}
+	return "Unknown error";
+}
+
+std::string DecodeStatus::ToString() const
+{
+	if (this->Ok())
+	{
+		return this->Message();
+	}
+	std::string result = this->Message();
+	if (*_segment)
+	{
+		result += std::string(" in ") + _segment;
+	}
+	return result + " at byte " + std::to_string(_offset);
+}
+
+DecodeException::DecodeException(const DecodeStatus& status_)
+	: std::runtime_error(status_.ToString())
+	, _status(status_)
+{
+}
+
+const DecodeStatus& DecodeException::GetStatus() const
+{
+	return _status;
+}
\ No newline at end of file
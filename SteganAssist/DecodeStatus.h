@@ -0,0 +1,64 @@
+#pragma once
+#include<string>
+#include<stdexcept>
+
+/// Why decoding failed, malformed data is reported by code instead of exception
+enum class DecodeError
+{
+	None,
+	NotJpeg,                  // no SOI at the start of the file
+	TruncatedData,            // file or entropy-coded segment ends before the data it must contain
+	MissingMarkerPrefix,      // 0xFF expected between segments
+	UnsupportedMarker,
+	UnsupportedProcess,       // any frame except baseline DCT, height defined by DNL
+	InvalidFrame,
+	InvalidHuffmanTable,
+	InvalidQuantizationTable,
+	InvalidScan,              // scan before frame, unknown or repeated component, bad number of components,
+	                          // spectral selection or approximation of a progressive scan
+	UndefinedHuffmanTable,
+	InvalidHuffmanCode,       // bits are not a prefix of any code of the table
+	CoefficientOutOfBlock,    // AC run goes past the 63rd coefficient
+	InvalidCategory,          // DC difference or AC value wider than 8-bit precision allows
+	MissingRestartMarker,
+	OutOfMemory,
+	MemoryBudgetExceeded,     // Allocator of the image refused to go over its budget
+	HandlerFailed,            // BlockHandler has thrown
+	InvalidBitmapHeader,      // BMP headers contradict each other or the size of the file
+	UnsupportedBitmap,        // BMP compression or bit depth other than uncompressed 1, 4, 8, 24 and 32 bits
+	InvalidPngChunk,          // PNG chunk out of order, of wrong size or with invalid fields
+	ChecksumMismatch,         // CRC-32 of PNG chunk or Adler-32 of zlib stream
+	InvalidDeflateStream,     // zlib stream is malformed or inflates to other amount of data than the image needs
+	InvalidIndex,             // JpegIndex is malformed, of another file or does not match its scans
+	NotStreamable,            // components are not interleaved in a single scan, so rows can't be streamed
+};
+
+/// Result of decoding: first error met, where it was met and in which segment
+struct DecodeStatus
+{
+	DecodeError _error;
+	int _offset;          // byte of the file, at which the error was found
+	const char* _segment; // name of the segment being decoded, as in trace spans, "" before the first marker
+
+	DecodeStatus() noexcept;
+	DecodeStatus(DecodeError error_, int offset_, const char* segment_) noexcept;
+
+	bool Ok() const noexcept;
+	/// Stable name of the code, for logs and JSON
+	const char* Name() const noexcept;
+	/// Human readable description of the code alone
+	const char* Message() const noexcept;
+	/// Message with segment and offset
+	std::string ToString() const;
+};
+
+/// Thrown by the throwing Jpeg constructors, carries the same status as the non-throwing ones return
+class DecodeException : public std::runtime_error
+{
+	DecodeStatus _status;
+
+public:
+
+	explicit DecodeException(const DecodeStatus& status_);
+	const DecodeStatus& GetStatus() const;
+};
\ No newline at end of file
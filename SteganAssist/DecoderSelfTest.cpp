@@ -0,0 +1,388 @@
+#include "DecoderSelfTest.h"
+#include "Jpeg.h"
+#include "JpegDecoder.h"
+#include "JpegWriter.h"
+#include "Payload.h"
+#include "SyntheticJpeg.h"
+#include "Icc.h"
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <memory>
+#include <string>
+#include <stdexcept>
+
+namespace
+{
+	/// Marker segment of the file, offset of its 0xFF and the whole size with the marker
+	struct Segment
+	{
+		byte _marker;
+		std::size_t _offset;
+		std::size_t _size;
+	};
+
+	/// Segments after SOI up to and including the first SOS
+	std::vector<Segment> segments_of(const std::vector<byte>& file_)
+	{
+		std::vector<Segment> segments;
+		for (std::size_t offset = 2; offset + 4 <= file_.size();)
+		{
+			Segment segment = { file_[offset + 1], offset, 2 + std::size_t(file_[offset + 2] << 8 | file_[offset + 3]) };
+			segments.push_back(segment);
+			if (segment._marker == 0xDA)
+			{
+				break;
+			}
+			offset += segment._size;
+		}
+		return segments;
+	}
+
+	const Segment& find_segment(const std::vector<Segment>& segments_, byte marker_)
+	{
+		for (const Segment& segment : segments_)
+		{
+			if (segment._marker == marker_)
+			{
+				return segment;
+			}
+		}
+		throw std::logic_error("Synthetic image has no such segment");
+	}
+
+	/// Three interleaved components with 2x2 luminance, each segment once
+	std::vector<byte> source_image()
+	{
+		SyntheticJpeg::Parameters parameters = { 64, 48, 3, 2, 2, 0, 75, 1 };
+		return SyntheticJpeg::Generate(parameters);
+	}
+
+	/// [ICC.1:2010 B.4] APP2 chunk right after SOI, holding the header of a profile without tags
+	std::vector<byte> with_icc_profile(const std::vector<byte>& file_)
+	{
+		std::vector<byte> profile(IccProfile::header_size + 4);
+		profile[3] = byte(profile.size());
+		profile[36] = 'a';
+		profile[37] = 'c';
+		profile[38] = 's';
+		profile[39] = 'p';
+		const char identifier[] = "ICC_PROFILE";
+		const int length = 2 + sizeof(identifier) + 2 + int(profile.size());
+		std::vector<byte> segment(2 + length);
+		segment[0] = 0xFF;
+		segment[1] = 0xE2;
+		segment[2] = byte(length >> 8);
+		segment[3] = byte(length & 0xFF);
+		std::copy(identifier, identifier + sizeof(identifier), segment.begin() + 4);
+		segment[4 + sizeof(identifier)] = 1; // the first chunk of one
+		segment[5 + sizeof(identifier)] = 1;
+		std::copy(profile.begin(), profile.end(), segment.begin() + 6 + sizeof(identifier));
+		std::vector<byte> file = file_;
+		file.insert(file.begin() + 2, segment.begin(), segment.end());
+		return file;
+	}
+
+	/// [Annex K.3] luminance AC table of the source without its last 16-bit code, run 15 of category 10,
+	/// canonical codes of all other values stay the same, so the scans decode as before
+	std::vector<byte> without_last_luminance_ac_code(const std::vector<byte>& file_)
+	{
+		std::vector<byte> file = file_;
+		for (const Segment& segment : segments_of(file_))
+		{
+			if (segment._marker == 0xC4 && file[segment._offset + 4] == 0x10)
+			{
+				std::size_t last = segment._offset + segment._size - 1;
+				if (file[last] != 0xFA || !file[segment._offset + 20])
+				{
+					throw std::logic_error("Synthetic image has no standard luminance AC table");
+				}
+				file[segment._offset + 20]--;
+				file.erase(file.begin() + last);
+				file[segment._offset + 3]--;
+				return file;
+			}
+		}
+		throw std::logic_error("Synthetic image has no luminance AC table");
+	}
+
+	/// Empty when the file decodes to the coefficients of expected_
+	std::string check_coefficients(const Jpeg& expected_, std::vector<byte>&& file_)
+	{
+		DecodeStatus status;
+		Jpeg jpeg(std::move(file_), status);
+		if (!status.Ok())
+		{
+			return std::string("decoded with ") + status.Name();
+		}
+		for (int i = 0; i < expected_.GetComponentsCount(); i++)
+		{
+			if (jpeg.GetCoefficients(i) != expected_.GetCoefficients(i))
+			{
+				return "coefficients of component " + std::to_string(i) + " differ";
+			}
+		}
+		return "";
+	}
+
+	/// Empty when the file decodes and carries the profile of with_icc_profile
+	std::string check_icc_profile(std::vector<byte>&& file_)
+	{
+		DecodeStatus status;
+		Jpeg jpeg(std::move(file_), status);
+		if (!status.Ok())
+		{
+			return std::string("decoded with ") + status.Name();
+		}
+		const IccProfile profile = jpeg.GetIccProfile();
+		return profile && profile.Size() == IccProfile::header_size + 4 ? "" : "profile is lost";
+	}
+
+	class Cases
+	{
+		std::vector<DecoderSelfTest::Result> _results;
+
+	public:
+
+		void Add(const std::string& case_, const std::string& detail_)
+		{
+			_results.push_back(DecoderSelfTest::Result{ case_, detail_.empty(), detail_ });
+		}
+
+		/// The file has to fail with error_, the accessors of the image left after that have to throw
+		void ExpectError(const std::string& case_, std::vector<byte> file_, DecodeError error_)
+		{
+			DecodeStatus status;
+			Jpeg jpeg(std::move(file_), status);
+			if (status._error != error_)
+			{
+				this->Add(case_, std::string("decoded with ") + status.Name() + " instead of " + DecodeStatus(error_, 0, "").Name());
+				return;
+			}
+			this->Add(case_, "");
+			this->ExpectThrow(case_ + "_samples", [&jpeg]() { jpeg.GetSamples(0); });
+			this->ExpectThrow(case_ + "_rgb", [&jpeg]() { jpeg.GetRgb(); });
+			this->ExpectThrow(case_ + "_scaled_rgb", [&jpeg]() { jpeg.GetRgb(2); });
+		}
+
+		/// The check returns the detail of the failure, empty when it passes, exceptions fail it too
+		void Check(const std::string& case_, const std::function<std::string()>& check_)
+		{
+			std::string detail;
+			try
+			{
+				detail = check_();
+			}
+			catch (const std::exception& e)
+			{
+				detail = std::string("threw ") + e.what();
+			}
+			this->Add(case_, detail);
+		}
+
+		void ExpectThrow(const std::string& case_, const std::function<void()>& action_)
+		{
+			try
+			{
+				action_();
+			}
+			catch (const std::exception&)
+			{
+				this->Add(case_, "");
+				return;
+			}
+			this->Add(case_, "returned instead of throwing");
+		}
+
+		std::vector<DecoderSelfTest::Result> Release()
+		{
+			return std::move(_results);
+		}
+	};
+}
+
+std::vector<DecoderSelfTest::Result> DecoderSelfTest::Run()
+{
+	Cases cases;
+	const std::vector<byte> source = source_image();
+	const std::vector<Segment> segments = segments_of(source);
+	const Segment& frame = find_segment(segments, 0xC0);
+	const Segment& scan = find_segment(segments, 0xDA);
+	const std::vector<byte> end_of_image = { 0xFF, 0xD9 };
+
+	// the file ends at a segment boundary: after the frame, after the frame and EOI, EOI without any frame
+	std::vector<byte> file(source.begin(), source.begin() + frame._offset + frame._size);
+	cases.ExpectError("end_after_frame", file, DecodeError::TruncatedData);
+	file.insert(file.end(), end_of_image.begin(), end_of_image.end());
+	cases.ExpectError("end_of_image_after_frame", file, DecodeError::InvalidScan);
+	file.assign(source.begin(), source.begin() + frame._offset);
+	file.insert(file.end(), source.begin() + frame._offset + frame._size, source.begin() + scan._offset);
+	file.insert(file.end(), end_of_image.begin(), end_of_image.end());
+	cases.ExpectError("end_of_image_without_frame", file, DecodeError::InvalidScan);
+
+	// the scan ends its spectral selection at coefficient 5, as a progressive one would
+	file = source;
+	file[scan._offset + 12] = 5;
+	cases.ExpectError("partial_spectral_selection", file, DecodeError::InvalidScan);
+
+	// the third component of the scan names the second one again, so the third is never decoded
+	file = source;
+	file[scan._offset + 9] = file[scan._offset + 7];
+	cases.ExpectError("repeated_scan_component", file, DecodeError::InvalidScan);
+	{
+		// DC-only decoding stores the DC planes alone, the one of the component never scanned stays empty
+		DecodeStatus dc_status;
+		Jpeg dc_only(std::vector<byte>(file), 8, dc_status);
+		cases.Add("repeated_scan_component_dc_only", dc_status._error == DecodeError::InvalidScan ? "" :
+			std::string("decoded with ") + dc_status.Name() + " instead of invalid_scan");
+		cases.ExpectThrow("repeated_scan_component_dc_only_rgb", [&dc_only]() { dc_only.GetRgb(8); });
+		Jpeg whole(std::vector<byte>(source), 8, dc_status);
+		cases.ExpectThrow("dc_only_full_scale_rgb", [&whole]() { whole.GetRgb(2); });
+	}
+
+	// luminance refers to quantization table 3, which no DQT defines
+	file = source;
+	file[frame._offset + 12] = 3;
+	cases.ExpectError("undefined_quantization_table", file, DecodeError::InvalidQuantizationTable);
+
+	// a frame of 65535x65296 with a few bytes of scan data fails before storage for its planes is taken
+	file.assign(source.begin(), source.begin() + scan._offset + scan._size + 40);
+	file[frame._offset + 5] = 0xFF;
+	file[frame._offset + 6] = 0x10;
+	file[frame._offset + 7] = 0xFF;
+	file[frame._offset + 8] = 0xFF;
+	{
+		DecodeStatus huge_status;
+		Jpeg huge(std::vector<byte>(file), huge_status);
+		cases.Add("huge_dimensions", huge_status._error != DecodeError::TruncatedData ?
+			std::string("decoded with ") + huge_status.Name() + " instead of truncated_data" :
+			huge.GetPeakBytes() > (1 << 20) ? "held " + std::to_string(huge.GetPeakBytes()) + " bytes" : "");
+	}
+
+	// tables of the image decoded before do not count for the next one
+	JpegDecoder decoder;
+	DecodeStatus status;
+	decoder.Decode(std::vector<byte>(source), status);
+	file.assign(source.begin(), source.begin() + 2);
+	for (const Segment& segment : segments)
+	{
+		if (segment._marker != 0xDB)
+		{
+			file.insert(file.end(), source.begin() + segment._offset, source.begin() + segment._offset + segment._size);
+		}
+	}
+	file.insert(file.end(), source.begin() + scan._offset + scan._size, source.end());
+	decoder.Decode(std::move(file), status);
+	cases.Add("quantization_table_of_previous_image", status._error == DecodeError::InvalidQuantizationTable ? "" :
+		std::string("decoded with ") + status.Name() + " instead of invalid_quantization_table");
+
+	// storage kept from a large image is not charged to the small one decoded after it on the same context
+	SyntheticJpeg::Parameters large_parameters = { 512, 384, 3, 2, 2, 0, 75, 2 };
+	const std::vector<byte> large = SyntheticJpeg::Generate(large_parameters);
+	const std::size_t alone = Jpeg(std::vector<byte>(source)).GetPeakBytes();
+	for (std::size_t budget : { std::size_t(0), alone })
+	{
+		const std::string name = budget ? "budget_after_large_image" : "peak_after_large_image";
+		JpegDecoder reused(std::make_shared<Allocator>(Allocator::Kind::Default, budget));
+		reused.Decode(std::vector<byte>(large), status);
+		Jpeg& small = reused.Decode(std::vector<byte>(source), status);
+		cases.Add(name, !status.Ok() ? std::string("decoded with ") + status.Name() :
+			small.GetPeakBytes() != alone ? "peak of " + std::to_string(small.GetPeakBytes()) + " bytes instead of " + std::to_string(alone) : "");
+	}
+
+	// an arena of a reused context gives back the memory of the image before, instead of growing with every image
+	JpegDecoder arena_decoder(std::make_shared<Allocator>(Allocator::Kind::Arena));
+	std::string arena_detail;
+	for (int i = 0; i < 3 && arena_detail.empty(); i++)
+	{
+		Jpeg& decoded = arena_decoder.Decode(std::vector<byte>(i % 2 ? source : large), status);
+		if (!status.Ok())
+		{
+			arena_detail = std::string("decoded with ") + status.Name();
+		}
+		else if (decoded.GetAllocator().Retained())
+		{
+			arena_detail = std::to_string(decoded.GetAllocator().Retained()) + " bytes kept from the images before";
+		}
+	}
+	cases.Add("arena_after_images", arena_detail);
+
+	// metadata of the source stays in the embedded image, whether it is written incrementally or a row at a time
+	const std::vector<byte> with_profile = with_icc_profile(source);
+	const std::vector<byte> message = { 'p', 'a', 'y' };
+	cases.Check("icc_profile_after_embed", [&with_profile, &message]()
+	{
+		Jpeg embedded{ std::vector<byte>(with_profile) };
+		PayloadEmbedder::Embed(embedded, message);
+		return check_icc_profile(JpegWriter(embedded, with_profile).Release());
+	});
+	cases.Check("icc_profile_after_streamed_embed", [&with_profile, &message]()
+	{
+		std::vector<byte> content = with_profile;
+		std::ostringstream output;
+		PayloadEmbedder::Embed(content, message, output);
+		const std::string written = output.str();
+		std::vector<byte> file(written.begin(), written.end());
+		if (PayloadExtractor::Extract(file) != message)
+		{
+			return std::string("payload is lost");
+		}
+		return check_icc_profile(std::move(file));
+	});
+
+	// incremental writing of an image with restart intervals, whose luminance AC table lacks a code:
+	// the payload alone keeps the source tables and copies the clean intervals, a block needing the missing
+	// code has every scan coded again with the standard tables, both decode as the whole image re-encoded
+	SyntheticJpeg::Parameters restart_parameters = { 128, 96, 3, 2, 2, 2, 75, 3 };
+	const std::vector<byte> restarted = without_last_luminance_ac_code(with_icc_profile(SyntheticJpeg::Generate(restart_parameters)));
+	const std::size_t first_scan = find_segment(segments_of(restarted), 0xDA)._offset;
+	for (bool missing_code : { false, true })
+	{
+		const std::string name = missing_code ? "incremental_with_standard_tables" : "incremental_with_source_tables";
+		cases.Check(name, [&restarted, &message, first_scan, missing_code]()
+		{
+			Jpeg embedded{ std::vector<byte>(restarted) };
+			PayloadEmbedder::Embed(embedded, message);
+			if (missing_code)
+			{
+				// zigzag 1-15 zero and 600 at zigzag 16, natural 12: run 15 of category 10
+				bool changed = false;
+				embedded.ForEachBlockInScanOrder([&embedded, &changed](const Jpeg::BlockPosition& position_, short* coefficients_)
+				{
+					if (!changed && position_._component == 0)
+					{
+						std::fill(coefficients_ + 1, coefficients_ + 64, short(0));
+						coefficients_[12] = 600;
+						embedded.MarkDirty(position_);
+						changed = true;
+					}
+				});
+			}
+			std::vector<byte> incremental = JpegWriter(embedded, restarted).Release();
+			if (std::equal(restarted.begin(), restarted.begin() + first_scan, incremental.begin()) == missing_code)
+			{
+				return std::string(missing_code ? "source tables are kept" : "segments before the scan are not copied");
+			}
+			std::string detail = check_icc_profile(std::vector<byte>(incremental));
+			if (detail.empty())
+			{
+				Jpeg reencoded{ JpegWriter(embedded).Release() };
+				detail = check_coefficients(reencoded, std::move(incremental));
+			}
+			return detail;
+		});
+	}
+
+	// blocks passed to a handler are not stored, so there are no samples to give
+	Jpeg streamed(std::vector<byte>(source), status, [](const Jpeg::BlockPosition&, const short*) { return true; });
+	cases.Add("handler_decoding", status.Ok() ? "" : std::string("decoded with ") + status.Name());
+	cases.ExpectThrow("handler_decoding_samples", [&streamed]() { streamed.GetSamples(0); });
+	cases.ExpectThrow("handler_decoding_rgb", [&streamed]() { streamed.GetRgb(); });
+	cases.ExpectThrow("handler_decoding_conversion", [&streamed]() { streamed.ConvertToRgb({ {}, {}, {} }); });
+	cases.ExpectThrow("handler_decoding_scan_order", [&streamed]() { streamed.ForEachBlockInScanOrder([](const Jpeg::BlockPosition&, short*) {}); });
+	cases.ExpectThrow("handler_decoding_embed", [&streamed]() { PayloadEmbedder::Embed(streamed, { 1, 2, 3 }); });
+	// DC-only decoding stores no planes of 64 coefficients to embed into
+	Jpeg dc_only(std::vector<byte>(source), 8, status);
+	cases.ExpectThrow("dc_only_embed", [&dc_only]() { PayloadEmbedder::Embed(dc_only, { 1, 2, 3 }); });
+	return cases.Release();
+}
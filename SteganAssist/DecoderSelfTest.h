@@ -0,0 +1,21 @@
+#pragma once
+#include<vector>
+#include<string>
+
+/// DecoderSelfTest class, that runs the decoder over malformed files made from a synthetic image. Each case is a file,
+/// which once crashed the decoder or the accessors after it, or was taken for a whole image: it has to end with
+/// the expected DecodeError, and accessors of storage, which was never filled, have to throw instead of reading it.
+/// Images written back after embedding have to keep the metadata of the source and decode to the same coefficients.
+class DecoderSelfTest
+{
+public:
+
+	struct Result
+	{
+		std::string _case;
+		bool _passed;
+		std::string _detail; // what was met instead of the expected outcome, empty when passed
+	};
+
+	static std::vector<Result> Run();
+};
@@ -0,0 +1,1455 @@
+#include "Deflate.h"
+#include "Kernels.h"
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	// [RFC 1951 3.2.5] bases and extra bits of length symbols 257-285 and distance symbols 0-29
+	const unsigned short length_bases[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+		67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const byte length_extra_bits[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const unsigned short distance_bases[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+		1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const byte distance_extra_bits[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	// [3.2.7] order, in which code lengths of the code length alphabet are stored
+	const byte code_length_order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	const int max_code_bits = 15;
+	const int max_code_length_bits = 7;
+	const int literal_length_symbols = 288;
+	const int distance_symbols = 32;
+	const int end_of_block = 256;
+	const int min_match = 3;
+	const int max_match = 258;
+	const std::size_t window_size = 32768;
+
+	const int literal_length_primary_bits = 10;
+	const int distance_primary_bits = 8;
+
+	unsigned int reverse_bits(unsigned int code_, int bits_)
+	{
+		unsigned int reversed = 0;
+		for (int i = 0; i < bits_; i++, code_ >>= 1)
+		{
+			reversed = reversed << 1 | (code_ & 1);
+		}
+		return reversed;
+	}
+
+	/// Entry of a decoding table: value of the symbol in the high half, then extra bits of the value
+	/// (bits of the subtable for links), kind of the symbol and bits of the code
+	enum EntryKind
+	{
+		LITERAL = 0,
+		MATCH = 1,       // length or distance base
+		END_OF_BLOCK = 2,
+		SUBTABLE = 3,    // value is the first entry of the subtable
+		INVALID = 4,
+	};
+
+	unsigned int make_entry(unsigned int value_, unsigned int extra_bits_, EntryKind kind_)
+	{
+		return value_ << 16 | extra_bits_ << 8 | unsigned(kind_) << 5;
+	}
+
+	unsigned int entry_value(unsigned int entry_)
+	{
+		return entry_ >> 16;
+	}
+
+	unsigned int entry_extra_bits(unsigned int entry_)
+	{
+		return entry_ >> 8 & 0xFF;
+	}
+
+	EntryKind entry_kind(unsigned int entry_)
+	{
+		return EntryKind(entry_ >> 5 & 7);
+	}
+
+	unsigned int entry_bits(unsigned int entry_)
+	{
+		return entry_ & 31;
+	}
+
+	/// Entries without the bits of the code for every symbol of the three alphabets
+	struct SymbolEntries
+	{
+		unsigned int _literal_length[literal_length_symbols];
+		unsigned int _distance[distance_symbols];
+		unsigned int _code_length[19];
+
+		SymbolEntries()
+		{
+			for (int s = 0; s < literal_length_symbols; s++)
+			{
+				_literal_length[s] = s < end_of_block ? make_entry(s, 0, LITERAL)
+					: s == end_of_block ? make_entry(0, 0, END_OF_BLOCK)
+					: s < 286 ? make_entry(length_bases[s - 257], length_extra_bits[s - 257], MATCH)
+					: make_entry(0, 0, INVALID);
+			}
+			for (int s = 0; s < distance_symbols; s++)
+			{
+				_distance[s] = s < 30 ? make_entry(distance_bases[s], distance_extra_bits[s], MATCH) : make_entry(0, 0, INVALID);
+			}
+			for (int s = 0; s < 19; s++)
+			{
+				_code_length[s] = make_entry(s, 0, LITERAL);
+			}
+		}
+	};
+
+	const SymbolEntries& symbol_entries()
+	{
+		static const SymbolEntries entries;
+		return entries;
+	}
+
+	/// [3.2.2] Decoding table of the canonical code with lengths_, codes up to primary_bits_ long take one entry,
+	/// longer ones take a link to a subtable for the rest of their bits. False for over-subscribed codes and
+	/// for incomplete codes of more than one symbol.
+	bool build_table(const byte* lengths_, int count_, const unsigned int* symbols_, int primary_bits_, std::vector<unsigned int>& table_)
+	{
+		int counts[max_code_bits + 1] = {};
+		for (int s = 0; s < count_; s++)
+		{
+			counts[lengths_[s]]++;
+		}
+		counts[0] = 0;
+		int left = 1;
+		int used = 0;
+		unsigned int next_code[max_code_bits + 1] = {};
+		for (int bits = 1, code = 0; bits <= max_code_bits; bits++)
+		{
+			left = (left << 1) - counts[bits];
+			if (left < 0)
+			{
+				return false;
+			}
+			used += counts[bits];
+			code = (code + counts[bits - 1]) << 1;
+			next_code[bits] = code;
+		}
+		if (left > 0 && used > 1)
+		{
+			return false;
+		}
+
+		// subtables are as wide as the longest code behind their prefix
+		const unsigned int primary_size = 1u << primary_bits_;
+		int subtable_bits[1 << literal_length_primary_bits] = {};
+		unsigned int codes[max_code_bits + 1];
+		std::copy(next_code, next_code + max_code_bits + 1, codes);
+		for (int s = 0; s < count_; s++)
+		{
+			int length = lengths_[s];
+			if (length > primary_bits_)
+			{
+				unsigned int prefix = reverse_bits(codes[length] >> (length - primary_bits_), primary_bits_);
+				subtable_bits[prefix] = std::max(subtable_bits[prefix], length - primary_bits_);
+			}
+			codes[length]++;
+		}
+		unsigned int size = primary_size;
+		unsigned int subtable_offsets[1 << literal_length_primary_bits];
+		for (unsigned int prefix = 0; prefix < primary_size; prefix++)
+		{
+			subtable_offsets[prefix] = size;
+			size += subtable_bits[prefix] ? 1u << subtable_bits[prefix] : 0;
+		}
+		table_.assign(size, make_entry(0, 0, INVALID));
+		for (unsigned int prefix = 0; prefix < primary_size; prefix++)
+		{
+			if (subtable_bits[prefix])
+			{
+				table_[prefix] = make_entry(subtable_offsets[prefix], subtable_bits[prefix], SUBTABLE) | primary_bits_;
+			}
+		}
+
+		std::copy(next_code, next_code + max_code_bits + 1, codes);
+		for (int s = 0; s < count_; s++)
+		{
+			int length = lengths_[s];
+			if (!length)
+			{
+				continue;
+			}
+			unsigned int reversed = reverse_bits(codes[length]++, length);
+			if (length <= primary_bits_)
+			{
+				for (unsigned int i = reversed; i < primary_size; i += 1u << length)
+				{
+					table_[i] = symbols_[s] | length;
+				}
+				continue;
+			}
+			unsigned int prefix = reversed & (primary_size - 1);
+			int bits = length - primary_bits_;
+			for (unsigned int i = reversed >> primary_bits_; i < 1u << subtable_bits[prefix]; i += 1u << bits)
+			{
+				table_[subtable_offsets[prefix] + i] = symbols_[s] | bits;
+			}
+		}
+		return true;
+	}
+
+	/// Inflater class, that decodes one deflate stream from memory into the growing output
+	class Inflater
+	{
+		const byte* _input;
+		const byte* _input_end;
+		unsigned long long _bits;
+		int _bit_count;
+		int _overrun;          // zero bytes put into the bit buffer past the end of the input
+		std::vector<byte>& _output;
+		std::size_t _position;
+		std::size_t _limit;
+		bool _exact;
+		std::vector<unsigned int> _literal_length_table;
+		std::vector<unsigned int> _distance_table;
+		std::vector<unsigned int> _code_length_table;
+
+	public:
+
+		Inflater(const byte* data_, std::size_t size_, std::vector<byte>& output_, std::size_t expected_size_, std::size_t limit_)
+			: _input(data_)
+			, _input_end(data_ + size_)
+			, _bits(0)
+			, _bit_count(0)
+			, _overrun(0)
+			, _output(output_)
+			, _position(0)
+			, _limit(expected_size_ ? expected_size_ : limit_)
+			, _exact(expected_size_ != 0)
+		{
+			_output.resize(expected_size_ ? expected_size_ : std::min<std::size_t>(std::max<std::size_t>(size_ * 4, 4096), _limit));
+		}
+
+		/// 57 to 63 bits are in the buffer afterwards. The bytes, which do not fit whole, are loaded too,
+		/// but not counted, so the next refill puts the same bits over them.
+		void refill()
+		{
+			if (_input_end - _input >= 8)
+			{
+				unsigned long long word;
+				std::memcpy(&word, _input, 8);
+				_bits |= word << _bit_count;
+				_input += (63 - _bit_count) >> 3;
+				_bit_count |= 56;
+				return;
+			}
+			for (; _bit_count <= 56; _bit_count += 8)
+			{
+				if (_input < _input_end)
+				{
+					_bits |= static_cast<unsigned long long>(*_input++) << _bit_count;
+				}
+				else
+				{
+					_overrun++;
+				}
+			}
+		}
+
+		unsigned int take(int bits_)
+		{
+			unsigned int value = static_cast<unsigned int>(_bits & ((1ull << bits_) - 1));
+			_bits >>= bits_;
+			_bit_count -= bits_;
+			return value;
+		}
+
+		/// Bits taken so far went past the end of the input
+		bool overran() const
+		{
+			return _overrun * 8 > _bit_count;
+		}
+
+		/// Drops the rest of the byte and gives the whole bytes in the buffer back to the input
+		bool align()
+		{
+			this->take(_bit_count & 7);
+			int buffered = (_bit_count >> 3) - _overrun;
+			if (buffered < 0)
+			{
+				return false;
+			}
+			_input -= buffered;
+			_bits = 0;
+			_bit_count = 0;
+			_overrun = 0;
+			return true;
+		}
+
+		/// Makes room for count_ more bytes
+		bool reserve(std::size_t count_)
+		{
+			if (_output.size() - _position >= count_)
+			{
+				return true;
+			}
+			if (_exact || _limit - _position < count_)
+			{
+				return false;
+			}
+			_output.resize(std::min(_limit, std::max(_output.size() * 2, _position + count_)));
+			return true;
+		}
+
+		DecodeError stored_block()
+		{
+			if (!this->align() || _input_end - _input < 4)
+			{
+				return DecodeError::TruncatedData;
+			}
+			unsigned int length = _input[0] | _input[1] << 8;
+			unsigned int complement = _input[2] | _input[3] << 8;
+			_input += 4;
+			if ((length ^ 0xFFFF) != complement)
+			{
+				return DecodeError::InvalidDeflateStream;
+			}
+			if (std::size_t(_input_end - _input) < length)
+			{
+				return DecodeError::TruncatedData;
+			}
+			if (!this->reserve(length))
+			{
+				return DecodeError::InvalidDeflateStream;
+			}
+			std::memcpy(_output.data() + _position, _input, length);
+			_input += length;
+			_position += length;
+			return DecodeError::None;
+		}
+
+		/// [3.2.7] Code lengths of the block, coded by the code length code
+		DecodeError dynamic_tables()
+		{
+			this->refill();
+			int literal_lengths = this->take(5) + 257;
+			int distances = this->take(5) + 1;
+			int code_lengths = this->take(4) + 4;
+			if (literal_lengths > 286 || distances > 30)
+			{
+				return DecodeError::InvalidDeflateStream;
+			}
+			byte lengths[literal_length_symbols + distance_symbols] = {};
+			for (int i = 0; i < code_lengths; i++)
+			{
+				this->refill();
+				lengths[code_length_order[i]] = byte(this->take(3));
+			}
+			if (!build_table(lengths, 19, symbol_entries()._code_length, max_code_length_bits, _code_length_table))
+			{
+				return DecodeError::InvalidDeflateStream;
+			}
+			std::fill(lengths, lengths + 19, 0);
+			const unsigned int mask = (1u << max_code_length_bits) - 1;
+			for (int i = 0; i < literal_lengths + distances;)
+			{
+				this->refill();
+				unsigned int entry = _code_length_table[_bits & mask];
+				if (entry_kind(entry) == INVALID)
+				{
+					return DecodeError::InvalidDeflateStream;
+				}
+				this->take(entry_bits(entry));
+				unsigned int symbol = entry_value(entry);
+				if (symbol < 16)
+				{
+					lengths[i++] = byte(symbol);
+					continue;
+				}
+				// 16 repeats the previous length 3-6 times, 17 and 18 put 3-10 and 11-138 zeros
+				if (symbol == 16 && i == 0)
+				{
+					return DecodeError::InvalidDeflateStream;
+				}
+				byte value = symbol == 16 ? lengths[i - 1] : 0;
+				int repeat = symbol == 16 ? 3 + this->take(2) : symbol == 17 ? 3 + this->take(3) : 11 + this->take(7);
+				if (i + repeat > literal_lengths + distances)
+				{
+					return DecodeError::InvalidDeflateStream;
+				}
+				std::fill(lengths + i, lengths + i + repeat, value);
+				i += repeat;
+			}
+			if (this->overran())
+			{
+				return DecodeError::TruncatedData;
+			}
+			if (!lengths[end_of_block])
+			{
+				return DecodeError::InvalidDeflateStream;
+			}
+			// distances follow the literal and length codes right away
+			byte distance_lengths[distance_symbols] = {};
+			std::copy(lengths + literal_lengths, lengths + literal_lengths + distances, distance_lengths);
+			std::fill(lengths + literal_lengths, lengths + literal_length_symbols, 0);
+			if (!build_table(lengths, literal_length_symbols, symbol_entries()._literal_length, literal_length_primary_bits, _literal_length_table) ||
+				!build_table(distance_lengths, distance_symbols, symbol_entries()._distance, distance_primary_bits, _distance_table))
+			{
+				return DecodeError::InvalidDeflateStream;
+			}
+			return DecodeError::None;
+		}
+
+		/// [3.2.6] Fixed codes
+		void fixed_tables()
+		{
+			byte lengths[literal_length_symbols];
+			std::fill(lengths, lengths + 144, 8);
+			std::fill(lengths + 144, lengths + 256, 9);
+			std::fill(lengths + 256, lengths + 280, 7);
+			std::fill(lengths + 280, lengths + 288, 8);
+			build_table(lengths, literal_length_symbols, symbol_entries()._literal_length, literal_length_primary_bits, _literal_length_table);
+			byte distance_lengths[distance_symbols];
+			std::fill(distance_lengths, distance_lengths + distance_symbols, 5);
+			build_table(distance_lengths, distance_symbols, symbol_entries()._distance, distance_primary_bits, _distance_table);
+		}
+
+		/// Symbols of the block while there are 8 bytes of input and room for the longest match with 8 bytes
+		/// behind it, so neither refills nor copies check the ends. State is kept in locals, stores of output
+		/// bytes would make the compiler reload members. True when the block ended, error_ tells how.
+		bool fast_symbols(DecodeError& error_)
+		{
+			const unsigned int* literal_length_table = _literal_length_table.data();
+			const unsigned int* distance_table = _distance_table.data();
+			const unsigned int literal_length_mask = (1u << literal_length_primary_bits) - 1;
+			const unsigned int distance_mask = (1u << distance_primary_bits) - 1;
+			unsigned long long bits = _bits;
+			int bit_count = _bit_count;
+			const byte* input = _input;
+			const byte* const input_limit = _input_end - 8;
+			byte* const output_begin = _output.data();
+			byte* output = output_begin + _position;
+			byte* const output_limit = output_begin + _output.size() - (max_match + 8);
+			bool ended = false;
+			error_ = DecodeError::None;
+			while (input <= input_limit && output <= output_limit)
+			{
+				unsigned long long word;
+				std::memcpy(&word, input, 8);
+				bits |= word << bit_count;
+				input += (63 - bit_count) >> 3;
+				bit_count |= 56;
+
+				unsigned int entry = literal_length_table[bits & literal_length_mask];
+				if (entry_kind(entry) == SUBTABLE)
+				{
+					bits >>= literal_length_primary_bits;
+					bit_count -= literal_length_primary_bits;
+					entry = literal_length_table[entry_value(entry) + (bits & ((1u << entry_extra_bits(entry)) - 1))];
+				}
+				bits >>= entry_bits(entry);
+				bit_count -= entry_bits(entry);
+				EntryKind kind = entry_kind(entry);
+				if (kind == LITERAL)
+				{
+					*output++ = byte(entry_value(entry));
+					continue;
+				}
+				if (kind != MATCH)
+				{
+					ended = true;
+					error_ = kind == END_OF_BLOCK ? DecodeError::None : DecodeError::InvalidDeflateStream;
+					break;
+				}
+				unsigned int extra_bits = entry_extra_bits(entry);
+				std::size_t length = entry_value(entry) + (bits & ((1u << extra_bits) - 1));
+				bits >>= extra_bits;
+				bit_count -= extra_bits;
+
+				entry = distance_table[bits & distance_mask];
+				if (entry_kind(entry) == SUBTABLE)
+				{
+					bits >>= distance_primary_bits;
+					bit_count -= distance_primary_bits;
+					entry = distance_table[entry_value(entry) + (bits & ((1u << entry_extra_bits(entry)) - 1))];
+				}
+				bits >>= entry_bits(entry);
+				bit_count -= entry_bits(entry);
+				extra_bits = entry_extra_bits(entry);
+				std::size_t distance = entry_value(entry) + (bits & ((1u << extra_bits) - 1));
+				bits >>= extra_bits;
+				bit_count -= extra_bits;
+				if (entry_kind(entry) != MATCH || distance > std::size_t(output - output_begin))
+				{
+					ended = true;
+					error_ = DecodeError::InvalidDeflateStream;
+					break;
+				}
+
+				const byte* source = output - distance;
+				if (distance >= 8)
+				{
+					for (std::size_t i = 0; i < length; i += 8)
+					{
+						std::memcpy(output + i, source + i, 8);
+					}
+				}
+				else if (distance == 1)
+				{
+					std::memset(output, *source, length);
+				}
+				else
+				{
+					for (std::size_t i = 0; i < length; i++)
+					{
+						output[i] = source[i];
+					}
+				}
+				output += length;
+			}
+			_bits = bits;
+			_bit_count = bit_count;
+			_input = input;
+			_position = std::size_t(output - output_begin);
+			return ended;
+		}
+
+		/// Symbols of one block up to its end. One refill gives enough bits for the longest match:
+		/// 15 bits of length code, 5 extra bits, 15 bits of distance code and 13 extra bits.
+		DecodeError huffman_block()
+		{
+			const unsigned int* literal_length_table = _literal_length_table.data();
+			const unsigned int* distance_table = _distance_table.data();
+			const unsigned int literal_length_mask = (1u << literal_length_primary_bits) - 1;
+			const unsigned int distance_mask = (1u << distance_primary_bits) - 1;
+			for (;;)
+			{
+				DecodeError error;
+				if (this->fast_symbols(error))
+				{
+					return error;
+				}
+				this->refill();
+				if (this->overran())
+				{
+					return DecodeError::TruncatedData;
+				}
+				unsigned int entry = literal_length_table[_bits & literal_length_mask];
+				if (entry_kind(entry) == SUBTABLE)
+				{
+					this->take(literal_length_primary_bits);
+					entry = literal_length_table[entry_value(entry) + (_bits & ((1u << entry_extra_bits(entry)) - 1))];
+				}
+				this->take(entry_bits(entry));
+				EntryKind kind = entry_kind(entry);
+				if (kind == LITERAL)
+				{
+					if (_position == _output.size() && !this->reserve(1))
+					{
+						return DecodeError::InvalidDeflateStream;
+					}
+					_output[_position++] = byte(entry_value(entry));
+					continue;
+				}
+				if (kind == END_OF_BLOCK)
+				{
+					return DecodeError::None;
+				}
+				if (kind != MATCH)
+				{
+					return DecodeError::InvalidDeflateStream;
+				}
+				std::size_t length = entry_value(entry) + this->take(entry_extra_bits(entry));
+
+				entry = distance_table[_bits & distance_mask];
+				if (entry_kind(entry) == SUBTABLE)
+				{
+					this->take(distance_primary_bits);
+					entry = distance_table[entry_value(entry) + (_bits & ((1u << entry_extra_bits(entry)) - 1))];
+				}
+				this->take(entry_bits(entry));
+				if (entry_kind(entry) != MATCH)
+				{
+					return DecodeError::InvalidDeflateStream;
+				}
+				std::size_t distance = entry_value(entry) + this->take(entry_extra_bits(entry));
+				if (distance > _position)
+				{
+					return DecodeError::InvalidDeflateStream;
+				}
+				if (!this->reserve(length))
+				{
+					return DecodeError::InvalidDeflateStream;
+				}
+
+				byte* destination = _output.data() + _position;
+				const byte* source = destination - distance;
+				_position += length;
+				if (distance >= 8 && _output.size() - _position >= 8)
+				{
+					// 8 bytes at once, the last copy may write past the match into the room behind it
+					for (std::size_t i = 0; i < length; i += 8)
+					{
+						std::memcpy(destination + i, source + i, 8);
+					}
+				}
+				else if (distance == 1)
+				{
+					std::memset(destination, *source, length);
+				}
+				else
+				{
+					for (std::size_t i = 0; i < length; i++)
+					{
+						destination[i] = source[i];
+					}
+				}
+			}
+		}
+
+		DecodeError Run()
+		{
+			for (bool final = false; !final;)
+			{
+				this->refill();
+				final = this->take(1) != 0;
+				int type = this->take(2);
+				DecodeError error = DecodeError::None;
+				if (type == 0)
+				{
+					error = this->stored_block();
+				}
+				else if (type == 1)
+				{
+					this->fixed_tables();
+					error = this->huffman_block();
+				}
+				else if (type == 2)
+				{
+					error = this->dynamic_tables();
+					if (error == DecodeError::None)
+					{
+						error = this->huffman_block();
+					}
+				}
+				else
+				{
+					error = DecodeError::InvalidDeflateStream;
+				}
+				if (error == DecodeError::None && this->overran())
+				{
+					error = DecodeError::TruncatedData;
+				}
+				if (error != DecodeError::None)
+				{
+					return error;
+				}
+			}
+			if (!this->align())
+			{
+				return DecodeError::TruncatedData;
+			}
+			if (_exact && _position != _output.size())
+			{
+				return DecodeError::InvalidDeflateStream;
+			}
+			_output.resize(_position);
+			return DecodeError::None;
+		}
+
+		const byte* Position() const
+		{
+			return _input;
+		}
+	};
+
+	/// Fixed sizes of the matching of every level, as zlib configures its levels
+	struct Configuration
+	{
+		int _good_length; // the chain is searched 4 times shorter beyond a match this long
+		int _lazy_length; // no match is looked for at the next byte beyond this one
+		int _nice_length; // search stops at a match this long
+		int _max_chain;
+		bool _lazy;
+	};
+
+	const Configuration configurations[Deflate::max_level + 1] = {
+		{ 0, 0, 0, 0, false },
+		{ 4, 4, 8, 4, false },
+		{ 4, 5, 16, 8, false },
+		{ 4, 6, 32, 32, false },
+		{ 4, 4, 16, 16, true },
+		{ 8, 16, 32, 32, true },
+		{ 8, 16, 128, 128, true },
+		{ 8, 32, 128, 256, true },
+		{ 32, 128, 258, 1024, true },
+		{ 32, 258, 258, 4096, true },
+	};
+
+	/// Writes bits least significant first, as deflate packs them
+	class BitWriter
+	{
+		std::vector<byte>& _output;
+		unsigned long long _bits;
+		int _count;
+
+	public:
+
+		explicit BitWriter(std::vector<byte>& output_)
+			: _output(output_), _bits(0), _count(0)
+		{
+		}
+
+		void Write(unsigned int value_, int bits_)
+		{
+			_bits |= static_cast<unsigned long long>(value_) << _count;
+			_count += bits_;
+			if (_count >= 32)
+			{
+				for (int i = 0; i < 4; i++)
+				{
+					_output.push_back(byte(_bits >> (8 * i)));
+				}
+				_bits >>= 32;
+				_count -= 32;
+			}
+		}
+
+		/// Bytes as they are, after Flush
+		void WriteBytes(const byte* data_, std::size_t count_)
+		{
+			_output.insert(_output.end(), data_, data_ + count_);
+		}
+
+		/// Pads the last byte with zeros
+		void Flush()
+		{
+			for (; _count > 0; _count -= 8)
+			{
+				_output.push_back(byte(_bits));
+				_bits >>= 8;
+			}
+			_bits = 0;
+			_count = 0;
+		}
+	};
+
+	/// Code lengths of at most limit_ bits for count_ symbols with frequencies_. Huffman lengths are
+	/// clamped to the limit and the code is repaired: too long codes are made longer for the rarest symbols,
+	/// the room left is given back to the most frequent ones, so the code stays complete.
+	void build_lengths(const unsigned int* frequencies_, int count_, int limit_, byte* lengths_)
+	{
+		std::fill(lengths_, lengths_ + count_, 0);
+		std::vector<int> symbols;
+		for (int s = 0; s < count_; s++)
+		{
+			if (frequencies_[s])
+			{
+				symbols.push_back(s);
+			}
+		}
+		// a code of one symbol is not complete, so a second symbol is taken in
+		for (int s = 0; symbols.size() < 2; s++)
+		{
+			if (!frequencies_[s])
+			{
+				symbols.push_back(s);
+			}
+		}
+		std::stable_sort(symbols.begin(), symbols.end(), [frequencies_](int a_, int b_) { return frequencies_[a_] < frequencies_[b_]; });
+
+		// two queues: leaves in the order of frequency and inner nodes in the order they are made
+		const int leaves = int(symbols.size());
+		std::vector<unsigned long long> weights(2 * leaves - 1);
+		std::vector<int> parents(2 * leaves - 1);
+		for (int i = 0; i < leaves; i++)
+		{
+			weights[i] = frequencies_[symbols[i]];
+		}
+		int next_leaf = 0, next_node = leaves;
+		auto smallest = [&](int node_)
+		{
+			bool leaf = next_leaf < leaves && (next_node >= node_ || weights[next_leaf] <= weights[next_node]);
+			return leaf ? next_leaf++ : next_node++;
+		};
+		for (int node = leaves; node < 2 * leaves - 1; node++)
+		{
+			int first = smallest(node);
+			int second = smallest(node);
+			weights[node] = weights[first] + weights[second];
+			parents[first] = parents[second] = node;
+		}
+		std::vector<int> depths(2 * leaves - 1);
+		for (int node = 2 * leaves - 3; node >= 0; node--)
+		{
+			depths[node] = depths[parents[node]] + 1;
+		}
+
+		const long long full = 1ll << limit_;
+		long long kraft = 0;
+		for (int i = 0; i < leaves; i++)
+		{
+			lengths_[symbols[i]] = byte(std::min(depths[i], limit_));
+			kraft += 1ll << (limit_ - lengths_[symbols[i]]);
+		}
+		while (kraft > full)
+		{
+			for (int i = 0; i < leaves; i++)
+			{
+				byte& length = lengths_[symbols[i]];
+				if (length < limit_)
+				{
+					length++;
+					kraft -= 1ll << (limit_ - length);
+					break;
+				}
+			}
+		}
+		while (kraft < full)
+		{
+			for (int i = leaves - 1; i >= 0 && kraft < full; i--)
+			{
+				byte& length = lengths_[symbols[i]];
+				while (length > 1 && kraft + (1ll << (limit_ - length)) <= full)
+				{
+					kraft += 1ll << (limit_ - length);
+					length--;
+				}
+			}
+		}
+	}
+
+	/// [3.2.2] Canonical codes, bit reversed for BitWriter
+	void build_codes(const byte* lengths_, int count_, unsigned short* codes_)
+	{
+		int counts[max_code_bits + 1] = {};
+		for (int s = 0; s < count_; s++)
+		{
+			counts[lengths_[s]]++;
+		}
+		counts[0] = 0;
+		unsigned int next_code[max_code_bits + 1] = {};
+		for (int bits = 1, code = 0; bits <= max_code_bits; bits++)
+		{
+			code = (code + counts[bits - 1]) << 1;
+			next_code[bits] = code;
+		}
+		for (int s = 0; s < count_; s++)
+		{
+			codes_[s] = lengths_[s] ? static_cast<unsigned short>(reverse_bits(next_code[lengths_[s]]++, lengths_[s])) : 0;
+		}
+	}
+
+	/// Symbols of lengths 3-258 and of distances 1-32768
+	struct SymbolTables
+	{
+		byte _length_symbols[max_match + 1];
+		byte _distance_symbols[512]; // distances up to 256 directly, longer ones by (distance - 1) >> 7
+
+		SymbolTables()
+		{
+			for (int s = 0; s < 29; s++)
+			{
+				for (int length = length_bases[s]; length < length_bases[s] + (1 << length_extra_bits[s]) && length <= max_match; length++)
+				{
+					_length_symbols[length] = byte(s);
+				}
+			}
+			for (int s = 0; s < 30; s++)
+			{
+				for (int distance = distance_bases[s]; distance < distance_bases[s] + (1 << distance_extra_bits[s]); distance++)
+				{
+					if (distance <= 256)
+					{
+						_distance_symbols[distance - 1] = byte(s);
+					}
+					else
+					{
+						_distance_symbols[256 + ((distance - 1) >> 7)] = byte(s);
+					}
+				}
+			}
+		}
+
+		int DistanceSymbol(unsigned int distance_) const
+		{
+			return distance_ <= 256 ? _distance_symbols[distance_ - 1] : _distance_symbols[256 + ((distance_ - 1) >> 7)];
+		}
+	};
+
+	const SymbolTables& symbol_tables()
+	{
+		static const SymbolTables tables;
+		return tables;
+	}
+
+	/// Literal in the low byte, or a match: distance in the low 16 bits and length above them
+	struct Symbol
+	{
+		unsigned short _distance; // 0 for literals
+		unsigned short _value;    // literal or length
+	};
+
+	/// Compressor class, that finds matches of the whole input and writes them block by block
+	class Compressor
+	{
+		static const int hash_bits = 15;
+		static constexpr std::size_t none = ~std::size_t(0);
+		static const std::size_t block_symbols = 1 << 15;
+
+		const byte* _data;
+		std::size_t _size;
+		const Configuration& _configuration;
+		BitWriter _writer;
+		std::vector<std::size_t> _head;
+		std::vector<std::size_t> _previous; // older position of the same hash, by position modulo the window
+		std::vector<Symbol> _symbols;
+		std::size_t _block_start;
+
+		unsigned int hash(std::size_t position_) const
+		{
+			unsigned int value = _data[position_] | _data[position_ + 1] << 8 | _data[position_ + 2] << 16;
+			return (value * 2654435761u) >> (32 - hash_bits);
+		}
+
+		/// Puts the position into its chain, returns the previous head of the chain
+		std::size_t insert(std::size_t position_)
+		{
+			unsigned int h = this->hash(position_);
+			std::size_t candidate = _head[h];
+			_previous[position_ % window_size] = candidate;
+			_head[h] = position_;
+			return candidate;
+		}
+
+		std::size_t match_length(const byte* a_, const byte* b_, std::size_t max_) const
+		{
+			std::size_t length = 0;
+			for (; length + 8 <= max_; length += 8)
+			{
+				unsigned long long x, y;
+				std::memcpy(&x, a_ + length, 8);
+				std::memcpy(&y, b_ + length, 8);
+				if (x != y)
+				{
+					return length + LowestSetBit(x ^ y) / 8;
+				}
+			}
+			for (; length < max_ && a_[length] == b_[length]; length++)
+			{
+			}
+			return length;
+		}
+
+		/// Longest match longer than best_length_ along the chain from candidate_, 0 when there is none
+		int longest_match(std::size_t position_, std::size_t candidate_, int best_length_, unsigned int& distance_) const
+		{
+			int max_length = int(std::min<std::size_t>(max_match, _size - position_));
+			if (max_length < min_match || best_length_ >= max_length)
+			{
+				return 0;
+			}
+			int chain = best_length_ >= _configuration._good_length ? _configuration._max_chain >> 2 : _configuration._max_chain;
+			int nice_length = std::min(_configuration._nice_length, max_length);
+			int found = 0;
+			int best_length = std::max(best_length_, min_match - 1);
+			const byte* here = _data + position_;
+			for (; candidate_ != none && position_ - candidate_ <= window_size && chain > 0; chain--)
+			{
+				const byte* there = _data + candidate_;
+				if (there[best_length] == here[best_length] && there[0] == here[0])
+				{
+					int length = int(this->match_length(there, here, max_length));
+					if (length > best_length)
+					{
+						best_length = found = length;
+						distance_ = unsigned(position_ - candidate_);
+						if (length >= nice_length)
+						{
+							break;
+						}
+					}
+				}
+				std::size_t next = _previous[candidate_ % window_size];
+				if (next >= candidate_)
+				{
+					// the entry was taken over by a newer position
+					break;
+				}
+				candidate_ = next;
+			}
+			// a short match far away costs more than its literals
+			if (found == min_match && distance_ > 4096)
+			{
+				return 0;
+			}
+			return found;
+		}
+
+		void literal(std::size_t position_)
+		{
+			_symbols.push_back(Symbol{ 0, _data[position_] });
+			this->flush_if_full(position_ + 1);
+		}
+
+		void match(std::size_t position_, int length_, unsigned int distance_)
+		{
+			_symbols.push_back(Symbol{ static_cast<unsigned short>(distance_), static_cast<unsigned short>(length_) });
+			this->flush_if_full(position_ + length_);
+		}
+
+		void flush_if_full(std::size_t end_)
+		{
+			if (_symbols.size() >= block_symbols)
+			{
+				this->write_block(end_, false);
+			}
+		}
+
+		/// [3.2.7] Code lengths of both codes run-length coded by symbols 16, 17 and 18, extra bits
+		/// of the repeat counts go to the high byte
+		static void run_lengths(const byte* lengths_, int count_, std::vector<unsigned short>& output_)
+		{
+			for (int i = 0; i < count_;)
+			{
+				byte value = lengths_[i];
+				int run = 1;
+				while (i + run < count_ && lengths_[i + run] == value)
+				{
+					run++;
+				}
+				i += run;
+				if (!value)
+				{
+					while (run >= 11)
+					{
+						int n = std::min(run, 138);
+						output_.push_back(static_cast<unsigned short>(18 | (n - 11) << 8));
+						run -= n;
+					}
+					if (run >= 3)
+					{
+						output_.push_back(static_cast<unsigned short>(17 | (run - 3) << 8));
+						run = 0;
+					}
+				}
+				else
+				{
+					output_.push_back(value);
+					run--;
+					while (run >= 3)
+					{
+						int n = std::min(run, 6);
+						output_.push_back(static_cast<unsigned short>(16 | (n - 3) << 8));
+						run -= n;
+					}
+				}
+				for (; run > 0; run--)
+				{
+					output_.push_back(value);
+				}
+			}
+		}
+
+		void write_symbols(const unsigned short* literal_length_codes_, const byte* literal_length_lengths_,
+			const unsigned short* distance_codes_, const byte* distance_lengths_)
+		{
+			const SymbolTables& tables = symbol_tables();
+			for (const Symbol& symbol : _symbols)
+			{
+				if (!symbol._distance)
+				{
+					_writer.Write(literal_length_codes_[symbol._value], literal_length_lengths_[symbol._value]);
+					continue;
+				}
+				int length_symbol = tables._length_symbols[symbol._value];
+				_writer.Write(literal_length_codes_[257 + length_symbol], literal_length_lengths_[257 + length_symbol]);
+				_writer.Write(symbol._value - length_bases[length_symbol], length_extra_bits[length_symbol]);
+				int distance_symbol = tables.DistanceSymbol(symbol._distance);
+				_writer.Write(distance_codes_[distance_symbol], distance_lengths_[distance_symbol]);
+				_writer.Write(symbol._distance - distance_bases[distance_symbol], distance_extra_bits[distance_symbol]);
+			}
+			_writer.Write(literal_length_codes_[end_of_block], literal_length_lengths_[end_of_block]);
+		}
+
+		/// Symbols since the last block as a stored, fixed or dynamic block, whichever is the smallest
+		void write_block(std::size_t end_, bool final_)
+		{
+			const SymbolTables& tables = symbol_tables();
+			unsigned int literal_length_frequencies[286] = {};
+			unsigned int distance_frequencies[30] = {};
+			unsigned long long extra_bits = 0;
+			for (const Symbol& symbol : _symbols)
+			{
+				if (!symbol._distance)
+				{
+					literal_length_frequencies[symbol._value]++;
+					continue;
+				}
+				int length_symbol = tables._length_symbols[symbol._value];
+				int distance_symbol = tables.DistanceSymbol(symbol._distance);
+				literal_length_frequencies[257 + length_symbol]++;
+				distance_frequencies[distance_symbol]++;
+				extra_bits += length_extra_bits[length_symbol] + distance_extra_bits[distance_symbol];
+			}
+			literal_length_frequencies[end_of_block] = 1;
+
+			byte literal_length_lengths[286], distance_lengths[30];
+			build_lengths(literal_length_frequencies, 286, max_code_bits, literal_length_lengths);
+			build_lengths(distance_frequencies, 30, max_code_bits, distance_lengths);
+			int literal_lengths = 286, distances = 30;
+			while (literal_lengths > 257 && !literal_length_lengths[literal_lengths - 1])
+			{
+				literal_lengths--;
+			}
+			while (distances > 1 && !distance_lengths[distances - 1])
+			{
+				distances--;
+			}
+			byte lengths[286 + 30];
+			std::copy(literal_length_lengths, literal_length_lengths + literal_lengths, lengths);
+			std::copy(distance_lengths, distance_lengths + distances, lengths + literal_lengths);
+			std::vector<unsigned short> runs;
+			run_lengths(lengths, literal_lengths + distances, runs);
+			unsigned int code_length_frequencies[19] = {};
+			for (unsigned short run : runs)
+			{
+				code_length_frequencies[run & 0xFF]++;
+			}
+			byte code_length_lengths[19];
+			build_lengths(code_length_frequencies, 19, max_code_length_bits, code_length_lengths);
+			int code_lengths = 19;
+			while (code_lengths > 4 && !code_length_lengths[code_length_order[code_lengths - 1]])
+			{
+				code_lengths--;
+			}
+
+			// sizes in bits, the header of 3 bits is common to all three
+			static const int repeat_bits[3] = { 2, 3, 7 };
+			unsigned long long dynamic_size = 5 + 5 + 4 + 3 * code_lengths + extra_bits;
+			unsigned long long fixed_size = extra_bits;
+			for (unsigned short run : runs)
+			{
+				dynamic_size += code_length_lengths[run & 0xFF] + ((run & 0xFF) >= 16 ? repeat_bits[(run & 0xFF) - 16] : 0);
+			}
+			for (int s = 0; s < 286; s++)
+			{
+				dynamic_size += (unsigned long long)literal_length_frequencies[s] * literal_length_lengths[s];
+				fixed_size += (unsigned long long)literal_length_frequencies[s] * (s < 144 ? 8 : s < 256 ? 9 : s < 280 ? 7 : 8);
+			}
+			for (int s = 0; s < 30; s++)
+			{
+				dynamic_size += (unsigned long long)distance_frequencies[s] * distance_lengths[s];
+				fixed_size += (unsigned long long)distance_frequencies[s] * 5;
+			}
+			std::size_t stored_bytes = end_ - _block_start;
+			unsigned long long stored_size = 8 * (stored_bytes + 5 * std::max<std::size_t>(1, (stored_bytes + 65534) / 65535)) + 7;
+
+			if (stored_size <= fixed_size && stored_size <= dynamic_size)
+			{
+				this->write_stored(_block_start, end_, final_);
+			}
+			else if (fixed_size <= dynamic_size)
+			{
+				byte fixed_lengths[288];
+				std::fill(fixed_lengths, fixed_lengths + 144, 8);
+				std::fill(fixed_lengths + 144, fixed_lengths + 256, 9);
+				std::fill(fixed_lengths + 256, fixed_lengths + 280, 7);
+				std::fill(fixed_lengths + 280, fixed_lengths + 288, 8);
+				byte fixed_distance_lengths[30];
+				std::fill(fixed_distance_lengths, fixed_distance_lengths + 30, 5);
+				unsigned short codes[288], distance_codes[30];
+				build_codes(fixed_lengths, 288, codes);
+				build_codes(fixed_distance_lengths, 30, distance_codes);
+				_writer.Write(final_ ? 1 : 0, 1);
+				_writer.Write(1, 2);
+				this->write_symbols(codes, fixed_lengths, distance_codes, fixed_distance_lengths);
+			}
+			else
+			{
+				unsigned short codes[286], distance_codes[30], code_length_codes[19];
+				build_codes(literal_length_lengths, 286, codes);
+				build_codes(distance_lengths, 30, distance_codes);
+				build_codes(code_length_lengths, 19, code_length_codes);
+				_writer.Write(final_ ? 1 : 0, 1);
+				_writer.Write(2, 2);
+				_writer.Write(literal_lengths - 257, 5);
+				_writer.Write(distances - 1, 5);
+				_writer.Write(code_lengths - 4, 4);
+				for (int i = 0; i < code_lengths; i++)
+				{
+					_writer.Write(code_length_lengths[code_length_order[i]], 3);
+				}
+				for (unsigned short run : runs)
+				{
+					int symbol = run & 0xFF;
+					_writer.Write(code_length_codes[symbol], code_length_lengths[symbol]);
+					if (symbol >= 16)
+					{
+						_writer.Write(run >> 8, repeat_bits[symbol - 16]);
+					}
+				}
+				this->write_symbols(codes, literal_length_lengths, distance_codes, distance_lengths);
+			}
+			_symbols.clear();
+			_block_start = end_;
+		}
+
+		/// [3.2.4] Stored blocks of at most 65535 bytes, an empty block for no data
+		void write_stored(std::size_t begin_, std::size_t end_, bool final_)
+		{
+			std::size_t position = begin_;
+			do
+			{
+				std::size_t length = std::min<std::size_t>(end_ - position, 65535);
+				bool last = final_ && position + length == end_;
+				_writer.Write(last ? 1 : 0, 1);
+				_writer.Write(0, 2);
+				_writer.Flush();
+				_writer.Write(unsigned(length) | unsigned(length ^ 0xFFFF) << 16, 32);
+				_writer.Flush();
+				_writer.WriteBytes(_data + position, length);
+				position += length;
+			} while (position < end_);
+		}
+
+	public:
+
+		Compressor(const byte* data_, std::size_t size_, int level_, std::vector<byte>& output_)
+			: _data(data_)
+			, _size(size_)
+			, _configuration(configurations[level_])
+			, _writer(output_)
+			, _block_start(0)
+		{
+		}
+
+		void Run()
+		{
+			if (!_configuration._max_chain)
+			{
+				this->write_stored(0, _size, true);
+				return;
+			}
+			_head.assign(std::size_t(1) << hash_bits, none);
+			_previous.assign(window_size, none);
+			_symbols.reserve(block_symbols);
+			if (_configuration._lazy)
+			{
+				this->lazy_matches();
+			}
+			else
+			{
+				this->greedy_matches();
+			}
+			this->write_block(_size, true);
+			_writer.Flush();
+		}
+
+		/// Levels 1-3: the first match, which is long enough, is taken, positions inside of long matches are not hashed
+		void greedy_matches()
+		{
+			for (std::size_t position = 0; position < _size;)
+			{
+				int length = 0;
+				unsigned int distance = 0;
+				if (position + min_match <= _size)
+				{
+					length = this->longest_match(position, this->insert(position), 0, distance);
+				}
+				if (!length)
+				{
+					this->literal(position++);
+					continue;
+				}
+				this->match(position, length, distance);
+				if (length <= _configuration._lazy_length)
+				{
+					for (std::size_t p = position + 1; p < position + length && p + min_match <= _size; p++)
+					{
+						this->insert(p);
+					}
+				}
+				position += length;
+			}
+		}
+
+		/// Levels 4-9: a match is taken only when the next byte does not start a longer one
+		void lazy_matches()
+		{
+			int previous_length = 0;
+			unsigned int previous_distance = 0;
+			bool pending = false; // byte before position has no symbol yet
+			for (std::size_t position = 0; position < _size;)
+			{
+				int length = 0;
+				unsigned int distance = 0;
+				if (position + min_match <= _size)
+				{
+					std::size_t candidate = this->insert(position);
+					if (previous_length < _configuration._lazy_length)
+					{
+						length = this->longest_match(position, candidate, previous_length, distance);
+					}
+				}
+				if (previous_length >= min_match && length <= previous_length)
+				{
+					std::size_t start = position - 1;
+					this->match(start, previous_length, previous_distance);
+					for (std::size_t p = position + 1; p < start + previous_length && p + min_match <= _size; p++)
+					{
+						this->insert(p);
+					}
+					position = start + previous_length;
+					previous_length = 0;
+					pending = false;
+					continue;
+				}
+				if (pending)
+				{
+					this->literal(position - 1);
+				}
+				pending = true;
+				previous_length = length;
+				previous_distance = distance;
+				position++;
+			}
+			if (pending)
+			{
+				this->literal(_size - 1);
+			}
+		}
+	};
+}
+
+DecodeError Deflate::Inflate(const byte* data_, std::size_t size_, std::vector<byte>& output_,
+	std::size_t expected_size_, std::size_t limit_, std::size_t& consumed_)
+{
+	Inflater inflater(data_, size_, output_, expected_size_, limit_);
+	DecodeError error = inflater.Run();
+	consumed_ = std::size_t(inflater.Position() - data_);
+	return error;
+}
+
+DecodeError Deflate::InflateZlib(const byte* data_, std::size_t size_, std::vector<byte>& output_,
+	std::size_t expected_size_, std::size_t limit_)
+{
+	// [RFC 1950 2.2] deflate with window up to 32K, no preset dictionary, check bits make the header a multiple of 31
+	if (size_ < 2)
+	{
+		return DecodeError::TruncatedData;
+	}
+	if ((data_[0] & 0x0F) != 8 || data_[0] >> 4 > 7 || (data_[0] << 8 | data_[1]) % 31 || data_[1] & 0x20)
+	{
+		return DecodeError::InvalidDeflateStream;
+	}
+	std::size_t consumed = 0;
+	DecodeError error = Inflate(data_ + 2, size_ - 2, output_, expected_size_, limit_, consumed);
+	if (error != DecodeError::None)
+	{
+		return error;
+	}
+	const byte* trailer = data_ + 2 + consumed;
+	if (data_ + size_ - trailer < 4)
+	{
+		return DecodeError::TruncatedData;
+	}
+	unsigned int adler = unsigned(trailer[0]) << 24 | trailer[1] << 16 | trailer[2] << 8 | trailer[3];
+	return adler == Adler32(output_.data(), output_.size()) ? DecodeError::None : DecodeError::ChecksumMismatch;
+}
+
+void Deflate::Compress(const byte* data_, std::size_t size_, int level_, std::vector<byte>& output_)
+{
+	if (level_ < 0 || level_ > max_level)
+	{
+		throw std::invalid_argument("Compression level must be from 0 to " + std::to_string(max_level));
+	}
+	Compressor(data_, size_, level_, output_).Run();
+}
+
+std::vector<byte> Deflate::CompressZlib(const byte* data_, std::size_t size_, int level_)
+{
+	std::vector<byte> output;
+	output.reserve(size_ / 2 + 64);
+	// window of 32K, the level hint of [2.2] and check bits
+	int level_hint = level_ < 2 ? 0 : level_ < 6 ? 1 : level_ == 6 ? 2 : 3;
+	int header = 0x78 << 8 | level_hint << 6;
+	header += 31 - header % 31;
+	output.push_back(byte(header >> 8));
+	output.push_back(byte(header));
+	Compress(data_, size_, level_, output);
+	unsigned int adler = Adler32(data_, size_);
+	for (int shift = 24; shift >= 0; shift -= 8)
+	{
+		output.push_back(byte(adler >> shift));
+	}
+	return output;
+}
+
+unsigned int Deflate::Adler32(const byte* data_, std::size_t size_, unsigned int adler_)
+{
+	// sums stay within 32 bits for 5552 bytes between the reductions
+	const unsigned int modulus = 65521;
+	const std::size_t run = 5552;
+	unsigned int a = adler_ & 0xFFFF;
+	unsigned int b = adler_ >> 16;
+	while (size_)
+	{
+		std::size_t count = std::min(size_, run);
+		size_ -= count;
+		for (; count >= 8; count -= 8, data_ += 8)
+		{
+			for (int i = 0; i < 8; i++)
+			{
+				a += data_[i];
+				b += a;
+			}
+		}
+		for (; count; count--)
+		{
+			a += *data_++;
+			b += a;
+		}
+		a %= modulus;
+		b %= modulus;
+	}
+	return b << 16 | a;
+}
+
+unsigned int Deflate::Crc32(const byte* data_, std::size_t size_, unsigned int crc_)
+{
+	// slicing by 8: table k gives the CRC of a byte followed by k zero bytes
+	static const std::vector<unsigned int> tables = []()
+	{
+		std::vector<unsigned int> values(8 * 256);
+		for (unsigned int n = 0; n < 256; n++)
+		{
+			unsigned int c = n;
+			for (int k = 0; k < 8; k++)
+			{
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			values[n] = c;
+		}
+		for (int t = 1; t < 8; t++)
+		{
+			for (unsigned int n = 0; n < 256; n++)
+			{
+				unsigned int previous = values[(t - 1) * 256 + n];
+				values[t * 256 + n] = values[previous & 0xFF] ^ (previous >> 8);
+			}
+		}
+		return values;
+	}();
+	const unsigned int* table = tables.data();
+	unsigned int crc = ~crc_;
+	for (; size_ >= 8; size_ -= 8, data_ += 8)
+	{
+		unsigned int low = crc ^ (data_[0] | data_[1] << 8 | data_[2] << 16 | unsigned(data_[3]) << 24);
+		unsigned int high = data_[4] | data_[5] << 8 | data_[6] << 16 | unsigned(data_[7]) << 24;
+		crc = table[7 * 256 + (low & 0xFF)] ^ table[6 * 256 + (low >> 8 & 0xFF)] ^ table[5 * 256 + (low >> 16 & 0xFF)] ^ table[4 * 256 + (low >> 24)]
+			^ table[3 * 256 + (high & 0xFF)] ^ table[2 * 256 + (high >> 8 & 0xFF)] ^ table[1 * 256 + (high >> 16 & 0xFF)] ^ table[high >> 24];
+	}
+	for (; size_; size_--)
+	{
+		crc = table[(crc ^ *data_++) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+#include<vector>
+#include"BitStream.h"
+#include"DecodeStatus.h"
+
+/// Deflate class, that inflates and deflates [RFC 1950] zlib streams of [RFC 1951] deflate data, as PNG stores them.
+/// Inflating is table driven: codes up to 10 bits long are decoded by one lookup, longer ones by a second lookup
+/// in a subtable, and the bit buffer is refilled 8 bytes at once, which is enough for a whole match.
+/// Deflating finds matches in hash chains, the level trades speed for ratio the way zlib levels do.
+class Deflate
+{
+public:
+
+	static const int max_level = 9;
+	static const int default_level = 6;
+
+	/// Inflates the zlib stream into output_. When expected_size_ is not 0, the stream has to give exactly
+	/// that many bytes, otherwise output_ grows as needed up to limit_ bytes.
+	static DecodeError InflateZlib(const byte* data_, std::size_t size_, std::vector<byte>& output_,
+		std::size_t expected_size_, std::size_t limit_ = std::size_t(1) << 30);
+	/// The same for raw deflate data, consumed_ is the number of bytes up to the end of the final block
+	static DecodeError Inflate(const byte* data_, std::size_t size_, std::vector<byte>& output_,
+		std::size_t expected_size_, std::size_t limit_, std::size_t& consumed_);
+
+	/// Level 0 only stores the data, levels 1-3 take the first match long enough, levels 4-9 also try
+	/// the match at the next byte and search longer chains
+	static std::vector<byte> CompressZlib(const byte* data_, std::size_t size_, int level_ = default_level);
+	/// Raw deflate data appended to output_
+	static void Compress(const byte* data_, std::size_t size_, int level_, std::vector<byte>& output_);
+
+	/// [RFC 1950 8.2] Running checksum, 1 for no data
+	static unsigned int Adler32(const byte* data_, std::size_t size_, unsigned int adler_ = 1);
+	/// [PNG 5.5] Running CRC-32 of ISO 3309, 0 for no data
+	static unsigned int Crc32(const byte* data_, std::size_t size_, unsigned int crc_ = 0);
+};
\ No newline at end of file
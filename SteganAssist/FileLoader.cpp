@@ -0,0 +1,74 @@
+#include "FileLoader.h"
+#include "IoUringFileLoader.h"
+#include "ImageFileBuffer.h"
+#include "ThreadPool.h"
+#include <stdexcept>
+
+std::unique_ptr<FileLoader> FileLoader::Create(Backend backend_, int threads_)
+{
+#if defined(STEGANASSIST_IO_URING)
+	if (backend_ != Backend::Threads)
+	{
+		std::unique_ptr<FileLoader> loader = IoUringFileLoader::Create(threads_);
+		if (loader)
+		{
+			return loader;
+		}
+	}
+#endif
+	if (backend_ == Backend::IoUring)
+	{
+		throw std::runtime_error("io_uring loader is not available, it is not compiled in or the kernel refuses it");
+	}
+	return std::unique_ptr<FileLoader>(new ThreadFileLoader(threads_));
+}
+
+FileLoader::Backend FileLoader::ParseBackend(const std::string& name_)
+{
+	if (name_ == "auto")
+	{
+		return Backend::Auto;
+	}
+	if (name_ == "threads")
+	{
+		return Backend::Threads;
+	}
+	if (name_ == "io_uring")
+	{
+		return Backend::IoUring;
+	}
+	throw std::invalid_argument("Unknown loader " + name_);
+}
+
+ThreadFileLoader::ThreadFileLoader(int threads_)
+	: _threads(threads_ > 0 ? threads_ : 1)
+{
+}
+
+void ThreadFileLoader::Load(const std::vector<std::string>& files_, const Acquire& acquire_, const Loaded& loaded_)
+{
+	ThreadPool pool(_threads);
+	for (size_t i = 0; i < files_.size(); i++)
+	{
+		pool.Submit([&files_, &acquire_, &loaded_, i]()
+		{
+			std::vector<byte> content;
+			std::string error;
+			try
+			{
+				content = ImageFileBuffer(files_[i], acquire_()).Get();
+			}
+			catch (const std::exception& e)
+			{
+				error = e.what();
+			}
+			loaded_(i, std::move(content), error);
+		});
+	}
+	pool.Wait();
+}
+
+const char* ThreadFileLoader::Name() const
+{
+	return "threads";
+}
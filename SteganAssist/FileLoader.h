@@ -0,0 +1,47 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<memory>
+#include<functional>
+#include"BitStream.h"
+
+/// FileLoader class, that reads whole files of the batch into memory for the pipeline.
+/// Files are given to loaded_ in the order of completion, possibly from several threads at once.
+class FileLoader
+{
+public:
+	/// Returns recycled storage for the next file
+	typedef std::function<std::vector<byte>()> Acquire;
+	/// Content of files_[index_], or the reason why it could not be read
+	typedef std::function<void(size_t index_, std::vector<byte>&& content_, const std::string& error_)> Loaded;
+
+	enum class Backend
+	{
+		Auto,       // io_uring, when the kernel allows it, threads otherwise
+		Threads,    // blocking reads on the thread pool, available everywhere
+		IoUring,    // batched open/read/close through io_uring, Linux only
+	};
+
+	virtual ~FileLoader() {}
+	/// Returns when every file is passed to loaded_
+	virtual void Load(const std::vector<std::string>& files_, const Acquire& acquire_, const Loaded& loaded_) = 0;
+	virtual const char* Name() const = 0;
+
+	/// threads_ read the files with Threads and finish the files bigger than a slot with IoUring.
+	/// Auto falls back to threads, when io_uring is not compiled in or refused by the kernel, IoUring throws then
+	static std::unique_ptr<FileLoader> Create(Backend backend_, int threads_);
+	/// "auto", "threads" or "io_uring"
+	static Backend ParseBackend(const std::string& name_);
+};
+
+/// ThreadFileLoader class, that reads every file by a separate task of the work-stealing pool
+class ThreadFileLoader : public FileLoader
+{
+	int _threads;
+
+public:
+
+	explicit ThreadFileLoader(int threads_);
+	void Load(const std::vector<std::string>& files_, const Acquire& acquire_, const Loaded& loaded_) override;
+	const char* Name() const override;
+};
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "HuffmanCache.h"
+#include "Instrumentation.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+bool HuffmanTable::Build(const byte* bits_, const byte* values_)
+{
+	std::fill(_lookup, _lookup + (1 << lookahead_bits), LookupEntry{ 0, 0 });
+	// [C.2] codes of every length are consecutive numbers, following the codes of the shorter lengths
+	int code = 0;
+	int count = 0;
+	for (int length = 1; length <= 16; length++)
+	{
+		_value_offset[length] = count - code;
+		for (int i = 0; i < bits_[length - 1]; i++, code++, count++)
+		{
+			if (code >= (1 << length))
+			{
+				return false; // more codes than this length has
+			}
+			_values[count] = values_[count];
+			if (length <= lookahead_bits)
+			{
+				// every continuation of the short code leads to the same value
+				int free_bits = lookahead_bits - length;
+				for (int j = 0; j < (1 << free_bits); j++)
+				{
+					_lookup[(code << free_bits) | j] = LookupEntry{ byte(length), values_[count] };
+				}
+			}
+		}
+		_max_code[length] = bits_[length - 1] ? code - 1 : -1;
+		code <<= 1;
+	}
+	return true;
+}
+
+namespace
+{
+	struct CacheState
+	{
+		std::shared_mutex _mutex;
+		std::unordered_map<unsigned long long, std::shared_ptr<const SharedHuffmanTable>> _tables;
+	};
+
+	CacheState& cache_state()
+	{
+		static CacheState state;
+		return state;
+	}
+
+	/// FNV-1a of BITS followed by HUFFVAL
+	unsigned long long hash_of(const byte* bits_, const byte* values_, int number_of_values_)
+	{
+		unsigned long long hash = 14695981039346656037ull;
+		for (int i = 0; i < 16; i++)
+		{
+			hash = (hash ^ bits_[i]) * 1099511628211ull;
+		}
+		for (int i = 0; i < number_of_values_; i++)
+		{
+			hash = (hash ^ values_[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	bool same_table(const SharedHuffmanTable& table_, const byte* bits_, const byte* values_, int number_of_values_)
+	{
+		return table_._number_of_values == number_of_values_
+			&& std::memcmp(table_._bits, bits_, 16) == 0
+			&& std::memcmp(table_._values, values_, number_of_values_) == 0;
+	}
+
+	std::shared_ptr<const SharedHuffmanTable> build(const byte* bits_, const byte* values_, int number_of_values_)
+	{
+		std::shared_ptr<SharedHuffmanTable> table = std::make_shared<SharedHuffmanTable>();
+		if (!table->_decoding.Build(bits_, values_))
+		{
+			return nullptr;
+		}
+		std::memcpy(table->_bits, bits_, 16);
+		std::memcpy(table->_values, values_, number_of_values_);
+		table->_number_of_values = number_of_values_;
+
+		// [Figure C.1], [Figure C.2] codes of the same length are consecutive numbers,
+		// the first code of every next length is the doubled next code of previous length
+		std::fill(table->_encoding, table->_encoding + 256, HuffmanCode{ 0, 0 });
+		unsigned short code = 0;
+		int k = 0;
+		for (int length = 1; length <= 16; length++)
+		{
+			for (int i = 0; i < bits_[length - 1]; i++)
+			{
+				table->_encoding[values_[k]]._code = code;
+				table->_encoding[values_[k]]._length = length;
+				code++;
+				k++;
+			}
+			code <<= 1;
+		}
+		INSTRUMENT(DecodeCounters::Current()._tables_built++);
+		return table;
+	}
+}
+
+std::shared_ptr<const SharedHuffmanTable> HuffmanCache::Get(const byte* bits_, const byte* values_)
+{
+	int number_of_values = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		number_of_values += bits_[i];
+	}
+	if (number_of_values > 256)
+	{
+		return nullptr;
+	}
+	unsigned long long hash = hash_of(bits_, values_, number_of_values);
+
+	CacheState& state = cache_state();
+	{
+		std::shared_lock<std::shared_mutex> lock(state._mutex);
+		auto found = state._tables.find(hash);
+		if (found != state._tables.end() && same_table(*found->second, bits_, values_, number_of_values))
+		{
+			INSTRUMENT(DecodeCounters::Current()._tables_reused++);
+			return found->second;
+		}
+	}
+
+	// built without the lock, another thread may insert the same table meanwhile
+	std::shared_ptr<const SharedHuffmanTable> table = build(bits_, values_, number_of_values);
+	if (!table)
+	{
+		return nullptr;
+	}
+	std::unique_lock<std::shared_mutex> lock(state._mutex);
+	auto found = state._tables.find(hash);
+	if (found != state._tables.end())
+	{
+		// a colliding different table is used without caching
+		return same_table(*found->second, bits_, values_, number_of_values) ? found->second : table;
+	}
+	if (state._tables.size() >= max_tables)
+	{
+		state._tables.clear();
+	}
+	state._tables.emplace(hash, table);
+	return table;
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+#include<memory>
+#include"BitStream.h"
+
+/// [C.2] Code and its length in bits for every symbol, length 0 means the symbol has no code
+struct HuffmanCode
+{
+	unsigned short _code;
+	byte _length;
+};
+
+/// [C.2] and [F.2.2.3] Decoder tables of one Huffman table
+class HuffmanTable
+{
+public:
+
+	/// Code of up to lookahead_bits bits, resolved by a single table access, _length 0 means longer code
+	struct LookupEntry
+	{
+		byte _length;
+		byte _value;
+	};
+	static const int lookahead_bits = 8;
+
+private:
+
+	LookupEntry _lookup[1 << lookahead_bits];
+	int _max_code[17];     // MAXCODE, the largest code of every length, -1 when there is no code of that length
+	int _value_offset[17]; // VALPTR - MINCODE, so the value of code is _values[_value_offset[length] + code]
+	byte _values[256];     // HUFFVAL
+
+public:
+
+	/// bits_ are 16 numbers of codes of lengths 1..16 (BITS), values_ are their values (HUFFVAL).
+	/// Returns false, when the codes do not fit into their lengths.
+	bool Build(const byte* bits_, const byte* values_);
+	/// bits_ are the next lookahead_bits bits of the stream
+	const LookupEntry& Lookup(unsigned int bits_) const
+	{
+		return _lookup[bits_];
+	}
+	/// [F.2.2.3] Value of the code_ of length_ bits, -1 when code_ is larger than any code of this length.
+	/// Lengths must be tried from the shortest one.
+	int Decode(unsigned int code_, int length_) const
+	{
+		return int(code_) > _max_code[length_] ? -1 : _values[_value_offset[length_] + code_];
+	}
+};
+
+/// Everything built from one table specification, immutable once built, so images share it between threads
+struct SharedHuffmanTable
+{
+	byte _bits[16];               // BITS
+	byte _values[256];            // HUFFVAL, _number_of_values of them are used
+	int _number_of_values;
+	HuffmanTable _decoding;
+	HuffmanCode _encoding[256];   // [Annex C] EHUFCO and EHUFSI indexed by symbol
+};
+
+/// HuffmanCache class, that builds every distinct DHT once per process. Almost all encoders emit the
+/// typical tables of [Annex K.3], so decoding an image looks its tables up instead of building them.
+/// Tables are found by the hash of BITS and HUFFVAL, lookups take a shared lock, only misses take
+/// the exclusive one. The cache is dropped as a whole, when it is full, images keep their tables.
+class HuffmanCache
+{
+public:
+
+	static const size_t max_tables = 256;
+
+	/// Table of bits_ (BITS) and values_ (HUFFVAL), nullptr when the codes do not fit into their lengths
+	static std::shared_ptr<const SharedHuffmanTable> Get(const byte* bits_, const byte* values_);
+};
\ No newline at end of file
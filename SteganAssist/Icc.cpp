@@ -0,0 +1,422 @@
+#include "Icc.h"
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+	unsigned int read_u16(const byte* data_)
+	{
+		return data_[0] << 8 | data_[1];
+	}
+
+	unsigned int read_u32(const byte* data_)
+	{
+		return read_u16(data_) << 16 | read_u16(data_ + 2);
+	}
+
+	/// [4.6] s15Fixed16Number
+	double read_s15_fixed16(const byte* data_)
+	{
+		return int(read_u32(data_)) / 65536.0;
+	}
+
+	/// [4.9] u8Fixed8Number
+	double read_u8_fixed8(const byte* data_)
+	{
+		return read_u16(data_) / 256.0;
+	}
+
+	void append_utf8(std::string& text_, unsigned int code_point_)
+	{
+		if (code_point_ < 0x80)
+		{
+			text_ += char(code_point_);
+		}
+		else if (code_point_ < 0x800)
+		{
+			text_ += char(0xC0 | code_point_ >> 6);
+			text_ += char(0x80 | (code_point_ & 0x3F));
+		}
+		else
+		{
+			text_ += char(0xE0 | code_point_ >> 12);
+			text_ += char(0x80 | (code_point_ >> 6 & 0x3F));
+			text_ += char(0x80 | (code_point_ & 0x3F));
+		}
+	}
+
+	/// Text up to the first zero byte, the tag may end without it
+	std::string read_ascii(const byte* data_, std::size_t size_)
+	{
+		return std::string(reinterpret_cast<const char*>(data_), std::find(data_, data_ + size_, 0) - data_);
+	}
+}
+
+IccCurve::IccCurve()
+	: _function(-1)
+	, _parameters{ 1, 1, 0, 0, 0, 0, 0 }
+{
+}
+
+double IccCurve::Evaluate(double value_) const
+{
+	double x = std::min(std::max(value_, 0.0), 1.0);
+	const double& g = _parameters[0];
+	const double& a = _parameters[1];
+	const double& b = _parameters[2];
+	const double& c = _parameters[3];
+	const double& d = _parameters[4];
+	const double& e = _parameters[5];
+	const double& f = _parameters[6];
+	double result;
+	switch (_function)
+	{
+	case -1:
+	{
+		// no entries is identity, linear interpolation between the entries otherwise
+		if (_table.empty())
+		{
+			return x;
+		}
+		double position = x * (_table.size() - 1);
+		std::size_t index = std::min(std::size_t(position), _table.size() - 1);
+		std::size_t next = std::min(index + 1, _table.size() - 1);
+		result = _table[index] + (_table[next] - _table[index]) * (position - index);
+		break;
+	}
+	// [Table 65] Parametric curve definitions
+	case 0:
+		result = std::pow(x, g);
+		break;
+	case 1:
+		result = x >= -b / a ? std::pow(a * x + b, g) : 0;
+		break;
+	case 2:
+		result = x >= -b / a ? std::pow(a * x + b, g) + c : c;
+		break;
+	case 3:
+		result = x >= d ? std::pow(a * x + b, g) : c * x;
+		break;
+	default:
+		result = x >= d ? std::pow(a * x + b, g) + e : c * x + f;
+		break;
+	}
+	return std::min(std::max(result, 0.0), 1.0);
+}
+
+IccProfile::IccProfile()
+	: _data(nullptr)
+	, _size(0)
+	, _tags_read(true)
+{
+}
+
+IccProfile::IccProfile(const byte* data_, std::size_t size_)
+	: IccProfile()
+{
+	// [7.2.2] the size field may not be larger than the data, [7.2.9] 'acsp' identifies the profile
+	if (!data_ || size_ < header_size || read_u32(data_) < header_size || read_u32(data_) > size_ ||
+		read_u32(data_ + 36) != Signature("acsp"))
+	{
+		return;
+	}
+	_data = data_;
+	_size = read_u32(data_);
+	_tags_read = false;
+}
+
+IccProfile::IccProfile(const std::vector<std::pair<const byte*, std::size_t>>& chunks_)
+	: IccProfile()
+{
+	if (chunks_.empty())
+	{
+		return;
+	}
+	std::size_t size = chunks_[0].second;
+	bool contiguous = true;
+	for (std::size_t i = 1; i < chunks_.size(); i++)
+	{
+		contiguous = contiguous && chunks_[i].first == chunks_[i - 1].first + chunks_[i - 1].second;
+		size += chunks_[i].second;
+	}
+	if (contiguous)
+	{
+		*this = IccProfile(chunks_[0].first, size);
+		return;
+	}
+	std::vector<byte> reassembled;
+	reassembled.reserve(size);
+	for (std::size_t i = 0; i < chunks_.size(); i++)
+	{
+		reassembled.insert(reassembled.end(), chunks_[i].first, chunks_[i].first + chunks_[i].second);
+	}
+	IccProfile profile(reassembled.data(), reassembled.size());
+	if (profile)
+	{
+		*this = std::move(profile);
+		_reassembled = std::move(reassembled);
+	}
+}
+
+void IccProfile::read_tags() const
+{
+	_tags_read = true;
+	if (_size < header_size + 4)
+	{
+		return;
+	}
+	// [7.3] tags with data outside of the profile are dropped, the others stay usable
+	std::size_t count = std::min<std::size_t>(read_u32(_data + header_size), (_size - header_size - 4) / 12);
+	_tags.reserve(count);
+	for (std::size_t i = 0; i < count; i++)
+	{
+		const byte* entry = _data + header_size + 4 + 12 * i;
+		unsigned int offset = read_u32(entry + 4);
+		unsigned int size = read_u32(entry + 8);
+		if (size < 8 || offset > _size || size > _size - offset)
+		{
+			continue;
+		}
+		_tags.push_back(Tag{ read_u32(entry), read_u32(_data + offset), _data + offset, size });
+	}
+}
+
+const IccProfile::Tag* IccProfile::find_tag(unsigned int signature_, unsigned int type_) const
+{
+	const Tag* tag = this->FindTag(signature_);
+	return tag && tag->_type == type_ ? tag : nullptr;
+}
+
+IccProfile::operator bool() const
+{
+	return _data != nullptr;
+}
+
+const byte* IccProfile::Data() const
+{
+	return _data;
+}
+
+std::size_t IccProfile::Size() const
+{
+	return _size;
+}
+
+bool IccProfile::IsReassembled() const
+{
+	return !_reassembled.empty();
+}
+
+unsigned int IccProfile::GetVersion() const
+{
+	return _data ? read_u32(_data + 8) >> 8 : 0;
+}
+
+unsigned int IccProfile::GetDeviceClass() const
+{
+	return _data ? read_u32(_data + 12) : 0;
+}
+
+unsigned int IccProfile::GetColorSpace() const
+{
+	return _data ? read_u32(_data + 16) : 0;
+}
+
+unsigned int IccProfile::GetConnectionSpace() const
+{
+	return _data ? read_u32(_data + 20) : 0;
+}
+
+unsigned int IccProfile::GetRenderingIntent() const
+{
+	return _data ? read_u32(_data + 64) : 0;
+}
+
+DateTimeNumber IccProfile::GetCreated() const
+{
+	DateTimeNumber created{};
+	if (_data)
+	{
+		unsigned short* fields[] = { &created._year, &created._month, &created._day, &created._hours, &created._minutes, &created._seconds };
+		for (int i = 0; i < 6; i++)
+		{
+			*fields[i] = static_cast<unsigned short>(read_u16(_data + 24 + 2 * i));
+		}
+	}
+	return created;
+}
+
+XYZNumber IccProfile::GetIlluminant() const
+{
+	if (!_data)
+	{
+		return XYZNumber{};
+	}
+	return XYZNumber{ read_s15_fixed16(_data + 68), read_s15_fixed16(_data + 72), read_s15_fixed16(_data + 76) };
+}
+
+const std::vector<IccProfile::Tag>& IccProfile::GetTags() const
+{
+	if (!_tags_read)
+	{
+		this->read_tags();
+	}
+	return _tags;
+}
+
+const IccProfile::Tag* IccProfile::FindTag(unsigned int signature_) const
+{
+	const std::vector<Tag>& tags = this->GetTags();
+	for (std::size_t i = 0; i < tags.size(); i++)
+	{
+		if (tags[i]._signature == signature_)
+		{
+			return &tags[i];
+		}
+	}
+	return nullptr;
+}
+
+bool IccProfile::ReadXYZ(unsigned int signature_, XYZNumber& value_) const
+{
+	const Tag* tag = this->find_tag(signature_, Signature("XYZ "));
+	if (!tag || tag->_size < 20)
+	{
+		return false;
+	}
+	value_ = XYZNumber{ read_s15_fixed16(tag->_data + 8), read_s15_fixed16(tag->_data + 12), read_s15_fixed16(tag->_data + 16) };
+	return true;
+}
+
+bool IccProfile::ReadCurve(unsigned int signature_, IccCurve& curve_) const
+{
+	const Tag* tag = this->FindTag(signature_);
+	if (!tag || tag->_size < 12)
+	{
+		return false;
+	}
+	curve_ = IccCurve();
+	if (tag->_type == Signature("curv"))
+	{
+		std::size_t count = read_u32(tag->_data + 8);
+		if (count > (tag->_size - 12) / 2)
+		{
+			return false;
+		}
+		if (count == 1)
+		{
+			// a single entry is the gamma
+			curve_._function = 0;
+			curve_._parameters[0] = read_u8_fixed8(tag->_data + 12);
+			return true;
+		}
+		curve_._table.resize(count);
+		for (std::size_t i = 0; i < count; i++)
+		{
+			curve_._table[i] = read_u16(tag->_data + 12 + 2 * i) / 65535.0;
+		}
+		return true;
+	}
+	if (tag->_type == Signature("para"))
+	{
+		static const int parameters[] = { 1, 3, 4, 5, 7 };
+		int function = read_u16(tag->_data + 8);
+		if (function > 4 || tag->_size < 12 + 4u * parameters[function])
+		{
+			return false;
+		}
+		curve_._function = function;
+		for (int i = 0; i < parameters[function]; i++)
+		{
+			curve_._parameters[i] = read_s15_fixed16(tag->_data + 12 + 4 * i);
+		}
+		return true;
+	}
+	return false;
+}
+
+bool IccProfile::ReadText(unsigned int signature_, std::string& text_) const
+{
+	const Tag* tag = this->FindTag(signature_);
+	if (!tag)
+	{
+		return false;
+	}
+	if (tag->_type == Signature("text"))
+	{
+		text_ = read_ascii(tag->_data + 8, tag->_size - 8);
+		return true;
+	}
+	if (tag->_type == Signature("desc"))
+	{
+		// version 2 textDescriptionType, its ASCII part comes first
+		if (tag->_size < 12)
+		{
+			return false;
+		}
+		std::size_t length = std::min<std::size_t>(read_u32(tag->_data + 8), tag->_size - 12);
+		text_ = read_ascii(tag->_data + 12, length);
+		return true;
+	}
+	if (tag->_type == Signature("mluc"))
+	{
+		if (tag->_size < 16)
+		{
+			return false;
+		}
+		std::size_t records = read_u32(tag->_data + 8);
+		std::size_t record_size = read_u32(tag->_data + 12);
+		if (record_size < 12 || records > (tag->_size - 16) / record_size)
+		{
+			return false;
+		}
+		std::size_t chosen = records;
+		for (std::size_t r = 0; r < records; r++)
+		{
+			const byte* record = tag->_data + 16 + r * record_size;
+			if (chosen == records || (record[0] == 'e' && record[1] == 'n'))
+			{
+				chosen = r;
+			}
+		}
+		if (chosen == records)
+		{
+			return false;
+		}
+		const byte* record = tag->_data + 16 + chosen * record_size;
+		std::size_t length = read_u32(record + 4);
+		std::size_t offset = read_u32(record + 8);
+		if (offset > tag->_size || length > tag->_size - offset)
+		{
+			return false;
+		}
+		// UTF-16BE, surrogate pairs are replaced by U+FFFD
+		text_.clear();
+		for (std::size_t i = 0; i + 1 < length; i += 2)
+		{
+			unsigned int code_unit = read_u16(tag->_data + offset + i);
+			if (code_unit >= 0xD800 && code_unit < 0xE000)
+			{
+				if (code_unit < 0xDC00)
+				{
+					append_utf8(text_, 0xFFFD);
+				}
+				continue;
+			}
+			append_utf8(text_, code_unit);
+		}
+		return true;
+	}
+	return false;
+}
+
+std::string IccProfile::SignatureName(unsigned int signature_)
+{
+	std::string name;
+	for (int shift = 24; shift >= 0; shift -= 8)
+	{
+		char c = char(signature_ >> shift);
+		name += c >= 0x20 && c < 0x7F ? c : '?';
+	}
+	return name;
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+#include<vector>
+#include<string>
+#include"BitStream.h"
+
+// [ICC.1:2010] Basic numbers of the profile, all big-endian
+
+/// [4.2] Year, month, day, hours, minutes and seconds in UTC
+struct DateTimeNumber
+{
+	unsigned short _year;
+	unsigned short _month;
+	unsigned short _day;
+	unsigned short _hours;
+	unsigned short _minutes;
+	unsigned short _seconds;
+};
+
+/// [4.14] CIE XYZ tristimulus values, each one s15Fixed16Number
+struct XYZNumber
+{
+	double _x;
+	double _y;
+	double _z;
+};
+
+/// [10.6] curveType or [10.18] parametricCurveType, maps device values from 0..1 to 0..1
+struct IccCurve
+{
+	std::vector<double> _table; // sampled curve, empty for parametric ones
+	int _function;              // parametric function 0-4, -1 for the table
+	double _parameters[7];      // g, a, b, c, d, e, f as far as the function uses them
+
+	IccCurve();
+	double Evaluate(double value_) const;
+};
+
+/// IccProfile class, that reads the profile right inside of the buffer it came in.
+/// Only the header is checked on construction, the tag table is read on the first tag lookup
+/// and tag data is decoded only by the Read functions, so an image carrying a profile costs
+/// nothing unless color management asks for it. Views are valid while the buffer lives,
+/// for profiles of images that is until their file content is released.
+class IccProfile
+{
+public:
+
+	static const int header_size = 128;
+
+	/// [7.3] Entry of the tag table, the data stays in the profile buffer
+	struct Tag
+	{
+		unsigned int _signature;
+		unsigned int _type; // the first 4 bytes of the data, the tag type signature
+		const byte* _data;
+		unsigned int _size;
+	};
+
+private:
+
+	const byte* _data;
+	std::size_t _size;
+	std::vector<byte> _reassembled; // owns the data, when the chunks of the profile were apart
+	mutable std::vector<Tag> _tags;
+	mutable bool _tags_read;
+
+	void read_tags() const;
+	const Tag* find_tag(unsigned int signature_, unsigned int type_) const;
+
+public:
+
+	/// No profile
+	IccProfile();
+	/// Views size_ bytes of data_, an invalid profile becomes no profile
+	IccProfile(const byte* data_, std::size_t size_);
+	/// Profile split into chunks, as by JPEG APP2 segments. Chunks, which follow each other in memory,
+	/// are viewed as one, otherwise they are copied together once.
+	explicit IccProfile(const std::vector<std::pair<const byte*, std::size_t>>& chunks_);
+
+	// views into _reassembled move with it, copies would point into the source
+	IccProfile(IccProfile&& other_) = default;
+	IccProfile& operator=(IccProfile&& other_) = default;
+	IccProfile(const IccProfile&) = delete;
+	IccProfile& operator=(const IccProfile&) = delete;
+
+	explicit operator bool() const;
+	const byte* Data() const;
+	std::size_t Size() const;
+	/// True when the chunks were copied, false for views into the image
+	bool IsReassembled() const;
+
+	/// [7.2] Header fields
+	unsigned int GetVersion() const;         // major version in the high byte, then minor and bug fix digits
+	unsigned int GetDeviceClass() const;     // 'mntr', 'scnr', 'prtr', ...
+	unsigned int GetColorSpace() const;      // 'RGB ', 'GRAY', 'CMYK', ...
+	unsigned int GetConnectionSpace() const; // 'XYZ ' or 'Lab '
+	unsigned int GetRenderingIntent() const;
+	DateTimeNumber GetCreated() const;
+	XYZNumber GetIlluminant() const;
+
+	const std::vector<Tag>& GetTags() const;
+	/// nullptr when the profile has no such tag
+	const Tag* FindTag(unsigned int signature_) const;
+
+	/// [10.31] XYZType, the first value, as of 'wtpt' and 'rXYZ'
+	bool ReadXYZ(unsigned int signature_, XYZNumber& value_) const;
+	/// [10.6] curveType and [10.18] parametricCurveType, as of 'rTRC'
+	bool ReadCurve(unsigned int signature_, IccCurve& curve_) const;
+	/// [10.24] textType, ICC.1:2001-04 textDescriptionType and [10.15] multiLocalizedUnicodeType
+	/// (English when there is one, UTF-8 encoded), as of 'desc' and 'cprt'
+	bool ReadText(unsigned int signature_, std::string& text_) const;
+
+	static constexpr unsigned int Signature(const char (&name_)[5])
+	{
+		return unsigned(byte(name_[0])) << 24 | unsigned(byte(name_[1])) << 16 | unsigned(byte(name_[2])) << 8 | byte(name_[3]);
+	}
+	static std::string SignatureName(unsigned int signature_);
+};
\ No newline at end of file
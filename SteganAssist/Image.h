@@ -1,9 +1,105 @@
 #pragma once
+#include<vector>
+#include<cstddef>
+#include"BitStream.h"
 
+/// View of a plane of elements, that stay wherever the image keeps them. Rows are _stride elements apart,
+/// negative for images stored bottom-up, neighbours in a row are _step elements apart, so one component of
+/// interleaved pixels is a plane as well. Views are valid while the image and its buffers are not changed.
+template<class T>
+struct PlaneView
+{
+	T* _data;               // first element of the top row
+	int _width;
+	int _height;
+	std::ptrdiff_t _stride;
+	int _step;
+
+	PlaneView()
+		: _data(nullptr), _width(0), _height(0), _stride(0), _step(1)
+	{
+	}
+
+	PlaneView(T* data_, int width_, int height_, std::ptrdiff_t stride_, int step_ = 1)
+		: _data(data_), _width(width_), _height(height_), _stride(stride_), _step(step_)
+	{
+	}
+
+	explicit operator bool() const
+	{
+		return _data != nullptr;
+	}
+
+	T* Row(int y_) const
+	{
+		return _data + y_ * _stride;
+	}
 
+	T& At(int x_, int y_) const
+	{
+		return _data[y_ * _stride + std::ptrdiff_t(x_) * _step];
+	}
+
+	/// The same elements from x_, y_ on, no bounds are checked
+	PlaneView Crop(int x_, int y_, int width_, int height_) const
+	{
+		return PlaneView(&this->At(x_, y_), width_, height_, _stride, _step);
+	}
+};
+
+/// Image class, the carrier format as seen by analysis and embedding code. Samples are read a tile
+/// at a time: formats, which keep samples in their buffers, return views right into them, the others
+/// decode the tile into the scratch buffer of the caller. So there is one virtual call per tile,
+/// and the loops over samples are written against the view only.
 class Image
 {
+public:
+
+	virtual ~Image() {}
+
+	virtual int GetWidth() const = 0;
+	virtual int GetHeight() const = 0;
+	virtual int GetComponentsCount() const = 0;
+	/// Size of the component in samples, smaller than the image for subsampled components
+	virtual int GetComponentWidth(int component_) const = 0;
+	virtual int GetComponentHeight(int component_) const = 0;
 
+	/// True for transform coded images, which carry quantized coefficients
+	virtual bool HasCoefficients() const
+	{
+		return false;
+	}
+	/// Blocks of the component: element x, y is the first of the 64 coefficients of the block in natural order,
+	/// so _step is 64. Empty view when there are no coefficients.
+	virtual PlaneView<const short> GetCoefficientPlane(int component_) const
+	{
+		return PlaneView<const short>();
+	}
 
+	/// 8-bit samples of the component in the rectangle, which has to be inside of the component.
+	/// The view may point into scratch_, which is then valid until its next use.
+	virtual PlaneView<const byte> GetSampleTile(int component_, int x_, int y_, int width_, int height_, std::vector<byte>& scratch_) const = 0;
+	/// Samples to be changed in place, empty view when the format does not store them as they are
+	virtual PlaneView<byte> GetWritableSampleTile(int component_, int x_, int y_, int width_, int height_)
+	{
+		return PlaneView<byte>();
+	}
 
+	/// Calls visitor_(x, y, view) for tiles of the component in raster order, edge tiles are smaller
+	template<class Visitor>
+	void ForEachSampleTile(int component_, int tile_width_, int tile_height_, Visitor&& visitor_) const
+	{
+		std::vector<byte> scratch;
+		int width = this->GetComponentWidth(component_);
+		int height = this->GetComponentHeight(component_);
+		for (int y = 0; y < height; y += tile_height_)
+		{
+			for (int x = 0; x < width; x += tile_width_)
+			{
+				int tile_width = tile_width_ < width - x ? tile_width_ : width - x;
+				int tile_height = tile_height_ < height - y ? tile_height_ : height - y;
+				visitor_(x, y, this->GetSampleTile(component_, x, y, tile_width, tile_height, scratch));
+			}
+		}
+	}
 };
\ No newline at end of file
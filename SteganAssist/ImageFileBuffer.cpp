@@ -1,16 +1,42 @@
 #include "ImageFileBuffer.h"
 #include <iterator>
 #include <fstream>
+#include <stdexcept>
 
 ImageFileBuffer::ImageFileBuffer(const std::string & file_path_)
+	: ImageFileBuffer(file_path_, std::vector<unsigned char>())
 {
-	std::ifstream file(file_path_.c_str(), std::ios::binary);
-	unsigned char one_byte;
-	while ( file >> std::noskipws >> one_byte )
-		_file_content.push_back(one_byte);
 }
 
-std::vector<unsigned char> ImageFileBuffer::Get()
+ImageFileBuffer::ImageFileBuffer(const std::string & file_path_, std::vector<unsigned char>&& recycled_)
+	: _file_content(std::move(recycled_))
+{
+	_file_content.clear();
+	// whole file is read at once, byte by byte reading costs more than decoding of small images
+	std::ifstream file(file_path_.c_str(), std::ios::binary | std::ios::ate);
+	if (!file)
+	{
+		throw std::runtime_error("Can't open " + file_path_);
+	}
+	std::streamoff size = file.tellg();
+	if (size > 0)
+	{
+		_file_content.resize(size);
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(_file_content.data()), size);
+		if (file.gcount() != size)
+		{
+			throw std::runtime_error("Can't read " + file_path_);
+		}
+	}
+}
+
+std::vector<unsigned char> ImageFileBuffer::Get() &
 {
 	return _file_content;
 }
+
+std::vector<unsigned char> ImageFileBuffer::Get() &&
+{
+	return std::move(_file_content);
+}
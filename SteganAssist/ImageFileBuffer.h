@@ -7,5 +7,9 @@ class ImageFileBuffer
 	std::vector<unsigned char> _file_content;
 public:
 	ImageFileBuffer(const std::string& file_path_);
-	std::vector<unsigned char> Get();
+	/// Reads into the storage of recycled_ buffer, so batch reading does not allocate for every file
+	ImageFileBuffer(const std::string& file_path_, std::vector<unsigned char>&& recycled_);
+	std::vector<unsigned char> Get() &;
+	/// Temporary buffer gives its content away without copying
+	std::vector<unsigned char> Get() &&;
 };
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include "Instrumentation.h"
+#include "Json.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <functional>
+#include <algorithm>
+
+DecodeCounters::DecodeCounters()
+	: _bits_consumed(0)
+	, _huffman_fast(0)
+	, _huffman_slow(0)
+	, _tables_built(0)
+	, _tables_reused(0)
+	, _stuffed_bytes(0)
+	, _blocks(0)
+	, _header_seconds(0)
+	, _scan_seconds(0)
+{
+	std::fill(_end_of_block, _end_of_block + 65, 0);
+}
+
+DecodeCounters& DecodeCounters::operator+=(const DecodeCounters& other_)
+{
+	_bits_consumed += other_._bits_consumed;
+	_huffman_fast += other_._huffman_fast;
+	_huffman_slow += other_._huffman_slow;
+	_tables_built += other_._tables_built;
+	_tables_reused += other_._tables_reused;
+	_stuffed_bytes += other_._stuffed_bytes;
+	_blocks += other_._blocks;
+	for (int i = 0; i < 65; i++)
+	{
+		_end_of_block[i] += other_._end_of_block[i];
+	}
+	_header_seconds += other_._header_seconds;
+	_scan_seconds += other_._scan_seconds;
+	return *this;
+}
+
+DecodeCounters DecodeCounters::operator-(const DecodeCounters& other_) const
+{
+	DecodeCounters difference;
+	difference._bits_consumed = _bits_consumed - other_._bits_consumed;
+	difference._huffman_fast = _huffman_fast - other_._huffman_fast;
+	difference._huffman_slow = _huffman_slow - other_._huffman_slow;
+	difference._tables_built = _tables_built - other_._tables_built;
+	difference._tables_reused = _tables_reused - other_._tables_reused;
+	difference._stuffed_bytes = _stuffed_bytes - other_._stuffed_bytes;
+	difference._blocks = _blocks - other_._blocks;
+	for (int i = 0; i < 65; i++)
+	{
+		difference._end_of_block[i] = _end_of_block[i] - other_._end_of_block[i];
+	}
+	difference._header_seconds = _header_seconds - other_._header_seconds;
+	difference._scan_seconds = _scan_seconds - other_._scan_seconds;
+	return difference;
+}
+
+std::string DecodeCounters::ToJson() const
+{
+	std::string end_of_block = "[";
+	for (int i = 0; i < 65; i++)
+	{
+		end_of_block += (i ? "," : "") + std::to_string(_end_of_block[i]);
+	}
+	end_of_block += "]";
+	return JsonObject()
+		.Add("bits_consumed", _bits_consumed)
+		.Add("huffman_fast", _huffman_fast)
+		.Add("huffman_slow", _huffman_slow)
+		.Add("tables_built", _tables_built)
+		.Add("tables_reused", _tables_reused)
+		.Add("stuffed_bytes", _stuffed_bytes)
+		.Add("blocks", _blocks)
+		.AddRaw("end_of_block", end_of_block)
+		.Add("header_seconds", _header_seconds)
+		.Add("scan_seconds", _scan_seconds)
+		.Str();
+}
+
+DecodeCounters& DecodeCounters::Current()
+{
+	thread_local DecodeCounters counters;
+	return counters;
+}
+
+namespace
+{
+	struct TraceEvent
+	{
+		const char* _name;
+		long long _start; // microseconds since Start
+		long long _duration;
+		size_t _thread;
+	};
+
+	std::atomic<bool> trace_enabled(false);
+	std::mutex trace_mutex;
+	std::vector<TraceEvent> trace_events;
+	std::chrono::steady_clock::time_point trace_start;
+}
+
+Trace::Span::Span(const char* name_)
+	: _name(name_)
+	, _enabled(trace_enabled.load(std::memory_order_relaxed))
+{
+	if (_enabled)
+	{
+		_start = std::chrono::steady_clock::now();
+	}
+}
+
+Trace::Span::~Span()
+{
+	if (!_enabled)
+	{
+		return;
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	TraceEvent event;
+	event._name = _name;
+	event._start = std::chrono::duration_cast<std::chrono::microseconds>(_start - trace_start).count();
+	event._duration = std::chrono::duration_cast<std::chrono::microseconds>(end - _start).count();
+	event._thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	trace_events.push_back(event);
+}
+
+void Trace::Start()
+{
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	trace_events.clear();
+	trace_start = std::chrono::steady_clock::now();
+	trace_enabled = true;
+}
+
+bool Trace::IsEnabled()
+{
+	return trace_enabled;
+}
+
+void Trace::Save(const std::string& file_path_)
+{
+	std::ofstream file(file_path_.c_str());
+	std::lock_guard<std::mutex> lock(trace_mutex);
+	file << "{\"traceEvents\":[";
+	for (size_t i = 0; i < trace_events.size(); i++)
+	{
+		const TraceEvent& event = trace_events[i];
+		// thread ids are hashed, trace viewers only need them to be distinct
+		file << (i ? ",\n" : "\n") << JsonObject()
+			.Add("name", event._name)
+			.Add("ph", "X")
+			.Add("ts", event._start)
+			.Add("dur", event._duration)
+			.Add("pid", 1)
+			.Add("tid", static_cast<unsigned long long>(event._thread % 1000000))
+			.Str();
+	}
+	file << "\n]}\n";
+	if (!file)
+	{
+		throw std::runtime_error("Can't write trace " + file_path_);
+	}
+}
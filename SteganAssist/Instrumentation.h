@@ -0,0 +1,65 @@
+#pragma once
+#include<string>
+#include<chrono>
+
+/// Decode counters and trace spans cost a few instructions on the hot path,
+/// building with STEGANASSIST_INSTRUMENTATION=0 removes them completely
+#ifndef STEGANASSIST_INSTRUMENTATION
+#define STEGANASSIST_INSTRUMENTATION 1
+#endif
+
+#if STEGANASSIST_INSTRUMENTATION
+#define INSTRUMENT(statement_) statement_
+#else
+#define INSTRUMENT(statement_)
+#endif
+
+/// What the decoder did, accumulated per thread, every Jpeg keeps the difference over its own decoding
+struct DecodeCounters
+{
+	unsigned long long _bits_consumed;     // entropy-coded bits, without stuffed bytes
+	unsigned long long _huffman_fast;      // codes resolved by the lookahead table
+	unsigned long long _huffman_slow;      // codes longer than the lookahead, resolved by MAXCODE search
+	unsigned long long _tables_built;      // Huffman tables built on a miss of the HuffmanCache
+	unsigned long long _tables_reused;     // Huffman tables found in the HuffmanCache
+	unsigned long long _stuffed_bytes;     // 0x00 bytes skipped after 0xFF inside of entropy-coded segments
+	unsigned long long _blocks;
+	unsigned long long _end_of_block[65];  // zigzag index, where EOB was met, 64 for blocks coded up to the end
+	double _header_seconds;                // marker segments except scans
+	double _scan_seconds;                  // scan headers and entropy-coded segments
+
+	DecodeCounters();
+	DecodeCounters& operator+=(const DecodeCounters& other_);
+	DecodeCounters operator-(const DecodeCounters& other_) const;
+	std::string ToJson() const;
+
+	/// Counters of the calling thread
+	static DecodeCounters& Current();
+};
+
+/// Trace class, that collects spans in Chrome trace event format, viewable in chrome://tracing or Perfetto.
+/// Collection is off until Start, a disabled span costs one atomic load.
+class Trace
+{
+public:
+
+	/// Complete event ("ph":"X") from construction to destruction, name_ must outlive the span
+	class Span
+	{
+		const char* _name;
+		std::chrono::steady_clock::time_point _start;
+		bool _enabled;
+
+	public:
+
+		explicit Span(const char* name_);
+		~Span();
+		Span(const Span&) = delete;
+		Span& operator=(const Span&) = delete;
+	};
+
+	static void Start();
+	static bool IsEnabled();
+	/// Writes {"traceEvents":[...]} with every span finished so far
+	static void Save(const std::string& file_path_);
+};
\ No newline at end of file
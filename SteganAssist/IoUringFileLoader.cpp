@@ -0,0 +1,396 @@
+#include "IoUringFileLoader.h"
+#include "ThreadPool.h"
+
+#if defined(STEGANASSIST_IO_URING)
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+
+struct IoUringFileLoader::Ring
+{
+	int _fd;
+	unsigned _to_submit;
+
+	void* _sq_pointer;
+	size_t _sq_size;
+	void* _cq_pointer;
+	size_t _cq_size;
+	io_uring_sqe* _sqes;
+	size_t _sqes_size;
+	byte* _buffers;
+	size_t _buffers_size;
+
+	unsigned* _sq_head;
+	unsigned* _sq_tail;
+	unsigned _sq_mask;
+	unsigned _sq_entries;
+	unsigned* _sq_array;
+	unsigned* _cq_head;
+	unsigned* _cq_tail;
+	unsigned _cq_mask;
+	io_uring_cqe* _cqes;
+
+	Ring()
+		: _fd(-1)
+		, _to_submit(0)
+		, _sq_pointer(MAP_FAILED)
+		, _sq_size(0)
+		, _cq_pointer(MAP_FAILED)
+		, _cq_size(0)
+		, _sqes(static_cast<io_uring_sqe*>(MAP_FAILED))
+		, _sqes_size(0)
+		, _buffers(static_cast<byte*>(MAP_FAILED))
+		, _buffers_size(0)
+	{
+	}
+
+	~Ring()
+	{
+		if (_buffers != MAP_FAILED)
+		{
+			munmap(_buffers, _buffers_size);
+		}
+		if (_sqes != MAP_FAILED)
+		{
+			munmap(_sqes, _sqes_size);
+		}
+		if (_cq_pointer != MAP_FAILED && _cq_pointer != _sq_pointer)
+		{
+			munmap(_cq_pointer, _cq_size);
+		}
+		if (_sq_pointer != MAP_FAILED)
+		{
+			munmap(_sq_pointer, _sq_size);
+		}
+		if (_fd >= 0)
+		{
+			close(_fd);
+		}
+	}
+
+	/// Submits everything queued and waits for min_complete_ completions
+	void enter(unsigned min_complete_)
+	{
+		while (true)
+		{
+			long submitted = syscall(__NR_io_uring_enter, _fd, _to_submit, min_complete_, min_complete_ ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+			if (submitted >= 0)
+			{
+				_to_submit -= unsigned(submitted);
+				return;
+			}
+			if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			{
+				throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+			}
+		}
+	}
+
+	/// Copies prepared entry into the submission queue, flushing the queue when it is full
+	void push(const io_uring_sqe& sqe_)
+	{
+		unsigned tail = *_sq_tail;
+		while (tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) == _sq_entries)
+		{
+			this->enter(0);
+		}
+		unsigned index = tail & _sq_mask;
+		_sqes[index] = sqe_;
+		_sq_array[index] = index;
+		// the kernel must see the entry before the new tail
+		__atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+		_to_submit++;
+	}
+};
+
+namespace
+{
+	enum operation : unsigned long long
+	{
+		open_file = 1,
+		read_file = 2,
+		close_file = 3,
+	};
+
+	unsigned long long user_data(operation operation_, int slot_)
+	{
+		return (static_cast<unsigned long long>(operation_) << 32) | unsigned(slot_);
+	}
+
+	bool is_supported(const io_uring_probe* probe_, int operation_)
+	{
+		return operation_ <= probe_->last_op && (probe_->ops[operation_].flags & IO_URING_OP_SUPPORTED);
+	}
+
+	/// Reads content_ from its current size up to size_ bytes, returns the reason of a failure
+	std::string read_rest(int descriptor_, size_t size_, std::vector<byte>& content_, const std::string& file_)
+	{
+		size_t offset = content_.size();
+		content_.resize(size_);
+		ssize_t read_bytes = 0;
+		while (offset < content_.size())
+		{
+			read_bytes = pread(descriptor_, content_.data() + offset, content_.size() - offset, offset);
+			if (read_bytes <= 0)
+			{
+				break;
+			}
+			offset += size_t(read_bytes);
+		}
+		std::string error;
+		if (offset < content_.size())
+		{
+			error = "Can't read " + file_ + ": " + (read_bytes < 0 ? std::strerror(errno) : "file ends before its size");
+		}
+		content_.resize(offset);
+		return error;
+	}
+}
+
+IoUringFileLoader::IoUringFileLoader(std::unique_ptr<Ring> ring_, int threads_)
+	: _ring(std::move(ring_))
+	, _threads(threads_ > 0 ? threads_ : 1)
+{
+}
+
+IoUringFileLoader::~IoUringFileLoader()
+{
+}
+
+std::unique_ptr<FileLoader> IoUringFileLoader::Create(int threads_)
+{
+	std::unique_ptr<Ring> ring(new Ring());
+
+	// closes of finished files may stay in flight next to open and read of every slot
+	io_uring_params parameters;
+	std::memset(&parameters, 0, sizeof(parameters));
+	ring->_fd = int(syscall(__NR_io_uring_setup, 4 * slots, &parameters));
+	if (ring->_fd < 0)
+	{
+		return nullptr;
+	}
+
+	// OPENAT and CLOSE came with 5.6, the probe itself too
+	std::vector<byte> probe_storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+	io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probe_storage.data());
+	if (syscall(__NR_io_uring_register, ring->_fd, IORING_REGISTER_PROBE, probe, 256) < 0 ||
+		!is_supported(probe, IORING_OP_OPENAT) || !is_supported(probe, IORING_OP_READ_FIXED) || !is_supported(probe, IORING_OP_CLOSE))
+	{
+		return nullptr;
+	}
+
+	ring->_sq_size = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned);
+	ring->_cq_size = parameters.cq_off.cqes + parameters.cq_entries * sizeof(io_uring_cqe);
+	if (parameters.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		ring->_sq_size = ring->_cq_size = std::max(ring->_sq_size, ring->_cq_size);
+	}
+	ring->_sq_pointer = mmap(nullptr, ring->_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->_fd, IORING_OFF_SQ_RING);
+	if (ring->_sq_pointer == MAP_FAILED)
+	{
+		return nullptr;
+	}
+	ring->_cq_pointer = ring->_sq_pointer;
+	if (!(parameters.features & IORING_FEAT_SINGLE_MMAP))
+	{
+		ring->_cq_pointer = mmap(nullptr, ring->_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->_fd, IORING_OFF_CQ_RING);
+		if (ring->_cq_pointer == MAP_FAILED)
+		{
+			return nullptr;
+		}
+	}
+	ring->_sqes_size = parameters.sq_entries * sizeof(io_uring_sqe);
+	ring->_sqes = static_cast<io_uring_sqe*>(mmap(nullptr, ring->_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->_fd, IORING_OFF_SQES));
+	if (ring->_sqes == MAP_FAILED)
+	{
+		return nullptr;
+	}
+
+	byte* sq = static_cast<byte*>(ring->_sq_pointer);
+	byte* cq = static_cast<byte*>(ring->_cq_pointer);
+	ring->_sq_head = reinterpret_cast<unsigned*>(sq + parameters.sq_off.head);
+	ring->_sq_tail = reinterpret_cast<unsigned*>(sq + parameters.sq_off.tail);
+	ring->_sq_mask = *reinterpret_cast<unsigned*>(sq + parameters.sq_off.ring_mask);
+	ring->_sq_entries = parameters.sq_entries;
+	ring->_sq_array = reinterpret_cast<unsigned*>(sq + parameters.sq_off.array);
+	ring->_cq_head = reinterpret_cast<unsigned*>(cq + parameters.cq_off.head);
+	ring->_cq_tail = reinterpret_cast<unsigned*>(cq + parameters.cq_off.tail);
+	ring->_cq_mask = *reinterpret_cast<unsigned*>(cq + parameters.cq_off.ring_mask);
+	ring->_cqes = reinterpret_cast<io_uring_cqe*>(cq + parameters.cq_off.cqes);
+
+	// registered buffers are pinned once, instead of mapping user pages on every read
+	ring->_buffers_size = size_t(slots) * slot_size;
+	ring->_buffers = static_cast<byte*>(mmap(nullptr, ring->_buffers_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if (ring->_buffers == MAP_FAILED)
+	{
+		return nullptr;
+	}
+	std::vector<iovec> buffers(slots);
+	for (int i = 0; i < slots; i++)
+	{
+		buffers[i].iov_base = ring->_buffers + size_t(i) * slot_size;
+		buffers[i].iov_len = slot_size;
+	}
+	if (syscall(__NR_io_uring_register, ring->_fd, IORING_REGISTER_BUFFERS, buffers.data(), slots) < 0)
+	{
+		return nullptr; // RLIMIT_MEMLOCK may be too small for pinning
+	}
+
+	return std::unique_ptr<FileLoader>(new IoUringFileLoader(std::move(ring), threads_));
+}
+
+void IoUringFileLoader::Load(const std::vector<std::string>& files_, const Acquire& acquire_, const Loaded& loaded_)
+{
+	Ring& ring = *_ring;
+	// when the ring throws, the destructor still finishes and closes the files handed to the threads
+	ThreadPool pool(_threads);
+	std::vector<size_t> file_of_slot(slots);
+	std::vector<int> descriptor_of_slot(slots, -1);
+	std::vector<int> free_slots;
+	for (int i = slots - 1; i >= 0; i--)
+	{
+		free_slots.push_back(i);
+	}
+
+	size_t next_file = 0;
+	size_t in_flight = 0;
+	auto submit = [&ring, &in_flight](const io_uring_sqe& sqe_)
+	{
+		ring.push(sqe_);
+		in_flight++;
+	};
+	auto close_slot = [&](int slot_)
+	{
+		io_uring_sqe sqe;
+		std::memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_CLOSE;
+		sqe.fd = descriptor_of_slot[slot_];
+		sqe.user_data = user_data(close_file, slot_);
+		submit(sqe);
+		descriptor_of_slot[slot_] = -1;
+		free_slots.push_back(slot_);
+	};
+
+	while (next_file < files_.size() || in_flight > 0)
+	{
+		while (!free_slots.empty() && next_file < files_.size())
+		{
+			int slot = free_slots.back();
+			free_slots.pop_back();
+			file_of_slot[slot] = next_file++;
+
+			io_uring_sqe sqe;
+			std::memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode = IORING_OP_OPENAT;
+			sqe.fd = AT_FDCWD;
+			sqe.addr = reinterpret_cast<unsigned long long>(files_[file_of_slot[slot]].c_str());
+			sqe.open_flags = O_RDONLY | O_CLOEXEC;
+			sqe.user_data = user_data(open_file, slot);
+			submit(sqe);
+		}
+
+		ring.enter(1);
+
+		unsigned head = *ring._cq_head;
+		unsigned tail = __atomic_load_n(ring._cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++)
+		{
+			const io_uring_cqe& cqe = ring._cqes[head & ring._cq_mask];
+			operation completed = operation(cqe.user_data >> 32);
+			int slot = int(cqe.user_data & 0xFFFFFFFF);
+			int result = cqe.res;
+			in_flight--;
+
+			const std::string& file = files_[file_of_slot[slot]];
+			if (completed == open_file)
+			{
+				if (result < 0)
+				{
+					free_slots.push_back(slot);
+					loaded_(file_of_slot[slot], std::vector<byte>(), "Can't open " + file);
+					continue;
+				}
+				descriptor_of_slot[slot] = result;
+				io_uring_sqe sqe;
+				std::memset(&sqe, 0, sizeof(sqe));
+				sqe.opcode = IORING_OP_READ_FIXED;
+				sqe.fd = result;
+				sqe.addr = reinterpret_cast<unsigned long long>(ring._buffers + size_t(slot) * slot_size);
+				sqe.len = slot_size;
+				sqe.off = 0;
+				sqe.buf_index = slot;
+				sqe.user_data = user_data(read_file, slot);
+				submit(sqe);
+			}
+			else if (completed == read_file)
+			{
+				size_t index = file_of_slot[slot];
+				std::vector<byte> content;
+				std::string error;
+				if (result < 0)
+				{
+					error = "Can't read " + file + ": " + std::strerror(-result);
+				}
+				else
+				{
+					content = acquire_();
+					const byte* buffer = ring._buffers + size_t(slot) * slot_size;
+					content.assign(buffer, buffer + result);
+					int descriptor = descriptor_of_slot[slot];
+					struct stat status;
+					if (fstat(descriptor, &status) != 0)
+					{
+						error = "Can't read " + file + ": " + std::strerror(errno);
+					}
+					else if (status.st_size > result)
+					{
+						// the file does not fit into the slot or the read came back short, a thread reads the rest
+						// and closes the descriptor itself, the slot is reused right away
+						std::shared_ptr<std::vector<byte>> started(new std::vector<byte>(std::move(content)));
+						size_t size = size_t(status.st_size);
+						descriptor_of_slot[slot] = -1;
+						free_slots.push_back(slot);
+						pool.Submit([&files_, &loaded_, started, descriptor, size, index]()
+						{
+							std::string rest_error;
+							try
+							{
+								rest_error = read_rest(descriptor, size, *started, files_[index]);
+							}
+							catch (const std::exception& e)
+							{
+								rest_error = "Can't read " + files_[index] + ": " + e.what();
+							}
+							close(descriptor);
+							loaded_(index, std::move(*started), rest_error);
+						});
+						continue;
+					}
+				}
+				// the slot is reused right away, the descriptor is closed in the next submission
+				close_slot(slot);
+				loaded_(index, std::move(content), error);
+			}
+		}
+		__atomic_store_n(ring._cq_head, head, __ATOMIC_RELEASE);
+	}
+	pool.Wait();
+}
+
+const char* IoUringFileLoader::Name() const
+{
+	return "io_uring";
+}
+
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+#include"FileLoader.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define STEGANASSIST_IO_URING
+#endif
+#endif
+
+#if defined(STEGANASSIST_IO_URING)
+
+/// IoUringFileLoader class, that keeps a window of files in flight through io_uring, talking to the kernel
+/// by raw syscalls without liburing. Every file goes through OPENAT, READ_FIXED into one of the slots of
+/// registered buffers and CLOSE, and one io_uring_enter submits the next operations of all slots and
+/// reaps their completions, so small files cost a fraction of a syscall each instead of four.
+/// The content is copied out of the slot, so the slot is free again right after the read.
+/// Files bigger than a slot are finished by blocking reads on a pool of threads, while the ring goes on.
+class IoUringFileLoader : public FileLoader
+{
+	struct Ring;
+
+	std::unique_ptr<Ring> _ring;
+	int _threads; // finishing the files bigger than a slot
+
+	IoUringFileLoader(std::unique_ptr<Ring> ring_, int threads_);
+
+public:
+
+	static const int slots = 64;
+	static const int slot_size = 128 * 1024; // bigger files are read up to the end by pread on the threads
+
+	~IoUringFileLoader();
+	/// nullptr, when the kernel has no io_uring or forbids it, as seccomp profiles of containers often do
+	static std::unique_ptr<FileLoader> Create(int threads_);
+
+	void Load(const std::vector<std::string>& files_, const Acquire& acquire_, const Loaded& loaded_) override;
+	const char* Name() const override;
+};
+
+#endif
\ No newline at end of file
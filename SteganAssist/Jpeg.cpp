@@ -1,96 +1,415 @@
 #include "Jpeg.h"
+#include "Kernels.h"
+#include "Dct.h"
+#include "KeyedPermutation.h"
+#include <cmath>
 
-Jpeg::HuffmanTree::Node::Node()
-	: _left(nullptr)
-	, _right(nullptr)
-	, _value(-1)
-	, _code_end(false)
+Jpeg::CapacityEstimate::CapacityEstimate()
+	: _blocks(0)
+	, _nonzero_ac(0)
+	, _greater_than_one(0)
+	, _usable_ac(0)
 {
-
+	std::fill(_nonzero_per_frequency, _nonzero_per_frequency + 64, 0);
 }
-bool Jpeg::HuffmanTree::add_element(Node*& current_node, int lenght, int value)
+
+bool Jpeg::check_for_image_correctness(InputBitStream& image_content_)
 {
-	if (current_node != nullptr && current_node->_code_end == true)
+	// missing EOI is tolerated, the scans before it are still complete
+	if (image_content_.Size() < 4)
+	{
+		this->fail(DecodeError::TruncatedData);
 		return false;
-	if (current_node == nullptr)
+	}
+	byte first, second;
+	image_content_ >> first >> second;
+	image_content_.BytesBack(2);
+	if (first != 0xFF || second != SOI)
+	{
+		this->fail(DecodeError::NotJpeg);
+		return false;
+	}
+	return true;
+}
+
+void Jpeg::decode() noexcept
+{
+	try
+	{
+		// the buffer comes from the loader, it is not allocated here, but it is the memory of this image
+		_allocator->Charge(_image_content.Size());
+		_charged_file_bytes = _image_content.Size();
+		if (this->check_for_image_correctness(_image_content))
+		{
+			this->process_segments();
+		}
+	}
+	catch (const MemoryBudgetExceeded&)
+	{
+		this->fail(DecodeError::MemoryBudgetExceeded);
+	}
+	catch (const std::bad_alloc&)
+	{
+		this->fail(DecodeError::OutOfMemory);
+	}
+	catch (...)
+	{
+		// only BlockHandler throws, the decoder itself reports through fail
+		_handler_error = std::current_exception();
+		this->fail(DecodeError::HandlerFailed);
+	}
+}
+
+void Jpeg::decode_again(std::vector<unsigned char>&& file_content_, BlockHandler&& block_handler_, CapacityEstimate* capacity_estimate_) noexcept
+{
+	_allocator->Uncharge(_charged_file_bytes);
+	_charged_file_bytes = 0;
+	_image_content = InputBitStream(std::move(file_content_));
+	_block_handler = std::move(block_handler_);
+	_capacity_estimate = capacity_estimate_;
+	_decoding_stopped = false;
+	_status = DecodeStatus();
+	_segment = "";
+	_handler_error = nullptr;
+	_counters = DecodeCounters();
+
+	// tables of the previous image are overwritten, when this one defines them
+	for (auto& tables : _huffman_tables)
+	{
+		tables[coef_type::DC].reset();
+		tables[coef_type::AC].reset();
+	}
+	// quantization tables are not kept, an image may not use the tables of the one before
+	std::pmr::vector<std::pmr::vector<std::pmr::vector<int>>>(_allocator.get()).swap(_quantization_tables);
+	_comment.clear();
+	_icc_chunks.clear();
+	_frames.clear();
+	_max_horizontal_thinning = 0;
+	_max_vertical_thinning = 0;
+	_picture_height = 0;
+	_picture_width = 0;
+	_scan_components.clear();
+	_restart_interval = 0;
+	_scan_layouts.clear();
+	_interval_starts.clear();
+	try
+	{
+		for (; !_scans.empty(); _scans.pop_back())
+		{
+			_spare_scans.push_back(std::move(_scans.back()));
+		}
+		for (std::pmr::vector<short>& plane : _coefficients)
+		{
+			if (plane.capacity())
+			{
+				_spare_planes.push_back(std::move(plane));
+			}
+		}
+		for (std::pmr::vector<short>& plane : _dc_coefficients)
+		{
+			if (plane.capacity())
+			{
+				_spare_planes.push_back(std::move(plane));
+			}
+		}
+	}
+	catch (const std::bad_alloc&)
 	{
-		current_node = new Node();
+		this->fail(DecodeError::OutOfMemory);
+		return;
 	}
-	if (lenght == 0)
+	// the spare planes are all the allocator holds from now on, the new image is charged
+	// for them only when it takes one, so its peak and budget do not depend on the images before
+	std::pmr::vector<std::pmr::vector<short>>(_allocator.get()).swap(_coefficients);
+	std::pmr::vector<std::pmr::vector<short>>(_allocator.get()).swap(_dc_coefficients);
+	std::pmr::vector<std::pmr::vector<byte>>(_allocator.get()).swap(_dirty_blocks);
+	// an arena is released only when nothing taken from it is alive, so its planes are not kept
+	if (_allocator->GetKind() == Allocator::Kind::Arena)
 	{
-		current_node->_value = value;
-		current_node->_code_end = true;
-		return true;
+		this->release_spare_planes();
 	}
-	if (add_element(current_node->_left, lenght - 1, value))
+	_allocator->StartImage();
+	this->decode();
+	this->release_spare_planes();
+}
+
+void Jpeg::take_plane(std::pmr::vector<short>& plane_, std::size_t size_)
+{
+	if (!plane_.capacity())
 	{
-		return true;
+		for (std::size_t i = 0; i < _spare_planes.size(); i++)
+		{
+			if (_spare_planes[i].capacity() == size_)
+			{
+				_allocator->Reuse(size_ * sizeof(short));
+				plane_ = std::move(_spare_planes[i]);
+				std::swap(_spare_planes[i], _spare_planes.back());
+				_spare_planes.pop_back();
+				break;
+			}
+		}
 	}
-	if (add_element(current_node->_right, lenght - 1, value))
+	plane_.assign(size_, 0);
+}
+
+void Jpeg::release_spare_planes() noexcept
+{
+	for (const std::pmr::vector<short>& plane : _spare_planes)
 	{
-		return true;
+		_allocator->Forget(plane.capacity() * sizeof(short));
 	}
-	return false;
+	_spare_planes.clear();
 }
-Jpeg::HuffmanTree::HuffmanTree()
-	: _root(new Node())
-	, _state(_root)
+
+Jpeg::Jpeg(std::vector<unsigned char>&& file_content_, JpegIndex& index_, DecodeStatus& status_, std::shared_ptr<Allocator> allocator_) noexcept
+	: Jpeg(std::move(allocator_))
 {
+	index_.reset(file_content_);
+	_image_content = InputBitStream(std::move(file_content_));
+	_index_builder = &index_;
+	this->decode();
+	_index_builder = nullptr;
+	status_ = _status;
 }
-void Jpeg::HuffmanTree::AddElement(int lenght_, int value_)
+
+Jpeg::Jpeg(std::vector<unsigned char>&& file_content_, const JpegIndex& index_, const Region& region_, DecodeStatus& status_,
+	BlockHandler block_handler_, std::shared_ptr<Allocator> allocator_) noexcept
+	: Jpeg(std::move(allocator_))
 {
-	add_element(_root, lenght_, value_);
+	bool matches = index_.Matches(file_content_);
+	_image_content = InputBitStream(std::move(file_content_));
+	_block_handler = std::move(block_handler_);
+	if (!matches)
+	{
+		this->fail(DecodeError::InvalidIndex);
+		status_ = _status;
+		return;
+	}
+	_index = &index_;
+	_region = region_;
+	this->decode();
+	_index = nullptr;
+	status_ = _status;
 }
-Jpeg::HuffmanTree::Node * Jpeg::HuffmanTree::GetRoot()
+
+Jpeg::Jpeg(std::vector<unsigned char>&& file_content_, int scale_, DecodeStatus& status_, std::shared_ptr<Allocator> allocator_) noexcept
+	: Jpeg(std::move(allocator_))
 {
-	return _root;
+	_image_content = InputBitStream(std::move(file_content_));
+	_dc_only = scale_ == 8;
+	this->decode();
+	status_ = _status;
 }
 
-Jpeg::HuffmanTree::HuffmanTreeIterator::HuffmanTreeIterator(HuffmanTree * tree_)
-	: _state(tree_->GetRoot())
-	, _root(tree_->GetRoot())
+bool Jpeg::has_coefficients() const
 {
+	if (_coefficients.size() < _frames.size())
+	{
+		return false;
+	}
+	for (int i = 0; i < _frames.size(); i++)
+	{
+		if (_coefficients[i].empty())
+		{
+			return false;
+		}
+	}
+	return true;
 }
-Jpeg::HuffmanTree::HuffmanTreeIterator * Jpeg::HuffmanTree::HuffmanTreeIterator::Step(int way_)
+
+void Jpeg::require_coefficients() const
 {
-	_state = (way_ == 0 ? _state->_left : _state->_right);
-	if (_state == nullptr)
+	if (_frames.empty())
+	{
+		throw std::runtime_error("Image has no frame");
+	}
+	if (!this->has_coefficients())
 	{
-		throw std::exception("Something goes wrong");
+		throw std::runtime_error("Image was decoded without storing coefficients");
 	}
-	return this;
 }
-bool Jpeg::HuffmanTree::HuffmanTreeIterator::IsCodeEnd()
+
+bool Jpeg::every_component_scanned() const
 {
-	return _state->_code_end;
+	if (_frames.empty())
+	{
+		return false;
+	}
+	for (int i = 0; i < _frames.size(); i++)
+	{
+		bool scanned = false;
+		for (const std::vector<ScanComponent>& scan : _scans)
+		{
+			for (const ScanComponent& component : scan)
+			{
+				scanned = scanned || component._frame_index == i;
+			}
+		}
+		if (!scanned)
+		{
+			return false;
+		}
+	}
+	return true;
 }
-byte Jpeg::HuffmanTree::HuffmanTreeIterator::GetValue()
+
+void Jpeg::fail(DecodeError error_)
 {
-	return _state->_value;
+	if (_status.Ok())
+	{
+		_status = DecodeStatus(error_, _image_content.Position(), _segment);
+	}
+	_decoding_stopped = true;
 }
-void Jpeg::HuffmanTree::HuffmanTreeIterator::Reset()
+
+void Jpeg::throw_on_error() const
 {
-	_state = _root;
+	if (_handler_error)
+	{
+		std::rethrow_exception(_handler_error);
+	}
+	if (!_status.Ok())
+	{
+		throw DecodeException(_status);
+	}
 }
 
+void Jpeg::process_segments()
+{
+	_quantization_tables.resize(0x10);
+	if (_zigzag_to_natural.empty()) // an image decoded again keeps them
+	{
+		this->calculating_zigzag_order_traversal(0, 8);
+		for (int i = 0; i < _zigzag_order_traversal_indices.size(); i++)
+		{
+			_zigzag_to_natural.push_back(_zigzag_order_traversal_indices[i].first * 8 + _zigzag_order_traversal_indices[i].second);
+		}
+	}
 
-bool Jpeg::check_for_image_correctness(InputBitStream& image_content_)
+	INSTRUMENT(const DecodeCounters counters_before = DecodeCounters::Current());
+	bool end_of_image = false;
+	byte temp;
+	while ( !end_of_image && !_decoding_stopped && _image_content >> temp )
+	{
+		if (temp != 0xFF)
+		{
+			_image_content.BytesBack(1);
+			this->fail(DecodeError::MissingMarkerPrefix);
+			break;
+		}
+		byte marker;
+		_image_content >> marker;
+		_segment = marker_name(marker);
+		INSTRUMENT(Trace::Span span(_segment));
+		INSTRUMENT(const auto segment_start = std::chrono::steady_clock::now());
+			
+		switch (marker)
+		{
+		case SOI:
+			/*i += process_start_of_image(_image_content);*/
+			break;
+		case SOF0:
+			process_start_of_frame_baseline_DCT(_image_content);
+			break;
+		case SOF1:
+			process_start_of_frame_extended_sequential_DCT(_image_content);
+			break;
+		case SOF2:
+			process_start_of_frame_progressive_DCT(_image_content);
+			break;
+		case DHT:
+			process_huffman_table(_image_content);
+			break;
+		case DQT:
+			process_quantization_table(_image_content);
+			break;
+		case DRI:
+			process_restart_interval(_image_content);
+			break;
+		case SOS:
+			process_start_of_scan(_image_content);
+			break;
+		case RST0:
+		case RST1:
+		case RST2:
+		case RST3:
+		case RST4:
+		case RST5:
+		case RST6:
+		case RST7:
+			// restart markers are consumed inside of decode_scan
+			break;
+		case APP0:
+		case APP1:
+		case APP2:
+		case APP3:
+		case APP4:
+		case APP5:
+		case APP6:
+		case APP7:
+		case APP8:
+		case APP9:
+		case APP10:
+		case APP11:
+		case APP12:
+		case APP13:
+		case APP14:
+		case APP15:
+			_image_content.BytesBack(1); // 1 is for understanding application type
+			process_application_specific(_image_content);
+			break;
+		case COM:
+			process_comment(_image_content);
+			break;
+		case EOI:
+			end_of_image = true; // anything after EOI is not a part of image
+			break;
+		//	process_end_of_image(_image_content);
+		default:
+			this->fail(DecodeError::UnsupportedMarker);
+			break;
+		}
+		// scans check their own end, the data after the last one may be cut without EOI
+		if (marker != SOS && !_image_content)
+		{
+			this->fail(DecodeError::TruncatedData);
+		}
+		INSTRUMENT(double segment_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - segment_start).count());
+		INSTRUMENT((marker == SOS ? DecodeCounters::Current()._scan_seconds : DecodeCounters::Current()._header_seconds) += segment_seconds);
+	}
+	// the file may end between segments, with EOI or without, before the frame or before a scan of every component,
+	// a handler stopping the decoding on purpose is the only way out with a part of the image
+	if (!_decoding_stopped && !this->every_component_scanned())
+	{
+		this->fail(end_of_image ? DecodeError::InvalidScan : DecodeError::TruncatedData);
+	}
+	INSTRUMENT(_counters = DecodeCounters::Current() - counters_before);
+}
+
+const char* Jpeg::marker_name(byte marker_)
 {
-	throw std::exception("Not implemented yet");
-	//if (image_content_.size() < 4) // todo: understand, how much can be minimal size of picture
-	//{
-	//	throw std::exception("too small size of picture");
-	//}
-	//if (image_content_[0] * 0x100 + image_content_[1] != 0xffd8)
-	//{
-	//	throw std::exception("this is not jpeg file, start bytes are note matching");
-	//}
-	//if (image_content_[image_content_.size() - 2] * 0x100 + image_content_[image_content_.size() - 1] != 0xffd9)
-	//{
-	//	throw std::exception("this is not jpeg file, end bytes are note matching");
-	//}
-	//// todo: add another checks
-	//return true;
+	switch (marker_)
+	{
+	case SOI: return "SOI";
+	case SOF0: return "SOF0";
+	case SOF1: return "SOF1";
+	case SOF2: return "SOF2";
+	case DHT: return "DHT";
+	case DQT: return "DQT";
+	case DRI: return "DRI";
+	case SOS: return "SOS";
+	case COM: return "COM";
+	case EOI: return "EOI";
+	}
+	if (marker_ >= APP0 && marker_ <= APP15)
+	{
+		return "APPn";
+	}
+	if (marker_ >= RST0 && marker_ <= RST7)
+	{
+		return "RSTn";
+	}
+	return "marker";
 }
 
 void Jpeg::process_start_of_frame_baseline_DCT(InputBitStream& image_content_)
@@ -111,6 +430,17 @@ void Jpeg::process_start_of_frame_baseline_DCT(InputBitStream& image_content_)
 	byte components_count;
 	image_content_ >> components_count;
 
+	if (!_frames.empty() || precision != 8 || picture_width == 0 || components_count == 0 || components_count > 4)
+	{
+		this->fail(DecodeError::InvalidFrame);
+		return;
+	}
+	if (picture_height == 0)
+	{
+		this->fail(DecodeError::UnsupportedProcess); // number of lines is defined by DNL
+		return;
+	}
+
 	_max_horizontal_thinning = 0;
 	_max_vertical_thinning = 0;
 
@@ -124,21 +454,41 @@ void Jpeg::process_start_of_frame_baseline_DCT(InputBitStream& image_content_)
 		frame._vertical_thinning = thinning & 0x0F;
 
 		image_content_ >> frame._id_of_quantization_table;
+		if (frame._horizontal_thinning < 1 || frame._horizontal_thinning > 4 || frame._vertical_thinning < 1 || frame._vertical_thinning > 4
+			|| frame._id_of_quantization_table > 3)
+		{
+			_frames.clear();
+			this->fail(DecodeError::InvalidFrame);
+			return;
+		}
 		_frames.push_back(frame);
 
 		_max_horizontal_thinning = std::max(frame._horizontal_thinning, _max_horizontal_thinning);
 		_max_vertical_thinning = std::max(frame._vertical_thinning, _max_vertical_thinning);
 	}
+
+	_picture_height = picture_height;
+	_picture_width = picture_width;
+
+	// [A.2.4] Block grid of every component is padded to the whole number of MCUs
+	int mcus_per_line = (picture_width + 8 * _max_horizontal_thinning - 1) / (8 * _max_horizontal_thinning);
+	int mcus_per_column = (picture_height + 8 * _max_vertical_thinning - 1) / (8 * _max_vertical_thinning);
+	for (int i = 0; i < _frames.size(); i++)
+	{
+		_frames[i]._blocks_per_line = mcus_per_line * _frames[i]._horizontal_thinning;
+		_frames[i]._blocks_per_column = mcus_per_column * _frames[i]._vertical_thinning;
+	}
+	_dc_predictors.assign(_frames.size(), 0);
 }
 
 void Jpeg::process_start_of_frame_extended_sequential_DCT(InputBitStream& image_content_)
 {
-	throw std::exception("Not implemented yet");
+	this->fail(DecodeError::UnsupportedProcess);
 }
 
 void Jpeg::process_start_of_frame_progressive_DCT(InputBitStream& image_content_)
 {
-	throw std::exception("Not implemented yet");
+	this->fail(DecodeError::UnsupportedProcess);
 }
 
 void Jpeg::process_huffman_table(InputBitStream& image_content_)
@@ -146,35 +496,48 @@ void Jpeg::process_huffman_table(InputBitStream& image_content_)
 	byte size_1, size_2;
 	image_content_ >> size_1 >> size_2;
 	int size_of_table = size_1 * 0x100 + size_2;
+	int end_of_segment = image_content_.Position() + size_of_table - 2;
 
-	byte temp;
-	image_content_ >> temp;
-	byte coef_type = temp >> 4;
-	byte table_id = temp & 0x0F;
-
-	std::vector<byte> huffman_codes_lenght(0x10);
-	int number_of_lengths = 0;
-	for (int i = 0; i < huffman_codes_lenght.size(); i++)
+	// one segment may define several tables
+	while (image_content_ && image_content_.Position() < end_of_segment)
 	{
-		image_content_ >> huffman_codes_lenght[i];
-		number_of_lengths += huffman_codes_lenght[i];
-	}
+		byte temp;
+		image_content_ >> temp;
+		byte coef_type = temp >> 4;
+		byte table_id = temp & 0x0F;
+		if (coef_type > 1 || table_id > 3)
+		{
+			this->fail(DecodeError::InvalidHuffmanTable);
+			return;
+		}
 
-	std::vector<byte> huffman_codes_values(number_of_lengths);
-	for (int i = 0; i < huffman_codes_values.size(); i++)
-	{
-		image_content_ >> huffman_codes_values[i];
-	}
-	_huffman_trees[table_id].resize(2);
-	_huffman_trees[table_id][coef_type] = new HuffmanTree();
+		byte huffman_codes_lenght[0x10];
+		int number_of_lengths = 0;
+		for (int i = 0; i < 0x10; i++)
+		{
+			image_content_ >> huffman_codes_lenght[i];
+			number_of_lengths += huffman_codes_lenght[i];
+		}
+		if (number_of_lengths > 256)
+		{
+			this->fail(DecodeError::InvalidHuffmanTable);
+			return;
+		}
 
-	for (int i = 0, count = 0; i < huffman_codes_lenght.size(); i++)
-	{
-		while (huffman_codes_lenght[i])
+		byte huffman_codes_values[256];
+		for (int i = 0; i < number_of_lengths; i++)
+		{
+			image_content_ >> huffman_codes_values[i];
+		}
+
+		// a table may be redefined between scans, the scans before are already decoded
+		std::shared_ptr<const SharedHuffmanTable> table = HuffmanCache::Get(huffman_codes_lenght, huffman_codes_values);
+		if (!table)
 		{
-			_huffman_trees[table_id][coef_type]->AddElement(i + 1, huffman_codes_values[count++]);
-			huffman_codes_lenght[i]--;
+			this->fail(DecodeError::InvalidHuffmanTable); // more codes than this length has
+			return;
 		}
+		_huffman_tables[table_id][coef_type] = std::move(table);
 	}
 }
 
@@ -183,37 +546,48 @@ void Jpeg::process_quantization_table(InputBitStream& image_content_)
 	byte size_1, size_2;
 	image_content_ >> size_1 >> size_2;
 	int size_of_table = size_1 * 0x100 + size_2;
+	int end_of_segment = image_content_.Position() + size_of_table - 2;
 
-	byte temp;
-	image_content_ >> temp;
-	byte value_in_2_bytes = temp >> 4;
-	byte table_id = temp & 0x0F;
-
-	int size_of_matrix = (int)sqrt(size_of_table - 3);
+	int size_of_matrix = 8;
 
-	_quantization_tables[table_id].resize(size_of_matrix, std::vector<int>(size_of_matrix));
+	// one segment may define several tables
+	while (image_content_ && image_content_.Position() < end_of_segment)
+	{
+		byte temp;
+		image_content_ >> temp;
+		byte value_in_2_bytes = temp >> 4;
+		byte table_id = temp & 0x0F;
+		if (value_in_2_bytes > 1 || table_id > 3)
+		{
+			this->fail(DecodeError::InvalidQuantizationTable);
+			return;
+		}
 
-	this->calculating_zigzag_order_traversal(size_of_table, size_of_matrix);
+		if (_quantization_tables[table_id].size() != size_of_matrix)
+		{
+			_quantization_tables[table_id].assign(size_of_matrix, std::pmr::vector<int>(size_of_matrix));
+		}
 
-	for (int i = 3, t = 0; i < size_of_table; i += 1 + value_in_2_bytes, t++)
-	{
-		std::pair<int, int> next_index = _zigzag_order_traversal_indices[t];
-		byte first_byte_of_value;
-		image_content_ >> first_byte_of_value;
-		_quantization_tables[table_id][next_index.first][next_index.second] = first_byte_of_value;
-		if (value_in_2_bytes)
+		for (int t = 0; t < size_of_matrix * size_of_matrix; t++)
 		{
-			_quantization_tables[table_id][next_index.first][next_index.second] *= 0x100;
-			byte second_byte_of_value;
-			image_content_ >> second_byte_of_value;
-			_quantization_tables[table_id][next_index.first][next_index.second] += second_byte_of_value;
+			std::pair<int, int> next_index = _zigzag_order_traversal_indices[t];
+			byte first_byte_of_value;
+			image_content_ >> first_byte_of_value;
+			_quantization_tables[table_id][next_index.first][next_index.second] = first_byte_of_value;
+			if (value_in_2_bytes)
+			{
+				_quantization_tables[table_id][next_index.first][next_index.second] *= 0x100;
+				byte second_byte_of_value;
+				image_content_ >> second_byte_of_value;
+				_quantization_tables[table_id][next_index.first][next_index.second] += second_byte_of_value;
+			}
 		}
 	}
 }
 
 void Jpeg::process_arithmetic_table(InputBitStream & image_content_)
 {
-	throw std::exception("Not implemented yet");
+	this->fail(DecodeError::UnsupportedProcess);
 }
 
 void Jpeg::process_start_of_scan(InputBitStream& image_content_)
@@ -223,225 +597,1084 @@ void Jpeg::process_start_of_scan(InputBitStream& image_content_)
 	int header_size = size_1 * 0x100 + size_2;
 	byte number_components_to_read;
 	image_content_ >> number_components_to_read;
-
-	struct component_t
-	{
-		byte id;
-		byte id_for_DC_and_AC_coefs;
-	};
-
-	std::vector<component_t> components(number_components_to_read);
-
-	for (int i = 0; i < components.size(); i++)
+	if (_frames.empty() || number_components_to_read == 0 || number_components_to_read > 4)
 	{
-		image_content_ >> components[i].id;
-		image_content_ >> components[i].id_for_DC_and_AC_coefs;
+		this->fail(DecodeError::InvalidScan);
+		return;
 	}
 
-	byte Ss, Se, A;
-	image_content_ >> Ss >> Se >> A;
-	byte Ah = A >> 4, Al = A & 0xFF;
-
-	std::vector<std::vector<std::vector<int>>> resulting_matrices;
-	int number_of_matrices = 6;
-	bool skip_zero = false;
-	while (number_of_matrices--)
+	_scan_components.clear();
+	for (int i = 0; i < number_components_to_read; i++)
 	{
-		if (skip_zero)
+		byte component_id, id_for_DC_and_AC_coefs;
+		image_content_ >> component_id >> id_for_DC_and_AC_coefs;
+
+		ScanComponent component;
+		component._frame_index = -1;
+		for (int j = 0; j < _frames.size(); j++)
 		{
-			byte zeros[2];
-			image_content_ >> zeros[0] >> zeros[1];
-			if (zeros[0] == 0 && zeros[1] == 0)
+			if (_frames[j]._id == component_id)
 			{
-				skip_zero = false;
-				continue;
-			}
-			else
-			{
-				image_content_.BytesBack(2);
+				component._frame_index = j;
 			}
 		}
-		byte end_byte[2];
-		image_content_ >> end_byte[0] >> end_byte[1];
-		if (end_byte[0] == 0xFF)
+		if (component._frame_index == -1)
 		{
-			if (end_byte[1] == markers::EOI)
-			{
-				break;
-			}
-			else if (end_byte[1] == 0)
-			{
-				skip_zero = true;
-			}
+			this->fail(DecodeError::InvalidScan); // component is absent in frame
+			return;
 		}
-		image_content_.BytesBack(2);
-		for (int matrix_number = 0; matrix_number < 6; matrix_number++)
+		for (const ScanComponent& listed : _scan_components)
 		{
-			int component_index = std::max(matrix_number - 3, 0);
-			HuffmanTree::HuffmanTreeIterator* huffman_tree_iterator =
-				new HuffmanTree::HuffmanTreeIterator(_huffman_trees[components[component_index].id_for_DC_and_AC_coefs >> 4][coef_type::DC]);
-			std::vector<std::vector<int>> matrix(_quantization_tables[0].size(), std::vector<int>(_quantization_tables[0].size()));
-
-			int zigzag_order_counter = 0;
-
-			bit next;
-			// DC coef
-			while (image_content_ >> next)
-			{
-				huffman_tree_iterator->Step(next);
-				if (huffman_tree_iterator->IsCodeEnd())
-				{
-					byte bits_to_read = huffman_tree_iterator->GetValue();
-					// int number_of_0_to_add = huffman_tree_value >> 4;
-
-					if (bits_to_read)
-					{
-						bit first_bit = 0;
-						image_content_ >> first_bit;
-
-						int real_value = first_bit;
-
-						for (int i = 1; i < bits_to_read; i++)
-						{
-							real_value *= 2;
-							bit next_bit;
-							image_content_ >> next_bit;
-							real_value += next_bit;
-						}
-
-						if (first_bit == 0)
-						{
-							real_value -= (1 << bits_to_read) - 1;
-						}
-						matrix[_zigzag_order_traversal_indices[zigzag_order_counter].first]
-							[_zigzag_order_traversal_indices[zigzag_order_counter].second] = real_value;
-					}
-					zigzag_order_counter++;
-					break;
-				}
-			}
-			huffman_tree_iterator = 
-				new HuffmanTree::HuffmanTreeIterator(_huffman_trees[components[component_index].id_for_DC_and_AC_coefs >> 4][coef_type::AC]);
-			// AC coefs
-			int number = 0;
-			while (image_content_ >> next)
+			if (listed._frame_index == component._frame_index)
 			{
-				number++;
-				huffman_tree_iterator->Step(next);
-				if (huffman_tree_iterator->IsCodeEnd())
-				{
-					number+=10000;
-					byte huffman_tree_value = huffman_tree_iterator->GetValue();
-					if (huffman_tree_value == 0)
-					{
-						break;
-					}
-
-					byte number_of_0_to_add = huffman_tree_value >> 4;
-					zigzag_order_counter += number_of_0_to_add;
-
-					if (zigzag_order_counter >= _zigzag_order_traversal_indices.size())
-					{
-						break;
-					}
-
-					byte bits_to_read = huffman_tree_value & 0x0F;
-
-					if (bits_to_read)
-					{
-						bit first_bit = 0;
-						image_content_ >> first_bit;
-
-						int real_value = first_bit;
-
-						for (int i = 1; i < bits_to_read; i++)
-						{
-							real_value *= 2;
-							bit next_bit;
-							image_content_ >> next_bit;
-							real_value += next_bit;
-						}
-
-						if (first_bit == 0)
-						{
-							real_value -= (1 << bits_to_read) - 1;
-						}
-						matrix[_zigzag_order_traversal_indices[zigzag_order_counter].first]
-							[_zigzag_order_traversal_indices[zigzag_order_counter].second] = real_value;
-						zigzag_order_counter++;
-						if (zigzag_order_counter >= _zigzag_order_traversal_indices.size())
-						{
-							break;
-						}
-					}
-					huffman_tree_iterator->Reset();
-				}
+				this->fail(DecodeError::InvalidScan); // [B.2.3] selectors of a scan are distinct
+				return;
 			}
-
-			resulting_matrices.push_back(matrix);
-			// TODO
 		}
+		// [B.2.2] the table may be defined after the frame header, but before the first scan of the component
+		if (_quantization_tables[_frames[component._frame_index]._id_of_quantization_table].empty())
+		{
+			this->fail(DecodeError::InvalidQuantizationTable);
+			return;
+		}
+		component._id_of_DC_table = id_for_DC_and_AC_coefs >> 4;
+		component._id_of_AC_table = id_for_DC_and_AC_coefs & 0x0F;
+		if (component._id_of_DC_table > 3 || !_huffman_tables[component._id_of_DC_table][coef_type::DC]
+			|| component._id_of_AC_table > 3 || !_huffman_tables[component._id_of_AC_table][coef_type::AC])
+		{
+			this->fail(DecodeError::UndefinedHuffmanTable);
+			return;
+		}
+		_scan_components.push_back(component);
 	}
-	for (int i = 2; i < 5; i++)
+
+	byte Ss, Se, A;
+	image_content_ >> Ss >> Se >> A;
+	if (!image_content_)
 	{
-		resulting_matrices[i + 1][0][0] += resulting_matrices[i][0][0];
+		this->fail(DecodeError::TruncatedData);
+		return;
+	}
+	// [B.2.3] sequential DCT scans cover the whole zigzag band, successive approximation is progressive only
+	if (Ss != 0 || Se != 63 || A != 0)
+	{
+		this->fail(DecodeError::InvalidScan);
+		return;
 	}
-	// we have all matrices
-
-}
-
-void Jpeg::process_restart_interval(InputBitStream& image_content_)
-{
-	throw std::exception("Not implemented yet");
-}
 
-void Jpeg::process_application_specific(InputBitStream& image_content_)
-{
-	throw std::exception("Not implemented yet");
+	if (_spare_scans.empty())
+	{
+		_scans.push_back(_scan_components);
+	}
+	else
+	{
+		_scans.push_back(std::move(_spare_scans.back()));
+		_spare_scans.pop_back();
+		_scans.back() = _scan_components;
+	}
+	this->decode_scan(image_content_);
 }
 
-void Jpeg::process_comment(InputBitStream& image_content_)
+void Jpeg::decode_scan(InputBitStream& image_content_)
 {
-	byte size_1, size_2;
-	image_content_ >> size_1 >> size_2;
-	int size_of_comment = size_1 * 0x100 + size_2;
+	int mcus_per_line, mcus_per_column;
+	this->calculate_scan_size(_scan_components, mcus_per_line, mcus_per_column);
+	int number_of_mcus = mcus_per_line * mcus_per_column;
 
-	for (int i = 2; i < size_of_comment; i++)
+	// [F.1.2] the shortest block is a one-bit DC category and a one-bit EOB, so a scan of more blocks than
+	// four per byte left is cut for sure, and storage for what the frame header claims is never taken
+	unsigned long long blocks_per_mcu = 1;
+	if (_scan_components.size() > 1)
 	{
-		byte temp;
-		image_content_ >> temp;
-		_comment += temp;
+		blocks_per_mcu = 0;
+		for (const ScanComponent& component : _scan_components)
+		{
+			blocks_per_mcu += _frames[component._frame_index]._horizontal_thinning * _frames[component._frame_index]._vertical_thinning;
+		}
+	}
+	if ((unsigned long long)number_of_mcus * blocks_per_mcu > 4ull * image_content_.Size())
+	{
+		this->fail(DecodeError::TruncatedData);
+		return;
 	}
-}
-
-void Jpeg::process_number_of_lines(InputBitStream & image_content_)
-{
-	throw std::exception("Not implemented yet");
-}
 
-void Jpeg::calculating_zigzag_order_traversal(int size_of_table_, int size_of_matrix_)
-{
-	// _zigzag_order_traversal_indices.resize(size_of_table_ - 3);
-	// Calculating indices for zigzag order traversal
-	for (int i = 0; i < 2 * size_of_matrix_ - 1; i++)
+	if (!_block_handler && !_capacity_estimate)
 	{
-		if (i % 2 == 1)
+		// one plane for every component of the frame, spare planes of the image before are taken by size
+		if (_coefficients.size() < _frames.size())
 		{
-			int x = i < size_of_matrix_ ? 0 : i - size_of_matrix_ + 1;
-			int y = i < size_of_matrix_ ? i : size_of_matrix_ - 1;
-			while (x < size_of_matrix_ && y >= 0) {
-				_zigzag_order_traversal_indices.push_back({ x++, y-- });
-			}
+			_coefficients.resize(_frames.size());
 		}
-		else
+		// DC-only decoding keeps one coefficient per block, the planes of all 64 stay empty
+		std::pmr::vector<std::pmr::vector<short>>& planes = _dc_only ? _dc_coefficients : _coefficients;
+		if (planes.size() < _frames.size())
 		{
-			int x = i < size_of_matrix_ ? i : size_of_matrix_ - 1;
-			int y = i < size_of_matrix_ ? 0 : i - size_of_matrix_ + 1;
-			while (x >= 0 && y < size_of_matrix_) {
-				_zigzag_order_traversal_indices.push_back({ x--, y++ });
-			}
+			planes.resize(_frames.size());
+		}
+		const std::size_t coefficients_per_block = _dc_only ? 1 : 64;
+		for (int i = 0; i < _scan_components.size(); i++)
+		{
+			const Frame& frame = _frames[_scan_components[i]._frame_index];
+			this->take_plane(planes[_scan_components[i]._frame_index], size_t(frame._blocks_per_line) * frame._blocks_per_column * coefficients_per_block);
 		}
 	}
-}
 
+	std::fill(_dc_predictors.begin(), _dc_predictors.end(), 0);
+	image_content_.SetByteStuffing(true);
 
+	std::size_t layout = _scan_layouts.size();
+	if (!_index)
+	{
+		ScanLayout scan_layout{ image_content_.Position(), 0, _restart_interval, int(_interval_starts.size()) };
+		for (int i = 0; i < 4; i++)
+		{
+			scan_layout._huffman_tables[i][coef_type::DC] = _huffman_tables[i][coef_type::DC];
+			scan_layout._huffman_tables[i][coef_type::AC] = _huffman_tables[i][coef_type::AC];
+		}
+		_scan_layouts.push_back(std::move(scan_layout));
+		_interval_starts.push_back(image_content_.Position());
+	}
+	JpegIndex::Scan* indexed_scan = nullptr;
+	if (_index_builder)
+	{
+		_index_builder->_scans.push_back(JpegIndex::Scan{ number_of_mcus, 0, std::vector<JpegIndex::Checkpoint>() });
+		indexed_scan = &_index_builder->_scans.back();
+	}
+	if (_index)
+	{
+		this->decode_region(image_content_, mcus_per_line, mcus_per_column);
+		image_content_.SetByteStuffing(false);
+		return;
+	}
+
+	for (int mcu = 0; mcu < number_of_mcus && !_decoding_stopped; mcu++)
+	{
+		if (_restart_interval && mcu && mcu % _restart_interval == 0)
+		{
+			this->process_restart_marker(image_content_);
+			_interval_starts.push_back(image_content_.Position());
+		}
+		if (indexed_scan && mcu % _index_builder->_interval == 0)
+		{
+			indexed_scan->_checkpoints.push_back(this->checkpoint(image_content_));
+		}
+		this->decode_mcu(image_content_, mcu, mcus_per_line);
+		this->check_data_left(image_content_);
+	}
+	image_content_.AlignToByte();
+	image_content_.SetByteStuffing(false);
+	if (_decoding_stopped)
+	{
+		return;
+	}
+	// skip everything up to the next marker
+	byte temp;
+	while (image_content_ >> temp)
+	{
+		if (temp == 0xFF)
+		{
+			byte marker;
+			image_content_ >> marker;
+			if (marker != 0x00 && marker != 0xFF)
+			{
+				image_content_.BytesBack(2);
+				break;
+			}
+			image_content_.BytesBack(1);
+		}
+	}
+	if (indexed_scan)
+	{
+		indexed_scan->_end_position = image_content_.Position();
+	}
+	_scan_layouts[layout]._data_end = image_content_.Position();
+}
+
+void Jpeg::decode_mcu(InputBitStream& image_content_, int mcu_, int mcus_per_line_)
+{
+	bool interleaved = _scan_components.size() > 1;
+	int mcu_row = mcu_ / mcus_per_line_;
+	int mcu_column = mcu_ % mcus_per_line_;
+	short block[64];
+	for (int i = 0; i < _scan_components.size() && !_decoding_stopped; i++)
+	{
+		const Frame& frame = _frames[_scan_components[i]._frame_index];
+		int vertical_blocks = interleaved ? frame._vertical_thinning : 1;
+		int horizontal_blocks = interleaved ? frame._horizontal_thinning : 1;
+		for (int v = 0; v < vertical_blocks && !_decoding_stopped; v++)
+		{
+			for (int h = 0; h < horizontal_blocks && !_decoding_stopped; h++)
+			{
+				BlockPosition position;
+				position._component = _scan_components[i]._frame_index;
+				position._row = mcu_row * vertical_blocks + v;
+				position._column = mcu_column * horizontal_blocks + h;
+
+				if (_capacity_estimate)
+				{
+					this->decode_block(image_content_, _scan_components[i], nullptr);
+					continue;
+				}
+
+				this->decode_block(image_content_, _scan_components[i], block);
+
+				if (_index)
+				{
+					// blocks of the MCU rows around the region are decoded for their DC predictors only
+					const BlockRegion& blocks = _region_blocks[position._component];
+					if (position._row < blocks._first_row || position._row >= blocks._end_row ||
+						position._column < blocks._first_column || position._column >= blocks._end_column)
+					{
+						continue;
+					}
+				}
+				if (_block_handler)
+				{
+					_decoding_stopped = !_block_handler(position, block);
+				}
+				else if (_dc_only)
+				{
+					_dc_coefficients[position._component][position._row * frame._blocks_per_line + position._column] = block[0];
+				}
+				else
+				{
+					int block_index = position._row * frame._blocks_per_line + position._column;
+					std::copy(block, block + 64, _coefficients[position._component].begin() + block_index * 64);
+				}
+			}
+		}
+	}
+}
+
+void Jpeg::decode_region(InputBitStream& image_content_, int mcus_per_line_, int mcus_per_column_)
+{
+	// scans come in the same order as when the index was built, and have the same size
+	const std::size_t scan = _scans.size() - 1;
+	if (scan >= _index->_scans.size() || _index->_scans[scan]._mcus != mcus_per_line_ * mcus_per_column_)
+	{
+		this->fail(DecodeError::InvalidIndex);
+		return;
+	}
+	const JpegIndex::Scan& indexed_scan = _index->_scans[scan];
+	const int interval = _index->_interval;
+
+	// [A.1.1] component samples of the region clipped to the image, rounded out to whole blocks
+	int left = std::min(std::max(_region._x, 0), _picture_width);
+	int top = std::min(std::max(_region._y, 0), _picture_height);
+	int right = std::min(std::max(_region._x + _region._width, left), _picture_width);
+	int bottom = std::min(std::max(_region._y + _region._height, top), _picture_height);
+	_region_blocks.resize(_frames.size());
+	for (int c = 0; c < _frames.size(); c++)
+	{
+		int horizontal = _frames[c]._horizontal_thinning, vertical = _frames[c]._vertical_thinning;
+		BlockRegion& blocks = _region_blocks[c];
+		blocks._first_column = left * horizontal / _max_horizontal_thinning / 8;
+		blocks._first_row = top * vertical / _max_vertical_thinning / 8;
+		blocks._end_column = ((right * horizontal + _max_horizontal_thinning - 1) / _max_horizontal_thinning + 7) / 8;
+		blocks._end_row = ((bottom * vertical + _max_vertical_thinning - 1) / _max_vertical_thinning + 7) / 8;
+		if (left == right || top == bottom)
+		{
+			blocks._end_row = blocks._first_row;
+		}
+	}
+	// MCUs holding those blocks of the components of the scan
+	bool interleaved = _scan_components.size() > 1;
+	int first_row = mcus_per_column_, end_row = 0, first_column = mcus_per_line_, end_column = 0;
+	for (int i = 0; i < _scan_components.size(); i++)
+	{
+		const Frame& frame = _frames[_scan_components[i]._frame_index];
+		const BlockRegion& blocks = _region_blocks[_scan_components[i]._frame_index];
+		int vertical_blocks = interleaved ? frame._vertical_thinning : 1;
+		int horizontal_blocks = interleaved ? frame._horizontal_thinning : 1;
+		first_row = std::min(first_row, blocks._first_row / vertical_blocks);
+		first_column = std::min(first_column, blocks._first_column / horizontal_blocks);
+		end_row = std::max(end_row, std::min(mcus_per_column_, (blocks._end_row + vertical_blocks - 1) / vertical_blocks));
+		end_column = std::max(end_column, std::min(mcus_per_line_, (blocks._end_column + horizontal_blocks - 1) / horizontal_blocks));
+	}
+
+	int next = -1;    // MCU the decoder stands before, -1 before the first seek
+	int resumed = -1; // MCU of the last checkpoint, its restart marker is already behind
+	for (int row = first_row; row < end_row && !_decoding_stopped; row++)
+	{
+		int first = row * mcus_per_line_ + first_column;
+		int end = row * mcus_per_line_ + end_column;
+		std::size_t nearest = first / interval;
+		if (nearest >= indexed_scan._checkpoints.size())
+		{
+			this->fail(DecodeError::InvalidIndex);
+			return;
+		}
+		// decoding on is cheaper than seeking, when no checkpoint lies between
+		if (next < 0 || int(nearest) * interval > next)
+		{
+			const JpegIndex::Checkpoint& checkpoint = indexed_scan._checkpoints[nearest];
+			image_content_.Seek(checkpoint._position, checkpoint._bit_position);
+			for (int i = 0; i < _scan_components.size(); i++)
+			{
+				_dc_predictors[_scan_components[i]._frame_index] = checkpoint._dc_predictors[i];
+			}
+			next = resumed = int(nearest) * interval;
+		}
+		for (int mcu = next; mcu < end && !_decoding_stopped; mcu++)
+		{
+			if (_restart_interval && mcu && mcu % _restart_interval == 0 && mcu != resumed)
+			{
+				this->process_restart_marker(image_content_);
+			}
+			this->decode_mcu(image_content_, mcu, mcus_per_line_);
+			this->check_data_left(image_content_);
+		}
+		next = end;
+	}
+
+	if (!_decoding_stopped)
+	{
+		image_content_.Seek(indexed_scan._end_position, 0);
+	}
+}
+
+JpegIndex::Checkpoint Jpeg::checkpoint(const InputBitStream& image_content_) const
+{
+	JpegIndex::Checkpoint checkpoint = { image_content_.Position(), image_content_.BitPosition(), { 0, 0, 0, 0 } };
+	for (int i = 0; i < _scan_components.size(); i++)
+	{
+		checkpoint._dc_predictors[i] = _dc_predictors[_scan_components[i]._frame_index];
+	}
+	return checkpoint;
+}
+
+void Jpeg::calculate_scan_size(const std::vector<ScanComponent>& scan_components_, int& mcus_per_line_, int& mcus_per_column_) const
+{
+	// [A.2.2] Non-interleaved scan walks over the blocks of the single component,
+	// the padding blocks of its MCU grid are not coded
+	// [A.2.3] Interleaved scan walks over the MCUs, each containing Hi x Vi blocks of every component
+	if (scan_components_.size() > 1)
+	{
+		mcus_per_line_ = (_picture_width + 8 * _max_horizontal_thinning - 1) / (8 * _max_horizontal_thinning);
+		mcus_per_column_ = (_picture_height + 8 * _max_vertical_thinning - 1) / (8 * _max_vertical_thinning);
+	}
+	else
+	{
+		int component = scan_components_[0]._frame_index;
+		mcus_per_line_ = (GetComponentWidth(component) + 7) / 8;
+		mcus_per_column_ = (GetComponentHeight(component) + 7) / 8;
+	}
+}
+
+void Jpeg::decode_block(InputBitStream& image_content_, const ScanComponent& component_, short* coefficients_)
+{
+	if (coefficients_ && !_dc_only)
+	{
+		std::fill(coefficients_, coefficients_ + 64, 0);
+	}
+
+	// DC coef
+	byte bits_to_read = this->decode_huffman_value(image_content_, _huffman_tables[component_._id_of_DC_table][coef_type::DC]->_decoding);
+	// [F.1.2.1] Table F.1, categories of 8-bit DC differences go up to 11
+	if (bits_to_read > 11)
+	{
+		this->fail(DecodeError::InvalidCategory);
+		return;
+	}
+	_dc_predictors[component_._frame_index] += this->receive_and_extend(image_content_, bits_to_read);
+	if (coefficients_)
+	{
+		coefficients_[0] = _dc_predictors[component_._frame_index];
+	}
+	if (_capacity_estimate)
+	{
+		_capacity_estimate->_blocks++;
+	}
+	INSTRUMENT(DecodeCounters::Current()._blocks++);
+
+	// AC coefs
+	const HuffmanTable& ac_table = _huffman_tables[component_._id_of_AC_table][coef_type::AC]->_decoding;
+	for (int zigzag_order_counter = 1; zigzag_order_counter < 64; )
+	{
+		byte huffman_tree_value = this->decode_huffman_value(image_content_, ac_table);
+		byte number_of_0_to_add = huffman_tree_value >> 4;
+		byte bits_to_read = huffman_tree_value & 0x0F;
+		if (bits_to_read == 0)
+		{
+			if (number_of_0_to_add != 0x0F)
+			{
+				INSTRUMENT(DecodeCounters::Current()._end_of_block[zigzag_order_counter]++);
+				return; // EOB
+			}
+			zigzag_order_counter += 16; // ZRL
+			continue;
+		}
+		zigzag_order_counter += number_of_0_to_add;
+		if (zigzag_order_counter >= 64)
+		{
+			this->fail(DecodeError::CoefficientOutOfBlock);
+			return;
+		}
+		// [F.1.2.2] Table F.2, categories of 8-bit AC coefficients go up to 10
+		if (bits_to_read > 10)
+		{
+			this->fail(DecodeError::InvalidCategory);
+			return;
+		}
+		if (_dc_only)
+		{
+			// the extra bits are only stepped over, the coefficient is never extended nor stored
+			image_content_.SkipBits(bits_to_read);
+			INSTRUMENT(DecodeCounters::Current()._bits_consumed += bits_to_read);
+			zigzag_order_counter++;
+			continue;
+		}
+		int value = this->receive_and_extend(image_content_, bits_to_read);
+		if (coefficients_)
+		{
+			coefficients_[_zigzag_to_natural[zigzag_order_counter]] = value;
+		}
+		if (_capacity_estimate)
+		{
+			// value is never 0 here, it is the non-zero coefficient by construction
+			_capacity_estimate->_nonzero_ac++;
+			_capacity_estimate->_greater_than_one += (value > 1 || value < -1);
+			_capacity_estimate->_usable_ac += (value != 1);
+			_capacity_estimate->_nonzero_per_frequency[_zigzag_to_natural[zigzag_order_counter]]++;
+		}
+		zigzag_order_counter++;
+	}
+	INSTRUMENT(DecodeCounters::Current()._end_of_block[64]++);
+}
+
+byte Jpeg::decode_huffman_value(InputBitStream& image_content_, const HuffmanTable& table_)
+{
+	unsigned int bits = image_content_.PeekBits(16);
+	// most codes are short, they are resolved by the lookahead table at once
+	const HuffmanTable::LookupEntry& entry = table_.Lookup(bits >> (16 - HuffmanTable::lookahead_bits));
+	if (entry._length)
+	{
+		image_content_.SkipBits(entry._length);
+		INSTRUMENT(DecodeCounters::Current()._huffman_fast++);
+		INSTRUMENT(DecodeCounters::Current()._bits_consumed += entry._length);
+		return entry._value;
+	}
+
+	// no short code is a prefix of the bits, so the longer lengths are tried as by procedure DECODE
+	for (int length = HuffmanTable::lookahead_bits + 1; length <= 16; length++)
+	{
+		int value = table_.Decode(bits >> (16 - length), length);
+		if (value >= 0)
+		{
+			image_content_.SkipBits(length);
+			INSTRUMENT(DecodeCounters::Current()._huffman_slow++);
+			INSTRUMENT(DecodeCounters::Current()._bits_consumed += length);
+			return byte(value);
+		}
+	}
+	// 0 is EOB for AC and zero difference for DC, so the block ends right away and the scan stops after it
+	this->fail(DecodeError::InvalidHuffmanCode);
+	return 0;
+}
+
+int Jpeg::receive_and_extend(InputBitStream& image_content_, int number_of_bits_)
+{
+	if (number_of_bits_ == 0)
+	{
+		return 0;
+	}
+	int value = image_content_.ReadBits(number_of_bits_);
+	INSTRUMENT(DecodeCounters::Current()._bits_consumed += number_of_bits_);
+	if (value < (1 << (number_of_bits_ - 1)))
+	{
+		value -= (1 << number_of_bits_) - 1;
+	}
+	return value;
+}
+
+void Jpeg::check_data_left(const InputBitStream& image_content_)
+{
+	if (!_decoding_stopped && (image_content_.MarkerReached() || !image_content_))
+	{
+		this->fail(DecodeError::TruncatedData);
+	}
+}
+
+void Jpeg::process_restart_marker(InputBitStream& image_content_)
+{
+	if (image_content_.MarkerReached() || !image_content_)
+	{
+		this->fail(DecodeError::TruncatedData); // restart interval is shorter than it must be
+		return;
+	}
+	image_content_.AlignToByte();
+	image_content_.SetByteStuffing(false);
+	byte marker_prefix, marker;
+	image_content_ >> marker_prefix >> marker;
+	if (marker_prefix != 0xFF || marker < markers::RST0 || marker > markers::RST7)
+	{
+		image_content_.BytesBack(2);
+		this->fail(DecodeError::MissingRestartMarker);
+		return;
+	}
+	std::fill(_dc_predictors.begin(), _dc_predictors.end(), 0);
+	image_content_.SetByteStuffing(true);
+}
+
+void Jpeg::process_restart_interval(InputBitStream& image_content_)
+{
+	byte size_1, size_2;
+	image_content_ >> size_1 >> size_2;
+	byte interval_1, interval_2;
+	image_content_ >> interval_1 >> interval_2;
+	_restart_interval = interval_1 * 0x100 + interval_2;
+}
+
+void Jpeg::process_application_specific(InputBitStream& image_content_)
+{
+	byte application_type;
+	image_content_ >> application_type;
+	byte size_1, size_2;
+	image_content_ >> size_1 >> size_2;
+	int size_of_segment = size_1 * 0x100 + size_2;
+
+	// [ICC.1:2010 B.4] "ICC_PROFILE\0", sequence number and number of chunks precede the profile data,
+	// only the place of the data is kept, the profile is read when asked for
+	static const char icc_identifier[] = "ICC_PROFILE";
+	const int icc_header_size = sizeof(icc_identifier) + 2;
+	int start = image_content_.Position();
+	byte temp;
+	for (int i = 2; i < size_of_segment; i++)
+	{
+		image_content_ >> temp;
+	}
+	if (application_type == APP2 && image_content_ && size_of_segment >= 2 + icc_header_size &&
+		std::equal(icc_identifier, icc_identifier + sizeof(icc_identifier), image_content_.Data() + start))
+	{
+		const byte* numbers = image_content_.Data() + start + sizeof(icc_identifier);
+		_icc_chunks.push_back(IccChunk{ numbers[0], numbers[1], start + icc_header_size, size_of_segment - 2 - icc_header_size });
+	}
+}
+
+void Jpeg::process_comment(InputBitStream& image_content_)
+{
+	byte size_1, size_2;
+	image_content_ >> size_1 >> size_2;
+	int size_of_comment = size_1 * 0x100 + size_2;
+
+	for (int i = 2; i < size_of_comment; i++)
+	{
+		byte temp;
+		image_content_ >> temp;
+		_comment += temp;
+	}
+}
+
+void Jpeg::process_number_of_lines(InputBitStream & image_content_)
+{
+	this->fail(DecodeError::UnsupportedProcess);
+}
+
+void Jpeg::calculating_zigzag_order_traversal(int size_of_table_, int size_of_matrix_)
+{
+	// _zigzag_order_traversal_indices.resize(size_of_table_ - 3);
+	// Calculating indices for zigzag order traversal
+	for (int i = 0; i < 2 * size_of_matrix_ - 1; i++)
+	{
+		if (i % 2 == 1)
+		{
+			int x = i < size_of_matrix_ ? 0 : i - size_of_matrix_ + 1;
+			int y = i < size_of_matrix_ ? i : size_of_matrix_ - 1;
+			while (x < size_of_matrix_ && y >= 0) {
+				_zigzag_order_traversal_indices.push_back({ x++, y-- });
+			}
+		}
+		else
+		{
+			int x = i < size_of_matrix_ ? i : size_of_matrix_ - 1;
+			int y = i < size_of_matrix_ ? 0 : i - size_of_matrix_ + 1;
+			while (x >= 0 && y < size_of_matrix_) {
+				_zigzag_order_traversal_indices.push_back({ x--, y++ });
+			}
+		}
+	}
+}
+
+int Jpeg::GetWidth() const
+{
+	return _picture_width;
+}
+
+int Jpeg::GetHeight() const
+{
+	return _picture_height;
+}
+
+int Jpeg::GetComponentsCount() const
+{
+	return _frames.size();
+}
+
+int Jpeg::GetBlocksPerLine(int component_) const
+{
+	return _frames[component_]._blocks_per_line;
+}
+
+int Jpeg::GetBlocksPerColumn(int component_) const
+{
+	return _frames[component_]._blocks_per_column;
+}
+
+const std::pmr::vector<short>& Jpeg::GetCoefficients(int component_) const
+{
+	return _coefficients[component_];
+}
+
+unsigned long long Jpeg::CapacityEstimate::PayloadCapacity() const
+{
+	// 32 bits of every sequential payload are taken by its length
+	return _usable_ac > 32 ? (_usable_ac - 32) / 8 : 0;
+}
+
+Jpeg::CapacityEstimate Jpeg::EstimateCapacity(const std::string& file_path_)
+{
+	CapacityEstimate capacity_estimate;
+	Jpeg jpeg(file_path_, capacity_estimate);
+	return capacity_estimate;
+}
+
+std::vector<unsigned char> Jpeg::ReleaseFileContent()
+{
+	_allocator->Uncharge(_charged_file_bytes);
+	_charged_file_bytes = 0;
+	return _image_content.Release();
+}
+
+int Jpeg::GetComponentWidth(int component_) const
+{
+	return (_picture_width * _frames[component_]._horizontal_thinning + _max_horizontal_thinning - 1) / _max_horizontal_thinning;
+}
+
+int Jpeg::GetComponentHeight(int component_) const
+{
+	return (_picture_height * _frames[component_]._vertical_thinning + _max_vertical_thinning - 1) / _max_vertical_thinning;
+}
+
+void Jpeg::ForEachBlockInScanOrder(const std::function<void(const BlockPosition& position_, const short* coefficients_)>& visitor_) const
+{
+	const_cast<Jpeg*>(this)->ForEachBlockInScanOrder([&visitor_](const BlockPosition& position_, short* coefficients_)
+	{
+		visitor_(position_, coefficients_);
+	});
+}
+
+void Jpeg::ForEachBlockInScanOrder(const std::function<void(const BlockPosition& position_, short* coefficients_)>& visitor_)
+{
+	this->require_coefficients();
+	for (int scan = 0; scan < _scans.size(); scan++)
+	{
+		const std::vector<ScanComponent>& scan_components = _scans[scan];
+		bool interleaved = scan_components.size() > 1;
+		int mcus_per_line, mcus_per_column;
+		this->calculate_scan_size(scan_components, mcus_per_line, mcus_per_column);
+		for (int mcu = 0; mcu < mcus_per_line * mcus_per_column; mcu++)
+		{
+			int mcu_row = mcu / mcus_per_line;
+			int mcu_column = mcu % mcus_per_line;
+			for (int i = 0; i < scan_components.size(); i++)
+			{
+				const Frame& frame = _frames[scan_components[i]._frame_index];
+				int vertical_blocks = interleaved ? frame._vertical_thinning : 1;
+				int horizontal_blocks = interleaved ? frame._horizontal_thinning : 1;
+				for (int v = 0; v < vertical_blocks; v++)
+				{
+					for (int h = 0; h < horizontal_blocks; h++)
+					{
+						BlockPosition position;
+						position._component = scan_components[i]._frame_index;
+						position._row = mcu_row * vertical_blocks + v;
+						position._column = mcu_column * horizontal_blocks + h;
+						int block_index = position._row * frame._blocks_per_line + position._column;
+						visitor_(position, _coefficients[position._component].data() + block_index * 64);
+					}
+				}
+			}
+		}
+	}
+}
+
+void Jpeg::ForEachBlockInKeyedOrder(const std::string& key_, const std::function<bool(const BlockPosition& position_, const short* coefficients_)>& visitor_) const
+{
+	const_cast<Jpeg*>(this)->ForEachBlockInKeyedOrder(key_, [&visitor_](const BlockPosition& position_, short* coefficients_)
+	{
+		return visitor_(position_, coefficients_);
+	});
+}
+
+void Jpeg::ForEachBlockInKeyedOrder(const std::string& key_, const std::function<bool(const BlockPosition& position_, short* coefficients_)>& visitor_)
+{
+	this->require_coefficients();
+	unsigned long long blocks = 0;
+	for (const Frame& frame : _frames)
+	{
+		blocks += (unsigned long long)frame._blocks_per_line * frame._blocks_per_column;
+	}
+	// the order is derived block by block, every step touches the 128 bytes of one block alone
+	KeyedPermutation order(key_, blocks);
+	for (unsigned long long step = 0; step < blocks; step++)
+	{
+		unsigned long long block = order.At(step);
+		int component = 0;
+		for (; block >= (unsigned long long)_frames[component]._blocks_per_line * _frames[component]._blocks_per_column; component++)
+		{
+			block -= (unsigned long long)_frames[component]._blocks_per_line * _frames[component]._blocks_per_column;
+		}
+		BlockPosition position;
+		position._component = component;
+		position._row = int(block / _frames[component]._blocks_per_line);
+		position._column = int(block % _frames[component]._blocks_per_line);
+		if (!visitor_(position, _coefficients[component].data() + block * 64))
+		{
+			return;
+		}
+	}
+}
+
+void Jpeg::MarkDirty(const BlockPosition& position_)
+{
+	// flags are taken only by images, which are changed at all
+	if (_dirty_blocks.size() < _frames.size())
+	{
+		_dirty_blocks.resize(_frames.size());
+	}
+	const Frame& frame = _frames[position_._component];
+	std::pmr::vector<byte>& dirty_blocks = _dirty_blocks[position_._component];
+	if (dirty_blocks.empty())
+	{
+		dirty_blocks.assign(std::size_t(frame._blocks_per_line) * frame._blocks_per_column, 0);
+	}
+	dirty_blocks[std::size_t(position_._row) * frame._blocks_per_line + position_._column] = 1;
+}
+
+bool Jpeg::IsDirty(const BlockPosition& position_) const
+{
+	if (position_._component >= _dirty_blocks.size() || _dirty_blocks[position_._component].empty())
+	{
+		return false;
+	}
+	return _dirty_blocks[position_._component][std::size_t(position_._row) * _frames[position_._component]._blocks_per_line + position_._column] != 0;
+}
+
+std::vector<float> Jpeg::GetUnroundedSamples(int component_) const
+{
+	this->require_coefficients();
+	const Frame& frame = _frames[component_];
+	const std::pmr::vector<std::pmr::vector<int>>& quantization_table = _quantization_tables[frame._id_of_quantization_table];
+	int width = GetComponentWidth(component_);
+	int height = GetComponentHeight(component_);
+	std::vector<float> samples(width * height);
+
+	const KernelTable& kernels = Kernels::Get();
+	int table[64];
+	for (int i = 0; i < 64; i++)
+	{
+		table[i] = quantization_table[i / 8][i % 8];
+	}
+	float dequantized[64], block_samples[64];
+	for (int row = 0; row * 8 < height; row++)
+	{
+		for (int column = 0; column * 8 < width; column++)
+		{
+			const short* coefficients = _coefficients[component_].data() + (row * frame._blocks_per_line + column) * 64;
+			kernels._dequantize(coefficients, table, dequantized, 1);
+			kernels._inverse_dct(dequantized, block_samples);
+
+			// [A.3.1] level shift back to unsigned samples
+			for (int y = 0; y < 8 && row * 8 + y < height; y++)
+			{
+				for (int x = 0; x < 8 && column * 8 + x < width; x++)
+				{
+					samples[(row * 8 + y) * width + column * 8 + x] = block_samples[y * 8 + x] + 128.0f;
+				}
+			}
+		}
+	}
+	return samples;
+}
+
+bool Jpeg::HasCoefficients() const
+{
+	return this->has_coefficients();
+}
+
+PlaneView<const short> Jpeg::GetCoefficientPlane(int component_) const
+{
+	if (component_ >= _coefficients.size() || _coefficients[component_].empty())
+	{
+		return PlaneView<const short>();
+	}
+	const Frame& frame = _frames[component_];
+	return PlaneView<const short>(_coefficients[component_].data(), frame._blocks_per_line, frame._blocks_per_column,
+		std::ptrdiff_t(frame._blocks_per_line) * 64, 64);
+}
+
+PlaneView<const byte> Jpeg::GetSampleTile(int component_, int x_, int y_, int width_, int height_, std::vector<byte>& scratch_) const
+{
+	if (component_ >= _coefficients.size() || _coefficients[component_].empty())
+	{
+		return PlaneView<const byte>();
+	}
+	const Frame& frame = _frames[component_];
+	const std::pmr::vector<std::pmr::vector<int>>& quantization_table = _quantization_tables[frame._id_of_quantization_table];
+	const int first_column = x_ / 8, last_column = (x_ + width_ + 7) / 8;
+	const int first_row = y_ / 8, last_row = (y_ + height_ + 7) / 8;
+	const int width = (last_column - first_column) * 8;
+	scratch_.resize(std::size_t(width) * (last_row - first_row) * 8);
+
+	const KernelTable& kernels = Kernels::Get();
+	int table[64];
+	for (int i = 0; i < 64; i++)
+	{
+		table[i] = quantization_table[i / 8][i % 8];
+	}
+	float dequantized[64], block_samples[64];
+	for (int row = first_row; row < last_row; row++)
+	{
+		for (int column = first_column; column < last_column; column++)
+		{
+			const short* coefficients = _coefficients[component_].data() + (row * frame._blocks_per_line + column) * 64;
+			kernels._dequantize(coefficients, table, dequantized, 1);
+			kernels._inverse_dct(dequantized, block_samples);
+
+			byte* destination = scratch_.data() + std::size_t(row - first_row) * 8 * width + (column - first_column) * 8;
+			for (int y = 0; y < 8; y++)
+			{
+				for (int x = 0; x < 8; x++)
+				{
+					// rounded as in GetSamples, so tiles put together are the same samples
+					destination[y * width + x] = byte(std::min(std::max(std::round(block_samples[y * 8 + x] + 128.0f), 0.0f), 255.0f));
+				}
+			}
+		}
+	}
+	return PlaneView<const byte>(scratch_.data() + std::size_t(y_ - first_row * 8) * width + x_ - first_column * 8,
+		width_, height_, width);
+}
+
+std::vector<byte> Jpeg::GetSamples(int component_) const
+{
+	std::vector<float> unrounded_samples = GetUnroundedSamples(component_);
+	std::vector<byte> samples(unrounded_samples.size());
+	for (int i = 0; i < samples.size(); i++)
+	{
+		samples[i] = byte(std::min(std::max(std::round(unrounded_samples[i]), 0.0f), 255.0f));
+	}
+	return samples;
+}
+
+std::vector<byte> Jpeg::GetSamples(int component_, int scale_) const
+{
+	if (scale_ != 1 && scale_ != 2 && scale_ != 4 && scale_ != 8)
+	{
+		throw std::invalid_argument("Scale must be 1, 2, 4 or 8");
+	}
+	if (_frames.empty())
+	{
+		throw std::runtime_error("Image has no frame");
+	}
+	if (_dc_only && scale_ != 8)
+	{
+		throw std::invalid_argument("Only DC coefficients were decoded, samples are available at scale 8 alone");
+	}
+	// the constructor decides which planes are stored, the one of the component has to be there
+	const std::pmr::vector<std::pmr::vector<short>>& planes = _dc_only ? _dc_coefficients : _coefficients;
+	if (component_ < 0 || component_ >= _frames.size() || component_ >= planes.size() || planes[component_].empty())
+	{
+		throw std::runtime_error("Coefficients of the component were not decoded");
+	}
+	if (scale_ == 1)
+	{
+		return GetSamples(component_);
+	}
+
+	const Frame& frame = _frames[component_];
+	const std::pmr::vector<std::pmr::vector<int>>& quantization_table = _quantization_tables[frame._id_of_quantization_table];
+	const int size = 8 / scale_;
+	const int width = (GetComponentWidth(component_) + scale_ - 1) / scale_;
+	const int height = (GetComponentHeight(component_) + scale_ - 1) / scale_;
+	std::vector<byte> samples(size_t(width) * height);
+
+	// coefficients above the reduced size are never read, so they stay zero
+	float dequantized[64] = {}, block_samples[16];
+	for (int row = 0; row * size < height; row++)
+	{
+		for (int column = 0; column * size < width; column++)
+		{
+			const int block_index = row * frame._blocks_per_line + column;
+			if (_dc_only)
+			{
+				dequantized[0] = float(_dc_coefficients[component_][block_index] * quantization_table[0][0]);
+			}
+			else
+			{
+				const short* coefficients = _coefficients[component_].data() + block_index * 64;
+				for (int v = 0; v < size; v++)
+				{
+					for (int u = 0; u < size; u++)
+					{
+						dequantized[v * 8 + u] = float(coefficients[v * 8 + u] * quantization_table[v][u]);
+					}
+				}
+			}
+			Dct::InverseReduced(dequantized, size, block_samples);
+
+			// [A.3.1] level shift back to unsigned samples, rounded as in GetSamples
+			for (int y = 0; y < size && row * size + y < height; y++)
+			{
+				for (int x = 0; x < size && column * size + x < width; x++)
+				{
+					samples[size_t(row * size + y) * width + column * size + x] =
+						byte(std::min(std::max(std::round(block_samples[y * size + x] + 128.0f), 0.0f), 255.0f));
+				}
+			}
+		}
+	}
+	return samples;
+}
+
+std::vector<byte> Jpeg::GetRgb() const
+{
+	this->require_coefficients();
+	std::vector<std::vector<byte>> component_samples;
+	for (int i = 0; i < _frames.size(); i++)
+	{
+		component_samples.push_back(GetSamples(i));
+	}
+	return ConvertToRgb(component_samples);
+}
+
+std::vector<byte> Jpeg::GetRgb(int scale_) const
+{
+	if (_frames.empty())
+	{
+		throw std::runtime_error("Image has no frame");
+	}
+	std::vector<std::vector<byte>> component_samples;
+	for (int i = 0; i < _frames.size(); i++)
+	{
+		component_samples.push_back(GetSamples(i, scale_));
+	}
+	return this->convert_to_rgb(component_samples, scale_);
+}
+
+std::vector<byte> Jpeg::ConvertToRgb(const std::vector<std::vector<byte>>& component_samples_) const
+{
+	this->require_coefficients();
+	if (component_samples_.size() != _frames.size())
+	{
+		throw std::invalid_argument("Samples of every component are needed");
+	}
+	return this->convert_to_rgb(component_samples_, 1);
+}
+
+std::vector<byte> Jpeg::convert_to_rgb(const std::vector<std::vector<byte>>& component_samples_, int scale_) const
+{
+	const int picture_width = (_picture_width + scale_ - 1) / scale_;
+	const int picture_height = (_picture_height + scale_ - 1) / scale_;
+	std::vector<byte> rgb(size_t(picture_width) * picture_height * 3);
+	if (component_samples_.size() < 3)
+	{
+		const std::vector<byte>& gray = component_samples_[0];
+		for (size_t i = 0; i < gray.size() && i * 3 < rgb.size(); i++)
+		{
+			rgb[i * 3] = rgb[i * 3 + 1] = rgb[i * 3 + 2] = gray[i];
+		}
+		return rgb;
+	}
+
+	// column of every picture sample in the subsampled component, scaled sizes are rounded up separately,
+	// so the last column and row may lie past the component
+	std::vector<std::vector<int>> source_columns(3);
+	bool subsampled[3];
+	int component_widths[3], component_heights[3];
+	for (int c = 0; c < 3; c++)
+	{
+		component_widths[c] = (GetComponentWidth(c) + scale_ - 1) / scale_;
+		component_heights[c] = (GetComponentHeight(c) + scale_ - 1) / scale_;
+		source_columns[c].resize(picture_width);
+		for (int x = 0; x < picture_width; x++)
+		{
+			source_columns[c][x] = std::min(x * _frames[c]._horizontal_thinning / _max_horizontal_thinning, component_widths[c] - 1);
+		}
+		subsampled[c] = _frames[c]._horizontal_thinning != _max_horizontal_thinning;
+	}
+	// subsampled rows are replicated to the full width first, so the conversion runs over plain rows
+	std::vector<byte> upsampled_rows[3];
+	const KernelTable& kernels = Kernels::Get();
+	for (int y = 0; y < picture_height; y++)
+	{
+		const byte* rows[3];
+		for (int c = 0; c < 3; c++)
+		{
+			int row = std::min(y * _frames[c]._vertical_thinning / _max_vertical_thinning, component_heights[c] - 1);
+			rows[c] = component_samples_[c].data() + size_t(row) * component_widths[c];
+			if (subsampled[c])
+			{
+				upsampled_rows[c].resize(picture_width);
+				for (int x = 0; x < picture_width; x++)
+				{
+					upsampled_rows[c][x] = rows[c][source_columns[c][x]];
+				}
+				rows[c] = upsampled_rows[c].data();
+			}
+		}
+		kernels._ycbcr_to_rgb(rows[0], rows[1], rows[2], rgb.data() + size_t(y) * picture_width * 3, picture_width);
+	}
+	return rgb;
+}
+
+const std::pmr::vector<std::pmr::vector<int>>& Jpeg::GetQuantizationTable(int component_) const
+{
+	return _quantization_tables[_frames[component_]._id_of_quantization_table];
+}
+
+const DecodeCounters& Jpeg::GetCounters() const
+{
+	return _counters;
+}
+
+const DecodeStatus& Jpeg::GetStatus() const
+{
+	return _status;
+}
+
+std::size_t Jpeg::GetPeakBytes() const
+{
+	return _allocator->Peak();
+}
+
+const Allocator& Jpeg::GetAllocator() const
+{
+	return *_allocator;
+}
+
+
+IccProfile Jpeg::GetIccProfile() const
+{
+	if (_icc_chunks.empty() || !_image_content.Data())
+	{
+		return IccProfile();
+	}
+	// every chunk must be there once, they may come in any order
+	int count = _icc_chunks[0]._count;
+	std::vector<std::pair<const byte*, std::size_t>> chunks(count);
+	if (count != _icc_chunks.size())
+	{
+		return IccProfile();
+	}
+	for (int i = 0; i < _icc_chunks.size(); i++)
+	{
+		const IccChunk& chunk = _icc_chunks[i];
+		if (chunk._count != count || chunk._sequence < 1 || chunk._sequence > count || chunks[chunk._sequence - 1].first)
+		{
+			return IccProfile();
+		}
+		chunks[chunk._sequence - 1] = std::make_pair(_image_content.Data() + chunk._offset, std::size_t(chunk._size));
+	}
+	return IccProfile(chunks);
+}
\ No newline at end of file
@@ -1,57 +1,110 @@
 #pragma once
 #include<map>
 #include<vector>
+#include<deque>
+#include<memory>
+#include<memory_resource>
 #include<algorithm>
+#include<functional>
+#include<exception>
 #include"BitStream.h"
 #include"ImageFileBuffer.h"
 #include"Image.h"
+#include"Instrumentation.h"
+#include"DecodeStatus.h"
+#include"Allocator.h"
+#include"HuffmanCache.h"
+#include"Icc.h"
+#include"JpegIndex.h"
 
 // [ISO/IEC 10918-1 : 1993(E)]
 class Jpeg : public Image
 {
-	class HuffmanTree
+	friend class JpegWriter;
+	friend class SyntheticJpeg;
+	friend class JpegDecoder;
+	friend class JpegStream;
+
+	struct Frame
 	{
-	public:
+		byte _id;
+		byte _horizontal_thinning;
+		byte _vertical_thinning;
+		byte _id_of_quantization_table;
+		int _blocks_per_line;   // padded up to the whole number of MCUs
+		int _blocks_per_column; // padded up to the whole number of MCUs
+	};
 
-		struct Node
-		{
-			Node *_left, *_right;
-			byte _value;
-			bool _code_end;
-			Node();
-		};
+	/// Blocks [_first_row, _end_row) x [_first_column, _end_column) of a component
+	struct BlockRegion
+	{
+		int _first_row;
+		int _first_column;
+		int _end_row;
+		int _end_column;
+	};
 
-		class HuffmanTreeIterator
-		{
-			Node* _state;
-			Node* _root;
-		public:
-			HuffmanTreeIterator(HuffmanTree* tree_);
-			HuffmanTreeIterator* Step(int way_);
-			bool IsCodeEnd();
-			byte GetValue();
-			void Reset();
-		};
-	private:
-		
-		Node* _root;
-		Node* _state;
+	struct ScanComponent
+	{
+		int _frame_index;
+		byte _id_of_DC_table;
+		byte _id_of_AC_table;
+	};
 
-		bool add_element(Node*& current_node_, int lenght_, int value_);
-	public:
+	/// Where the entropy-coded data of a scan lies in the file and what it was coded with,
+	/// so JpegWriter copies its unchanged restart intervals instead of coding them again
+	struct ScanLayout
+	{
+		int _data_start;       // first byte after the scan header
+		int _data_end;         // the marker after the data, 0 when the scan was not decoded to its end
+		int _restart_interval;
+		int _first_interval;   // of _interval_starts
+		std::shared_ptr<const SharedHuffmanTable> _huffman_tables[4][2]; // as they were defined for the scan
+	};
 
-		HuffmanTree();
-		void AddElement(int lenght_, int value_);
-		Node* GetRoot();
+	/// [ICC.1:2010 B.4] Part of the profile carried by one APP2 segment, only its place in the file is kept
+	struct IccChunk
+	{
+		int _sequence; // from 1
+		int _count;
+		int _offset;   // of the profile data in the file content
+		int _size;
 	};
 
-	
-	struct Frame
+public:
+	/// Position of decoded 8x8 block in the block grid of its component
+	struct BlockPosition
 	{
-		byte _id;
-		byte _horizontal_thinning;
-		byte _vertical_thinning;
-		byte _id_of_quantization_table;
+		int _component;
+		int _row;
+		int _column;
+	};
+
+	/// Rectangle of the image in pixels, for region decoding
+	struct Region
+	{
+		int _x;
+		int _y;
+		int _width;
+		int _height;
+	};
+
+	/// Receives every decoded block in the scan order, with 64 coefficients in natural (row-major) order.
+	/// Returning false stops the decoding, nothing after that block is read.
+	typedef std::function<bool(const BlockPosition& position_, const short* coefficients_)> BlockHandler;
+
+	/// Counters gathered right inside of the entropy decoder, no block is ever stored
+	struct CapacityEstimate
+	{
+		unsigned long long _blocks;
+		unsigned long long _nonzero_ac;       // AC coefficients not equal to 0
+		unsigned long long _greater_than_one; // AC coefficients with |value| > 1
+		unsigned long long _usable_ac;        // AC coefficients, which may carry sequential payload bit
+		unsigned long long _nonzero_per_frequency[64]; // in natural order, DC is always 0
+
+		CapacityEstimate();
+		/// Bytes of message, which fit into sequential payload
+		unsigned long long PayloadCapacity() const;
 	};
 
 private:
@@ -113,6 +166,14 @@ private:
 		APP5 = 0xE5, // Reserved for application segments
 		APP6 = 0xE6, // Reserved for application segments
 		APP7 = 0xE7, // Reserved for application segments
+		APP8 = 0xE8, // Reserved for application segments
+		APP9 = 0xE9, // Reserved for application segments
+		APP10 = 0xEA, // Reserved for application segments
+		APP11 = 0xEB, // Reserved for application segments
+		APP12 = 0xEC, // Reserved for application segments
+		APP13 = 0xED, // Reserved for application segments
+		APP14 = 0xEE, // Reserved for application segments
+		APP15 = 0xEF, // Reserved for application segments
 		JPG0 = 0xF0, // Reserved for JPEG extensions
 		JPG1 = 0xF1, // Reserved for JPEG extensions
 		JPG2 = 0xF2, // Reserved for JPEG extensions
@@ -136,6 +197,31 @@ private:
 	};
 
 	bool check_for_image_correctness(InputBitStream& image_content_);
+	/// Runs process_segments, anything going wrong ends up in _status, never in exception
+	void decode() noexcept;
+	/// Decodes the next file into this image: everything of the previous one is dropped, its coefficient planes
+	/// are kept for the components of the same size, the image is charged only for the storage it uses
+	void decode_again(std::vector<unsigned char>&& file_content_, BlockHandler&& block_handler_, CapacityEstimate* capacity_estimate_) noexcept;
+	/// size_ zeros in plane_, in a spare plane of exactly that capacity when there is one
+	void take_plane(std::pmr::vector<short>& plane_, std::size_t size_);
+	/// Frees the spare planes no component of the image has taken
+	void release_spare_planes() noexcept;
+	/// Every component has its blocks stored, that is neither BlockHandler nor CapacityEstimate was used
+	bool has_coefficients() const;
+	/// Throws std::runtime_error for an image without a frame or without stored coefficients, before anything reads them
+	void require_coefficients() const;
+	/// Every component of the frame was in some scan, a file may end at a segment boundary before that
+	bool every_component_scanned() const;
+	/// Color conversion of component samples scaled down by scale_ to the picture scaled the same way
+	std::vector<byte> convert_to_rgb(const std::vector<std::vector<byte>>& component_samples_, int scale_) const;
+	/// Remembers the first error with the current position and segment, and stops the decoding
+	void fail(DecodeError error_);
+	/// The throwing constructors report _status this way, exceptions of BlockHandler are rethrown as they are
+	void throw_on_error() const;
+	/// Reads marker segments one after another up to EOI
+	void process_segments();
+	/// Name of the marker for trace spans
+	static const char* marker_name(byte marker_);
 	// void process_start_of_image(InputBitStream& image_content_);
 
 	/**
@@ -632,6 +718,29 @@ private:
 	 */
 	void process_start_of_scan(InputBitStream& image_content_);
 
+	/// [F.2.2] Decodes MCUs of the current scan one by one, passing blocks to the handler
+	void decode_scan(InputBitStream& image_content_);
+	/// Decodes the blocks of every component of the MCU, stores them or passes them to BlockHandler,
+	/// while decoding a region only those of the region
+	void decode_mcu(InputBitStream& image_content_, int mcu_, int mcus_per_line_);
+	/// Decodes the rows of MCUs under _region, each from the checkpoint of _index nearest before it,
+	/// and moves to the end of the scan
+	void decode_region(InputBitStream& image_content_, int mcus_per_line_, int mcus_per_column_);
+	/// State of the decoder before the next MCU
+	JpegIndex::Checkpoint checkpoint(const InputBitStream& image_content_) const;
+	/// [F.2.2.1], [F.2.2.2] Decodes DC and AC coefficients of one block
+	void decode_block(InputBitStream& image_content_, const ScanComponent& component_, short* coefficients_);
+	/// [F.2.2.3] Decodes the next Huffman coded value, procedure DECODE
+	byte decode_huffman_value(InputBitStream& image_content_, const HuffmanTable& table_);
+	/// [F.2.2.1] Reads additional bits and extends them to the signed value (procedure EXTEND)
+	int receive_and_extend(InputBitStream& image_content_, int number_of_bits_);
+	/// Fails with TruncatedData once an MCU was read past the end of the entropy-coded data
+	void check_data_left(const InputBitStream& image_content_);
+	/// Reads RSTm marker between entropy-coded segments and resets DC predictors
+	void process_restart_marker(InputBitStream& image_content_);
+	/// Number of MCUs in the scan, which consists of the given components
+	void calculate_scan_size(const std::vector<ScanComponent>& scan_components_, int& mcus_per_line_, int& mcus_per_column_) const;
+
 	/**
 	* \verbatim
 	* [B.2.4.4] Restart interval definition syntax
@@ -823,16 +932,95 @@ private:
 	void calculating_zigzag_order_traversal(int size_of_table_, int size_of_matrix_);
 	// void process_end_of_image(InputBitStream& image_content_);
 
+	std::shared_ptr<Allocator> _allocator; // declared first, everything below may take memory from it
 	InputBitStream _image_content;
 
-	std::map<int,std::vector<HuffmanTree*>> _huffman_trees; // trees for DC and AC coefs
+	std::shared_ptr<const SharedHuffmanTable> _huffman_tables[4][2]; // tables for DC and AC coefs of every destination, shared by HuffmanCache
 	std::string _comment;
-	std::vector<std::vector<std::vector<int>>> _quantization_tables;
+	std::vector<IccChunk> _icc_chunks;
+	std::pmr::vector<std::pmr::vector<std::pmr::vector<int>>> _quantization_tables;
 	std::vector<std::pair<int, int>> _zigzag_order_traversal_indices;
 	std::vector<Frame> _frames;
 	byte _max_horizontal_thinning;
 	byte _max_vertical_thinning;
+	int _picture_height;
+	int _picture_width;
+
+	std::vector<ScanComponent> _scan_components;
+	std::vector<std::vector<ScanComponent>> _scans; // components of all scans met so far
+	std::vector<std::vector<ScanComponent>> _spare_scans; // storage of the scans of the previous image
+	std::vector<int> _dc_predictors;
+	int _restart_interval;
+	JpegIndex* _index_builder;          // gets a checkpoint every interval MCUs while decoding
+	const JpegIndex* _index;            // checkpoints to decode _region from
+	Region _region;
+	std::vector<BlockRegion> _region_blocks; // blocks under _region for every component
+	std::vector<int> _zigzag_to_natural; // zigzag index -> row * 8 + column
+
+	std::pmr::vector<std::pmr::vector<short>> _coefficients; // for every component, 64 coefficients per block
+	std::pmr::vector<std::pmr::vector<byte>> _dirty_blocks;  // for every component, 1 for blocks changed since decoding
+	std::vector<ScanLayout> _scan_layouts;
+	std::vector<int> _interval_starts; // first byte of every restart interval of every scan
+	bool _dc_only; // AC coefficients are skipped, not stored
+	std::pmr::vector<std::pmr::vector<short>> _dc_coefficients; // for every component, DC coefficient of every block, when _dc_only
+	std::vector<std::pmr::vector<short>> _spare_planes; // coefficient planes of the previous image, not charged to this one
+	BlockHandler _block_handler;
+	CapacityEstimate* _capacity_estimate;
+	bool _decoding_stopped;
+	DecodeCounters _counters;
+	DecodeStatus _status;
+	const char* _segment; // name of the segment being decoded, for _status
+	std::exception_ptr _handler_error;
+	std::size_t _charged_file_bytes; // size of the file buffer charged to the allocator
 
+	/// Empty image, which is filled by encoders or by JpegDecoder instead of the constructor
+	explicit Jpeg(std::shared_ptr<Allocator>&& allocator_ = nullptr)
+		: _allocator(allocator_ ? std::move(allocator_) : std::make_shared<Allocator>())
+		, _image_content(std::vector<unsigned char>())
+		, _quantization_tables(_allocator.get())
+		, _max_horizontal_thinning(1)
+		, _max_vertical_thinning(1)
+		, _picture_height(0)
+		, _picture_width(0)
+		, _restart_interval(0)
+		, _index_builder(nullptr)
+		, _index(nullptr)
+		, _region{ 0, 0, 0, 0 }
+		, _coefficients(_allocator.get())
+		, _dirty_blocks(_allocator.get())
+		, _dc_only(false)
+		, _dc_coefficients(_allocator.get())
+		, _capacity_estimate(nullptr)
+		, _decoding_stopped(false)
+		, _segment("")
+		, _charged_file_bytes(0)
+	{
+	}
+
+	/// Every other constructor comes here, the caller decides whether _status is thrown or returned
+	Jpeg(std::vector<unsigned char>&& file_content_, BlockHandler&& block_handler_, CapacityEstimate* capacity_estimate_,
+		std::shared_ptr<Allocator>&& allocator_) noexcept
+		: _allocator(allocator_ ? std::move(allocator_) : std::make_shared<Allocator>())
+		, _image_content(std::move(file_content_))
+		, _quantization_tables(_allocator.get())
+		, _picture_height(0)
+		, _picture_width(0)
+		, _restart_interval(0)
+		, _index_builder(nullptr)
+		, _index(nullptr)
+		, _region{ 0, 0, 0, 0 }
+		, _coefficients(_allocator.get())
+		, _dirty_blocks(_allocator.get())
+		, _dc_only(false)
+		, _dc_coefficients(_allocator.get())
+		, _block_handler(std::move(block_handler_))
+		, _capacity_estimate(capacity_estimate_)
+		, _decoding_stopped(false)
+		, _segment("")
+		, _charged_file_bytes(0)
+	{
+		this->decode();
+	}
 
 public:
 	/**
@@ -918,83 +1106,18 @@ public:
 	*            Application data                  _|
 	*
 	*/
-	Jpeg(const std::string& file_path_)
-		: _image_content(ImageFileBuffer(file_path_).Get())
+	Jpeg(const std::string& file_path_, BlockHandler block_handler_ = BlockHandler())
+		: Jpeg(ImageFileBuffer(file_path_).Get(), block_handler_)
 	{
-		// check_for_image_correctness(_image_content);
-
-		_quantization_tables.resize(0x10);
-
-		byte temp;
-		while ( _image_content >> temp )
-		{
-			if (temp != 0xFF)
-			{
-				throw std::exception("There must be 0xFF byte");
-			}
-			byte marker;
-			_image_content >> marker;
-				
-			switch (marker)
-			{
-			case SOI:
-				/*i += process_start_of_image(_image_content);*/
-				break;
-			case SOF0:
-				process_start_of_frame_baseline_DCT(_image_content);
-				break;
-			case SOF1:
-				process_start_of_frame_extended_sequential_DCT(_image_content);
-				break;
-			case SOF2:
-				process_start_of_frame_progressive_DCT(_image_content);
-				break;
-			case DHT:
-				process_huffman_table(_image_content);
-				break;
-			case DQT:
-				process_quantization_table(_image_content);
-				break;
-			case DRI:
-				process_restart_interval(_image_content);
-				break;
-			case SOS:
-				process_start_of_scan(_image_content);
-				break;
-			case RST0:
-			case RST1:
-			case RST2:
-			case RST3:
-			case RST4:
-			case RST5:
-			case RST6:
-			case RST7:
-				_image_content.BytesBack(1); // 1 is for understanding restart type
-				process_restart_interval(_image_content); 
-				break;
-			case APP0:
-			case APP1:
-			case APP2:
-			case APP3:
-			case APP4:
-			case APP5:
-			case APP6:
-			case APP7:
-				_image_content.BytesBack(1); // 1 is for understanding application type
-				process_application_specific(_image_content);
-				break;
-			case COM:
-				process_comment(_image_content);
-				break;
-			case EOI:
-				break;
-			//	process_end_of_image(_image_content);
-			default:
-				throw std::runtime_error("Found not supported yet marker: " + std::to_string(EOI));
-			}
-		}
-
+	}
 
+	/// Decodes the file, which is already read into memory, so reading and decoding may run on different threads.
+	/// The buffer may be taken back with ReleaseFileContent for reuse.
+	/// Malformed data is thrown as DecodeException.
+	Jpeg(std::vector<unsigned char>&& file_content_, BlockHandler block_handler_ = BlockHandler())
+		: Jpeg(std::move(file_content_), std::move(block_handler_), nullptr, nullptr)
+	{
+		this->throw_on_error();
 
 		/*tree = new HuffmanTree();
 		tree->AddElement(1, 1);
@@ -1016,6 +1139,115 @@ public:
 		i;*/
 	}
 
+	/// Capacity-only decoding: blocks are entropy decoded and counted into capacity_estimate_,
+	/// but neither stored nor dequantized
+	Jpeg(const std::string& file_path_, CapacityEstimate& capacity_estimate_)
+		: Jpeg(ImageFileBuffer(file_path_).Get(), capacity_estimate_)
+	{
+	}
+
+	Jpeg(std::vector<unsigned char>&& file_content_, CapacityEstimate& capacity_estimate_)
+		: Jpeg(std::move(file_content_), BlockHandler(), &capacity_estimate_, nullptr)
+	{
+		this->throw_on_error();
+	}
+
+	/// Non-throwing decoding for batches over untrusted files: the first error is returned in status_
+	/// with its offset and segment, the image holds whatever was decoded before it.
+	/// Memory of the image is taken from allocator_, a new default one when not given,
+	/// going over its budget stops the decoding with DecodeError::MemoryBudgetExceeded.
+	Jpeg(std::vector<unsigned char>&& file_content_, DecodeStatus& status_, BlockHandler block_handler_ = BlockHandler(),
+		std::shared_ptr<Allocator> allocator_ = nullptr) noexcept
+		: Jpeg(std::move(file_content_), std::move(block_handler_), nullptr, std::move(allocator_))
+	{
+		status_ = _status;
+	}
+
+	Jpeg(std::vector<unsigned char>&& file_content_, CapacityEstimate& capacity_estimate_, DecodeStatus& status_,
+		std::shared_ptr<Allocator> allocator_ = nullptr) noexcept
+		: Jpeg(std::move(file_content_), BlockHandler(), &capacity_estimate_, std::move(allocator_))
+	{
+		status_ = _status;
+	}
+
+	/// Decodes the whole file as the non-throwing constructor and checkpoints the decoder into index_ on the way,
+	/// index_ keeps its interval and drops the scans of any file it had before
+	Jpeg(std::vector<unsigned char>&& file_content_, JpegIndex& index_, DecodeStatus& status_,
+		std::shared_ptr<Allocator> allocator_ = nullptr) noexcept;
+
+	/// Region decoding: only the rows of MCUs under region_ are decoded, each from the nearest checkpoint of index_ before it,
+	/// and the decoder jumps over the rest of every scan. Blocks of every component under the region are stored or passed
+	/// to block_handler_, other coefficients stay zero, so GetSampleTile and GetCoefficientPlane give the same as after
+	/// a full decoding inside of the region. index_ must be built from this very file, DecodeError::InvalidIndex otherwise.
+	Jpeg(std::vector<unsigned char>&& file_content_, const JpegIndex& index_, const Region& region_, DecodeStatus& status_,
+		BlockHandler block_handler_ = BlockHandler(), std::shared_ptr<Allocator> allocator_ = nullptr) noexcept;
+
+	/// Non-throwing decoding for the output scaled down by scale_ of 1, 2, 4 or 8. At 1/8 only DC coefficients are kept:
+	/// AC ones are skipped by their Huffman codes and extra bits, never stored nor dequantized, so the image has
+	/// no coefficients and GetSamples and GetRgb give it at scale 8 alone. Other scales need every coefficient.
+	Jpeg(std::vector<unsigned char>&& file_content_, int scale_, DecodeStatus& status_, std::shared_ptr<Allocator> allocator_ = nullptr) noexcept;
+
+	static CapacityEstimate EstimateCapacity(const std::string& file_path_);
+	/// Content of the file, given to the constructor, for reuse by the next image
+	std::vector<unsigned char> ReleaseFileContent();
+
+	int GetWidth() const override;
+	int GetHeight() const override;
+	int GetComponentsCount() const override;
+	int GetBlocksPerLine(int component_) const;
+	int GetBlocksPerColumn(int component_) const;
+	/// Coefficients of the component, block after block in raster order, 64 per block in natural order.
+	/// Empty when blocks were passed to the BlockHandler instead.
+	const std::pmr::vector<short>& GetCoefficients(int component_) const;
+	/// Size of the component in samples, without padding to the whole blocks
+	int GetComponentWidth(int component_) const override;
+	int GetComponentHeight(int component_) const override;
+	bool HasCoefficients() const override;
+	/// GetCoefficients as blocks_per_line * blocks_per_column blocks, padding blocks included
+	PlaneView<const short> GetCoefficientPlane(int component_) const override;
+	/// Only the blocks under the tile are transformed, samples are the same as of GetSamples
+	PlaneView<const byte> GetSampleTile(int component_, int x_, int y_, int width_, int height_, std::vector<byte>& scratch_) const override;
+	/// Walks over the stored blocks in the same order, in which decoder met them in the scans,
+	/// that is the order of sequential embedding
+	void ForEachBlockInScanOrder(const std::function<void(const BlockPosition& position_, const short* coefficients_)>& visitor_) const;
+	/// The same walk with writable blocks, used to embed the payload before re-encoding
+	void ForEachBlockInScanOrder(const std::function<void(const BlockPosition& position_, short* coefficients_)>& visitor_);
+	/// Walks over the stored blocks of all components, padding blocks included, in the order of KeyedPermutation
+	/// of key_ over them, numbered component after component in raster order. Returning false stops the walk.
+	void ForEachBlockInKeyedOrder(const std::string& key_, const std::function<bool(const BlockPosition& position_, const short* coefficients_)>& visitor_) const;
+	void ForEachBlockInKeyedOrder(const std::string& key_, const std::function<bool(const BlockPosition& position_, short* coefficients_)>& visitor_);
+	/// Tells that coefficients of the block were changed: JpegWriter given the source file codes again only the restart
+	/// intervals holding such blocks and copies the others, so every change has to be marked
+	void MarkDirty(const BlockPosition& position_);
+	bool IsDirty(const BlockPosition& position_) const;
+	/// [A.3] Dequantized and inverse transformed samples of the component, width * height bytes without padding
+	std::vector<byte> GetSamples(int component_) const;
+	/// The same samples scaled down by scale_ of 1, 2, 4 or 8, ceil(width / scale_) * ceil(height / scale_) bytes.
+	/// Blocks go through the reduced inverse DCT of their lowest 8 / scale_ x 8 / scale_ coefficients, 1/8 is the DC alone.
+	std::vector<byte> GetSamples(int component_, int scale_) const;
+	/// The same samples before rounding and clamping, as used by DCTR features
+	std::vector<float> GetUnroundedSamples(int component_) const;
+	/// [JFIF] Interleaved RGB, width * height * 3 bytes. Subsampled chroma is replicated,
+	/// the single component image becomes gray.
+	std::vector<byte> GetRgb() const;
+	/// Interleaved RGB of the picture scaled down by scale_, ceil(width / scale_) * ceil(height / scale_) * 3 bytes
+	std::vector<byte> GetRgb(int scale_) const;
+	/// Color conversion alone, component_samples_ as returned by GetSamples for every component
+	std::vector<byte> ConvertToRgb(const std::vector<std::vector<byte>>& component_samples_) const;
+	/// 8x8 table in natural order
+	const std::pmr::vector<std::pmr::vector<int>>& GetQuantizationTable(int component_) const;
+	/// What the decoder did for this image, all zeros when built with STEGANASSIST_INSTRUMENTATION=0
+	const DecodeCounters& GetCounters() const;
+	/// The first error met while decoding, Ok for images built by the throwing constructors
+	const DecodeStatus& GetStatus() const;
+	/// Most bytes the image held at once: its structures and the file buffer,
+	/// for JpegDecoder the storage kept from the images decoded before counts only when this one uses it
+	std::size_t GetPeakBytes() const;
+	const Allocator& GetAllocator() const;
+	/// Profile of the ICC_PROFILE APP2 segments viewed in the file content, no profile when chunks are
+	/// missing or contradict each other. Valid until ReleaseFileContent.
+	IccProfile GetIccProfile() const;
+
 
 
 
@@ -0,0 +1,27 @@
+#include "JpegDecoder.h"
+
+JpegDecoder::JpegDecoder(std::shared_ptr<Allocator> allocator_)
+	: _jpeg(std::move(allocator_))
+{
+}
+
+Jpeg& JpegDecoder::Decode(std::vector<unsigned char>&& file_content_, DecodeStatus& status_, Jpeg::BlockHandler block_handler_) noexcept
+{
+	_jpeg.decode_again(std::move(file_content_), std::move(block_handler_), nullptr);
+	status_ = _jpeg._status;
+	return _jpeg;
+}
+
+Jpeg& JpegDecoder::Decode(std::vector<unsigned char>&& file_content_, Jpeg::CapacityEstimate& capacity_estimate_, DecodeStatus& status_) noexcept
+{
+	_jpeg.decode_again(std::move(file_content_), Jpeg::BlockHandler(), &capacity_estimate_);
+	status_ = _jpeg._status;
+	return _jpeg;
+}
+
+Jpeg& JpegDecoder::Decode(std::vector<unsigned char>&& file_content_, Jpeg::BlockHandler block_handler_)
+{
+	_jpeg.decode_again(std::move(file_content_), std::move(block_handler_), nullptr);
+	_jpeg.throw_on_error();
+	return _jpeg;
+}
\ No newline at end of file
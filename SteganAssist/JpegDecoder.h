@@ -0,0 +1,27 @@
+#pragma once
+#include<vector>
+#include<memory>
+#include"Jpeg.h"
+
+/// JpegDecoder class, that decodes file after file into the same Jpeg. Coefficient planes of the previous image
+/// are reused by the components of the same size, the rest is freed before the next image, so a batch of images
+/// of one size does no large allocations in steady state. Every image is charged to the allocator only for the storage
+/// it uses, its peak and budget verdict are the same as decoded alone.
+/// Huffman tables come from HuffmanCache. Every image stays valid up to the next Decode, one decoder belongs to one thread.
+class JpegDecoder
+{
+	Jpeg _jpeg;
+
+public:
+
+	/// Memory of every image is taken from allocator_, its budget bounds each of them
+	explicit JpegDecoder(std::shared_ptr<Allocator> allocator_ = nullptr);
+	JpegDecoder(const JpegDecoder&) = delete;
+	JpegDecoder& operator=(const JpegDecoder&) = delete;
+
+	/// As the non-throwing Jpeg constructors, the file buffer may be taken back by Jpeg::ReleaseFileContent
+	Jpeg& Decode(std::vector<unsigned char>&& file_content_, DecodeStatus& status_, Jpeg::BlockHandler block_handler_ = Jpeg::BlockHandler()) noexcept;
+	Jpeg& Decode(std::vector<unsigned char>&& file_content_, Jpeg::CapacityEstimate& capacity_estimate_, DecodeStatus& status_) noexcept;
+	/// As the throwing Jpeg constructors
+	Jpeg& Decode(std::vector<unsigned char>&& file_content_, Jpeg::BlockHandler block_handler_ = Jpeg::BlockHandler());
+};
\ No newline at end of file
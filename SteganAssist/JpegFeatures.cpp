@@ -0,0 +1,217 @@
+#include "JpegFeatures.h"
+#include "Jpeg.h"
+#include "JpegWriter.h"
+#include "Parallel.h"
+#include "Kernels.h"
+#include <cmath>
+#include <algorithm>
+
+int JpegFeatures::EstimateQuality(const Jpeg& jpeg_)
+{
+	const std::pmr::vector<std::pmr::vector<int>>& table = jpeg_.GetQuantizationTable(0);
+	double scale = 0;
+	for (int i = 0; i < 64; i++)
+	{
+		scale += 100.0 * table[i / 8][i % 8] / JpegWriter::standard_luminance_quantization[i];
+	}
+	scale /= 64;
+	int quality = scale <= 100 ? int(std::round((200 - scale) / 2)) : int(std::round(5000 / scale));
+	return std::min(std::max(quality, 1), 100);
+}
+
+std::vector<float> JpegFeatures::Dctr(const Jpeg& jpeg_, float quantization_step_, int threads_)
+{
+	const int truncation = 4;
+	const int bins = truncation + 1;
+	const int strip_height = 32;
+
+	if (quantization_step_ <= 0)
+	{
+		// the step recommended by the authors, 8 * (2 - QF / 50) above quality 50
+		int quality = EstimateQuality(jpeg_);
+		quantization_step_ = quality >= 50 ? 8.0f * (2.0f - quality / 50.0f) : 8.0f;
+		quantization_step_ = std::max(quantization_step_, 0.5f);
+	}
+	const float inverse_step = 1.0f / quantization_step_;
+
+	std::vector<float> samples = jpeg_.GetUnroundedSamples(0);
+	const int width = jpeg_.GetComponentWidth(0);
+	const int height = jpeg_.GetComponentHeight(0);
+	std::vector<float> features(dctr_size);
+	if (width < 8 || height < 8)
+	{
+		return features;
+	}
+	const int output_width = width - 7;
+	const int output_height = height - 7;
+
+	// B(k, l)(m, n) = f_k(m) * f_l(n), so every pattern is a row filter followed by a column filter
+	float basis[8][8];
+	const double pi = std::acos(-1.0);
+	for (int k = 0; k < 8; k++)
+	{
+		for (int m = 0; m < 8; m++)
+		{
+			basis[k][m] = float((k == 0 ? 1.0 : std::sqrt(2.0)) / std::sqrt(8.0) * std::cos(pi * k * (2 * m + 1) / 16));
+		}
+	}
+
+	// phases a and 8 - a give the same histograms up to symmetry of the basis patterns
+	int phase_class[8];
+	for (int a = 0; a < 8; a++)
+	{
+		phase_class[a] = std::min(a, (8 - a) % 8);
+	}
+
+	int threads = Parallel::ThreadsFor(threads_, size_t(output_width) * output_height);
+	std::vector<std::vector<unsigned int>> histograms(threads, std::vector<unsigned int>(dctr_size));
+
+	const KernelTable& kernels = Kernels::Get();
+	Parallel::Run(threads, [&](int thread_)
+	{
+		std::vector<unsigned int>& histogram = histograms[thread_];
+		// rows filtered by all 8 row filters, only for the current strip, so they stay in cache
+		std::vector<float> filtered_rows(8 * (strip_height + 7) * output_width);
+		std::vector<float> responses(output_width);
+		int strips = (output_height + strip_height - 1) / strip_height;
+		for (int strip = strips * thread_ / threads; strip < strips * (thread_ + 1) / threads; strip++)
+		{
+			int first_row = strip * strip_height;
+			int rows = std::min(strip_height, output_height - first_row);
+
+			for (int l = 0; l < 8; l++)
+			{
+				for (int y = 0; y < rows + 7; y++)
+				{
+					const float* input = samples.data() + (first_row + y) * width;
+					float* output = filtered_rows.data() + (l * (strip_height + 7) + y) * output_width;
+					kernels._filter_8_taps(input, 1, basis[l], output, output_width);
+				}
+			}
+
+			for (int k = 0; k < 8; k++)
+			{
+				for (int l = 0; l < 8; l++)
+				{
+					unsigned int* pattern_histogram = histogram.data() + (k * 8 + l) * 25 * bins;
+					for (int y = 0; y < rows; y++)
+					{
+						const float* input = filtered_rows.data() + (l * (strip_height + 7) + y) * output_width;
+						int row_class = phase_class[(first_row + y) % 8] * 5;
+						kernels._filter_8_taps(input, output_width, basis[k], responses.data(), output_width);
+						for (int x = 0; x < output_width; x++)
+						{
+							int quantized_value = std::min(int(std::fabs(responses[x]) * inverse_step + 0.5f), truncation);
+							pattern_histogram[(row_class + phase_class[x % 8]) * bins + quantized_value]++;
+						}
+					}
+				}
+			}
+		}
+	});
+
+	for (int i = 0; i < threads; i++)
+	{
+		for (int j = 0; j < dctr_size; j++)
+		{
+			features[j] += histograms[i][j];
+		}
+	}
+	// every histogram is normalized to the sum of 1
+	for (int i = 0; i < dctr_size; i += bins)
+	{
+		float sum = 0;
+		for (int j = 0; j < bins; j++)
+		{
+			sum += features[i + j];
+		}
+		for (int j = 0; sum > 0 && j < bins; j++)
+		{
+			features[i + j] /= sum;
+		}
+	}
+	return features;
+}
+
+std::vector<float> JpegFeatures::Jrm(const Image& image_, int threads_)
+{
+	const int truncation = 3;
+	const int bins = (truncation + 1) * (truncation + 1);
+	const int modes = 35;
+
+	const PlaneView<const short> blocks = image_.GetCoefficientPlane(0);
+	const int blocks_per_line = blocks._width;
+	const int blocks_per_column = blocks._height;
+
+	int mode_index[64];
+	std::fill(mode_index, mode_index + 64, -1);
+	for (int k = 0, mode = 0; k < 6; k++)
+	{
+		for (int l = 0; l < 6; l++)
+		{
+			if (k || l)
+			{
+				mode_index[k * 8 + l] = mode++;
+			}
+		}
+	}
+
+	int threads = Parallel::ThreadsFor(threads_, std::size_t(blocks_per_line) * blocks_per_column * 64);
+	std::vector<std::vector<unsigned int>> histograms(threads, std::vector<unsigned int>(jrm_size));
+
+	Parallel::Run(threads, [&](int thread_)
+	{
+		std::vector<unsigned int>& histogram = histograms[thread_];
+		auto truncated = [truncation](short value_) { return std::min<int>(std::abs(value_), truncation); };
+		for (int row = blocks_per_column * thread_ / threads; row < blocks_per_column * (thread_ + 1) / threads; row++)
+		{
+			for (int column = 0; column < blocks_per_line; column++)
+			{
+				const short* block = &blocks.At(column, row);
+				const short* right_block = column + 1 < blocks_per_line ? block + blocks._step : nullptr;
+				const short* lower_block = row + 1 < blocks_per_column ? block + blocks._stride : nullptr;
+				for (int i = 0; i < 64; i++)
+				{
+					int mode = mode_index[i];
+					if (mode < 0)
+					{
+						continue;
+					}
+					int value = truncated(block[i]) * (truncation + 1);
+					histogram[(0 * modes + mode) * bins + value + truncated(block[i + 1])]++;
+					histogram[(1 * modes + mode) * bins + value + truncated(block[i + 8])]++;
+					if (right_block)
+					{
+						histogram[(2 * modes + mode) * bins + value + truncated(right_block[i])]++;
+					}
+					if (lower_block)
+					{
+						histogram[(3 * modes + mode) * bins + value + truncated(lower_block[i])]++;
+					}
+				}
+			}
+		}
+	});
+
+	std::vector<float> features(jrm_size);
+	for (int i = 0; i < threads; i++)
+	{
+		for (int j = 0; j < jrm_size; j++)
+		{
+			features[j] += histograms[i][j];
+		}
+	}
+	for (int i = 0; i < jrm_size; i += bins)
+	{
+		float sum = 0;
+		for (int j = 0; j < bins; j++)
+		{
+			sum += features[i + j];
+		}
+		for (int j = 0; sum > 0 && j < bins; j++)
+		{
+			features[i + j] /= sum;
+		}
+	}
+	return features;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include<vector>
+#include"Image.h"
+
+class Jpeg;
+
+/// JpegFeatures class, that extracts high-dimensional features for classifier-based steganalysis.
+/// Work is split between threads by rows, every thread accumulates its own histograms, threads_ equal to 0
+/// means hardware concurrency.
+class JpegFeatures
+{
+public:
+
+	/// [Holub, Fridrich: Low-complexity features for JPEG steganalysis using undecimated DCT]
+	/// Unrounded luminance is convolved with all 64 8x8 DCT basis patterns, absolute values are quantized with
+	/// step quantization_step_ and truncated to 4. Histograms are collected for 25 phase classes of every pattern:
+	/// 64 * 25 * 5 = 8000 features. quantization_step_ equal to 0 derives the step from JPEG quality.
+	static std::vector<float> Dctr(const Jpeg& jpeg_, float quantization_step_ = 0, int threads_ = 0);
+	static const int dctr_size = 64 * 25 * 5;
+
+	/// Co-occurrences of absolute values of quantized luminance coefficients truncated to 3, in the spirit of
+	/// JPEG rich model: intra-block horizontal and vertical neighbours and the same mode in the right and lower
+	/// blocks, for the 35 modes of 6x6 low-frequency square without DC: 4 * 35 * 16 = 2240 features.
+	/// Images without coefficients give zero features.
+	static std::vector<float> Jrm(const Image& image_, int threads_ = 0);
+	static const int jrm_size = 4 * 35 * 16;
+
+	/// Quality factor, for which IJG scaling of [Table K.1] gives the closest luminance table
+	static int EstimateQuality(const Jpeg& jpeg_);
+};
\ No newline at end of file
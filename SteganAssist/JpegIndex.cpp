@@ -0,0 +1,164 @@
+#include "JpegIndex.h"
+#include "Deflate.h"
+#include <stdexcept>
+
+namespace
+{
+	const std::size_t header_size = 24;
+	const std::size_t scan_size = 12;
+	const std::size_t checkpoint_size = 21;
+
+	void append_u32(std::vector<byte>& output_, unsigned int value_)
+	{
+		for (int shift = 24; shift >= 0; shift -= 8)
+		{
+			output_.push_back(byte(value_ >> shift));
+		}
+	}
+
+	unsigned int read_u32(const byte* data_)
+	{
+		return unsigned(data_[0]) << 24 | data_[1] << 16 | data_[2] << 8 | data_[3];
+	}
+}
+
+JpegIndex::JpegIndex(int interval_)
+	: _interval(interval_)
+	, _file_size(0)
+	, _file_crc(0)
+{
+	if (interval_ <= 0)
+	{
+		throw std::invalid_argument("Checkpoint interval must be positive");
+	}
+}
+
+JpegIndex::JpegIndex(const std::vector<byte>& serialized_)
+	: JpegIndex()
+{
+	DecodeStatus status = this->parse(serialized_);
+	if (!status.Ok())
+	{
+		throw DecodeException(status);
+	}
+}
+
+JpegIndex::JpegIndex(const std::vector<byte>& serialized_, DecodeStatus& status_)
+	: JpegIndex()
+{
+	status_ = this->parse(serialized_);
+}
+
+DecodeStatus JpegIndex::parse(const std::vector<byte>& serialized_)
+{
+	const byte* data = serialized_.data();
+	const std::size_t size = serialized_.size();
+	if (size < header_size || read_u32(data) != magic || read_u32(data + 4) != version || !read_u32(data + 8) || read_u32(data + 8) > 0x7FFFFFFF)
+	{
+		return DecodeStatus(DecodeError::InvalidIndex, 0, "index");
+	}
+	std::vector<Scan> scans(std::min<std::size_t>(read_u32(data + 20), (size - header_size) / scan_size));
+	if (scans.size() != read_u32(data + 20))
+	{
+		return DecodeStatus(DecodeError::TruncatedData, int(size), "index");
+	}
+	const unsigned int file_size = read_u32(data + 12);
+	std::size_t offset = header_size;
+	for (Scan& scan : scans)
+	{
+		if (size - offset < scan_size)
+		{
+			return DecodeStatus(DecodeError::TruncatedData, int(size), "index");
+		}
+		unsigned int mcus = read_u32(data + offset);
+		unsigned int end_position = read_u32(data + offset + 4);
+		std::size_t checkpoints = read_u32(data + offset + 8);
+		offset += scan_size;
+		if (mcus > 0x7FFFFFFF || end_position > file_size || checkpoints > (size - offset) / checkpoint_size)
+		{
+			return DecodeStatus(DecodeError::InvalidIndex, int(offset - scan_size), "index");
+		}
+		scan._mcus = int(mcus);
+		scan._end_position = int(end_position);
+		scan._checkpoints.resize(checkpoints);
+		for (Checkpoint& checkpoint : scan._checkpoints)
+		{
+			unsigned int position = read_u32(data + offset);
+			if (position >= file_size || data[offset + 4] > 7)
+			{
+				return DecodeStatus(DecodeError::InvalidIndex, int(offset), "index");
+			}
+			checkpoint._position = int(position);
+			checkpoint._bit_position = data[offset + 4];
+			for (int i = 0; i < 4; i++)
+			{
+				checkpoint._dc_predictors[i] = int(read_u32(data + offset + 5 + 4 * i));
+			}
+			offset += checkpoint_size;
+		}
+	}
+	_interval = int(read_u32(data + 8));
+	_file_size = file_size;
+	_file_crc = read_u32(data + 16);
+	_scans = std::move(scans);
+	return DecodeStatus();
+}
+
+void JpegIndex::reset(const std::vector<byte>& file_content_)
+{
+	_file_size = unsigned(file_content_.size());
+	_file_crc = Deflate::Crc32(file_content_.data(), file_content_.size());
+	_scans.clear();
+}
+
+std::string JpegIndex::PathFor(const std::string& image_path_)
+{
+	return image_path_ + ".idx";
+}
+
+int JpegIndex::GetInterval() const
+{
+	return _interval;
+}
+
+const std::vector<JpegIndex::Scan>& JpegIndex::GetScans() const
+{
+	return _scans;
+}
+
+bool JpegIndex::Empty() const
+{
+	return _scans.empty();
+}
+
+bool JpegIndex::Matches(const std::vector<byte>& file_content_) const
+{
+	return !_scans.empty() && file_content_.size() == _file_size && Deflate::Crc32(file_content_.data(), file_content_.size()) == _file_crc;
+}
+
+std::vector<byte> JpegIndex::Serialize() const
+{
+	std::vector<byte> output;
+	append_u32(output, magic);
+	append_u32(output, version);
+	append_u32(output, unsigned(_interval));
+	append_u32(output, _file_size);
+	append_u32(output, _file_crc);
+	append_u32(output, unsigned(_scans.size()));
+	for (const Scan& scan : _scans)
+	{
+		append_u32(output, unsigned(scan._mcus));
+		append_u32(output, unsigned(scan._end_position));
+		append_u32(output, unsigned(scan._checkpoints.size()));
+		for (const Checkpoint& checkpoint : scan._checkpoints)
+		{
+			append_u32(output, unsigned(checkpoint._position));
+			output.push_back(byte(checkpoint._bit_position));
+			for (int i = 0; i < 4; i++)
+			{
+				append_u32(output, unsigned(checkpoint._dc_predictors[i]));
+			}
+		}
+	}
+	return output;
+}
\ No newline at end of file
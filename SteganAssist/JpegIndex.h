@@ -0,0 +1,69 @@
+#pragma once
+#include<vector>
+#include<string>
+#include"BitStream.h"
+#include"DecodeStatus.h"
+
+/// JpegIndex class, that checkpoints the entropy decoder every N MCUs of every scan: where the next bit is
+/// and the DC predictors, which is the whole state of a baseline decoder between MCUs. Jpeg fills it during
+/// a normal decoding and uses it to decode a region starting from the nearest checkpoint instead of the first MCU.
+/// Serialized, it is stored next to the file, the size and CRC-32 of the file tell whether it still belongs to it.
+class JpegIndex
+{
+	friend class Jpeg;
+
+public:
+
+	static const int default_interval = 32;
+
+	/// State of the decoder right before an MCU, after the restart marker in front of it, if any
+	struct Checkpoint
+	{
+		int _position;         // byte of the file holding the next bit
+		int _bit_position;     // bits of that byte already read
+		int _dc_predictors[4]; // of the scan components, in the order of the scan header
+	};
+
+	struct Scan
+	{
+		int _mcus;
+		int _end_position; // the marker after the entropy-coded data
+		std::vector<Checkpoint> _checkpoints; // before MCUs 0, interval, 2 * interval and so on
+	};
+
+private:
+
+	static const unsigned int magic = 0x53414A49; // "SAJI"
+	static const unsigned int version = 1;
+
+	int _interval;
+	unsigned int _file_size;
+	unsigned int _file_crc;
+	std::vector<Scan> _scans;
+
+	DecodeStatus parse(const std::vector<byte>& serialized_);
+	/// Forgets the scans, the index is built anew for file_content_
+	void reset(const std::vector<byte>& file_content_);
+
+public:
+
+	/// Empty index, a checkpoint every interval_ MCUs once Jpeg fills it
+	explicit JpegIndex(int interval_ = default_interval);
+	/// Serialized index, throws DecodeException when it is malformed
+	explicit JpegIndex(const std::vector<byte>& serialized_);
+	/// Non-throwing, malformed index is reported by status_ and left empty
+	JpegIndex(const std::vector<byte>& serialized_, DecodeStatus& status_);
+
+	/// Where the index of the image is stored by default: next to it, with .idx appended
+	static std::string PathFor(const std::string& image_path_);
+
+	int GetInterval() const;
+	const std::vector<Scan>& GetScans() const;
+	bool Empty() const;
+	/// Size and CRC-32 of the file are those the index was built from
+	bool Matches(const std::vector<byte>& file_content_) const;
+
+	/// Big-endian fields: magic, version, interval, file size and CRC, scans, then every scan
+	/// with its MCUs, end, checkpoints and the checkpoints themselves
+	std::vector<byte> Serialize() const;
+};
\ No newline at end of file
@@ -0,0 +1,295 @@
+#include "JpegStream.h"
+#include "Kernels.h"
+#include <cmath>
+#include <algorithm>
+
+JpegStream::JpegStream(std::shared_ptr<Allocator>&& allocator_)
+	: _jpeg(std::move(allocator_))
+	, _format(PixelFormat::Rgb)
+	, _started(false)
+	, _interleaved(false)
+	, _mcus_per_line(0)
+	, _blocks_per_row(0)
+	, _blocks_received(0)
+	, _mcu_row(0)
+	, _picture_rows(0)
+	, _block_rows(_jpeg._allocator.get())
+	, _coefficient_rows(_jpeg._allocator.get())
+	, _sample_rows(_jpeg._allocator.get())
+	, _upsampled_rows(_jpeg._allocator.get())
+	, _source_columns(_jpeg._allocator.get())
+	, _rgb_row(_jpeg._allocator.get())
+	, _coefficient_row{ 0, std::vector<PlaneView<short>>(), &_jpeg }
+	, _pixel_row{ 0, 0, std::vector<PlaneView<const byte>>() }
+{
+}
+
+JpegStream::JpegStream(std::vector<unsigned char>&& file_content_, CoefficientRowHandler handler_, DecodeStatus& status_,
+	std::shared_ptr<Allocator> allocator_) noexcept
+	: JpegStream(std::move(allocator_))
+{
+	_coefficient_handler = std::move(handler_);
+	this->decode(std::move(file_content_));
+	status_ = _jpeg._status;
+}
+
+JpegStream::JpegStream(std::vector<unsigned char>&& file_content_, PixelFormat format_, PixelRowHandler handler_, DecodeStatus& status_,
+	std::shared_ptr<Allocator> allocator_) noexcept
+	: JpegStream(std::move(allocator_))
+{
+	_pixel_handler = std::move(handler_);
+	_format = format_;
+	this->decode(std::move(file_content_));
+	status_ = _jpeg._status;
+}
+
+void JpegStream::decode(std::vector<unsigned char>&& file_content_) noexcept
+{
+	_jpeg._image_content = InputBitStream(std::move(file_content_));
+	_jpeg._block_handler = [this](const Jpeg::BlockPosition& position_, const short* coefficients_)
+	{
+		return this->consume_block(position_, coefficients_);
+	};
+	_jpeg.decode();
+}
+
+bool JpegStream::consume_block(const Jpeg::BlockPosition& position_, const short* coefficients_)
+{
+	// a second scan means the first one did not carry every component
+	if (_jpeg._scans.size() != 1 || (!_started && !this->start()))
+	{
+		_jpeg.fail(DecodeError::NotStreamable);
+		return false;
+	}
+	const int component = position_._component;
+	const std::size_t row = position_._row - _mcu_row * _block_rows[component];
+	const std::size_t block_index = row * _jpeg._frames[component]._blocks_per_line + position_._column;
+	std::copy(coefficients_, coefficients_ + 64, _coefficient_rows[component].begin() + block_index * 64);
+	if (++_blocks_received < _blocks_per_row)
+	{
+		return true;
+	}
+	_blocks_received = 0;
+	bool go_on = this->emit_row();
+	_mcu_row++;
+	return go_on;
+}
+
+bool JpegStream::start()
+{
+	const std::vector<Jpeg::ScanComponent>& scan_components = _jpeg._scan_components;
+	const std::size_t components = _jpeg._frames.size();
+	if (scan_components.size() != components)
+	{
+		return false;
+	}
+	_interleaved = components > 1;
+	int mcus_per_column;
+	_jpeg.calculate_scan_size(scan_components, _mcus_per_line, mcus_per_column);
+	_picture_rows = _interleaved ? 8 * _jpeg._max_vertical_thinning : 8;
+
+	_block_rows.assign(components, 1);
+	_coefficient_rows.resize(components);
+	_coefficient_row._components.resize(components);
+	_blocks_per_row = 0;
+	for (const Jpeg::ScanComponent& scan_component : scan_components)
+	{
+		const int c = scan_component._frame_index;
+		const Jpeg::Frame& frame = _jpeg._frames[c];
+		const int vertical_blocks = _interleaved ? frame._vertical_thinning : 1;
+		const int horizontal_blocks = _interleaved ? frame._horizontal_thinning : 1;
+		_block_rows[c] = vertical_blocks;
+		_blocks_per_row += _mcus_per_line * horizontal_blocks * vertical_blocks;
+		_coefficient_rows[c].assign(std::size_t(frame._blocks_per_line) * vertical_blocks * 64, 0);
+		_coefficient_row._components[c] = PlaneView<short>(_coefficient_rows[c].data(), frame._blocks_per_line, vertical_blocks,
+			std::ptrdiff_t(frame._blocks_per_line) * 64, 64);
+	}
+
+	if (_pixel_handler)
+	{
+		const int width = _jpeg._picture_width;
+		_sample_rows.resize(components);
+		_upsampled_rows.resize(components);
+		_source_columns.resize(components);
+		_pixel_row._planes.resize(_format == PixelFormat::Rgb ? 1 : components);
+		for (std::size_t c = 0; c < components; c++)
+		{
+			const Jpeg::Frame& frame = _jpeg._frames[c];
+			_sample_rows[c].resize(std::size_t(frame._blocks_per_line) * 8 * _block_rows[c] * 8);
+			if (frame._horizontal_thinning != _jpeg._max_horizontal_thinning || frame._vertical_thinning != _jpeg._max_vertical_thinning)
+			{
+				_upsampled_rows[c].resize(std::size_t(width) * _picture_rows);
+				_source_columns[c].resize(width);
+				for (int x = 0; x < width; x++)
+				{
+					_source_columns[c][x] = x * frame._horizontal_thinning / _jpeg._max_horizontal_thinning;
+				}
+			}
+		}
+		if (_format == PixelFormat::Rgb)
+		{
+			_rgb_row.resize(std::size_t(width) * _picture_rows * 3);
+		}
+	}
+	_started = true;
+	return true;
+}
+
+bool JpegStream::emit_row()
+{
+	if (_coefficient_handler)
+	{
+		_coefficient_row._mcu_row = _mcu_row;
+		return _coefficient_handler(_coefficient_row);
+	}
+	this->transform_row();
+	this->convert_row();
+	return _pixel_handler(_pixel_row);
+}
+
+void JpegStream::transform_row()
+{
+	const KernelTable& kernels = Kernels::Get();
+	int table[64];
+	float dequantized[64], block_samples[64];
+	for (std::size_t c = 0; c < _jpeg._frames.size(); c++)
+	{
+		const Jpeg::Frame& frame = _jpeg._frames[c];
+		const std::pmr::vector<std::pmr::vector<int>>& quantization_table = _jpeg._quantization_tables[frame._id_of_quantization_table];
+		for (int i = 0; i < 64; i++)
+		{
+			table[i] = quantization_table[i / 8][i % 8];
+		}
+		// blocks right of the component are padding of the MCUs, nothing shows them
+		const int columns = (_jpeg.GetComponentWidth(int(c)) + 7) / 8;
+		const std::size_t width = std::size_t(frame._blocks_per_line) * 8;
+		for (int row = 0; row < _block_rows[c]; row++)
+		{
+			for (int column = 0; column < columns; column++)
+			{
+				const short* coefficients = _coefficient_rows[c].data() + (std::size_t(row) * frame._blocks_per_line + column) * 64;
+				kernels._dequantize(coefficients, table, dequantized, 1);
+				kernels._inverse_dct(dequantized, block_samples);
+
+				// [A.3.1] level shift back to unsigned samples, rounded as in Jpeg::GetSamples
+				byte* destination = _sample_rows[c].data() + std::size_t(row) * 8 * width + column * 8;
+				for (int y = 0; y < 8; y++)
+				{
+					for (int x = 0; x < 8; x++)
+					{
+						destination[y * width + x] = byte(std::min(std::max(std::round(block_samples[y * 8 + x] + 128.0f), 0.0f), 255.0f));
+					}
+				}
+			}
+		}
+	}
+}
+
+void JpegStream::convert_row()
+{
+	const int width = _jpeg._picture_width;
+	const int first_y = _mcu_row * _picture_rows;
+	const int height = std::min(_picture_rows, _jpeg._picture_height - first_y);
+	_pixel_row._y = first_y;
+	_pixel_row._height = height;
+
+	// planes of the components at the picture size, subsampled ones replicated into _upsampled_rows
+	PlaneView<const byte> planes[4];
+	const std::size_t components = std::min<std::size_t>(_jpeg._frames.size(), 4);
+	for (std::size_t c = 0; c < components; c++)
+	{
+		const Jpeg::Frame& frame = _jpeg._frames[c];
+		const std::ptrdiff_t sample_width = std::ptrdiff_t(frame._blocks_per_line) * 8;
+		const byte* samples = _sample_rows[c].data();
+		if (_upsampled_rows[c].empty())
+		{
+			planes[c] = PlaneView<const byte>(samples, width, height, sample_width);
+			continue;
+		}
+		const int first_sample_row = _mcu_row * _block_rows[c] * 8;
+		for (int y = 0; y < height; y++)
+		{
+			const byte* source = samples + ((first_y + y) * frame._vertical_thinning / _jpeg._max_vertical_thinning - first_sample_row) * sample_width;
+			byte* destination = _upsampled_rows[c].data() + std::size_t(y) * width;
+			for (int x = 0; x < width; x++)
+			{
+				destination[x] = source[_source_columns[c][x]];
+			}
+		}
+		planes[c] = PlaneView<const byte>(_upsampled_rows[c].data(), width, height, width);
+	}
+
+	if (_format == PixelFormat::YCbCr)
+	{
+		for (std::size_t c = 0; c < _pixel_row._planes.size(); c++)
+		{
+			_pixel_row._planes[c] = c < components ? planes[c] : PlaneView<const byte>();
+		}
+		return;
+	}
+	const KernelTable& kernels = Kernels::Get();
+	for (int y = 0; y < height; y++)
+	{
+		byte* rgb = _rgb_row.data() + std::size_t(y) * width * 3;
+		if (components < 3)
+		{
+			const byte* gray = planes[0].Row(y);
+			for (int x = 0; x < width; x++)
+			{
+				rgb[x * 3] = rgb[x * 3 + 1] = rgb[x * 3 + 2] = gray[x];
+			}
+			continue;
+		}
+		kernels._ycbcr_to_rgb(planes[0].Row(y), planes[1].Row(y), planes[2].Row(y), rgb, width);
+	}
+	_pixel_row._planes[0] = PlaneView<const byte>(_rgb_row.data(), width, height, std::ptrdiff_t(width) * 3, 3);
+}
+
+void JpegStream::ForEachBlockInScanOrder(CoefficientRow& row_, const std::function<void(const Jpeg::BlockPosition& position_, short* coefficients_)>& visitor_)
+{
+	// the same MCU walk, as in Jpeg::decode_mcu
+	const std::vector<Jpeg::ScanComponent>& scan_components = row_._image->_scans.front();
+	const bool interleaved = scan_components.size() > 1;
+	int mcus_per_line, mcus_per_column;
+	row_._image->calculate_scan_size(scan_components, mcus_per_line, mcus_per_column);
+	for (int mcu_column = 0; mcu_column < mcus_per_line; mcu_column++)
+	{
+		for (const Jpeg::ScanComponent& scan_component : scan_components)
+		{
+			const Jpeg::Frame& frame = row_._image->_frames[scan_component._frame_index];
+			const int vertical_blocks = interleaved ? frame._vertical_thinning : 1;
+			const int horizontal_blocks = interleaved ? frame._horizontal_thinning : 1;
+			for (int v = 0; v < vertical_blocks; v++)
+			{
+				for (int h = 0; h < horizontal_blocks; h++)
+				{
+					Jpeg::BlockPosition position;
+					position._component = scan_component._frame_index;
+					position._row = row_._mcu_row * vertical_blocks + v;
+					position._column = mcu_column * horizontal_blocks + h;
+					visitor_(position, &row_._components[position._component].At(position._column, v));
+				}
+			}
+		}
+	}
+}
+
+const Jpeg& JpegStream::GetJpeg() const
+{
+	return _jpeg;
+}
+
+std::size_t JpegStream::GetPeakBytes() const
+{
+	return _jpeg.GetPeakBytes();
+}
+
+void JpegStream::ThrowOnError() const
+{
+	_jpeg.throw_on_error();
+}
+
+std::vector<unsigned char> JpegStream::ReleaseFileContent()
+{
+	return _jpeg.ReleaseFileContent();
+}
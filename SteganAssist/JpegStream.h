@@ -0,0 +1,103 @@
+#pragma once
+#include<vector>
+#include<memory>
+#include<memory_resource>
+#include<functional>
+#include"Jpeg.h"
+
+/// JpegStream class, that decodes the image a row of MCUs at a time and hands every row to the caller as soon as
+/// its last block is decoded. Only the blocks and samples of the current row are kept, in buffers reused by the next
+/// one, so besides the file the memory grows with the width of the image and never with its height. Chroma is
+/// replicated as by Jpeg::GetRgb, which needs no rows of the neighbouring MCUs, so one row is all the upsampler holds.
+/// Components have to be interleaved in a single scan: separate scans come one whole plane after another, and such
+/// files stop with DecodeError::NotStreamable at their first block.
+class JpegStream
+{
+public:
+
+	/// Blocks of one row of MCUs, for every component its blocks_per_line x V blocks of the row (one block row,
+	/// when the only component is not interleaved). Element x, y is the first of 64 coefficients in natural order,
+	/// as of Jpeg::GetCoefficientPlane, the coefficients may be changed in place.
+	struct CoefficientRow
+	{
+		int _mcu_row;
+		std::vector<PlaneView<short>> _components;
+		const Jpeg* _image; // frame and tables, the image itself stores no coefficients
+	};
+
+	enum class PixelFormat
+	{
+		YCbCr, // a plane of every component, subsampled ones replicated to the picture size
+		Rgb,   // a single plane, element x, y is the red sample of the pixel, green and blue follow it
+	};
+
+	/// Picture rows [_y, _y + _height) under one row of MCUs, the last one is cut at the bottom of the picture
+	struct PixelRow
+	{
+		int _y;
+		int _height;
+		std::vector<PlaneView<const byte>> _planes;
+	};
+
+	/// Returning false stops the decoding, nothing after that row is read
+	typedef std::function<bool(CoefficientRow& row_)> CoefficientRowHandler;
+	typedef std::function<bool(const PixelRow& row_)> PixelRowHandler;
+
+private:
+
+	Jpeg _jpeg; // declared first, the row buffers take their memory from its allocator
+	CoefficientRowHandler _coefficient_handler;
+	PixelRowHandler _pixel_handler;
+	PixelFormat _format;
+	bool _started;
+	bool _interleaved;
+	int _mcus_per_line;
+	int _blocks_per_row;   // of all components in a row of MCUs
+	int _blocks_received;  // of the current row
+	int _mcu_row;
+	int _picture_rows;     // under a row of MCUs
+	std::pmr::vector<int> _block_rows;                             // of every component in a row of MCUs
+	std::pmr::vector<std::pmr::vector<short>> _coefficient_rows;   // 64 coefficients per block of the current row
+	std::pmr::vector<std::pmr::vector<byte>> _sample_rows;         // samples of the current row, padded to whole blocks
+	std::pmr::vector<std::pmr::vector<byte>> _upsampled_rows;      // subsampled components replicated to the picture width
+	std::pmr::vector<std::pmr::vector<int>> _source_columns;       // column of every picture sample in the component
+	std::pmr::vector<byte> _rgb_row;
+	CoefficientRow _coefficient_row;
+	PixelRow _pixel_row;
+
+	explicit JpegStream(std::shared_ptr<Allocator>&& allocator_);
+
+	void decode(std::vector<unsigned char>&& file_content_) noexcept;
+	/// Stores the block into the row, passes the row on when it is the last block of it
+	bool consume_block(const Jpeg::BlockPosition& position_, const short* coefficients_);
+	/// Sizes the row buffers at the first block, false when the scan does not carry every component
+	bool start();
+	bool emit_row();
+	/// Dequantized and inverse transformed samples of every component of the row
+	void transform_row();
+	/// Planes of the picture rows of the current row, as _format asks
+	void convert_row();
+
+public:
+
+	/// Non-throwing streaming of blocks, failures are returned in status_ as by the Jpeg constructors
+	JpegStream(std::vector<unsigned char>&& file_content_, CoefficientRowHandler handler_, DecodeStatus& status_,
+		std::shared_ptr<Allocator> allocator_ = nullptr) noexcept;
+	/// The same with the rows transformed into pixels of format_
+	JpegStream(std::vector<unsigned char>&& file_content_, PixelFormat format_, PixelRowHandler handler_, DecodeStatus& status_,
+		std::shared_ptr<Allocator> allocator_ = nullptr) noexcept;
+	JpegStream(const JpegStream&) = delete;
+	JpegStream& operator=(const JpegStream&) = delete;
+
+	/// Walks over the blocks of the row in the order, in which decoder met them, that is the order of sequential embedding
+	static void ForEachBlockInScanOrder(CoefficientRow& row_, const std::function<void(const Jpeg::BlockPosition& position_, short* coefficients_)>& visitor_);
+
+	/// Frame and tables of the image, its coefficients are never stored
+	const Jpeg& GetJpeg() const;
+	/// Most bytes held at once: the file and the buffers of a single row
+	std::size_t GetPeakBytes() const;
+	/// Reports the failure as the throwing Jpeg constructors do, exceptions of the handler are rethrown as they are
+	void ThrowOnError() const;
+	/// Content of the file, given to the constructor, for reuse by the next image
+	std::vector<unsigned char> ReleaseFileContent();
+};
@@ -0,0 +1,680 @@
+#include "JpegWriter.h"
+#include "Jpeg.h"
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace
+{
+	// [Table K.3] Table for luminance DC coefficient differences
+	const byte luminance_dc_bits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+	const byte luminance_dc_values[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+	// [Table K.4] Table for chrominance DC coefficient differences
+	const byte chrominance_dc_bits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+	const byte chrominance_dc_values[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+	// [Table K.5] Table for luminance AC coefficients
+	const byte luminance_ac_bits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D };
+	const byte luminance_ac_values[162] =
+	{
+		0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+		0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+		0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+		0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+		0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+		0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+		0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+		0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+		0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+		0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+		0xF9, 0xFA,
+	};
+
+	// [Table K.6] Table for chrominance AC coefficients
+	const byte chrominance_ac_bits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+	const byte chrominance_ac_values[162] =
+	{
+		0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+		0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+		0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+		0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+		0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+		0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+		0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+		0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+		0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+		0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+		0xF9, 0xFA,
+	};
+
+	// Table B.1 markers used by the writer
+	const byte SOI = 0xD8, EOI = 0xD9, SOF0 = 0xC0, DHT = 0xC4, DQT = 0xDB, DRI = 0xDD, SOS = 0xDA, RST0 = 0xD0, TEM = 0x01;
+
+	/// Luminance gets the tables of destination 0, all other components share destination 1
+	int table_of_component(int component_)
+	{
+		return component_ == 0 ? 0 : 1;
+	}
+
+	/// [Table F.1], [Table F.2] number of bits in the magnitude of the value
+	int category_of(int value_)
+	{
+		int category = 0;
+		for (int magnitude = std::abs(value_); magnitude; magnitude >>= 1)
+		{
+			category++;
+		}
+		return category;
+	}
+}
+
+const int JpegWriter::standard_luminance_quantization[64] =
+{
+	16, 11, 10, 16, 24, 40, 51, 61,
+	12, 12, 14, 19, 26, 58, 60, 55,
+	14, 13, 16, 24, 40, 57, 69, 56,
+	14, 17, 22, 29, 51, 87, 80, 62,
+	18, 22, 37, 56, 68, 109, 103, 77,
+	24, 35, 55, 64, 81, 104, 113, 92,
+	49, 64, 78, 87, 103, 121, 120, 101,
+	72, 92, 95, 98, 112, 100, 103, 99,
+};
+
+const int JpegWriter::standard_chrominance_quantization[64] =
+{
+	17, 18, 24, 47, 99, 99, 99, 99,
+	18, 21, 26, 66, 99, 99, 99, 99,
+	24, 26, 56, 99, 99, 99, 99, 99,
+	47, 66, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+std::vector<int> JpegWriter::ScaledQuantizationTable(const int* standard_table_, int quality_)
+{
+	quality_ = std::min(std::max(quality_, 1), 100);
+	int scale = quality_ < 50 ? 5000 / quality_ : 200 - 2 * quality_;
+	std::vector<int> table(64);
+	for (int i = 0; i < 64; i++)
+	{
+		table[i] = std::min(std::max((standard_table_[i] * scale + 50) / 100, 1), 255);
+	}
+	return table;
+}
+
+JpegWriter::JpegWriter(const Jpeg& jpeg_, std::vector<byte>&& recycled_)
+	: _jpeg(jpeg_)
+	, _output(std::move(recycled_))
+	, _dc_predictors(jpeg_._frames.size())
+	, _dc_codes(jpeg_._frames.size())
+	, _ac_codes(jpeg_._frames.size())
+	, _stream(nullptr)
+	, _mcu(0)
+	, _restart_interval(jpeg_._restart_interval)
+{
+	if (!_jpeg.has_coefficients())
+	{
+		throw std::runtime_error("Image was decoded without storing coefficients");
+	}
+	this->write_image();
+}
+
+JpegWriter::JpegWriter(const Jpeg& jpeg_, const std::vector<byte>& source_, std::vector<byte>&& recycled_)
+	: _jpeg(jpeg_)
+	, _output(std::move(recycled_))
+	, _dc_predictors(jpeg_._frames.size())
+	, _dc_codes(jpeg_._frames.size())
+	, _ac_codes(jpeg_._frames.size())
+	, _stream(nullptr)
+	, _mcu(0)
+	, _restart_interval(jpeg_._restart_interval)
+{
+	if (!_jpeg.has_coefficients())
+	{
+		throw std::runtime_error("Image was decoded without storing coefficients");
+	}
+	if (!this->source_matches(source_))
+	{
+		throw std::invalid_argument("Source is not the file the image was decoded from");
+	}
+	try
+	{
+		this->write_incremental(source_);
+	}
+	catch (const std::runtime_error&)
+	{
+		// a changed coefficient fell into a category, which the source tables never needed
+		_output = OutputBitStream(_output.Release());
+		this->write_reencoded(source_);
+	}
+}
+
+JpegWriter::JpegWriter(const Jpeg& jpeg_, std::ostream& output_)
+	: _jpeg(jpeg_)
+	, _dc_predictors(jpeg_._frames.size())
+	, _dc_codes(jpeg_._frames.size())
+	, _ac_codes(jpeg_._frames.size())
+	, _stream(&output_)
+	, _mcu(0)
+	, _restart_interval(jpeg_._restart_interval)
+{
+	if (_jpeg._scans.size() != 1 || _jpeg._scan_layouts.size() != 1)
+	{
+		throw std::runtime_error("Only images of a single scan are encoded while streaming");
+	}
+	// metadata, quantization tables and frame of the source are kept, the scan is coded with the standard tables
+	this->load_standard_tables();
+	this->copy_segments_but_tables(_jpeg._image_content.Data(), 0, this->scan_header_start(0));
+	this->write_huffman_tables();
+	this->write_scan_header(0);
+	this->flush();
+}
+
+void JpegWriter::write_image()
+{
+	this->write_headers();
+	for (int scan = 0; scan < _jpeg._scans.size(); scan++)
+	{
+		this->write_scan(scan);
+	}
+	this->write_marker(EOI);
+}
+
+void JpegWriter::load_standard_tables()
+{
+	_dc_tables[0] = HuffmanCache::Get(luminance_dc_bits, luminance_dc_values);
+	_dc_tables[1] = HuffmanCache::Get(chrominance_dc_bits, chrominance_dc_values);
+	_ac_tables[0] = HuffmanCache::Get(luminance_ac_bits, luminance_ac_values);
+	_ac_tables[1] = HuffmanCache::Get(chrominance_ac_bits, chrominance_ac_values);
+}
+
+void JpegWriter::write_headers()
+{
+	this->load_standard_tables();
+	this->write_marker(SOI);
+	this->write_quantization_tables();
+	this->write_start_of_frame();
+	this->write_huffman_tables();
+	this->write_restart_interval();
+}
+
+int JpegWriter::scan_header_start(int scan_) const
+{
+	// [B.2.3] marker, Ls, Ns, selector and table destinations of every component, Ss, Se, Ah and Al
+	return _jpeg._scan_layouts[scan_]._data_start - 8 - 2 * int(_jpeg._scans[scan_].size());
+}
+
+void JpegWriter::copy_segments_but_tables(const byte* source_, int begin_, int end_)
+{
+	for (int position = begin_; position + 1 < end_;)
+	{
+		byte marker = source_[position + 1];
+		if (marker == 0xFF)
+		{
+			position++; // [B.1.1.2] fill byte before the marker
+			continue;
+		}
+		// [B.1.1.3] SOI, RSTn and TEM stand alone, the others are followed by the length
+		int size = 2;
+		if (marker != SOI && marker != TEM && (marker & 0xF8) != RST0 && position + 3 < end_)
+		{
+			size += source_[position + 2] << 8 | source_[position + 3];
+		}
+		size = std::min(size, end_ - position);
+		if (marker != DHT)
+		{
+			_output.WriteBytes(source_ + position, size);
+		}
+		position += size;
+	}
+}
+
+void JpegWriter::write_marker(byte marker_)
+{
+	_output << byte(0xFF) << marker_;
+}
+
+void JpegWriter::write_word(int value_)
+{
+	_output << byte(value_ >> 8) << byte(value_ & 0xFF);
+}
+
+void JpegWriter::write_quantization_tables()
+{
+	// [B.2.4.1] only the tables referred by the frame, values in zigzag order
+	std::vector<bool> written(_jpeg._quantization_tables.size());
+	for (int i = 0; i < _jpeg._frames.size(); i++)
+	{
+		int table_id = _jpeg._frames[i]._id_of_quantization_table;
+		if (written[table_id])
+		{
+			continue;
+		}
+		written[table_id] = true;
+		const std::pmr::vector<std::pmr::vector<int>>& table = _jpeg._quantization_tables[table_id];
+		bool precise = false;
+		for (int j = 0; j < 64; j++)
+		{
+			precise |= table[j / 8][j % 8] > 0xFF;
+		}
+		this->write_marker(DQT);
+		this->write_word(2 + 1 + (precise ? 128 : 64));
+		_output << byte((precise << 4) | table_id);
+		for (int j = 0; j < 64; j++)
+		{
+			int natural = _jpeg._zigzag_to_natural[j];
+			int value = table[natural / 8][natural % 8];
+			if (precise)
+			{
+				_output << byte(value >> 8);
+			}
+			_output << byte(value & 0xFF);
+		}
+	}
+}
+
+void JpegWriter::write_start_of_frame()
+{
+	// [B.2.2]
+	this->write_marker(SOF0);
+	this->write_word(8 + 3 * _jpeg._frames.size());
+	_output << byte(8);
+	this->write_word(_jpeg._picture_height);
+	this->write_word(_jpeg._picture_width);
+	_output << byte(_jpeg._frames.size());
+	for (int i = 0; i < _jpeg._frames.size(); i++)
+	{
+		const Jpeg::Frame& frame = _jpeg._frames[i];
+		_output << frame._id << byte((frame._horizontal_thinning << 4) | frame._vertical_thinning) << frame._id_of_quantization_table;
+	}
+}
+
+void JpegWriter::write_huffman_tables()
+{
+	this->write_huffman_table(0, 0, luminance_dc_bits, luminance_dc_values);
+	this->write_huffman_table(1, 0, luminance_ac_bits, luminance_ac_values);
+	if (_jpeg._frames.size() > 1)
+	{
+		this->write_huffman_table(0, 1, chrominance_dc_bits, chrominance_dc_values);
+		this->write_huffman_table(1, 1, chrominance_ac_bits, chrominance_ac_values);
+	}
+}
+
+void JpegWriter::write_huffman_table(int class_, int id_, const byte* bits_, const byte* values_)
+{
+	// [B.2.4.2]
+	int number_of_values = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		number_of_values += bits_[i];
+	}
+	this->write_marker(DHT);
+	this->write_word(2 + 1 + 16 + number_of_values);
+	_output << byte((class_ << 4) | id_);
+	for (int i = 0; i < 16; i++)
+	{
+		_output << bits_[i];
+	}
+	for (int i = 0; i < number_of_values; i++)
+	{
+		_output << values_[i];
+	}
+}
+
+void JpegWriter::write_restart_interval()
+{
+	// [B.2.4.4]
+	if (_jpeg._restart_interval)
+	{
+		this->write_marker(DRI);
+		this->write_word(4);
+		this->write_word(_jpeg._restart_interval);
+	}
+}
+
+void JpegWriter::write_scan(int scan_)
+{
+	this->write_scan_header(scan_);
+	int mcus_per_line, mcus_per_column;
+	_jpeg.calculate_scan_size(_jpeg._scans[scan_], mcus_per_line, mcus_per_column);
+	std::vector<PlaneView<const short>> planes(_jpeg._frames.size());
+	for (int i = 0; i < planes.size(); i++)
+	{
+		planes[i] = _jpeg.GetCoefficientPlane(i);
+	}
+	for (int mcu = 0; mcu < mcus_per_line * mcus_per_column; mcu++)
+	{
+		this->restart_if_due(mcu);
+		this->encode_mcu(scan_, mcu, mcus_per_line, mcu / mcus_per_line, planes);
+	}
+	this->end_scan();
+}
+
+bool JpegWriter::source_matches(const std::vector<byte>& source_) const
+{
+	const std::vector<Jpeg::ScanLayout>& layouts = _jpeg._scan_layouts;
+	if (layouts.size() != _jpeg._scans.size())
+	{
+		return false;
+	}
+	int copied = 0;
+	for (int scan = 0; scan < layouts.size(); scan++)
+	{
+		const Jpeg::ScanLayout& layout = layouts[scan];
+		if (layout._data_start < copied || layout._data_end < layout._data_start || layout._data_end > int(source_.size()))
+		{
+			return false;
+		}
+		int mcus_per_line, mcus_per_column;
+		_jpeg.calculate_scan_size(_jpeg._scans[scan], mcus_per_line, mcus_per_column);
+		int mcus = mcus_per_line * mcus_per_column;
+		int interval = layout._restart_interval ? layout._restart_interval : mcus;
+		int end_of_intervals = scan + 1 < layouts.size() ? layouts[scan + 1]._first_interval : int(_jpeg._interval_starts.size());
+		if (!mcus || end_of_intervals - layout._first_interval != (mcus + interval - 1) / interval)
+		{
+			return false;
+		}
+		// every interval but the first one follows its RSTn marker
+		for (int k = layout._first_interval + 1; k < end_of_intervals; k++)
+		{
+			int start = _jpeg._interval_starts[k];
+			if (start - 2 < _jpeg._interval_starts[k - 1] || start > layout._data_end || source_[start - 2] != 0xFF || (source_[start - 1] & 0xF8) != RST0)
+			{
+				return false;
+			}
+		}
+		for (const Jpeg::ScanComponent& scan_component : _jpeg._scans[scan])
+		{
+			if (!layout._huffman_tables[scan_component._id_of_DC_table][Jpeg::DC] || !layout._huffman_tables[scan_component._id_of_AC_table][Jpeg::AC])
+			{
+				return false;
+			}
+		}
+		copied = layout._data_end;
+	}
+	return true;
+}
+
+void JpegWriter::write_incremental(const std::vector<byte>& source_)
+{
+	std::vector<PlaneView<const short>> planes(_jpeg._frames.size());
+	for (int i = 0; i < planes.size(); i++)
+	{
+		planes[i] = _jpeg.GetCoefficientPlane(i);
+	}
+	int copied = 0; // everything of the source before it is in the output
+	for (int scan = 0; scan < _jpeg._scans.size(); scan++)
+	{
+		const Jpeg::ScanLayout& layout = _jpeg._scan_layouts[scan];
+		for (const Jpeg::ScanComponent& scan_component : _jpeg._scans[scan])
+		{
+			_dc_codes[scan_component._frame_index] = layout._huffman_tables[scan_component._id_of_DC_table][Jpeg::DC]->_encoding;
+			_ac_codes[scan_component._frame_index] = layout._huffman_tables[scan_component._id_of_AC_table][Jpeg::AC]->_encoding;
+		}
+		// segments between the scans and the scan header itself
+		_output.WriteBytes(source_.data() + copied, layout._data_start - copied);
+
+		int mcus_per_line, mcus_per_column;
+		_jpeg.calculate_scan_size(_jpeg._scans[scan], mcus_per_line, mcus_per_column);
+		int mcus = mcus_per_line * mcus_per_column;
+		int interval = layout._restart_interval ? layout._restart_interval : mcus;
+		int intervals = (mcus + interval - 1) / interval;
+		for (int k = 0; k < intervals; k++)
+		{
+			int start = _jpeg._interval_starts[layout._first_interval + k];
+			// data of the interval ends at the RSTn marker of the next one, the last at the marker after the scan
+			int end = k + 1 < intervals ? _jpeg._interval_starts[layout._first_interval + k + 1] - 2 : layout._data_end;
+			int first_mcu = k * interval;
+			int end_mcu = std::min(first_mcu + interval, mcus);
+			if (!this->interval_is_dirty(scan, first_mcu, end_mcu, mcus_per_line))
+			{
+				_output.WriteBytes(source_.data() + start, end - start);
+			}
+			else
+			{
+				// [F.1.2.3] every interval starts from zero predictors, so it is coded knowing nothing of the others
+				std::fill(_dc_predictors.begin(), _dc_predictors.end(), 0);
+				_output.SetByteStuffing(true);
+				for (int mcu = first_mcu; mcu < end_mcu; mcu++)
+				{
+					this->encode_mcu(scan, mcu, mcus_per_line, mcu / mcus_per_line, planes);
+				}
+				this->end_scan();
+			}
+			if (k + 1 < intervals)
+			{
+				_output.WriteBytes(source_.data() + end, 2);
+			}
+		}
+		copied = layout._data_end;
+	}
+	_output.WriteBytes(source_.data() + copied, source_.size() - copied);
+}
+
+void JpegWriter::write_reencoded(const std::vector<byte>& source_)
+{
+	this->load_standard_tables();
+	int copied = 0; // everything of the source before it is in the output or left out
+	for (int scan = 0; scan < _jpeg._scans.size(); scan++)
+	{
+		const Jpeg::ScanLayout& layout = _jpeg._scan_layouts[scan];
+		this->copy_segments_but_tables(source_.data(), copied, this->scan_header_start(scan));
+		if (scan == 0)
+		{
+			this->write_huffman_tables();
+		}
+		// DRI segments of the source are copied, so every scan restarts as in the source
+		_restart_interval = layout._restart_interval;
+		this->write_scan(scan);
+		copied = layout._data_end;
+	}
+	_output.WriteBytes(source_.data() + copied, source_.size() - copied);
+}
+
+bool JpegWriter::interval_is_dirty(int scan_, int first_mcu_, int end_mcu_, int mcus_per_line_) const
+{
+	// the same MCU walk, as in Jpeg::decode_mcu
+	const std::vector<Jpeg::ScanComponent>& scan_components = _jpeg._scans[scan_];
+	bool interleaved = scan_components.size() > 1;
+	for (int mcu = first_mcu_; mcu < end_mcu_; mcu++)
+	{
+		for (int i = 0; i < scan_components.size(); i++)
+		{
+			const Jpeg::Frame& frame = _jpeg._frames[scan_components[i]._frame_index];
+			int vertical_blocks = interleaved ? frame._vertical_thinning : 1;
+			int horizontal_blocks = interleaved ? frame._horizontal_thinning : 1;
+			for (int v = 0; v < vertical_blocks; v++)
+			{
+				for (int h = 0; h < horizontal_blocks; h++)
+				{
+					Jpeg::BlockPosition position;
+					position._component = scan_components[i]._frame_index;
+					position._row = mcu / mcus_per_line_ * vertical_blocks + v;
+					position._column = mcu % mcus_per_line_ * horizontal_blocks + h;
+					if (_jpeg.IsDirty(position))
+					{
+						return true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
+
+void JpegWriter::write_scan_header(int scan_)
+{
+	const std::vector<Jpeg::ScanComponent>& scan_components = _jpeg._scans[scan_];
+
+	// [B.2.3] sequential scan: Ss = 0, Se = 63, Ah = Al = 0
+	this->write_marker(SOS);
+	this->write_word(6 + 2 * scan_components.size());
+	_output << byte(scan_components.size());
+	for (int i = 0; i < scan_components.size(); i++)
+	{
+		int component = scan_components[i]._frame_index;
+		int table = table_of_component(component);
+		_output << _jpeg._frames[component]._id << byte((table << 4) | table);
+		_dc_codes[component] = _dc_tables[table]->_encoding;
+		_ac_codes[component] = _ac_tables[table]->_encoding;
+	}
+	_output << byte(0) << byte(63) << byte(0);
+
+	std::fill(_dc_predictors.begin(), _dc_predictors.end(), 0);
+	_output.SetByteStuffing(true);
+}
+
+void JpegWriter::restart_if_due(int mcu_)
+{
+	if (_restart_interval && mcu_ && mcu_ % _restart_interval == 0)
+	{
+		// [F.1.2.3] restart marker follows the byte-aligned segment, predictors start from zero again
+		_output.AlignToByte();
+		_output.SetByteStuffing(false);
+		this->write_marker(RST0 + (mcu_ / _restart_interval - 1) % 8);
+		_output.SetByteStuffing(true);
+		std::fill(_dc_predictors.begin(), _dc_predictors.end(), 0);
+	}
+}
+
+void JpegWriter::encode_mcu(int scan_, int mcu_, int mcus_per_line_, int plane_row_, const std::vector<PlaneView<const short>>& planes_)
+{
+	// the same MCU walk, as in Jpeg::decode_mcu
+	const std::vector<Jpeg::ScanComponent>& scan_components = _jpeg._scans[scan_];
+	bool interleaved = scan_components.size() > 1;
+	int mcu_column = mcu_ % mcus_per_line_;
+	for (int i = 0; i < scan_components.size(); i++)
+	{
+		int component = scan_components[i]._frame_index;
+		const Jpeg::Frame& frame = _jpeg._frames[component];
+		int vertical_blocks = interleaved ? frame._vertical_thinning : 1;
+		int horizontal_blocks = interleaved ? frame._horizontal_thinning : 1;
+		for (int v = 0; v < vertical_blocks; v++)
+		{
+			for (int h = 0; h < horizontal_blocks; h++)
+			{
+				int row = plane_row_ * vertical_blocks + v;
+				int column = mcu_column * horizontal_blocks + h;
+				this->encode_block(&planes_[component].At(column, row), component);
+			}
+		}
+	}
+}
+
+void JpegWriter::end_scan()
+{
+	_output.AlignToByte();
+	_output.SetByteStuffing(false);
+}
+
+void JpegWriter::WriteRow(const std::vector<PlaneView<const short>>& row_)
+{
+	int mcus_per_line, mcus_per_column;
+	_jpeg.calculate_scan_size(_jpeg._scans[0], mcus_per_line, mcus_per_column);
+	if (_mcu >= mcus_per_line * mcus_per_column)
+	{
+		throw std::runtime_error("Every row of the scan is written already");
+	}
+	for (int end = _mcu + mcus_per_line; _mcu < end; _mcu++)
+	{
+		this->restart_if_due(_mcu);
+		this->encode_mcu(0, _mcu, mcus_per_line, 0, row_);
+	}
+	this->flush();
+}
+
+void JpegWriter::Finish()
+{
+	this->end_scan();
+	this->write_marker(EOI);
+	this->flush();
+}
+
+void JpegWriter::flush()
+{
+	if (!_stream)
+	{
+		return;
+	}
+	std::vector<byte>& bytes = _output.Get();
+	_stream->write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+	bytes.clear();
+	if (!*_stream)
+	{
+		throw std::runtime_error("Can't write the encoded image");
+	}
+}
+
+void JpegWriter::encode_block(const short* coefficients_, int component_)
+{
+	const HuffmanCode* dc_codes = _dc_codes[component_];
+	const HuffmanCode* ac_codes = _ac_codes[component_];
+
+	// DC coef
+	int difference = coefficients_[0] - _dc_predictors[component_];
+	_dc_predictors[component_] = coefficients_[0];
+	this->encode_value(difference, dc_codes[category_of(difference)]);
+
+	// AC coefs
+	int run = 0;
+	for (int k = 1; k < 64; k++)
+	{
+		int value = coefficients_[_jpeg._zigzag_to_natural[k]];
+		if (value == 0)
+		{
+			run++;
+			continue;
+		}
+		while (run > 15)
+		{
+			this->write_code(ac_codes[0xF0]); // ZRL
+			run -= 16;
+		}
+		this->encode_value(value, ac_codes[(run << 4) | category_of(value)]);
+		run = 0;
+	}
+	if (run)
+	{
+		this->write_code(ac_codes[0x00]); // EOB
+	}
+}
+
+void JpegWriter::encode_value(int value_, const HuffmanCode& code_of_category_)
+{
+	this->write_code(code_of_category_);
+	// [F.1.2.1.1] negative values are coded as value - 1 in category bits
+	_output.WriteBits(value_ < 0 ? value_ - 1 : value_, category_of(value_));
+}
+
+void JpegWriter::write_code(const HuffmanCode& code_)
+{
+	if (code_._length == 0)
+	{
+		throw std::runtime_error("Coefficient is out of range of the Huffman tables");
+	}
+	_output.WriteBits(code_._code, code_._length);
+}
+
+const std::vector<byte>& JpegWriter::Get() const
+{
+	return _output.Get();
+}
+
+std::vector<byte> JpegWriter::Release()
+{
+	return _output.Release();
+}
+
+void JpegWriter::Save(const std::string& file_path_) const
+{
+	std::ofstream file(file_path_.c_str(), std::ios::binary);
+	file.write(reinterpret_cast<const char*>(_output.Get().data()), _output.Get().size());
+	if (!file)
+	{
+		throw std::runtime_error("Can't write " + file_path_);
+	}
+}
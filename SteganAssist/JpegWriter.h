@@ -0,0 +1,103 @@
+#pragma once
+#include<vector>
+#include<string>
+#include<memory>
+#include<ostream>
+#include"BitStream.h"
+#include"HuffmanCache.h"
+#include"Image.h"
+
+class Jpeg;
+
+/// JpegWriter class, that encodes coefficients of the decoded image back into baseline JPEG.
+/// Frame, quantization tables, restart interval and scan layout of the source are kept, so the
+/// blocks are coded in the same order and sequential payload survives re-encoding.
+/// Huffman coding uses the typical tables of [Annex K.3].
+/// Given the file the image was decoded from, only the restart intervals holding blocks marked by Jpeg::MarkDirty
+/// are coded again, with the tables of the source, the other intervals and everything around the scans are copied.
+class JpegWriter
+{
+	const Jpeg& _jpeg;
+	OutputBitStream _output;
+	std::shared_ptr<const SharedHuffmanTable> _dc_tables[2]; // [Annex C] codes are built once per process by HuffmanCache
+	std::shared_ptr<const SharedHuffmanTable> _ac_tables[2];
+	std::vector<int> _dc_predictors;
+	std::vector<const HuffmanCode*> _dc_codes; // of every component in the current scan
+	std::vector<const HuffmanCode*> _ac_codes;
+	std::ostream* _stream; // streaming output, whole bytes are moved into it after every row
+	int _mcu;              // next MCU of the streamed scan
+	int _restart_interval; // of the scan being coded
+
+	void write_marker(byte marker_);
+	void write_word(int value_);
+	void write_quantization_tables();
+	void write_start_of_frame();
+	void write_huffman_tables();
+	void write_huffman_table(int class_, int id_, const byte* bits_, const byte* values_);
+	void write_restart_interval();
+	/// [Annex K.3] tables the scans are coded with, when the source tables are not kept
+	void load_standard_tables();
+	/// Offset of the SOS marker of the scan in the source
+	int scan_header_start(int scan_) const;
+	/// Marker segments of source_ in [begin_, end_) but DHT, so metadata survives coding with other tables
+	void copy_segments_but_tables(const byte* source_, int begin_, int end_);
+	/// Whole image with the standard tables
+	void write_image();
+	/// SOI and the tables, everything before the first scan
+	void write_headers();
+	/// [B.2.3] Scan header followed by entropy-coded segments of the scan
+	void write_scan(int scan_);
+	void write_scan_header(int scan_);
+	/// Copies the source, coding again only the dirty restart intervals, throws when their
+	/// coefficients need a symbol, which the source tables do not code
+	void write_incremental(const std::vector<byte>& source_);
+	/// Fallback of write_incremental: segments of the source are copied but DHT, the standard tables
+	/// take their place and every scan is coded again with them
+	void write_reencoded(const std::vector<byte>& source_);
+	/// Restart intervals and data of every scan lie where the source puts them
+	bool source_matches(const std::vector<byte>& source_) const;
+	bool interval_is_dirty(int scan_, int first_mcu_, int end_mcu_, int mcus_per_line_) const;
+	/// [F.1.2.3] Restart marker, when mcu_ begins a restart interval
+	void restart_if_due(int mcu_);
+	/// Blocks of the MCU, taken from planes_ of every component, in which the MCU lies in the row plane_row_
+	void encode_mcu(int scan_, int mcu_, int mcus_per_line_, int plane_row_, const std::vector<PlaneView<const short>>& planes_);
+	/// Byte-aligns the last entropy-coded segment
+	void end_scan();
+	void flush();
+	/// [F.1.2.1], [F.1.2.2] Codes DC difference and run-length AC coefficients of one block
+	void encode_block(const short* coefficients_, int component_);
+	/// Huffman code of the category followed by additional bits of the value
+	void encode_value(int value_, const HuffmanCode& code_of_category_);
+	void write_code(const HuffmanCode& code_);
+
+public:
+
+	/// [Table K.1], [Table K.2] in natural order
+	static const int standard_luminance_quantization[64];
+	static const int standard_chrominance_quantization[64];
+	/// IJG scaling of the standard table for quality_ from 1 to 100, values are limited to 8-bit precision
+	static std::vector<int> ScaledQuantizationTable(const int* standard_table_, int quality_);
+
+	/// Output goes into the storage of recycled_ buffer, if one is given
+	JpegWriter(const Jpeg& jpeg_, std::vector<byte>&& recycled_ = std::vector<byte>());
+	/// Incremental re-encoding of the image decoded from source_, which has to be kept as it was. Clean restart intervals
+	/// are copied byte for byte, so are metadata and tables. When a changed block needs a code missing from the tables
+	/// of the source, every scan is coded again with the standard tables, which replace those of the source,
+	/// and the other segments are still copied. Throws std::invalid_argument, when
+	/// source_ is not the file of the image.
+	JpegWriter(const Jpeg& jpeg_, const std::vector<byte>& source_, std::vector<byte>&& recycled_ = std::vector<byte>());
+	/// Streaming encoding of the image decoded by JpegStream, which has a single scan and stores no coefficients:
+	/// the segments of the source before the scan are copied here with the standard Huffman tables in place of its own,
+	/// the blocks follow a row of MCUs at a time by WriteRow, and Finish writes EOI.
+	/// Whole bytes go into output_ after every row, so only the bits of an unfinished byte are kept.
+	JpegWriter(const Jpeg& jpeg_, std::ostream& output_);
+
+	/// Blocks of the next row of MCUs, for every component the row as JpegStream::CoefficientRow gives it
+	void WriteRow(const std::vector<PlaneView<const short>>& row_);
+	void Finish();
+
+	const std::vector<byte>& Get() const;
+	/// Gives the encoded file away without copying
+	std::vector<byte> Release();
+	void Save(const std::string& file_path_) const;
+};
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "Json.h"
+#include <cmath>
+#include <cstdio>
+
+void JsonObject::add_key(const std::string& key_)
+{
+	if (!_content.empty())
+	{
+		_content += ',';
+	}
+	_content += Quote(key_);
+	_content += ':';
+}
+
+JsonObject& JsonObject::Add(const std::string& key_, const std::string& value_)
+{
+	this->add_key(key_);
+	_content += Quote(value_);
+	return *this;
+}
+
+JsonObject& JsonObject::Add(const std::string& key_, const char* value_)
+{
+	return this->Add(key_, std::string(value_));
+}
+
+JsonObject& JsonObject::Add(const std::string& key_, bool value_)
+{
+	return this->AddRaw(key_, value_ ? "true" : "false");
+}
+
+JsonObject& JsonObject::Add(const std::string& key_, int value_)
+{
+	return this->AddRaw(key_, std::to_string(value_));
+}
+
+JsonObject& JsonObject::Add(const std::string& key_, long long value_)
+{
+	return this->AddRaw(key_, std::to_string(value_));
+}
+
+JsonObject& JsonObject::Add(const std::string& key_, unsigned long long value_)
+{
+	return this->AddRaw(key_, std::to_string(value_));
+}
+
+JsonObject& JsonObject::Add(const std::string& key_, double value_)
+{
+	return this->AddRaw(key_, Number(value_));
+}
+
+JsonObject& JsonObject::Add(const std::string& key_, const std::vector<double>& values_)
+{
+	std::string array = "[";
+	for (int i = 0; i < values_.size(); i++)
+	{
+		if (i)
+		{
+			array += ',';
+		}
+		array += Number(values_[i]);
+	}
+	array += ']';
+	return this->AddRaw(key_, array);
+}
+
+JsonObject& JsonObject::AddRaw(const std::string& key_, const std::string& value_)
+{
+	this->add_key(key_);
+	_content += value_;
+	return *this;
+}
+
+JsonObject& JsonObject::Append(const JsonObject& other_)
+{
+	if (!_content.empty() && !other_._content.empty())
+	{
+		_content += ',';
+	}
+	_content += other_._content;
+	return *this;
+}
+
+std::string JsonObject::Str() const
+{
+	return '{' + _content + '}';
+}
+
+std::string JsonObject::Quote(const std::string& value_)
+{
+	std::string quoted = "\"";
+	for (int i = 0; i < value_.size(); i++)
+	{
+		unsigned char c = value_[i];
+		switch (c)
+		{
+		case '"': quoted += "\\\""; break;
+		case '\\': quoted += "\\\\"; break;
+		case '\n': quoted += "\\n"; break;
+		case '\r': quoted += "\\r"; break;
+		case '\t': quoted += "\\t"; break;
+		default:
+			if (c < 0x20 || c > 0x7E)
+			{
+				char escaped[8];
+				std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+				quoted += escaped;
+			}
+			else
+			{
+				quoted += c;
+			}
+		}
+	}
+	quoted += '"';
+	return quoted;
+}
+
+std::string JsonObject::Number(double value_)
+{
+	if (!std::isfinite(value_))
+	{
+		return "null";
+	}
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), "%.6g", value_);
+	return buffer;
+}
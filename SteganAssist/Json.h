@@ -0,0 +1,34 @@
+#pragma once
+#include<string>
+#include<vector>
+
+/// JsonObject class, that builds one-line JSON object field by field, as used by JSON-lines output
+class JsonObject
+{
+	std::string _content;
+
+	void add_key(const std::string& key_);
+
+public:
+
+	JsonObject& Add(const std::string& key_, const std::string& value_);
+	JsonObject& Add(const std::string& key_, const char* value_);
+	JsonObject& Add(const std::string& key_, bool value_);
+	JsonObject& Add(const std::string& key_, int value_);
+	JsonObject& Add(const std::string& key_, long long value_);
+	JsonObject& Add(const std::string& key_, unsigned long long value_);
+	JsonObject& Add(const std::string& key_, double value_);
+	JsonObject& Add(const std::string& key_, const std::vector<double>& values_);
+	/// value_ must already be valid JSON
+	JsonObject& AddRaw(const std::string& key_, const std::string& value_);
+	/// Fields of other_ follow the fields of this object
+	JsonObject& Append(const JsonObject& other_);
+
+	std::string Str() const;
+
+	/// String literal with quotes, control characters and bytes above 0x7F are written as \u00XX,
+	/// so arbitrary binary payload stays valid JSON
+	static std::string Quote(const std::string& value_);
+	/// Non-finite values have no JSON representation and become null
+	static std::string Number(double value_);
+};
\ No newline at end of file
@@ -0,0 +1,537 @@
+#include "Kernels.h"
+#include "Dct.h"
+#include "Payload.h"
+#include <atomic>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#if KERNELS_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#elif KERNELS_X86
+#include <cpuid.h>
+#endif
+
+namespace
+{
+	void dequantize(const short* coefficients_, const int* table_, float* output_, std::size_t blocks_)
+	{
+		for (std::size_t i = 0; i < blocks_ * 64; i += 64)
+		{
+			for (int k = 0; k < 64; k++)
+			{
+				output_[i + k] = float(coefficients_[i + k] * table_[k]);
+			}
+		}
+	}
+
+	byte clamp_sample(float value_)
+	{
+		return byte(std::min(std::max(value_ + 0.5f, 0.0f), 255.0f));
+	}
+
+	void ycbcr_to_rgb(const byte* luminance_, const byte* blue_difference_, const byte* red_difference_, byte* rgb_, int count_)
+	{
+		for (int x = 0; x < count_; x++)
+		{
+			float luminance = luminance_[x];
+			float blue_difference = blue_difference_[x] - 128.0f;
+			float red_difference = red_difference_[x] - 128.0f;
+			rgb_[x * 3] = clamp_sample(luminance + 1.402f * red_difference);
+			rgb_[x * 3 + 1] = clamp_sample(luminance - 0.344136f * blue_difference - 0.714136f * red_difference);
+			rgb_[x * 3 + 2] = clamp_sample(luminance + 1.772f * blue_difference);
+		}
+	}
+
+	unsigned long long usable_mask(const short* coefficients_)
+	{
+		unsigned long long mask = 0;
+		for (int i = 1; i < 64; i++)
+		{
+			if (IsUsableCoefficient(i, coefficients_[i]))
+			{
+				mask |= 1ull << i;
+			}
+		}
+		return mask;
+	}
+
+	void histogram(const short* values_, std::size_t count_, int offset_, int bins_, unsigned long long* histogram_)
+	{
+		for (std::size_t i = 0; i < count_; i++)
+		{
+			histogram_[std::min(std::max(values_[i] + offset_, 0), bins_ - 1)]++;
+		}
+	}
+
+	void filter_8_taps(const float* input_, std::ptrdiff_t step_, const float* weights_, float* output_, int count_)
+	{
+		for (int x = 0; x < count_; x++)
+		{
+			float sum = 0;
+			for (int n = 0; n < 8; n++)
+			{
+				sum += input_[x + n * step_] * weights_[n];
+			}
+			output_[x] = sum;
+		}
+	}
+
+	void residual(const short* const* rows_, const short* weights_, int taps_, short* output_, int count_)
+	{
+		for (int x = 0; x < count_; x++)
+		{
+			int sum = 0;
+			for (int t = 0; t < taps_; t++)
+			{
+				sum += weights_[t] * rows_[t][x];
+			}
+			output_[x] = short(sum);
+		}
+	}
+
+	void quantize_residual(const short* const* bases_, int bases_count_, bool minimum_, short first_threshold_,
+		short second_threshold_, signed char* output_, int count_)
+	{
+		for (int x = 0; x < count_; x++)
+		{
+			short value = bases_[0][x];
+			for (int b = 1; b < bases_count_; b++)
+			{
+				value = minimum_ ? std::min(value, bases_[b][x]) : std::max(value, bases_[b][x]);
+			}
+			output_[x] = static_cast<signed char>((value >= first_threshold_) + (value >= second_threshold_)
+				- (value <= -first_threshold_) - (value <= -second_threshold_));
+		}
+	}
+
+#if KERNELS_X86
+	void cpuid(int leaf_, int subleaf_, unsigned int* registers_)
+	{
+#if defined(_MSC_VER)
+		int values[4];
+		__cpuidex(values, leaf_, subleaf_);
+		for (int i = 0; i < 4; i++)
+		{
+			registers_[i] = unsigned(values[i]);
+		}
+#else
+		__cpuid_count(leaf_, subleaf_, registers_[0], registers_[1], registers_[2], registers_[3]);
+#endif
+	}
+
+	/// XCR0, the register states the operating system saves on context switches
+	unsigned long long enabled_states()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		unsigned int low, high;
+		__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+		return (unsigned long long)(high) << 32 | low;
+#endif
+	}
+#endif
+
+	std::atomic<const KernelTable*>& bound_table()
+	{
+		static std::atomic<const KernelTable*> table(nullptr);
+		return table;
+	}
+
+	std::atomic<Kernels::Level>& bound_level()
+	{
+		static std::atomic<Kernels::Level> level(Kernels::Level::Scalar);
+		return level;
+	}
+}
+
+void Kernels::bind_scalar(KernelTable& table_)
+{
+	table_._dequantize = dequantize;
+	table_._inverse_dct = Dct::Inverse;
+	table_._ycbcr_to_rgb = ycbcr_to_rgb;
+	table_._usable_mask = usable_mask;
+	table_._histogram = histogram;
+	table_._filter_8_taps = filter_8_taps;
+	table_._residual = residual;
+	table_._quantize_residual = quantize_residual;
+	table_._extract_bit_plane = ExtractBitPlane;
+	table_._embed_bit_plane = EmbedBitPlane;
+	table_._unfilter_row = UnfilterRow;
+	table_._philox = Philox;
+	table_._gf_multiply_add = GfMultiplyAdd;
+}
+
+Kernels::Level Kernels::Detect()
+{
+#if KERNELS_X86
+	unsigned int registers[4]; // EAX, EBX, ECX, EDX
+	cpuid(0, 0, registers);
+	unsigned int max_leaf = registers[0];
+	if (max_leaf < 1)
+	{
+		return Level::Scalar;
+	}
+	cpuid(1, 0, registers);
+	bool ssse3 = registers[2] >> 9 & 1;
+	bool sse41 = registers[2] >> 19 & 1;
+	bool sse42 = registers[2] >> 20 & 1;
+	bool xsave_enabled = registers[2] >> 27 & 1;
+	bool avx = registers[2] >> 28 & 1;
+	if (!(ssse3 && sse41 && sse42))
+	{
+		return Level::Scalar;
+	}
+	if (!xsave_enabled || !avx || max_leaf < 7)
+	{
+		return Level::Sse42;
+	}
+	// the registers are usable only when the operating system saves them
+	unsigned long long states = enabled_states();
+	cpuid(7, 0, registers);
+	bool avx2 = registers[1] >> 5 & 1;
+	bool avx512f = registers[1] >> 16 & 1;
+	bool avx512bw = registers[1] >> 30 & 1;
+	if (!avx2 || (states & 0x06) != 0x06) // XMM and YMM
+	{
+		return Level::Sse42;
+	}
+	if (!avx512f || !avx512bw || (states & 0xE6) != 0xE6) // and opmask, ZMM0-15 upper halves, ZMM16-31
+	{
+		return Level::Avx2;
+	}
+	return Level::Avx512;
+#else
+	return Level::Scalar;
+#endif
+}
+
+KernelTable Kernels::ForLevel(Level level_)
+{
+	KernelTable table;
+	bind_scalar(table);
+	if (level_ >= Level::Sse42)
+	{
+		bind_sse42(table);
+	}
+	if (level_ >= Level::Avx2)
+	{
+		bind_avx2(table);
+	}
+	if (level_ >= Level::Avx512)
+	{
+		bind_avx512(table);
+	}
+	return table;
+}
+
+void Kernels::Bind(Level level_)
+{
+	static KernelTable tables[4] = { ForLevel(Level::Scalar), ForLevel(Level::Sse42), ForLevel(Level::Avx2), ForLevel(Level::Avx512) };
+	Level level = std::min(level_, Detect());
+	bound_level().store(level);
+	bound_table().store(&tables[int(level)], std::memory_order_release);
+}
+
+const KernelTable& Kernels::Get()
+{
+	const KernelTable* table = bound_table().load(std::memory_order_acquire);
+	if (!table)
+	{
+		Bind(Level::Avx512);
+		table = bound_table().load(std::memory_order_acquire);
+	}
+	return *table;
+}
+
+Kernels::Level Kernels::Bound()
+{
+	Get();
+	return bound_level().load();
+}
+
+std::vector<Kernels::SelfTestResult> Kernels::SelfTest()
+{
+	std::mt19937 random(20240601);
+	auto uniform = [&random](int low_, int high_)
+	{
+		return std::uniform_int_distribution<int>(low_, high_)(random);
+	};
+
+	// inputs are shared by all levels, lengths are odd, so the scalar tails of vector kernels run too
+	const int blocks = 37;
+	const int count = 1003;
+	std::vector<short> coefficients(blocks * 64);
+	for (int i = 0; i < coefficients.size(); i++)
+	{
+		// mostly small values as in real images, with the extremes of 16 bits between them
+		int kind = uniform(0, 9);
+		coefficients[i] = short(kind < 7 ? uniform(-3, 3) : kind < 9 ? uniform(-2047, 2047) : uniform(0, 1) ? 32767 : -32768);
+	}
+	std::vector<int> quantization(64);
+	for (int i = 0; i < 64; i++)
+	{
+		quantization[i] = uniform(1, 255);
+	}
+	std::vector<float> dequantized(blocks * 64);
+	std::vector<short> small_coefficients(blocks * 64);
+	for (int i = 0; i < small_coefficients.size(); i++)
+	{
+		small_coefficients[i] = short(uniform(-2047, 2047) / (1 + uniform(0, 64)));
+	}
+	dequantize(small_coefficients.data(), quantization.data(), dequantized.data(), blocks);
+	std::vector<byte> planes[3];
+	for (int c = 0; c < 3; c++)
+	{
+		planes[c].resize(count);
+		for (int i = 0; i < count; i++)
+		{
+			planes[c][i] = byte(uniform(0, 255));
+		}
+	}
+	std::vector<float> signal(count + 8 * count);
+	for (int i = 0; i < signal.size(); i++)
+	{
+		signal[i] = uniform(-255000, 255000) / 1000.0f;
+	}
+	float weights[8];
+	for (int n = 0; n < 8; n++)
+	{
+		weights[n] = uniform(-1000, 1000) / 1000.0f;
+	}
+	std::vector<short> residual_rows(25 * count);
+	std::vector<short> residual_weights(25);
+	for (int i = 0; i < residual_rows.size(); i++)
+	{
+		residual_rows[i] = short(uniform(0, 255));
+	}
+	for (int t = 0; t < 25; t++)
+	{
+		residual_weights[t] = short(uniform(-12, 12));
+	}
+	std::vector<short> residuals(4 * count);
+	for (int i = 0; i < residuals.size(); i++)
+	{
+		residuals[i] = short(uniform(-40, 40));
+	}
+	std::vector<byte> stream(count / 8 + 2);
+	for (int i = 0; i < stream.size(); i++)
+	{
+		stream[i] = byte(uniform(0, 255));
+	}
+
+	const unsigned int philox_key[2] = { unsigned(uniform(0, 0x7FFFFFFF)) * 2 + 1, unsigned(uniform(0, 0x7FFFFFFF)) };
+
+	// every kernel writes into a vector of doubles, so the outputs of all kernels are compared the same way
+	typedef std::vector<double> Output;
+	auto run = [&](const KernelTable& table_, int kernel_) -> Output
+	{
+		Output output;
+		switch (kernel_)
+		{
+		case 0:
+		{
+			std::vector<float> result(blocks * 64);
+			table_._dequantize(coefficients.data(), quantization.data(), result.data(), blocks);
+			output.assign(result.begin(), result.end());
+			break;
+		}
+		case 1:
+		{
+			std::vector<float> result(blocks * 64);
+			for (int b = 0; b < blocks; b++)
+			{
+				table_._inverse_dct(dequantized.data() + b * 64, result.data() + b * 64);
+			}
+			output.assign(result.begin(), result.end());
+			break;
+		}
+		case 2:
+		{
+			std::vector<byte> result(count * 3);
+			table_._ycbcr_to_rgb(planes[0].data(), planes[1].data(), planes[2].data(), result.data(), count);
+			output.assign(result.begin(), result.end());
+			break;
+		}
+		case 3:
+			for (int b = 0; b < blocks; b++)
+			{
+				unsigned long long mask = table_._usable_mask(coefficients.data() + b * 64);
+				output.push_back(double(mask >> 32));
+				output.push_back(double(mask & 0xFFFFFFFF));
+			}
+			break;
+		case 4:
+		{
+			std::vector<unsigned long long> result(4096);
+			table_._histogram(coefficients.data(), coefficients.size(), 2048, 4096, result.data());
+			table_._histogram(coefficients.data() + 1, coefficients.size() - 1, 3, 7, result.data());
+			output.assign(result.begin(), result.end());
+			break;
+		}
+		case 5:
+		{
+			std::vector<float> result(count);
+			table_._filter_8_taps(signal.data(), 1, weights, result.data(), count);
+			output.assign(result.begin(), result.end());
+			table_._filter_8_taps(signal.data() + 3, count, weights, result.data(), count - 3);
+			output.insert(output.end(), result.begin(), result.end());
+			break;
+		}
+		case 6:
+		{
+			std::vector<short> result(count);
+			for (int taps = 1; taps <= 25; taps += 4)
+			{
+				const short* rows[25];
+				for (int t = 0; t < taps; t++)
+				{
+					rows[t] = residual_rows.data() + t * count + (t % 3);
+				}
+				table_._residual(rows, residual_weights.data(), taps, result.data(), count - 2);
+				output.insert(output.end(), result.begin(), result.end());
+			}
+			break;
+		}
+		case 7:
+		{
+			std::vector<signed char> result(count);
+			const short* bases[4] = { residuals.data(), residuals.data() + count, residuals.data() + 2 * count, residuals.data() + 3 * count };
+			const int steps[] = { 1, 2, 3, 4, 12 };
+			for (int bases_count = 1; bases_count <= 4; bases_count++)
+			{
+				for (int q : steps)
+				{
+					table_._quantize_residual(bases, bases_count, q % 2 == 0, short((q + 1) / 2), short((3 * q + 1) / 2), result.data(), count);
+					output.insert(output.end(), result.begin(), result.end());
+				}
+			}
+			break;
+		}
+		case 8:
+			// stream offsets inside of a byte and lengths, which end inside of a byte
+			for (int first_bit = 0; first_bit < 10; first_bit += 3)
+			{
+				for (int plane = 0; plane < 8; plane += 3)
+				{
+					std::vector<byte> result(stream);
+					table_._extract_bit_plane(planes[0].data() + plane, plane, result.data(), first_bit, count - first_bit - plane);
+					output.insert(output.end(), result.begin(), result.end());
+				}
+			}
+			break;
+		case 9:
+			for (int first_bit = 0; first_bit < 10; first_bit += 3)
+			{
+				for (int plane = 0; plane < 8; plane += 3)
+				{
+					std::vector<byte> result(planes[1]);
+					table_._embed_bit_plane(result.data() + plane, plane, stream.data(), first_bit, count - first_bit - plane);
+					output.insert(output.end(), result.begin(), result.end());
+				}
+			}
+			break;
+		case 10:
+		{
+			const int pixel_sizes[] = { 1, 2, 3, 4, 6, 8 };
+			for (int filter = 0; filter <= 4; filter++)
+			{
+				for (int bytes : pixel_sizes)
+				{
+					// whole pixels and a row, which ends inside of a pixel
+					for (int size : { count - count % bytes, count })
+					{
+						std::vector<byte> result(planes[0]);
+						table_._unfilter_row(filter, result.data(), planes[1].data(), size, bytes);
+						output.insert(output.end(), result.begin(), result.end());
+					}
+				}
+			}
+			break;
+		}
+		case 11:
+		{
+			// the lower word of the counter wraps inside of the run
+			std::vector<unsigned int> result(4 * blocks);
+			table_._philox(philox_key, 0xFFFFFFF0ull, result.data(), blocks);
+			output.assign(result.begin(), result.end());
+			break;
+		}
+		case 12:
+			// any 32 bytes serve as the tables, unaligned starts and odd lengths run the scalar tails
+			for (int offset = 0; offset < 3; offset++)
+			{
+				std::vector<byte> result(planes[1]);
+				table_._gf_multiply_add(stream.data() + offset, planes[0].data() + offset, result.data() + 2 * offset, count - 2 * offset);
+				output.insert(output.end(), result.begin(), result.end());
+			}
+			break;
+		}
+		return output;
+	};
+	const char* names[] = { "dequantize", "inverse_dct", "ycbcr_to_rgb", "usable_mask", "histogram", "filter_8_taps", "residual", "quantize_residual",
+		"extract_bit_plane", "embed_bit_plane", "unfilter_row", "philox", "gf_multiply_add" };
+	const int kernels = sizeof(names) / sizeof(names[0]);
+	auto pointer = [](const KernelTable& table_, int kernel_) -> const void*
+	{
+		const void* pointers[] = { (const void*)table_._dequantize, (const void*)table_._inverse_dct, (const void*)table_._ycbcr_to_rgb,
+			(const void*)table_._usable_mask, (const void*)table_._histogram, (const void*)table_._filter_8_taps,
+			(const void*)table_._residual, (const void*)table_._quantize_residual, (const void*)table_._extract_bit_plane,
+			(const void*)table_._embed_bit_plane, (const void*)table_._unfilter_row, (const void*)table_._philox,
+			(const void*)table_._gf_multiply_add };
+		return pointers[kernel_];
+	};
+
+	std::vector<SelfTestResult> results;
+	KernelTable reference = ForLevel(Level::Scalar);
+	std::vector<Output> expected(kernels);
+	for (int k = 0; k < kernels; k++)
+	{
+		expected[k] = run(reference, k);
+	}
+	for (int l = int(Level::Sse42); l <= int(Detect()); l++)
+	{
+		// kernels taken over from the level below were checked there
+		KernelTable below = ForLevel(Level(l - 1));
+		KernelTable table = ForLevel(Level(l));
+		for (int k = 0; k < kernels; k++)
+		{
+			if (pointer(table, k) == pointer(below, k))
+			{
+				continue;
+			}
+			Output output = run(table, k);
+			double max_difference = output.size() == expected[k].size() ? 0 : HUGE_VAL;
+			for (int i = 0; i < output.size() && i < expected[k].size(); i++)
+			{
+				max_difference = std::max(max_difference, std::fabs(output[i] - expected[k][i]));
+			}
+			results.push_back(SelfTestResult{ names[k], Level(l), max_difference == 0, max_difference });
+		}
+	}
+	return results;
+}
+
+Kernels::Level Kernels::ParseLevel(const std::string& name_)
+{
+	for (int l = int(Level::Scalar); l <= int(Level::Avx512); l++)
+	{
+		if (name_ == LevelName(Level(l)))
+		{
+			return Level(l);
+		}
+	}
+	throw std::invalid_argument("Unknown CPU level " + name_);
+}
+
+const char* Kernels::LevelName(Level level_)
+{
+	switch (level_)
+	{
+	case Level::Sse42: return "sse4.2";
+	case Level::Avx2: return "avx2";
+	case Level::Avx512: return "avx512";
+	default: return "scalar";
+	}
+}
\ No newline at end of file
@@ -0,0 +1,226 @@
+#pragma once
+#include<cstddef>
+#include<cstdlib>
+#include<string>
+#include<vector>
+#include<bitset>
+#include<algorithm>
+#include"BitStream.h"
+#if defined(_MSC_VER)
+#include<intrin.h>
+#endif
+
+/// Kernels of every instruction set live in one binary, each function carries its own target,
+/// so no build flag raises the baseline. MSVC accepts intrinsics of any instruction set without it.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define KERNEL_TARGET(target_)
+#else
+#define KERNEL_TARGET(target_) __attribute__((target(target_)))
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86 1
+#else
+#define KERNELS_X86 0
+#endif
+
+/// Index of the lowest set bit, mask_ must not be 0
+inline int LowestSetBit(unsigned long long mask_)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	unsigned long index;
+	if (_BitScanForward(&index, static_cast<unsigned long>(mask_)))
+	{
+		return int(index);
+	}
+	_BitScanForward(&index, static_cast<unsigned long>(mask_ >> 32));
+	return int(index) + 32;
+#else
+	return __builtin_ctzll(mask_);
+#endif
+}
+
+inline int CountSetBits(unsigned long long mask_)
+{
+	return int(std::bitset<64>(mask_).count());
+}
+
+/// Bits are packed most significant first, bit k of the stream is bit 7 - k % 8 of byte k / 8.
+/// Copies bit plane_ of count_ samples into the stream from bit first_bit_ on, other bits of bits_ are kept.
+inline void ExtractBitPlane(const byte* samples_, int plane_, byte* bits_, std::size_t first_bit_, std::size_t count_)
+{
+	for (std::size_t i = 0; i < count_; i++)
+	{
+		std::size_t k = first_bit_ + i;
+		byte mask = byte(0x80 >> (k & 7));
+		bits_[k >> 3] = (samples_[i] >> plane_ & 1) ? byte(bits_[k >> 3] | mask) : byte(bits_[k >> 3] & ~mask);
+	}
+}
+
+/// Replaces bit plane_ of count_ samples with the stream bits from first_bit_ on
+inline void EmbedBitPlane(byte* samples_, int plane_, const byte* bits_, std::size_t first_bit_, std::size_t count_)
+{
+	for (std::size_t i = 0; i < count_; i++)
+	{
+		std::size_t k = first_bit_ + i;
+		int value = bits_[k >> 3] >> (7 - (k & 7)) & 1;
+		samples_[i] = byte((samples_[i] & ~(1 << plane_)) | value << plane_);
+	}
+}
+
+/// [Salmon et al., Parallel random numbers: as easy as 1, 2, 3] Philox4x32-10 round constants
+const unsigned int philox_multipliers[2] = { 0xD2511F53, 0xCD9E8D57 };
+const unsigned int philox_key_increments[2] = { 0x9E3779B9, 0xBB67AE85 };
+const int philox_rounds = 10;
+
+/// Philox4x32-10 of blocks_ counters from first_counter_ on under the 64-bit key_ of two words. The counter is
+/// the lower two words of the 128-bit counter block, the upper two are 0. Block b gives output_[4 * b] .. output_[4 * b + 3].
+inline void Philox(const unsigned int* key_, unsigned long long first_counter_, unsigned int* output_, std::size_t blocks_)
+{
+	for (std::size_t b = 0; b < blocks_; b++)
+	{
+		unsigned long long counter = first_counter_ + b;
+		unsigned int x[4] = { unsigned(counter), unsigned(counter >> 32), 0, 0 };
+		unsigned int key[2] = { key_[0], key_[1] };
+		for (int round = 0; round < philox_rounds; round++)
+		{
+			unsigned long long first = (unsigned long long)philox_multipliers[0] * x[0];
+			unsigned long long second = (unsigned long long)philox_multipliers[1] * x[2];
+			unsigned int next[4] = { unsigned(second >> 32) ^ x[1] ^ key[0], unsigned(second), unsigned(first >> 32) ^ x[3] ^ key[1], unsigned(first) };
+			std::copy(next, next + 4, x);
+			key[0] += philox_key_increments[0];
+			key[1] += philox_key_increments[1];
+		}
+		std::copy(x, x + 4, output_ + 4 * b);
+	}
+}
+
+/// [Plank et al., Screaming fast Galois field arithmetic using Intel SIMD instructions] Adds c * input_ into output_
+/// over GF(2^8). tables_ are the 16 products of c with the low nibbles followed by the 16 products with the high
+/// nibbles, the product of a byte is the sum of the two, so vector kernels look both up by PSHUFB.
+inline void GfMultiplyAdd(const byte* tables_, const byte* input_, byte* output_, std::size_t count_)
+{
+	for (std::size_t i = 0; i < count_; i++)
+	{
+		output_[i] ^= tables_[input_[i] & 0x0F] ^ tables_[16 + (input_[i] >> 4)];
+	}
+}
+
+/// [PNG 9.2] Reverses filter filter_ (1 Sub, 2 Up, 3 Average, 4 Paeth) of the row in place. prior_ is the row above
+/// already unfiltered, zeros for the first row, bytes_per_pixel_ is 1 for bit depths below 8. Filter 0 and unknown
+/// filters leave the row as it is, the caller rejects the latter.
+inline void UnfilterRow(int filter_, byte* row_, const byte* prior_, std::size_t size_, int bytes_per_pixel_)
+{
+	std::size_t left = std::size_t(bytes_per_pixel_);
+	switch (filter_)
+	{
+	case 1:
+		for (std::size_t i = left; i < size_; i++)
+		{
+			row_[i] = byte(row_[i] + row_[i - left]);
+		}
+		break;
+	case 2:
+		for (std::size_t i = 0; i < size_; i++)
+		{
+			row_[i] = byte(row_[i] + prior_[i]);
+		}
+		break;
+	case 3:
+		for (std::size_t i = 0; i < size_; i++)
+		{
+			int a = i >= left ? row_[i - left] : 0;
+			row_[i] = byte(row_[i] + ((a + prior_[i]) >> 1));
+		}
+		break;
+	case 4:
+		for (std::size_t i = 0; i < size_; i++)
+		{
+			int a = i >= left ? row_[i - left] : 0;
+			int b = prior_[i];
+			int c = i >= left ? prior_[i - left] : 0;
+			// [9.4] the predictor nearest to a + b - c, ties go to a, then b
+			int pa = std::abs(b - c);
+			int pb = std::abs(a - c);
+			int pc = std::abs(a + b - 2 * c);
+			row_[i] = byte(row_[i] + (pa <= pb && pa <= pc ? a : pb <= pc ? b : c));
+		}
+		break;
+	}
+}
+
+/// Hot loops of decoding, embedding and steganalysis, one table per instruction set level.
+/// Vector kernels give the same results as the scalar ones bit for bit, floating point sums are
+/// taken in the same order and without fused multiply-add.
+struct KernelTable
+{
+	/// blocks_ blocks of 64 coefficients multiplied by table_ of 64 values in natural order
+	void (*_dequantize)(const short* coefficients_, const int* table_, float* output_, std::size_t blocks_);
+	/// [A.3.3] Dct::Inverse of one block
+	void (*_inverse_dct)(const float* coefficients_, float* samples_);
+	/// [JFIF] count_ samples of full resolution rows to interleaved RGB
+	void (*_ycbcr_to_rgb)(const byte* luminance_, const byte* blue_difference_, const byte* red_difference_, byte* rgb_, int count_);
+	/// Bit i is set, when coefficient i of the block is usable by IsUsableCoefficient
+	unsigned long long (*_usable_mask)(const short* coefficients_);
+	/// Counts values_ into histogram_ of bins_ bins, value v goes into bin v + offset_ limited to the bins
+	void (*_histogram)(const short* values_, std::size_t count_, int offset_, int bins_, unsigned long long* histogram_);
+	/// output_[x] is the sum of input_[x + n * step_] * weights_[n] over n from 0 to 7
+	void (*_filter_8_taps)(const float* input_, std::ptrdiff_t step_, const float* weights_, float* output_, int count_);
+	/// output_[x] is the sum of rows_[t][x] * weights_[t] over taps_ taps, wrapped to 16 bits
+	void (*_residual)(const short* const* rows_, const short* weights_, int taps_, short* output_, int count_);
+	/// Minimum or maximum over bases_count_ residuals quantized to -2..2, |value| >= first_threshold_
+	/// counts one, |value| >= second_threshold_ counts two
+	void (*_quantize_residual)(const short* const* bases_, int bases_count_, bool minimum_, short first_threshold_,
+		short second_threshold_, signed char* output_, int count_);
+	/// ExtractBitPlane, vector kernels take whole bytes of the stream at once
+	void (*_extract_bit_plane)(const byte* samples_, int plane_, byte* bits_, std::size_t first_bit_, std::size_t count_);
+	/// EmbedBitPlane
+	void (*_embed_bit_plane)(byte* samples_, int plane_, const byte* bits_, std::size_t first_bit_, std::size_t count_);
+	/// UnfilterRow, Sub, Average and Paeth are vectorized across the bytes of a pixel, as they depend on the pixel to the left
+	void (*_unfilter_row)(int filter_, byte* row_, const byte* prior_, std::size_t size_, int bytes_per_pixel_);
+	/// Philox, vector kernels run a block in every lane
+	void (*_philox)(const unsigned int* key_, unsigned long long first_counter_, unsigned int* output_, std::size_t blocks_);
+	/// GfMultiplyAdd, vector kernels look up 16, 32 or 64 bytes by a shuffle of each table
+	void (*_gf_multiply_add)(const byte* tables_, const byte* input_, byte* output_, std::size_t count_);
+};
+
+/// Kernels class, that detects CPU features once and binds the best kernels of the host,
+/// so one build runs on SSE4.2-only machines as well as on AVX2 and AVX-512 ones
+class Kernels
+{
+public:
+
+	/// Every level includes the ones below it
+	enum class Level { Scalar, Sse42, Avx2, Avx512 };
+
+	struct SelfTestResult
+	{
+		std::string _kernel;
+		Level _level;
+		bool _passed;
+		double _max_difference; // largest difference from the scalar kernel over all checked outputs
+	};
+
+	/// Kernels of the bound level, the best one supported by the host unless Bind was called
+	static const KernelTable& Get();
+	static Level Bound();
+	/// The best level supported by both the CPU and the operating system
+	static Level Detect();
+	/// Binds level_ or the best supported level below it, before any worker starts
+	static void Bind(Level level_);
+	/// Kernels of level_, the ones the level does not vectorize come from the level below
+	static KernelTable ForLevel(Level level_);
+
+	/// Runs every kernel of every supported level over random input and compares it with the scalar kernel
+	static std::vector<SelfTestResult> SelfTest();
+
+	static Level ParseLevel(const std::string& name_);
+	static const char* LevelName(Level level_);
+
+private:
+
+	static void bind_scalar(KernelTable& table_);
+	static void bind_sse42(KernelTable& table_);
+	static void bind_avx2(KernelTable& table_);
+	static void bind_avx512(KernelTable& table_);
+};
\ No newline at end of file
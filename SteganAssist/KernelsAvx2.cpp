@@ -0,0 +1,394 @@
+#include "Kernels.h"
+#include "Dct.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#if KERNELS_X86
+#include <immintrin.h>
+
+namespace
+{
+	KERNEL_TARGET("avx2")
+	void dequantize(const short* coefficients_, const int* table_, float* output_, std::size_t blocks_)
+	{
+		for (std::size_t i = 0; i < blocks_ * 64; i += 64)
+		{
+			for (int k = 0; k < 64; k += 8)
+			{
+				__m256i coefficients = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(coefficients_ + i + k)));
+				__m256i table = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(table_ + k));
+				_mm256_storeu_ps(output_ + i + k, _mm256_cvtepi32_ps(_mm256_mullo_epi32(coefficients, table)));
+			}
+		}
+	}
+
+	/// [u][x] = [x][u] of Dct::Cosines, so a row of the basis is one load
+	const float* transposed_cosines()
+	{
+		static const std::vector<float> transposed = []()
+		{
+			std::vector<float> values(64);
+			for (int x = 0; x < 8; x++)
+			{
+				for (int u = 0; u < 8; u++)
+				{
+					values[u * 8 + x] = Dct::Cosines()[x * 8 + u];
+				}
+			}
+			return values;
+		}();
+		return transposed.data();
+	}
+
+	KERNEL_TARGET("avx2")
+	void inverse_dct(const float* coefficients_, float* samples_)
+	{
+		const float* cosines = Dct::Cosines();
+		const float* transposed = transposed_cosines();
+		__m256 basis[8];
+		for (int u = 0; u < 8; u++)
+		{
+			basis[u] = _mm256_loadu_ps(transposed + u * 8);
+		}
+
+		// rows first, then columns as in Dct::Inverse, every row of 8 samples is one vector
+		__m256 temp[8];
+		for (int v = 0; v < 8; v++)
+		{
+			__m256 sum = _mm256_setzero_ps();
+			for (int u = 0; u < 8; u++)
+			{
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(basis[u], _mm256_set1_ps(coefficients_[v * 8 + u])));
+			}
+			temp[v] = sum;
+		}
+		for (int y = 0; y < 8; y++)
+		{
+			__m256 sum = _mm256_setzero_ps();
+			for (int v = 0; v < 8; v++)
+			{
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(cosines[y * 8 + v]), temp[v]));
+			}
+			_mm256_storeu_ps(samples_ + y * 8, sum);
+		}
+	}
+
+	/// Shuffles, that spread 16 samples of one channel over the 48 bytes of interleaved RGB,
+	/// [part][channel], bytes of the other channels are zeroed
+	const byte* interleave_masks()
+	{
+		static const std::vector<byte> masks = []()
+		{
+			std::vector<byte> values(3 * 3 * 16);
+			for (int part = 0; part < 3; part++)
+			{
+				for (int channel = 0; channel < 3; channel++)
+				{
+					for (int i = 0; i < 16; i++)
+					{
+						int position = part * 16 + i;
+						values[(part * 3 + channel) * 16 + i] = position % 3 == channel ? byte(position / 3) : 0x80;
+					}
+				}
+			}
+			return values;
+		}();
+		return masks.data();
+	}
+
+	/// 8 clamped samples packed into 16-bit lanes of the lower half
+	KERNEL_TARGET("avx2")
+	__m128i clamp_samples(__m256 value_)
+	{
+		__m256 clamped = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(value_, _mm256_set1_ps(0.5f)), _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+		__m256i samples = _mm256_cvttps_epi32(clamped);
+		return _mm_packs_epi32(_mm256_castsi256_si128(samples), _mm256_extracti128_si256(samples, 1));
+	}
+
+	KERNEL_TARGET("avx2")
+	void ycbcr_to_rgb(const byte* luminance_, const byte* blue_difference_, const byte* red_difference_, byte* rgb_, int count_)
+	{
+		const __m128i* masks = reinterpret_cast<const __m128i*>(interleave_masks());
+		const __m256 center = _mm256_set1_ps(128.0f);
+		int x = 0;
+		for (; x + 16 <= count_; x += 16)
+		{
+			__m128i channels[3][2];
+			for (int i = 0; i < 2; i++)
+			{
+				__m256 luminance = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(luminance_ + x + 8 * i))));
+				__m256 blue_difference = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+					_mm_loadl_epi64(reinterpret_cast<const __m128i*>(blue_difference_ + x + 8 * i)))), center);
+				__m256 red_difference = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+					_mm_loadl_epi64(reinterpret_cast<const __m128i*>(red_difference_ + x + 8 * i)))), center);
+				channels[0][i] = clamp_samples(_mm256_add_ps(luminance, _mm256_mul_ps(_mm256_set1_ps(1.402f), red_difference)));
+				channels[1][i] = clamp_samples(_mm256_sub_ps(_mm256_sub_ps(luminance, _mm256_mul_ps(_mm256_set1_ps(0.344136f), blue_difference)),
+					_mm256_mul_ps(_mm256_set1_ps(0.714136f), red_difference)));
+				channels[2][i] = clamp_samples(_mm256_add_ps(luminance, _mm256_mul_ps(_mm256_set1_ps(1.772f), blue_difference)));
+			}
+			__m128i packed[3];
+			for (int c = 0; c < 3; c++)
+			{
+				packed[c] = _mm_packus_epi16(channels[c][0], channels[c][1]);
+			}
+			for (int part = 0; part < 3; part++)
+			{
+				__m128i output = _mm_or_si128(_mm_or_si128(
+					_mm_shuffle_epi8(packed[0], masks[part * 3]),
+					_mm_shuffle_epi8(packed[1], masks[part * 3 + 1])),
+					_mm_shuffle_epi8(packed[2], masks[part * 3 + 2]));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(rgb_ + x * 3 + part * 16), output);
+			}
+		}
+		for (; x < count_; x++)
+		{
+			float luminance = luminance_[x];
+			float blue_difference = blue_difference_[x] - 128.0f;
+			float red_difference = red_difference_[x] - 128.0f;
+			rgb_[x * 3] = byte(std::min(std::max(luminance + 1.402f * red_difference + 0.5f, 0.0f), 255.0f));
+			rgb_[x * 3 + 1] = byte(std::min(std::max(luminance - 0.344136f * blue_difference - 0.714136f * red_difference + 0.5f, 0.0f), 255.0f));
+			rgb_[x * 3 + 2] = byte(std::min(std::max(luminance + 1.772f * blue_difference + 0.5f, 0.0f), 255.0f));
+		}
+	}
+
+	KERNEL_TARGET("avx2")
+	unsigned long long usable_mask(const short* coefficients_)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i one = _mm256_set1_epi16(1);
+		unsigned long long unusable = 0;
+		for (int i = 0; i < 64; i += 32)
+		{
+			__m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(coefficients_ + i));
+			__m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(coefficients_ + i + 16));
+			first = _mm256_or_si256(_mm256_cmpeq_epi16(first, zero), _mm256_cmpeq_epi16(first, one));
+			second = _mm256_or_si256(_mm256_cmpeq_epi16(second, zero), _mm256_cmpeq_epi16(second, one));
+			// packing works within 128-bit lanes, the permutation restores the order of coefficients
+			__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(first, second), 0xD8);
+			unusable |= (unsigned long long)(unsigned(_mm256_movemask_epi8(packed))) << i;
+		}
+		// DC coefficient is never usable
+		return ~unusable & ~1ull;
+	}
+
+	KERNEL_TARGET("avx2")
+	void filter_8_taps(const float* input_, std::ptrdiff_t step_, const float* weights_, float* output_, int count_)
+	{
+		int x = 0;
+		for (; x + 8 <= count_; x += 8)
+		{
+			__m256 sum = _mm256_setzero_ps();
+			for (int n = 0; n < 8; n++)
+			{
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(input_ + x + n * step_), _mm256_set1_ps(weights_[n])));
+			}
+			_mm256_storeu_ps(output_ + x, sum);
+		}
+		for (; x < count_; x++)
+		{
+			float sum = 0;
+			for (int n = 0; n < 8; n++)
+			{
+				sum += input_[x + n * step_] * weights_[n];
+			}
+			output_[x] = sum;
+		}
+	}
+
+	KERNEL_TARGET("avx2")
+	void residual(const short* const* rows_, const short* weights_, int taps_, short* output_, int count_)
+	{
+		int x = 0;
+		for (; x + 16 <= count_; x += 16)
+		{
+			__m256i sum = _mm256_setzero_si256();
+			for (int t = 0; t < taps_; t++)
+			{
+				__m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows_[t] + x));
+				sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(value, _mm256_set1_epi16(weights_[t])));
+			}
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(output_ + x), sum);
+		}
+		for (; x < count_; x++)
+		{
+			int sum = 0;
+			for (int t = 0; t < taps_; t++)
+			{
+				sum += weights_[t] * rows_[t][x];
+			}
+			output_[x] = short(sum);
+		}
+	}
+
+	KERNEL_TARGET("avx2")
+	void quantize_residual(const short* const* bases_, int bases_count_, bool minimum_, short first_threshold_,
+		short second_threshold_, signed char* output_, int count_)
+	{
+		const __m256i positive_1 = _mm256_set1_epi16(short(first_threshold_ - 1));
+		const __m256i positive_2 = _mm256_set1_epi16(short(second_threshold_ - 1));
+		const __m256i negative_1 = _mm256_set1_epi16(short(1 - first_threshold_));
+		const __m256i negative_2 = _mm256_set1_epi16(short(1 - second_threshold_));
+		int x = 0;
+		for (; x + 16 <= count_; x += 16)
+		{
+			__m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bases_[0] + x));
+			for (int b = 1; b < bases_count_; b++)
+			{
+				__m256i other = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bases_[b] + x));
+				value = minimum_ ? _mm256_min_epi16(value, other) : _mm256_max_epi16(value, other);
+			}
+			// comparison masks are -1 where true
+			__m256i quantized = _mm256_sub_epi16(
+				_mm256_add_epi16(_mm256_cmpgt_epi16(negative_1, value), _mm256_cmpgt_epi16(negative_2, value)),
+				_mm256_add_epi16(_mm256_cmpgt_epi16(value, positive_1), _mm256_cmpgt_epi16(value, positive_2)));
+			__m128i packed = _mm_packs_epi16(_mm256_castsi256_si128(quantized), _mm256_extracti128_si256(quantized, 1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output_ + x), packed);
+		}
+		for (; x < count_; x++)
+		{
+			short value = bases_[0][x];
+			for (int b = 1; b < bases_count_; b++)
+			{
+				value = minimum_ ? std::min(value, bases_[b][x]) : std::max(value, bases_[b][x]);
+			}
+			output_[x] = static_cast<signed char>((value >= first_threshold_) + (value >= second_threshold_)
+				- (value <= -first_threshold_) - (value <= -second_threshold_));
+		}
+	}
+	KERNEL_TARGET("avx2")
+	void extract_bit_plane(const byte* samples_, int plane_, byte* bits_, std::size_t first_bit_, std::size_t count_)
+	{
+		std::size_t i = std::min(count_, (8 - first_bit_ % 8) % 8);
+		ExtractBitPlane(samples_, plane_, bits_, first_bit_, i);
+		byte* output = bits_ + (first_bit_ + i) / 8;
+		const __m256i reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+			7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+		const __m128i shift = _mm_cvtsi32_si128(7 - plane_);
+		for (; i + 32 <= count_; i += 32, output += 4)
+		{
+			__m256i samples = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples_ + i)), reverse);
+			unsigned int bits = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_sll_epi16(samples, shift)));
+			std::memcpy(output, &bits, sizeof(bits));
+		}
+		ExtractBitPlane(samples_ + i, plane_, bits_, first_bit_ + i, count_ - i);
+	}
+
+	KERNEL_TARGET("avx2")
+	void embed_bit_plane(byte* samples_, int plane_, const byte* bits_, std::size_t first_bit_, std::size_t count_)
+	{
+		std::size_t i = std::min(count_, (8 - first_bit_ % 8) % 8);
+		EmbedBitPlane(samples_, plane_, bits_, first_bit_, i);
+		const byte* input = bits_ + (first_bit_ + i) / 8;
+		// shuffles stay inside of 128-bit lanes, the upper lane takes the upper 2 bytes of the broadcast value
+		const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+			2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+		const __m256i select = _mm256_set1_epi64x(0x0102040810204080ll);
+		const __m256i plane = _mm256_set1_epi8(char(1 << plane_));
+		for (; i + 32 <= count_; i += 32, input += 4)
+		{
+			unsigned int bits;
+			std::memcpy(&bits, input, sizeof(bits));
+			__m256i selected = _mm256_and_si256(_mm256_shuffle_epi8(_mm256_set1_epi32(int(bits)), spread), select);
+			__m256i set = _mm256_and_si256(_mm256_cmpeq_epi8(selected, select), plane);
+			__m256i samples = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples_ + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(samples_ + i), _mm256_or_si256(_mm256_andnot_si256(plane, samples), set));
+		}
+		EmbedBitPlane(samples_ + i, plane_, bits_, first_bit_ + i, count_ - i);
+	}
+
+	/// Upper and lower words of the 64-bit products of every lane, the multiplier is the same in all lanes
+	KERNEL_TARGET("avx2")
+	void multiply_wide(__m256i value_, __m256i multiplier_, __m256i& high_, __m256i& low_)
+	{
+		__m256i even = _mm256_mul_epu32(value_, multiplier_);
+		__m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(value_, 32), multiplier_);
+		low_ = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+		high_ = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+	}
+
+	KERNEL_TARGET("avx2")
+	void philox(const unsigned int* key_, unsigned long long first_counter_, unsigned int* output_, std::size_t blocks_)
+	{
+		const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m256i sign = _mm256_set1_epi32(int(0x80000000));
+		const __m256i multipliers[2] = { _mm256_set1_epi32(int(philox_multipliers[0])), _mm256_set1_epi32(int(philox_multipliers[1])) };
+		std::size_t b = 0;
+		for (; b + 8 <= blocks_; b += 8)
+		{
+			// 8 counters in the words of the lanes, the lower word wraps in some lanes and carries into the upper one
+			unsigned long long counter = first_counter_ + b;
+			__m256i first_low = _mm256_set1_epi32(int(unsigned(counter)));
+			__m256i low = _mm256_add_epi32(first_low, lanes);
+			__m256i carry = _mm256_cmpgt_epi32(_mm256_xor_si256(first_low, sign), _mm256_xor_si256(low, sign));
+			__m256i x[4] = { low, _mm256_sub_epi32(_mm256_set1_epi32(int(unsigned(counter >> 32))), carry), _mm256_setzero_si256(), _mm256_setzero_si256() };
+			unsigned int key[2] = { key_[0], key_[1] };
+			for (int round = 0; round < philox_rounds; round++)
+			{
+				__m256i first_high, first_product_low, second_high, second_product_low;
+				multiply_wide(x[0], multipliers[0], first_high, first_product_low);
+				multiply_wide(x[2], multipliers[1], second_high, second_product_low);
+				x[0] = _mm256_xor_si256(_mm256_xor_si256(second_high, x[1]), _mm256_set1_epi32(int(key[0])));
+				x[1] = second_product_low;
+				x[2] = _mm256_xor_si256(_mm256_xor_si256(first_high, x[3]), _mm256_set1_epi32(int(key[1])));
+				x[3] = first_product_low;
+				key[0] += philox_key_increments[0];
+				key[1] += philox_key_increments[1];
+			}
+			// words of the lanes back into blocks, unpacking works within 128-bit lanes, blocks b and b + 4 share one
+			__m256i words_01 = _mm256_unpacklo_epi32(x[0], x[1]);
+			__m256i words_23 = _mm256_unpacklo_epi32(x[2], x[3]);
+			__m256i upper_01 = _mm256_unpackhi_epi32(x[0], x[1]);
+			__m256i upper_23 = _mm256_unpackhi_epi32(x[2], x[3]);
+			__m256i blocks_04 = _mm256_unpacklo_epi64(words_01, words_23);
+			__m256i blocks_15 = _mm256_unpackhi_epi64(words_01, words_23);
+			__m256i blocks_26 = _mm256_unpacklo_epi64(upper_01, upper_23);
+			__m256i blocks_37 = _mm256_unpackhi_epi64(upper_01, upper_23);
+			__m256i* output = reinterpret_cast<__m256i*>(output_ + 4 * b);
+			_mm256_storeu_si256(output, _mm256_permute2x128_si256(blocks_04, blocks_15, 0x20));
+			_mm256_storeu_si256(output + 1, _mm256_permute2x128_si256(blocks_26, blocks_37, 0x20));
+			_mm256_storeu_si256(output + 2, _mm256_permute2x128_si256(blocks_04, blocks_15, 0x31));
+			_mm256_storeu_si256(output + 3, _mm256_permute2x128_si256(blocks_26, blocks_37, 0x31));
+		}
+		Philox(key_, first_counter_ + b, output_ + 4 * b, blocks_ - b);
+	}
+
+	KERNEL_TARGET("avx2")
+	void gf_multiply_add(const byte* tables_, const byte* input_, byte* output_, std::size_t count_)
+	{
+		// PSHUFB looks up within 128-bit lanes, so both lanes hold the tables
+		const __m256i low_products = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tables_)));
+		const __m256i high_products = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tables_ + 16)));
+		const __m256i nibble = _mm256_set1_epi8(0x0F);
+		std::size_t i = 0;
+		for (; i + 32 <= count_; i += 32)
+		{
+			__m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input_ + i));
+			__m256i low = _mm256_shuffle_epi8(low_products, _mm256_and_si256(input, nibble));
+			__m256i high = _mm256_shuffle_epi8(high_products, _mm256_and_si256(_mm256_srli_epi64(input, 4), nibble));
+			__m256i* output = reinterpret_cast<__m256i*>(output_ + i);
+			_mm256_storeu_si256(output, _mm256_xor_si256(_mm256_loadu_si256(output), _mm256_xor_si256(low, high)));
+		}
+		GfMultiplyAdd(tables_, input_ + i, output_ + i, count_ - i);
+	}
+}
+
+/// Histogram is bound by the increments, not by finding the bins, so it stays with SSE4.2
+void Kernels::bind_avx2(KernelTable& table_)
+{
+	table_._dequantize = dequantize;
+	table_._inverse_dct = inverse_dct;
+	table_._ycbcr_to_rgb = ycbcr_to_rgb;
+	table_._usable_mask = usable_mask;
+	table_._filter_8_taps = filter_8_taps;
+	table_._residual = residual;
+	table_._quantize_residual = quantize_residual;
+	table_._extract_bit_plane = extract_bit_plane;
+	table_._embed_bit_plane = embed_bit_plane;
+	table_._philox = philox;
+	table_._gf_multiply_add = gf_multiply_add;
+}
+#else
+void Kernels::bind_avx2(KernelTable& table_)
+{
+}
+#endif
\ No newline at end of file
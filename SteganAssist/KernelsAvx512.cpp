@@ -0,0 +1,195 @@
+#include "Kernels.h"
+#include <algorithm>
+#include <cstring>
+#if KERNELS_X86
+#include <immintrin.h>
+
+namespace
+{
+	KERNEL_TARGET("avx2,avx512f,avx512bw")
+	void dequantize(const short* coefficients_, const int* table_, float* output_, std::size_t blocks_)
+	{
+		for (std::size_t i = 0; i < blocks_ * 64; i += 64)
+		{
+			for (int k = 0; k < 64; k += 16)
+			{
+				__m512i coefficients = _mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(coefficients_ + i + k)));
+				__m512i table = _mm512_loadu_si512(table_ + k);
+				_mm512_storeu_ps(output_ + i + k, _mm512_cvtepi32_ps(_mm512_mullo_epi32(coefficients, table)));
+			}
+		}
+	}
+
+	KERNEL_TARGET("avx2,avx512f,avx512bw")
+	unsigned long long usable_mask(const short* coefficients_)
+	{
+		const __m512i zero = _mm512_setzero_si512();
+		const __m512i one = _mm512_set1_epi16(1);
+		__m512i first = _mm512_loadu_si512(coefficients_);
+		__m512i second = _mm512_loadu_si512(coefficients_ + 32);
+		unsigned long long low = _mm512_cmpneq_epi16_mask(first, zero) & _mm512_cmpneq_epi16_mask(first, one);
+		unsigned long long high = _mm512_cmpneq_epi16_mask(second, zero) & _mm512_cmpneq_epi16_mask(second, one);
+		// DC coefficient is never usable
+		return (low | high << 32) & ~1ull;
+	}
+
+	KERNEL_TARGET("avx2,avx512f,avx512bw")
+	void filter_8_taps(const float* input_, std::ptrdiff_t step_, const float* weights_, float* output_, int count_)
+	{
+		int x = 0;
+		for (; x + 16 <= count_; x += 16)
+		{
+			// AVX-512 implies FMA, the explicit rounding forms keep products and sums from being fused
+			__m512 sum = _mm512_setzero_ps();
+			for (int n = 0; n < 8; n++)
+			{
+				__m512 product = _mm512_mul_round_ps(_mm512_loadu_ps(input_ + x + n * step_), _mm512_set1_ps(weights_[n]), _MM_FROUND_CUR_DIRECTION);
+				sum = _mm512_add_round_ps(sum, product, _MM_FROUND_CUR_DIRECTION);
+			}
+			_mm512_storeu_ps(output_ + x, sum);
+		}
+		for (; x < count_; x++)
+		{
+			float sum = 0;
+			for (int n = 0; n < 8; n++)
+			{
+				sum += input_[x + n * step_] * weights_[n];
+			}
+			output_[x] = sum;
+		}
+	}
+
+	KERNEL_TARGET("avx2,avx512f,avx512bw")
+	void residual(const short* const* rows_, const short* weights_, int taps_, short* output_, int count_)
+	{
+		int x = 0;
+		for (; x + 32 <= count_; x += 32)
+		{
+			__m512i sum = _mm512_setzero_si512();
+			for (int t = 0; t < taps_; t++)
+			{
+				__m512i value = _mm512_loadu_si512(rows_[t] + x);
+				sum = _mm512_add_epi16(sum, _mm512_mullo_epi16(value, _mm512_set1_epi16(weights_[t])));
+			}
+			_mm512_storeu_si512(output_ + x, sum);
+		}
+		for (; x < count_; x++)
+		{
+			int sum = 0;
+			for (int t = 0; t < taps_; t++)
+			{
+				sum += weights_[t] * rows_[t][x];
+			}
+			output_[x] = short(sum);
+		}
+	}
+
+	KERNEL_TARGET("avx2,avx512f,avx512bw")
+	void quantize_residual(const short* const* bases_, int bases_count_, bool minimum_, short first_threshold_,
+		short second_threshold_, signed char* output_, int count_)
+	{
+		const __m512i positive_1 = _mm512_set1_epi16(short(first_threshold_ - 1));
+		const __m512i positive_2 = _mm512_set1_epi16(short(second_threshold_ - 1));
+		const __m512i negative_1 = _mm512_set1_epi16(short(1 - first_threshold_));
+		const __m512i negative_2 = _mm512_set1_epi16(short(1 - second_threshold_));
+		const __m512i one = _mm512_set1_epi16(1);
+		int x = 0;
+		for (; x + 32 <= count_; x += 32)
+		{
+			__m512i value = _mm512_loadu_si512(bases_[0] + x);
+			for (int b = 1; b < bases_count_; b++)
+			{
+				__m512i other = _mm512_loadu_si512(bases_[b] + x);
+				value = minimum_ ? _mm512_min_epi16(value, other) : _mm512_max_epi16(value, other);
+			}
+			// every comparison adds or subtracts one in the lanes, where it holds
+			__m512i quantized = _mm512_setzero_si512();
+			quantized = _mm512_mask_add_epi16(quantized, _mm512_cmpgt_epi16_mask(value, positive_1), quantized, one);
+			quantized = _mm512_mask_add_epi16(quantized, _mm512_cmpgt_epi16_mask(value, positive_2), quantized, one);
+			quantized = _mm512_mask_sub_epi16(quantized, _mm512_cmpgt_epi16_mask(negative_1, value), quantized, one);
+			quantized = _mm512_mask_sub_epi16(quantized, _mm512_cmpgt_epi16_mask(negative_2, value), quantized, one);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(output_ + x), _mm512_cvtepi16_epi8(quantized));
+		}
+		for (; x < count_; x++)
+		{
+			short value = bases_[0][x];
+			for (int b = 1; b < bases_count_; b++)
+			{
+				value = minimum_ ? std::min(value, bases_[b][x]) : std::max(value, bases_[b][x]);
+			}
+			output_[x] = static_cast<signed char>((value >= first_threshold_) + (value >= second_threshold_)
+				- (value <= -first_threshold_) - (value <= -second_threshold_));
+		}
+	}
+	KERNEL_TARGET("avx2,avx512f,avx512bw")
+	void extract_bit_plane(const byte* samples_, int plane_, byte* bits_, std::size_t first_bit_, std::size_t count_)
+	{
+		std::size_t i = std::min(count_, (8 - first_bit_ % 8) % 8);
+		ExtractBitPlane(samples_, plane_, bits_, first_bit_, i);
+		byte* output = bits_ + (first_bit_ + i) / 8;
+		const __m512i reverse = _mm512_broadcast_i32x4(_mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8));
+		const __m512i plane = _mm512_set1_epi8(char(1 << plane_));
+		for (; i + 64 <= count_; i += 64, output += 8)
+		{
+			__m512i samples = _mm512_shuffle_epi8(_mm512_loadu_si512(samples_ + i), reverse);
+			unsigned long long bits = _mm512_test_epi8_mask(samples, plane);
+			std::memcpy(output, &bits, sizeof(bits));
+		}
+		ExtractBitPlane(samples_ + i, plane_, bits_, first_bit_ + i, count_ - i);
+	}
+
+	KERNEL_TARGET("avx2,avx512f,avx512bw")
+	void embed_bit_plane(byte* samples_, int plane_, const byte* bits_, std::size_t first_bit_, std::size_t count_)
+	{
+		std::size_t i = std::min(count_, (8 - first_bit_ % 8) % 8);
+		EmbedBitPlane(samples_, plane_, bits_, first_bit_, i);
+		const byte* input = bits_ + (first_bit_ + i) / 8;
+		const __m512i reverse = _mm512_broadcast_i32x4(_mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8));
+		const __m512i plane = _mm512_set1_epi8(char(1 << plane_));
+		for (; i + 64 <= count_; i += 64, input += 8)
+		{
+			unsigned long long bits;
+			std::memcpy(&bits, input, sizeof(bits));
+			// bit k of the mask sets byte k, the reversal puts the most significant bit of every stream byte first
+			__m512i set = _mm512_and_si512(_mm512_shuffle_epi8(_mm512_movm_epi8(bits), reverse), plane);
+			__m512i samples = _mm512_loadu_si512(samples_ + i);
+			_mm512_storeu_si512(samples_ + i, _mm512_or_si512(_mm512_andnot_si512(plane, samples), set));
+		}
+		EmbedBitPlane(samples_ + i, plane_, bits_, first_bit_ + i, count_ - i);
+	}
+
+	KERNEL_TARGET("avx2,avx512f,avx512bw")
+	void gf_multiply_add(const byte* tables_, const byte* input_, byte* output_, std::size_t count_)
+	{
+		const __m512i low_products = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tables_)));
+		const __m512i high_products = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tables_ + 16)));
+		const __m512i nibble = _mm512_set1_epi8(0x0F);
+		std::size_t i = 0;
+		for (; i + 64 <= count_; i += 64)
+		{
+			__m512i input = _mm512_loadu_si512(input_ + i);
+			__m512i low = _mm512_shuffle_epi8(low_products, _mm512_and_si512(input, nibble));
+			__m512i high = _mm512_shuffle_epi8(high_products, _mm512_and_si512(_mm512_srli_epi64(input, 4), nibble));
+			_mm512_storeu_si512(output_ + i, _mm512_xor_si512(_mm512_loadu_si512(output_ + i), _mm512_xor_si512(low, high)));
+		}
+		GfMultiplyAdd(tables_, input_ + i, output_ + i, count_ - i);
+	}
+}
+
+/// IDCT rows, color conversion and Philox fit 256-bit vectors, they stay with AVX2
+void Kernels::bind_avx512(KernelTable& table_)
+{
+	table_._dequantize = dequantize;
+	table_._usable_mask = usable_mask;
+	table_._filter_8_taps = filter_8_taps;
+	table_._residual = residual;
+	table_._quantize_residual = quantize_residual;
+	table_._extract_bit_plane = extract_bit_plane;
+	table_._embed_bit_plane = embed_bit_plane;
+	table_._gf_multiply_add = gf_multiply_add;
+}
+#else
+void Kernels::bind_avx512(KernelTable& table_)
+{
+}
+#endif
\ No newline at end of file
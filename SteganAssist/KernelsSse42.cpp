@@ -0,0 +1,548 @@
+#include "Kernels.h"
+#include "Dct.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#if KERNELS_X86
+#include <immintrin.h>
+
+namespace
+{
+	KERNEL_TARGET("sse4.2")
+	void dequantize(const short* coefficients_, const int* table_, float* output_, std::size_t blocks_)
+	{
+		for (std::size_t i = 0; i < blocks_ * 64; i += 64)
+		{
+			for (int k = 0; k < 64; k += 4)
+			{
+				__m128i coefficients = _mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(coefficients_ + i + k)));
+				__m128i table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table_ + k));
+				_mm_storeu_ps(output_ + i + k, _mm_cvtepi32_ps(_mm_mullo_epi32(coefficients, table)));
+			}
+		}
+	}
+
+	/// [u][x] = [x][u] of Dct::Cosines, so a row of the basis is one load
+	const float* transposed_cosines()
+	{
+		static const std::vector<float> transposed = []()
+		{
+			std::vector<float> values(64);
+			for (int x = 0; x < 8; x++)
+			{
+				for (int u = 0; u < 8; u++)
+				{
+					values[u * 8 + x] = Dct::Cosines()[x * 8 + u];
+				}
+			}
+			return values;
+		}();
+		return transposed.data();
+	}
+
+	KERNEL_TARGET("sse4.2")
+	void inverse_dct(const float* coefficients_, float* samples_)
+	{
+		const float* cosines = Dct::Cosines();
+		const float* transposed = transposed_cosines();
+
+		// rows first, then columns as in Dct::Inverse, every row of 8 samples is two vectors
+		alignas(16) float temp[64];
+		for (int v = 0; v < 8; v++)
+		{
+			__m128 low = _mm_setzero_ps();
+			__m128 high = _mm_setzero_ps();
+			for (int u = 0; u < 8; u++)
+			{
+				__m128 coefficient = _mm_set1_ps(coefficients_[v * 8 + u]);
+				low = _mm_add_ps(low, _mm_mul_ps(_mm_loadu_ps(transposed + u * 8), coefficient));
+				high = _mm_add_ps(high, _mm_mul_ps(_mm_loadu_ps(transposed + u * 8 + 4), coefficient));
+			}
+			_mm_store_ps(temp + v * 8, low);
+			_mm_store_ps(temp + v * 8 + 4, high);
+		}
+		for (int y = 0; y < 8; y++)
+		{
+			__m128 low = _mm_setzero_ps();
+			__m128 high = _mm_setzero_ps();
+			for (int v = 0; v < 8; v++)
+			{
+				__m128 cosine = _mm_set1_ps(cosines[y * 8 + v]);
+				low = _mm_add_ps(low, _mm_mul_ps(cosine, _mm_load_ps(temp + v * 8)));
+				high = _mm_add_ps(high, _mm_mul_ps(cosine, _mm_load_ps(temp + v * 8 + 4)));
+			}
+			_mm_storeu_ps(samples_ + y * 8, low);
+			_mm_storeu_ps(samples_ + y * 8 + 4, high);
+		}
+	}
+
+	/// Shuffles, that spread 16 samples of one channel over the 48 bytes of interleaved RGB,
+	/// [part][channel], bytes of the other channels are zeroed
+	const byte* interleave_masks()
+	{
+		static const std::vector<byte> masks = []()
+		{
+			std::vector<byte> values(3 * 3 * 16);
+			for (int part = 0; part < 3; part++)
+			{
+				for (int channel = 0; channel < 3; channel++)
+				{
+					for (int i = 0; i < 16; i++)
+					{
+						int position = part * 16 + i;
+						values[(part * 3 + channel) * 16 + i] = position % 3 == channel ? byte(position / 3) : 0x80;
+					}
+				}
+			}
+			return values;
+		}();
+		return masks.data();
+	}
+
+	KERNEL_TARGET("sse4.2")
+	__m128i clamp_samples(__m128 value_)
+	{
+		__m128 clamped = _mm_min_ps(_mm_max_ps(_mm_add_ps(value_, _mm_set1_ps(0.5f)), _mm_setzero_ps()), _mm_set1_ps(255.0f));
+		return _mm_cvttps_epi32(clamped);
+	}
+
+	KERNEL_TARGET("sse4.2")
+	void ycbcr_to_rgb(const byte* luminance_, const byte* blue_difference_, const byte* red_difference_, byte* rgb_, int count_)
+	{
+		const __m128i* masks = reinterpret_cast<const __m128i*>(interleave_masks());
+		const __m128 center = _mm_set1_ps(128.0f);
+		int x = 0;
+		for (; x + 16 <= count_; x += 16)
+		{
+			// groups of 4 samples in the lowest bytes, byte shifts need immediate counts
+			__m128i bytes[3][4];
+			const byte* planes[3] = { luminance_, blue_difference_, red_difference_ };
+			for (int c = 0; c < 3; c++)
+			{
+				bytes[c][0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[c] + x));
+				bytes[c][1] = _mm_srli_si128(bytes[c][0], 4);
+				bytes[c][2] = _mm_srli_si128(bytes[c][0], 8);
+				bytes[c][3] = _mm_srli_si128(bytes[c][0], 12);
+			}
+			__m128i channels[3][4];
+			for (int i = 0; i < 4; i++)
+			{
+				__m128 luminance = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes[0][i]));
+				__m128 blue_difference = _mm_sub_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes[1][i])), center);
+				__m128 red_difference = _mm_sub_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes[2][i])), center);
+				channels[0][i] = clamp_samples(_mm_add_ps(luminance, _mm_mul_ps(_mm_set1_ps(1.402f), red_difference)));
+				channels[1][i] = clamp_samples(_mm_sub_ps(_mm_sub_ps(luminance, _mm_mul_ps(_mm_set1_ps(0.344136f), blue_difference)),
+					_mm_mul_ps(_mm_set1_ps(0.714136f), red_difference)));
+				channels[2][i] = clamp_samples(_mm_add_ps(luminance, _mm_mul_ps(_mm_set1_ps(1.772f), blue_difference)));
+			}
+			__m128i packed[3];
+			for (int c = 0; c < 3; c++)
+			{
+				packed[c] = _mm_packus_epi16(_mm_packs_epi32(channels[c][0], channels[c][1]), _mm_packs_epi32(channels[c][2], channels[c][3]));
+			}
+			for (int part = 0; part < 3; part++)
+			{
+				__m128i output = _mm_or_si128(_mm_or_si128(
+					_mm_shuffle_epi8(packed[0], masks[part * 3]),
+					_mm_shuffle_epi8(packed[1], masks[part * 3 + 1])),
+					_mm_shuffle_epi8(packed[2], masks[part * 3 + 2]));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(rgb_ + x * 3 + part * 16), output);
+			}
+		}
+		for (; x < count_; x++)
+		{
+			float luminance = luminance_[x];
+			float blue_difference = blue_difference_[x] - 128.0f;
+			float red_difference = red_difference_[x] - 128.0f;
+			rgb_[x * 3] = byte(std::min(std::max(luminance + 1.402f * red_difference + 0.5f, 0.0f), 255.0f));
+			rgb_[x * 3 + 1] = byte(std::min(std::max(luminance - 0.344136f * blue_difference - 0.714136f * red_difference + 0.5f, 0.0f), 255.0f));
+			rgb_[x * 3 + 2] = byte(std::min(std::max(luminance + 1.772f * blue_difference + 0.5f, 0.0f), 255.0f));
+		}
+	}
+
+	KERNEL_TARGET("sse4.2")
+	unsigned long long usable_mask(const short* coefficients_)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i one = _mm_set1_epi16(1);
+		unsigned long long unusable = 0;
+		for (int i = 0; i < 64; i += 16)
+		{
+			__m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefficients_ + i));
+			__m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(coefficients_ + i + 8));
+			first = _mm_or_si128(_mm_cmpeq_epi16(first, zero), _mm_cmpeq_epi16(first, one));
+			second = _mm_or_si128(_mm_cmpeq_epi16(second, zero), _mm_cmpeq_epi16(second, one));
+			unusable |= (unsigned long long)(unsigned(_mm_movemask_epi8(_mm_packs_epi16(first, second)))) << i;
+		}
+		// DC coefficient is never usable
+		return ~unusable & ~1ull;
+	}
+
+	KERNEL_TARGET("sse4.2")
+	void histogram(const short* values_, std::size_t count_, int offset_, int bins_, unsigned long long* histogram_)
+	{
+		// bins are found by 16-bit arithmetic, which needs the bins to fit into it
+		int low = -offset_;
+		int high = bins_ - 1 - offset_;
+		if (low < -32768 || high > 32767 || bins_ > 65536)
+		{
+			for (std::size_t i = 0; i < count_; i++)
+			{
+				histogram_[std::min(std::max(values_[i] + offset_, 0), bins_ - 1)]++;
+			}
+			return;
+		}
+		const __m128i minimum = _mm_set1_epi16(short(low));
+		const __m128i maximum = _mm_set1_epi16(short(high));
+		const __m128i offset = _mm_set1_epi16(short(offset_));
+
+		// 4 partial histograms, so runs of equal values do not wait for each other's increments,
+		// 32-bit counters are flushed before they can overflow
+		const std::size_t flush_period = std::size_t(1) << 30;
+		std::vector<unsigned int> partial(4 * std::size_t(bins_));
+		alignas(16) unsigned short bins[8];
+		std::size_t i = 0;
+		while (i < count_)
+		{
+			std::size_t end = std::min(count_, i + flush_period);
+			for (; i + 8 <= end; i += 8)
+			{
+				__m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values_ + i));
+				value = _mm_add_epi16(_mm_min_epi16(_mm_max_epi16(value, minimum), maximum), offset);
+				_mm_store_si128(reinterpret_cast<__m128i*>(bins), value);
+				partial[bins[0]]++;
+				partial[bins_ + bins[1]]++;
+				partial[2 * bins_ + bins[2]]++;
+				partial[3 * bins_ + bins[3]]++;
+				partial[bins[4]]++;
+				partial[bins_ + bins[5]]++;
+				partial[2 * bins_ + bins[6]]++;
+				partial[3 * bins_ + bins[7]]++;
+			}
+			for (; i < end; i++)
+			{
+				partial[std::min(std::max(values_[i] + offset_, 0), bins_ - 1)]++;
+			}
+			for (int b = 0; b < bins_; b++)
+			{
+				histogram_[b] += partial[b] + partial[bins_ + b] + partial[2 * bins_ + b] + partial[3 * bins_ + b];
+			}
+			std::fill(partial.begin(), partial.end(), 0);
+		}
+	}
+
+	KERNEL_TARGET("sse4.2")
+	void filter_8_taps(const float* input_, std::ptrdiff_t step_, const float* weights_, float* output_, int count_)
+	{
+		int x = 0;
+		for (; x + 4 <= count_; x += 4)
+		{
+			__m128 sum = _mm_setzero_ps();
+			for (int n = 0; n < 8; n++)
+			{
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(input_ + x + n * step_), _mm_set1_ps(weights_[n])));
+			}
+			_mm_storeu_ps(output_ + x, sum);
+		}
+		for (; x < count_; x++)
+		{
+			float sum = 0;
+			for (int n = 0; n < 8; n++)
+			{
+				sum += input_[x + n * step_] * weights_[n];
+			}
+			output_[x] = sum;
+		}
+	}
+
+	KERNEL_TARGET("sse4.2")
+	void residual(const short* const* rows_, const short* weights_, int taps_, short* output_, int count_)
+	{
+		int x = 0;
+		for (; x + 8 <= count_; x += 8)
+		{
+			__m128i sum = _mm_setzero_si128();
+			for (int t = 0; t < taps_; t++)
+			{
+				__m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows_[t] + x));
+				sum = _mm_add_epi16(sum, _mm_mullo_epi16(value, _mm_set1_epi16(weights_[t])));
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(output_ + x), sum);
+		}
+		for (; x < count_; x++)
+		{
+			int sum = 0;
+			for (int t = 0; t < taps_; t++)
+			{
+				sum += weights_[t] * rows_[t][x];
+			}
+			output_[x] = short(sum);
+		}
+	}
+
+	KERNEL_TARGET("sse4.2")
+	void quantize_residual(const short* const* bases_, int bases_count_, bool minimum_, short first_threshold_,
+		short second_threshold_, signed char* output_, int count_)
+	{
+		const __m128i positive_1 = _mm_set1_epi16(short(first_threshold_ - 1));
+		const __m128i positive_2 = _mm_set1_epi16(short(second_threshold_ - 1));
+		const __m128i negative_1 = _mm_set1_epi16(short(1 - first_threshold_));
+		const __m128i negative_2 = _mm_set1_epi16(short(1 - second_threshold_));
+		int x = 0;
+		for (; x + 8 <= count_; x += 8)
+		{
+			__m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bases_[0] + x));
+			for (int b = 1; b < bases_count_; b++)
+			{
+				__m128i other = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bases_[b] + x));
+				value = minimum_ ? _mm_min_epi16(value, other) : _mm_max_epi16(value, other);
+			}
+			// comparison masks are -1 where true
+			__m128i quantized = _mm_sub_epi16(
+				_mm_add_epi16(_mm_cmpgt_epi16(negative_1, value), _mm_cmpgt_epi16(negative_2, value)),
+				_mm_add_epi16(_mm_cmpgt_epi16(value, positive_1), _mm_cmpgt_epi16(value, positive_2)));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(output_ + x), _mm_packs_epi16(quantized, quantized));
+		}
+		for (; x < count_; x++)
+		{
+			short value = bases_[0][x];
+			for (int b = 1; b < bases_count_; b++)
+			{
+				value = minimum_ ? std::min(value, bases_[b][x]) : std::max(value, bases_[b][x]);
+			}
+			output_[x] = static_cast<signed char>((value >= first_threshold_) + (value >= second_threshold_)
+				- (value <= -first_threshold_) - (value <= -second_threshold_));
+		}
+	}
+	KERNEL_TARGET("sse4.2")
+	void extract_bit_plane(const byte* samples_, int plane_, byte* bits_, std::size_t first_bit_, std::size_t count_)
+	{
+		// bits before the first whole byte of the stream
+		std::size_t i = std::min(count_, (8 - first_bit_ % 8) % 8);
+		ExtractBitPlane(samples_, plane_, bits_, first_bit_, i);
+		byte* output = bits_ + (first_bit_ + i) / 8;
+		// samples are reversed inside of every 8, so the first one becomes the most significant bit,
+		// and the plane is shifted into the sign bit of every byte
+		const __m128i reverse = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+		const __m128i shift = _mm_cvtsi32_si128(7 - plane_);
+		for (; i + 16 <= count_; i += 16, output += 2)
+		{
+			__m128i samples = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples_ + i)), reverse);
+			unsigned short bits = static_cast<unsigned short>(_mm_movemask_epi8(_mm_sll_epi16(samples, shift)));
+			std::memcpy(output, &bits, sizeof(bits));
+		}
+		ExtractBitPlane(samples_ + i, plane_, bits_, first_bit_ + i, count_ - i);
+	}
+
+	KERNEL_TARGET("sse4.2")
+	void embed_bit_plane(byte* samples_, int plane_, const byte* bits_, std::size_t first_bit_, std::size_t count_)
+	{
+		std::size_t i = std::min(count_, (8 - first_bit_ % 8) % 8);
+		EmbedBitPlane(samples_, plane_, bits_, first_bit_, i);
+		const byte* input = bits_ + (first_bit_ + i) / 8;
+		// every byte of the stream goes to 8 lanes, each lane keeps its own bit of it
+		const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+		const __m128i select = _mm_setr_epi8(char(0x80), 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+			char(0x80), 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+		const __m128i plane = _mm_set1_epi8(char(1 << plane_));
+		for (; i + 16 <= count_; i += 16, input += 2)
+		{
+			unsigned short bits;
+			std::memcpy(&bits, input, sizeof(bits));
+			__m128i selected = _mm_and_si128(_mm_shuffle_epi8(_mm_cvtsi32_si128(bits), spread), select);
+			__m128i set = _mm_and_si128(_mm_cmpeq_epi8(selected, select), plane);
+			__m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples_ + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(samples_ + i), _mm_or_si128(_mm_andnot_si128(plane, samples), set));
+		}
+		EmbedBitPlane(samples_ + i, plane_, bits_, first_bit_ + i, count_ - i);
+	}
+
+	/// Pixel of 3, 4, 6 or 8 bytes in the low bytes of the register, the rest is zero.
+	/// The size is known at compile time, so the copies become plain moves.
+	template<int bytes_>
+	KERNEL_TARGET("sse4.2")
+	__m128i load_pixel(const byte* pixel_)
+	{
+		long long value = 0;
+		std::memcpy(&value, pixel_, bytes_);
+		return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(&value));
+	}
+
+	template<int bytes_>
+	KERNEL_TARGET("sse4.2")
+	void store_pixel(byte* pixel_, __m128i value_)
+	{
+		long long value;
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(&value), value_);
+		std::memcpy(pixel_, &value, bytes_);
+	}
+
+	/// Sub, Avg and Paeth depend on the pixel to the left, so they go pixel by pixel, all its bytes at once
+	template<int bytes_>
+	KERNEL_TARGET("sse4.2")
+	void unfilter_pixels(int filter_, byte* row_, const byte* prior_, std::size_t size_)
+	{
+		// a, b and c of [9.2] are the pixel to the left, the one above and the one above to the left
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i one = _mm_set1_epi8(1);
+		__m128i a = zero;
+		__m128i c = zero;
+		for (std::size_t i = 0; i < size_; i += bytes_)
+		{
+			__m128i x = load_pixel<bytes_>(row_ + i);
+			if (filter_ == 1)
+			{
+				a = _mm_add_epi8(x, a);
+			}
+			else if (filter_ == 3)
+			{
+				// avg_epu8 rounds up, the filter rounds down
+				__m128i b = load_pixel<bytes_>(prior_ + i);
+				__m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+				a = _mm_add_epi8(x, average);
+			}
+			else
+			{
+				__m128i b = load_pixel<bytes_>(prior_ + i);
+				__m128i a16 = _mm_unpacklo_epi8(a, zero);
+				__m128i b16 = _mm_unpacklo_epi8(b, zero);
+				__m128i c16 = _mm_unpacklo_epi8(c, zero);
+				__m128i pa = _mm_sub_epi16(b16, c16);
+				__m128i pb = _mm_sub_epi16(a16, c16);
+				__m128i pc = _mm_abs_epi16(_mm_add_epi16(pa, pb));
+				pa = _mm_abs_epi16(pa);
+				pb = _mm_abs_epi16(pb);
+				__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+				// c unless b is nearest, a wins all ties
+				__m128i nearest = _mm_blendv_epi8(c16, b16, _mm_cmpeq_epi16(pb, smallest));
+				nearest = _mm_blendv_epi8(nearest, a16, _mm_cmpeq_epi16(pa, smallest));
+				a = _mm_add_epi8(x, _mm_packus_epi16(nearest, nearest));
+				c = b;
+			}
+			store_pixel<bytes_>(row_ + i, a);
+		}
+	}
+
+	KERNEL_TARGET("sse4.2")
+	void unfilter_row(int filter_, byte* row_, const byte* prior_, std::size_t size_, int bytes_per_pixel_)
+	{
+		const std::size_t left = std::size_t(bytes_per_pixel_);
+		if (filter_ == 2)
+		{
+			std::size_t i = 0;
+			for (; i + 16 <= size_; i += 16)
+			{
+				__m128i row = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row_ + i));
+				__m128i prior = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prior_ + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(row_ + i), _mm_add_epi8(row, prior));
+			}
+			UnfilterRow(2, row_ + i, prior_ + i, size_ - i, bytes_per_pixel_);
+			return;
+		}
+		if (filter_ < 1 || filter_ > 4 || size_ % left)
+		{
+			UnfilterRow(filter_, row_, prior_, size_, bytes_per_pixel_);
+			return;
+		}
+		switch (left)
+		{
+		case 3: unfilter_pixels<3>(filter_, row_, prior_, size_); break;
+		case 4: unfilter_pixels<4>(filter_, row_, prior_, size_); break;
+		case 6: unfilter_pixels<6>(filter_, row_, prior_, size_); break;
+		case 8: unfilter_pixels<8>(filter_, row_, prior_, size_); break;
+		default: UnfilterRow(filter_, row_, prior_, size_, bytes_per_pixel_); break;
+		}
+	}
+
+	/// Upper and lower words of the 64-bit products of every lane, the multiplier is the same in all lanes
+	KERNEL_TARGET("sse4.2")
+	void multiply_wide(__m128i value_, __m128i multiplier_, __m128i& high_, __m128i& low_)
+	{
+		__m128i even = _mm_mul_epu32(value_, multiplier_);
+		__m128i odd = _mm_mul_epu32(_mm_srli_epi64(value_, 32), multiplier_);
+		low_ = _mm_blend_epi16(even, _mm_slli_epi64(odd, 32), 0xCC);
+		high_ = _mm_blend_epi16(_mm_srli_epi64(even, 32), odd, 0xCC);
+	}
+
+	KERNEL_TARGET("sse4.2")
+	void philox(const unsigned int* key_, unsigned long long first_counter_, unsigned int* output_, std::size_t blocks_)
+	{
+		const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+		const __m128i sign = _mm_set1_epi32(int(0x80000000));
+		const __m128i multipliers[2] = { _mm_set1_epi32(int(philox_multipliers[0])), _mm_set1_epi32(int(philox_multipliers[1])) };
+		std::size_t b = 0;
+		for (; b + 4 <= blocks_; b += 4)
+		{
+			// 4 counters in the words of the lanes, the lower word wraps in some lanes and carries into the upper one
+			unsigned long long counter = first_counter_ + b;
+			__m128i first_low = _mm_set1_epi32(int(unsigned(counter)));
+			__m128i low = _mm_add_epi32(first_low, lanes);
+			__m128i carry = _mm_cmpgt_epi32(_mm_xor_si128(first_low, sign), _mm_xor_si128(low, sign));
+			__m128i x[4] = { low, _mm_sub_epi32(_mm_set1_epi32(int(unsigned(counter >> 32))), carry), _mm_setzero_si128(), _mm_setzero_si128() };
+			unsigned int key[2] = { key_[0], key_[1] };
+			for (int round = 0; round < philox_rounds; round++)
+			{
+				__m128i first_high, first_product_low, second_high, second_product_low;
+				multiply_wide(x[0], multipliers[0], first_high, first_product_low);
+				multiply_wide(x[2], multipliers[1], second_high, second_product_low);
+				x[0] = _mm_xor_si128(_mm_xor_si128(second_high, x[1]), _mm_set1_epi32(int(key[0])));
+				x[1] = second_product_low;
+				x[2] = _mm_xor_si128(_mm_xor_si128(first_high, x[3]), _mm_set1_epi32(int(key[1])));
+				x[3] = first_product_low;
+				key[0] += philox_key_increments[0];
+				key[1] += philox_key_increments[1];
+			}
+			// 4 x 4 transposition, words of the lanes back into blocks
+			__m128i words_01 = _mm_unpacklo_epi32(x[0], x[1]);
+			__m128i words_23 = _mm_unpacklo_epi32(x[2], x[3]);
+			__m128i upper_01 = _mm_unpackhi_epi32(x[0], x[1]);
+			__m128i upper_23 = _mm_unpackhi_epi32(x[2], x[3]);
+			__m128i* output = reinterpret_cast<__m128i*>(output_ + 4 * b);
+			_mm_storeu_si128(output, _mm_unpacklo_epi64(words_01, words_23));
+			_mm_storeu_si128(output + 1, _mm_unpackhi_epi64(words_01, words_23));
+			_mm_storeu_si128(output + 2, _mm_unpacklo_epi64(upper_01, upper_23));
+			_mm_storeu_si128(output + 3, _mm_unpackhi_epi64(upper_01, upper_23));
+		}
+		Philox(key_, first_counter_ + b, output_ + 4 * b, blocks_ - b);
+	}
+
+	KERNEL_TARGET("sse4.2")
+	void gf_multiply_add(const byte* tables_, const byte* input_, byte* output_, std::size_t count_)
+	{
+		const __m128i low_products = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tables_));
+		const __m128i high_products = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tables_ + 16));
+		const __m128i nibble = _mm_set1_epi8(0x0F);
+		std::size_t i = 0;
+		for (; i + 16 <= count_; i += 16)
+		{
+			__m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input_ + i));
+			__m128i low = _mm_shuffle_epi8(low_products, _mm_and_si128(input, nibble));
+			__m128i high = _mm_shuffle_epi8(high_products, _mm_and_si128(_mm_srli_epi64(input, 4), nibble));
+			__m128i* output = reinterpret_cast<__m128i*>(output_ + i);
+			_mm_storeu_si128(output, _mm_xor_si128(_mm_loadu_si128(output), _mm_xor_si128(low, high)));
+		}
+		GfMultiplyAdd(tables_, input_ + i, output_ + i, count_ - i);
+	}
+}
+
+void Kernels::bind_sse42(KernelTable& table_)
+{
+	table_._dequantize = dequantize;
+	table_._inverse_dct = inverse_dct;
+	table_._ycbcr_to_rgb = ycbcr_to_rgb;
+	table_._usable_mask = usable_mask;
+	table_._histogram = histogram;
+	table_._filter_8_taps = filter_8_taps;
+	table_._residual = residual;
+	table_._quantize_residual = quantize_residual;
+	table_._extract_bit_plane = extract_bit_plane;
+	table_._embed_bit_plane = embed_bit_plane;
+	table_._unfilter_row = unfilter_row;
+	table_._philox = philox;
+	table_._gf_multiply_add = gf_multiply_add;
+}
+#else
+void Kernels::bind_sse42(KernelTable& table_)
+{
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,141 @@
+#include "KeyedPermutation.h"
+#include "Kernels.h"
+#include <stdexcept>
+#include <algorithm>
+
+namespace
+{
+	/// [MurmurHash3] 32-bit finalizer, every bit of the input flips every bit of the output with probability near 1/2
+	unsigned int mix(unsigned int value_)
+	{
+		value_ ^= value_ >> 16;
+		value_ *= 0x85EBCA6B;
+		value_ ^= value_ >> 13;
+		value_ *= 0xC2B2AE35;
+		value_ ^= value_ >> 16;
+		return value_;
+	}
+}
+
+KeyedPermutation::KeyedPermutation(const std::string& key_, unsigned long long size_)
+	: _size(size_)
+{
+	if (key_.empty())
+	{
+		throw std::invalid_argument("Key of the permutation is empty");
+	}
+	if (size_ > max_size)
+	{
+		throw std::invalid_argument("Permutation of more than 2^62 indices");
+	}
+	const KernelTable& kernels = Kernels::Get();
+
+	// Davies-Meyer over Philox: every 8 bytes of the key string key the generator at the chaining value,
+	// its output is added into the chain, the length goes last, so trailing zero bytes count
+	unsigned long long chain = 0;
+	unsigned int block[4];
+	for (std::size_t i = 0; i < key_.size(); i += 8)
+	{
+		unsigned int words[2] = { 0, 0 };
+		for (std::size_t j = i; j < std::min(i + 8, key_.size()); j++)
+		{
+			words[(j - i) / 4] |= unsigned(byte(key_[j])) << (8 * ((j - i) % 4));
+		}
+		kernels._philox(words, chain, block, 1);
+		chain ^= (unsigned long long)(block[1] ^ block[3]) << 32 | (block[0] ^ block[2]);
+	}
+	const unsigned int chain_words[2] = { unsigned(chain), unsigned(chain >> 32) };
+	kernels._philox(chain_words, key_.size(), block, 1);
+	_key[0] = block[0];
+	_key[1] = block[1];
+
+	// counters 0 and 1 of the key give the round keys, Shuffle counts from 2 on
+	int bits = 0;
+	while ((1ull << bits) < size_)
+	{
+		bits++;
+	}
+	_half_bits = std::max(1, (bits + 1) / 2);
+	_half_mask = (1u << _half_bits) - 1;
+	unsigned int round_keys[8];
+	kernels._philox(_key, 0, round_keys, 2);
+	std::copy(round_keys, round_keys + feistel_rounds, _round_keys);
+}
+
+unsigned int KeyedPermutation::round_function(int round_, unsigned int half_) const
+{
+	return mix(half_ ^ _round_keys[round_]) & _half_mask;
+}
+
+unsigned long long KeyedPermutation::encrypt(unsigned long long value_) const
+{
+	unsigned int left = unsigned(value_ >> _half_bits);
+	unsigned int right = unsigned(value_) & _half_mask;
+	for (int round = 0; round < feistel_rounds; round++)
+	{
+		unsigned int next = left ^ this->round_function(round, right);
+		left = right;
+		right = next;
+	}
+	return (unsigned long long)left << _half_bits | right;
+}
+
+unsigned long long KeyedPermutation::Size() const
+{
+	return _size;
+}
+
+unsigned long long KeyedPermutation::At(unsigned long long position_) const
+{
+	// cycle walking: the domain holds less than 4 times the indices, so a few passes on average,
+	// and the cycle of an index below the size always comes back below it
+	unsigned long long index = position_;
+	do
+	{
+		index = this->encrypt(index);
+	} while (index >= _size);
+	return index;
+}
+
+std::vector<unsigned int> KeyedPermutation::Shuffle() const
+{
+	if (_size > 0x100000000ull)
+	{
+		throw std::invalid_argument("Table of the order holds 32-bit indices");
+	}
+	std::vector<unsigned int> order(_size);
+	for (std::size_t i = 0; i < order.size(); i++)
+	{
+		order[i] = unsigned(i);
+	}
+	const KernelTable& kernels = Kernels::Get();
+	unsigned int random[4 * random_batch];
+	std::size_t used = 4 * random_batch;
+	unsigned long long counter = 2;
+	auto next = [&]()
+	{
+		if (used == 4 * random_batch)
+		{
+			kernels._philox(_key, counter, random, random_batch);
+			counter += random_batch;
+			used = 0;
+		}
+		return random[used++];
+	};
+	// [Lemire, Fast random integer generation in an interval] the upper word of random * i is uniform in 0 .. i - 1
+	// once the rare lower words below (2^32 - i) mod i are rejected
+	for (unsigned long long i = _size; i > 1; i--)
+	{
+		unsigned long long product = (unsigned long long)next() * i;
+		if (unsigned(product) < i)
+		{
+			const unsigned int threshold = unsigned((0x100000000ull - i) % i);
+			while (unsigned(product) < threshold)
+			{
+				product = (unsigned long long)next() * i;
+			}
+		}
+		std::swap(order[i - 1], order[product >> 32]);
+	}
+	return order;
+}
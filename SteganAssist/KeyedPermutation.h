@@ -0,0 +1,39 @@
+#pragma once
+#include<vector>
+#include<string>
+
+/// KeyedPermutation class, that orders indices 0 .. size - 1 by a secret key. The key string is absorbed into the
+/// 64-bit key of Philox4x32-10, a counter-based generator, so any block of its output is computed without the ones
+/// before it and the vector kernels produce many blocks at once.
+/// At is the bijective mode: a balanced Feistel network over the smallest domain of an even number of bits holding
+/// the indices, walking the cycle of the index until it falls below the size. Nothing but the round keys is stored,
+/// so the order of any size is derived on the fly. Shuffle is the table mode: Fisher-Yates with the random numbers
+/// taken from Philox in batches, for callers, who want the whole order at hand.
+class KeyedPermutation
+{
+	static const int feistel_rounds = 6;
+	static const int random_batch = 64; // Philox blocks generated at once by Shuffle
+
+	unsigned int _key[2];
+	unsigned long long _size;
+	int _half_bits;
+	unsigned int _half_mask;
+	unsigned int _round_keys[feistel_rounds];
+
+	unsigned int round_function(int round_, unsigned int half_) const;
+	/// One pass of the Feistel network over the whole domain
+	unsigned long long encrypt(unsigned long long value_) const;
+
+public:
+
+	static const unsigned long long max_size = 1ull << 62;
+
+	/// Order of size_ indices under key_, throws std::invalid_argument for an empty key or a size above max_size
+	KeyedPermutation(const std::string& key_, unsigned long long size_);
+
+	unsigned long long Size() const;
+	/// Index at position position_ of the order, position_ must be below Size
+	unsigned long long At(unsigned long long position_) const;
+	/// Another order of the same key as a table of Size indices, throws std::invalid_argument when they do not fit 32 bits
+	std::vector<unsigned int> Shuffle() const;
+};
@@ -0,0 +1,29 @@
+#include "Parallel.h"
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+int Parallel::ThreadsFor(int threads_, size_t work_)
+{
+	if (threads_ <= 0)
+	{
+		threads_ = std::max(1u, std::thread::hardware_concurrency());
+	}
+	// threads are not worth starting for small images
+	const size_t min_work_per_thread = 1 << 16;
+	return int(std::max<size_t>(1, std::min<size_t>(threads_, work_ / min_work_per_thread)));
+}
+
+void Parallel::Run(int threads_, const std::function<void(int thread_)>& work_)
+{
+	std::vector<std::thread> threads;
+	for (int i = 1; i < threads_; i++)
+	{
+		threads.emplace_back(work_, i);
+	}
+	work_(0);
+	for (int i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+}
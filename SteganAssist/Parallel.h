@@ -0,0 +1,13 @@
+#pragma once
+#include<functional>
+#include<cstddef>
+
+/// Parallel class, that splits per-image work between short-living threads
+class Parallel
+{
+public:
+	/// Number of threads worth starting for work_ elementary operations, threads_ equal to 0 means hardware concurrency
+	static int ThreadsFor(int threads_, size_t work_);
+	/// Runs work_(thread_) for thread_ from 0 to threads_ - 1, the 0th one on the calling thread
+	static void Run(int threads_, const std::function<void(int thread_)>& work_);
+};
\ No newline at end of file
@@ -0,0 +1,572 @@
+#include "Payload.h"
+#include "Jpeg.h"
+#include "JpegDecoder.h"
+#include "Bmp.h"
+#include "Png.h"
+#include "JpegStream.h"
+#include "JpegWriter.h"
+#include "Kernels.h"
+#include "ReedSolomon.h"
+#include "Deflate.h"
+#include <stdexcept>
+#include <algorithm>
+
+namespace
+{
+	/// Payload carrying bytes of every row, 0 for bitmaps, which can't carry spatial payload
+	std::size_t carrier_row_size(const Bmp& bmp_)
+	{
+		if (bmp_.IsPalettized() && !bmp_.IsGrayscale())
+		{
+			return 0;
+		}
+		return std::size_t(bmp_.GetWidth()) * bmp_.GetBytesPerPixel();
+	}
+
+	/// 8-bit samples of every color type but indexed, alpha included
+	std::size_t carrier_row_size(const Png& png_)
+	{
+		if (png_.IsPalettized() || png_.GetBitDepth() != 8)
+		{
+			return 0;
+		}
+		return png_.GetRowSize();
+	}
+
+	void check_message_fits(std::size_t message_size_, unsigned long long capacity_)
+	{
+		if (message_size_ > capacity_)
+		{
+			throw std::runtime_error("Message does not fit into the image: " + std::to_string(message_size_) +
+				" bytes, capacity " + std::to_string(capacity_) + " bytes");
+		}
+	}
+
+	/// Bits of the length and of the message written into usable coefficients of block after block
+	class SequentialPayload
+	{
+		const std::vector<byte>& _message;
+		unsigned long long _bits_written;
+		unsigned long long _bits_to_write;
+
+		bit next_bit()
+		{
+			unsigned long long index = _bits_written++;
+			if (index < 32)
+			{
+				return (_message.size() >> (31 - index)) & 1;
+			}
+			index -= 32;
+			return (_message[index / 8] >> (7 - index % 8)) & 1;
+		}
+
+	public:
+
+		explicit SequentialPayload(const std::vector<byte>& message_)
+			: _message(message_)
+			, _bits_written(0)
+			, _bits_to_write(32 + 8ull * message_.size())
+		{
+		}
+
+		bool IsComplete() const
+		{
+			return _bits_written >= _bits_to_write;
+		}
+
+		/// True, when a coefficient of the block was changed
+		bool EmbedBlock(short* coefficients_, const KernelTable& kernels_)
+		{
+			// usable coefficients stay usable, so the mask found before writing holds
+			bool changed = false;
+			for (unsigned long long mask = kernels_._usable_mask(coefficients_); mask && _bits_written < _bits_to_write; mask &= mask - 1)
+			{
+				int i = LowestSetBit(mask);
+				short value = short((coefficients_[i] & ~1) | next_bit());
+				changed |= value != coefficients_[i];
+				coefficients_[i] = value;
+			}
+			return changed;
+		}
+	};
+
+	const char* carrier_requirement(const Bmp&)
+	{
+		return "Only 24-bit, 32-bit and 8-bit grayscale bitmaps carry spatial payload";
+	}
+
+	const char* carrier_requirement(const Png&)
+	{
+		return "Only PNG images of 8-bit samples without a palette carry spatial payload";
+	}
+
+	template<class Carrier>
+	void check_carrier(const Carrier& carrier_, int plane_)
+	{
+		if (!carrier_row_size(carrier_))
+		{
+			throw std::runtime_error(carrier_requirement(carrier_));
+		}
+		if (plane_ < 0 || plane_ > 7)
+		{
+			throw std::invalid_argument("Bit plane must be from 0 to 7");
+		}
+	}
+
+	/// Calls kernel_(samples, first bit of the span in bits_, count) for the samples of payload bits
+	/// from first_bit_ to first_bit_ + count_, a span never crosses rows
+	template<class Samples, class Kernel>
+	void for_each_span(Samples& carrier_, unsigned long long first_bit_, unsigned long long count_, Kernel kernel_)
+	{
+		std::size_t row_size = carrier_row_size(carrier_);
+		for (unsigned long long k = first_bit_; k < first_bit_ + count_;)
+		{
+			std::size_t x = std::size_t(k % row_size);
+			std::size_t count = std::size_t(std::min<unsigned long long>(row_size - x, first_bit_ + count_ - k));
+			kernel_(carrier_.Row(int(k / row_size)) + x, std::size_t(k - first_bit_), count);
+			k += count;
+		}
+	}
+
+	/// Bytes of message, which fit into the usable coefficients of the decoded image
+	unsigned long long capacity_of(const Jpeg& jpeg_, const KernelTable& kernels_)
+	{
+		unsigned long long usable = 0;
+		jpeg_.ForEachBlockInScanOrder([&usable, &kernels_](const Jpeg::BlockPosition& position_, const short* coefficients_)
+		{
+			usable += CountSetBits(kernels_._usable_mask(coefficients_));
+		});
+		return usable >= 32 ? (usable - 32) / 8 : 0;
+	}
+
+	template<class Carrier>
+	unsigned long long capacity_spatial(const Carrier& carrier_)
+	{
+		unsigned long long bits = (unsigned long long)carrier_row_size(carrier_) * carrier_.GetHeight();
+		return bits >= 32 ? (bits - 32) / 8 : 0;
+	}
+
+	template<class Carrier>
+	std::vector<byte> extract_spatial(const Carrier& carrier_, int plane_)
+	{
+		const int length_bits = 32;
+		check_carrier(carrier_, plane_);
+		const KernelTable& kernels = Kernels::Get();
+		unsigned long long capacity = (unsigned long long)carrier_row_size(carrier_) * carrier_.GetHeight();
+		auto read = [&carrier_, &kernels, plane_](byte* bits_, unsigned long long first_bit_, unsigned long long count_)
+		{
+			for_each_span(carrier_, first_bit_, count_, [&](const byte* samples_, std::size_t bit_, std::size_t span_)
+			{
+				kernels._extract_bit_plane(samples_, plane_, bits_, bit_, span_);
+			});
+		};
+		if (capacity < length_bits)
+		{
+			throw std::runtime_error("Image ends before the end of payload");
+		}
+		byte length[4];
+		read(length, 0, length_bits);
+		unsigned long long message_length = (unsigned long long)length[0] << 24 | length[1] << 16 | length[2] << 8 | length[3];
+		if (length_bits + 8 * message_length > capacity)
+		{
+			throw std::runtime_error("Image ends before the end of payload");
+		}
+		std::vector<byte> message(message_length);
+		read(message.data(), length_bits, 8 * message_length);
+		return message;
+	}
+
+	template<class Carrier>
+	void embed_spatial(Carrier& carrier_, const std::vector<byte>& message_, int plane_)
+	{
+		check_carrier(carrier_, plane_);
+		check_message_fits(message_.size(), capacity_spatial(carrier_));
+		// the length and the message form one stream of bits, so the kernels never stop between them
+		std::vector<byte> stream(4 + message_.size());
+		for (int i = 0; i < 4; i++)
+		{
+			stream[i] = byte(message_.size() >> (24 - 8 * i));
+		}
+		std::copy(message_.begin(), message_.end(), stream.begin() + 4);
+		const KernelTable& kernels = Kernels::Get();
+		for_each_span(carrier_, 0, 8ull * stream.size(), [&](byte* samples_, std::size_t bit_, std::size_t span_)
+		{
+			kernels._embed_bit_plane(samples_, plane_, stream.data(), bit_, span_);
+		});
+	}
+
+	const unsigned int shard_magic = 0x53415348; // "SASH"
+	const byte shard_version = 1;
+
+	void write_u32(unsigned int value_, byte* output_)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			output_[i] = byte(value_ >> (24 - 8 * i));
+		}
+	}
+
+	unsigned int read_u32(const byte* input_)
+	{
+		return unsigned(input_[0]) << 24 | unsigned(input_[1]) << 16 | unsigned(input_[2]) << 8 | input_[3];
+	}
+
+	/// Fields of the shard header
+	struct ShardHeader
+	{
+		int _data_shards;
+		int _total_shards;
+		int _index;
+		unsigned int _length;
+		unsigned int _crc;
+
+		std::size_t ShardSize() const
+		{
+			return (std::size_t(_length) + _data_shards - 1) / _data_shards;
+		}
+
+		bool SameMessage(const ShardHeader& other_) const
+		{
+			return _data_shards == other_._data_shards && _total_shards == other_._total_shards &&
+				_length == other_._length && _crc == other_._crc;
+		}
+	};
+
+	/// Header of an intact shard, false for anything else
+	bool read_shard_header(const std::vector<byte>& payload_, std::size_t header_size_, ShardHeader& header_)
+	{
+		if (payload_.size() < header_size_ || read_u32(payload_.data()) != shard_magic || payload_[4] != shard_version)
+		{
+			return false;
+		}
+		header_._data_shards = payload_[5];
+		header_._total_shards = payload_[6];
+		header_._index = payload_[7];
+		header_._length = read_u32(payload_.data() + 8);
+		header_._crc = read_u32(payload_.data() + 12);
+		if (header_._data_shards == 0 || header_._total_shards < header_._data_shards || header_._index >= header_._total_shards ||
+			payload_.size() != header_size_ + header_.ShardSize())
+		{
+			return false;
+		}
+		unsigned int crc = Deflate::Crc32(payload_.data(), 16);
+		crc = Deflate::Crc32(payload_.data() + header_size_, payload_.size() - header_size_, crc);
+		return crc == read_u32(payload_.data() + 16);
+	}
+}
+
+PayloadExtractor::PayloadExtractor()
+	: _bits_read(0)
+	, _length(0)
+	, _current_byte(0)
+{
+}
+
+void PayloadExtractor::consume_bit(bit value_)
+{
+	if (_bits_read < length_bits)
+	{
+		_length = (_length << 1) | value_;
+	}
+	else
+	{
+		_current_byte = (_current_byte << 1) | value_;
+		if ((_bits_read - length_bits) % 8 == 7)
+		{
+			_message.push_back(_current_byte);
+			_current_byte = 0;
+		}
+	}
+	_bits_read++;
+}
+
+bool PayloadExtractor::ConsumeBlock(const short* coefficients_)
+{
+	for (unsigned long long usable = Kernels::Get()._usable_mask(coefficients_); usable && !IsComplete(); usable &= usable - 1)
+	{
+		consume_bit(coefficients_[LowestSetBit(usable)] & 1);
+	}
+	return IsComplete();
+}
+
+bool PayloadExtractor::IsComplete() const
+{
+	return _bits_read >= length_bits && _message.size() == _length;
+}
+
+const std::vector<byte>& PayloadExtractor::Get() const
+{
+	return _message;
+}
+
+std::vector<byte> PayloadExtractor::Extract(const std::string& file_path_)
+{
+	std::vector<byte> file_content = ImageFileBuffer(file_path_).Get();
+	return Extract(file_content);
+}
+
+std::vector<byte> PayloadExtractor::Extract(std::vector<byte>& file_content_)
+{
+	JpegDecoder decoder;
+	DecodeStatus status;
+	std::vector<byte> message = Extract(file_content_, decoder, status);
+	if (!status.Ok())
+	{
+		throw DecodeException(status);
+	}
+	return message;
+}
+
+std::vector<byte> PayloadExtractor::Extract(std::vector<byte>& file_content_, JpegDecoder& decoder_, DecodeStatus& status_)
+{
+	PayloadExtractor extractor;
+	Jpeg& jpeg = decoder_.Decode(std::move(file_content_), status_, [&extractor](const Jpeg::BlockPosition& position_, const short* coefficients_)
+	{
+		return !extractor.ConsumeBlock(coefficients_);
+	});
+	file_content_ = jpeg.ReleaseFileContent();
+	if (!status_.Ok())
+	{
+		return std::vector<byte>();
+	}
+	if (!extractor.IsComplete())
+	{
+		throw std::runtime_error("Image ends before the end of payload");
+	}
+	return extractor.Get();
+}
+
+std::vector<byte> PayloadExtractor::Extract(std::vector<byte>& file_content_, JpegDecoder& decoder_, const std::string& key_, DecodeStatus& status_)
+{
+	// the blocks come in the keyed order, so every one of them is stored before the first is read
+	Jpeg& jpeg = decoder_.Decode(std::move(file_content_), status_);
+	file_content_ = jpeg.ReleaseFileContent();
+	if (!status_.Ok())
+	{
+		return std::vector<byte>();
+	}
+	PayloadExtractor extractor;
+	jpeg.ForEachBlockInKeyedOrder(key_, [&extractor](const Jpeg::BlockPosition& position_, const short* coefficients_)
+	{
+		return !extractor.ConsumeBlock(coefficients_);
+	});
+	if (!extractor.IsComplete())
+	{
+		throw std::runtime_error("Image ends before the end of payload");
+	}
+	return extractor.Get();
+}
+
+std::vector<byte> PayloadExtractor::Extract(const Bmp& bmp_, int plane_)
+{
+	return extract_spatial(bmp_, plane_);
+}
+
+std::vector<byte> PayloadExtractor::Extract(const Png& png_, int plane_)
+{
+	return extract_spatial(png_, plane_);
+}
+
+void PayloadEmbedder::Embed(Jpeg& jpeg_, const std::vector<byte>& message_)
+{
+	const KernelTable& kernels = Kernels::Get();
+	check_message_fits(message_.size(), capacity_of(jpeg_, kernels));
+
+	SequentialPayload payload(message_);
+	jpeg_.ForEachBlockInScanOrder([&jpeg_, &payload, &kernels](const Jpeg::BlockPosition& position_, short* coefficients_)
+	{
+		if (payload.EmbedBlock(coefficients_, kernels))
+		{
+			jpeg_.MarkDirty(position_);
+		}
+	});
+}
+
+void PayloadEmbedder::Embed(Jpeg& jpeg_, const std::vector<byte>& message_, const std::string& key_)
+{
+	const KernelTable& kernels = Kernels::Get();
+	check_message_fits(message_.size(), capacity_of(jpeg_, kernels));
+
+	SequentialPayload payload(message_);
+	jpeg_.ForEachBlockInKeyedOrder(key_, [&jpeg_, &payload, &kernels](const Jpeg::BlockPosition& position_, short* coefficients_)
+	{
+		if (payload.EmbedBlock(coefficients_, kernels))
+		{
+			jpeg_.MarkDirty(position_);
+		}
+		return !payload.IsComplete();
+	});
+}
+
+void PayloadEmbedder::Embed(std::vector<byte>& file_content_, const std::vector<byte>& message_, std::ostream& output_)
+{
+	// the entropy decoder alone counts the capacity first, so nothing is written for a message too long
+	Jpeg::CapacityEstimate estimate;
+	DecodeStatus status;
+	{
+		Jpeg counted(std::move(file_content_), estimate, status);
+		file_content_ = counted.ReleaseFileContent();
+	}
+	if (!status.Ok())
+	{
+		throw DecodeException(status);
+	}
+	check_message_fits(message_.size(), estimate.PayloadCapacity());
+
+	const KernelTable& kernels = Kernels::Get();
+	SequentialPayload payload(message_);
+	std::unique_ptr<JpegWriter> writer; // the scan header is known at the first row
+	std::vector<PlaneView<const short>> row;
+	JpegStream stream(std::move(file_content_), [&](JpegStream::CoefficientRow& row_)
+	{
+		JpegStream::ForEachBlockInScanOrder(row_, [&payload, &kernels](const Jpeg::BlockPosition& position_, short* coefficients_)
+		{
+			payload.EmbedBlock(coefficients_, kernels);
+		});
+		if (!writer)
+		{
+			writer.reset(new JpegWriter(*row_._image, output_));
+		}
+		row.clear();
+		for (const PlaneView<short>& blocks : row_._components)
+		{
+			row.emplace_back(blocks._data, blocks._width, blocks._height, blocks._stride, blocks._step);
+		}
+		writer->WriteRow(row);
+		return true;
+	}, status);
+	file_content_ = stream.ReleaseFileContent();
+	stream.ThrowOnError();
+	if (!writer)
+	{
+		throw std::runtime_error("Image has no scan to carry the payload");
+	}
+	writer->Finish();
+}
+
+void PayloadEmbedder::Embed(Bmp& bmp_, const std::vector<byte>& message_, int plane_)
+{
+	embed_spatial(bmp_, message_, plane_);
+}
+
+void PayloadEmbedder::Embed(Png& png_, const std::vector<byte>& message_, int plane_)
+{
+	embed_spatial(png_, message_, plane_);
+}
+
+unsigned long long PayloadEmbedder::Capacity(const Bmp& bmp_)
+{
+	return capacity_spatial(bmp_);
+}
+
+unsigned long long PayloadEmbedder::Capacity(const Png& png_)
+{
+	return capacity_spatial(png_);
+}
+
+std::vector<std::vector<byte>> PayloadShards::Split(const std::vector<byte>& message_, int data_shards_, int total_shards_)
+{
+	if (message_.size() > 0xFFFFFFFFull)
+	{
+		throw std::invalid_argument("Sharded message is longer than 2^32 - 1 bytes");
+	}
+	ReedSolomon code(data_shards_, total_shards_);
+	ShardHeader header = { data_shards_, total_shards_, 0, unsigned(message_.size()), Deflate::Crc32(message_.data(), message_.size()) };
+	const std::size_t shard_size = header.ShardSize();
+
+	// shards are coded right inside of the payloads, the last data shard is padded with zeros
+	std::vector<std::vector<byte>> payloads(total_shards_, std::vector<byte>(header_size + shard_size, 0));
+	std::vector<const byte*> data;
+	std::vector<byte*> parity;
+	for (int i = 0; i < total_shards_; i++)
+	{
+		byte* shard = payloads[i].data() + header_size;
+		if (i < data_shards_)
+		{
+			const std::size_t first = std::min(std::size_t(i) * shard_size, message_.size());
+			std::copy(message_.begin() + first, message_.begin() + std::min(first + shard_size, message_.size()), shard);
+			data.push_back(shard);
+		}
+		else
+		{
+			parity.push_back(shard);
+		}
+	}
+	code.Encode(data, parity, shard_size);
+
+	for (int i = 0; i < total_shards_; i++)
+	{
+		byte* payload = payloads[i].data();
+		write_u32(shard_magic, payload);
+		payload[4] = shard_version;
+		payload[5] = byte(data_shards_);
+		payload[6] = byte(total_shards_);
+		payload[7] = byte(i);
+		write_u32(header._length, payload + 8);
+		write_u32(header._crc, payload + 12);
+		unsigned int crc = Deflate::Crc32(payload, 16);
+		write_u32(Deflate::Crc32(payload + header_size, shard_size, crc), payload + 16);
+	}
+	return payloads;
+}
+
+int PayloadShards::Index(const std::vector<byte>& payload_)
+{
+	ShardHeader header;
+	return read_shard_header(payload_, header_size, header) ? header._index : -1;
+}
+
+std::vector<byte> PayloadShards::Join(const std::vector<std::vector<byte>>& payloads_)
+{
+	// the first intact shard tells, which message is joined
+	ShardHeader message_header = {};
+	std::vector<const std::vector<byte>*> shards;
+	for (const std::vector<byte>& payload : payloads_)
+	{
+		ShardHeader header;
+		if (!read_shard_header(payload, header_size, header) || (!shards.empty() && !header.SameMessage(message_header)))
+		{
+			continue;
+		}
+		if (shards.empty())
+		{
+			message_header = header;
+			shards.resize(header._total_shards, nullptr);
+		}
+		shards[header._index] = &payload;
+	}
+	const int present = int(std::count_if(shards.begin(), shards.end(), [](const std::vector<byte>* shard_) { return shard_ != nullptr; }));
+	if (present == 0)
+	{
+		throw std::runtime_error("No intact shard is found");
+	}
+	if (present < message_header._data_shards)
+	{
+		throw std::runtime_error("Only " + std::to_string(present) + " intact shards of " +
+			std::to_string(message_header._data_shards) + " needed are found");
+	}
+
+	const std::size_t shard_size = message_header.ShardSize();
+	std::vector<byte> buffer(shards.size() * shard_size);
+	std::vector<byte*> pointers;
+	std::vector<bool> present_shards;
+	for (std::size_t i = 0; i < shards.size(); i++)
+	{
+		byte* shard = buffer.data() + i * shard_size;
+		if (shards[i])
+		{
+			std::copy(shards[i]->begin() + header_size, shards[i]->end(), shard);
+		}
+		pointers.push_back(shard);
+		present_shards.push_back(shards[i] != nullptr);
+	}
+	ReedSolomon(message_header._data_shards, message_header._total_shards).Reconstruct(pointers, present_shards, shard_size);
+
+	// data shards lie one after another in the buffer, the padding is cut off
+	std::vector<byte> message(buffer.begin(), buffer.begin() + message_header._length);
+	if (Deflate::Crc32(message.data(), message.size()) != message_header._crc)
+	{
+		throw std::runtime_error("CRC-32 of the joined message does not match");
+	}
+	return message;
+}
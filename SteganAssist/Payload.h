@@ -0,0 +1,106 @@
+#pragma once
+#include<vector>
+#include<string>
+#include<ostream>
+#include"BitStream.h"
+
+class Jpeg;
+class JpegDecoder;
+struct DecodeStatus;
+class Bmp;
+class Png;
+
+/// JSteg rule: AC coefficients equal to 0 and 1 carry nothing,
+/// so changing least significant bit never makes the coefficient unusable or usable
+inline bool IsUsableCoefficient(int natural_index_, short value_)
+{
+	return natural_index_ != 0 && value_ != 0 && value_ != 1;
+}
+
+/// PayloadExtractor class, that collects sequential LSB payload from the blocks in scan order.
+/// Payload is 32-bit big-endian length of the message in bytes, followed by the message,
+/// both stored most significant bit first in the usable coefficients.
+class PayloadExtractor
+{
+	static const int length_bits = 32;
+
+	unsigned long long _bits_read;
+	unsigned int _length;
+	byte _current_byte;
+	std::vector<byte> _message;
+
+	void consume_bit(bit value_);
+
+public:
+
+	PayloadExtractor();
+
+	/// Takes 64 coefficients in natural order, returns true when the whole payload is recovered
+	bool ConsumeBlock(const short* coefficients_);
+	bool IsComplete() const;
+	const std::vector<byte>& Get() const;
+
+	/// Drives the entropy decoder block by block and stops right after the last bit of payload,
+	/// so the rest of the scan is never decoded
+	static std::vector<byte> Extract(const std::string& file_path_);
+	/// The same for the file already read into memory, file_content_ is given back after decoding for reuse
+	static std::vector<byte> Extract(std::vector<byte>& file_content_);
+	/// The same with the decoder context of the calling worker, decoding errors go into status_ and give no payload
+	static std::vector<byte> Extract(std::vector<byte>& file_content_, JpegDecoder& decoder_, DecodeStatus& status_);
+	/// Payload embedded in the order of key_, the whole image is decoded first
+	static std::vector<byte> Extract(std::vector<byte>& file_content_, JpegDecoder& decoder_, const std::string& key_, DecodeStatus& status_);
+	/// Spatial payload written by PayloadEmbedder::Embed into the bitmap, only the rows holding it are read
+	static std::vector<byte> Extract(const Bmp& bmp_, int plane_ = 0);
+	/// The same for PNG images, rows are read after unfiltering
+	static std::vector<byte> Extract(const Png& png_, int plane_ = 0);
+};
+
+/// PayloadEmbedder class, that writes sequential LSB payload in the format read by PayloadExtractor
+class PayloadEmbedder
+{
+public:
+
+	/// Replaces least significant bits of usable coefficients of the decoded image in scan order.
+	/// Throws, if the message does not fit, the image is left untouched in that case.
+	/// Changed blocks are marked dirty, for JpegWriter to copy the rest from the source file.
+	static void Embed(Jpeg& jpeg_, const std::vector<byte>& message_);
+	/// The same payload in the blocks taken in the order of KeyedPermutation of key_ instead of scan order, so the message
+	/// is spread over the whole image and only the key tells where it lies. Capacity is the same.
+	static void Embed(Jpeg& jpeg_, const std::vector<byte>& message_, const std::string& key_);
+	/// The same payload in bit plane plane_ of every byte of pixel data, rows top-down, padding skipped.
+	/// Carriers are 24-bit, 32-bit and 8-bit grayscale bitmaps, changing an index of a color palette
+	/// changes the color arbitrarily, so other palettized bitmaps throw.
+	static void Embed(Bmp& bmp_, const std::vector<byte>& message_, int plane_ = 0);
+	/// The same payload embedded while streaming: the file is decoded by JpegStream a row of MCUs at a time, and every row
+	/// gets its bits and is encoded into output_ right away, so memory grows with the width of the image only.
+	/// Capacity is counted by an entropy decoding pass before, nothing is written when the message does not fit.
+	/// Images of several scans throw DecodeException, file_content_ is given back in any case.
+	static void Embed(std::vector<byte>& file_content_, const std::vector<byte>& message_, std::ostream& output_);
+	/// Bytes of message, which fit into the bitmap, 0 when it can't carry spatial payload
+	static unsigned long long Capacity(const Bmp& bmp_);
+	/// The same payload in PNG images of 8-bit samples without a palette, alpha samples carry it as well.
+	/// The pixels are changed in place, Png::Encode writes the file.
+	static void Embed(Png& png_, const std::vector<byte>& message_, int plane_ = 0);
+	static unsigned long long Capacity(const Png& png_);
+};
+
+/// PayloadShards class, that spreads a message over several carriers: the message is split into data_shards equal
+/// shards, ReedSolomon adds parity ones up to total_shards, and every carrier gets one of them as its payload,
+/// so the message comes back from any data_shards carriers. Every shard is preceded by a 20-byte big-endian header:
+/// "SASH", version 1, the data and total numbers of shards, its index, the length and the CRC-32 of the message,
+/// and the CRC-32 of the header before it and of the shard, so a changed carrier counts as a lost one.
+class PayloadShards
+{
+	static const std::size_t header_size = 20;
+
+public:
+
+	/// Payloads of all total_shards_ carriers in order of their index, throws std::invalid_argument for the numbers
+	/// of shards, which ReedSolomon does not take, or for a message longer than 2^32 - 1 bytes
+	static std::vector<std::vector<byte>> Split(const std::vector<byte>& message_, int data_shards_, int total_shards_);
+	/// Index of the shard, -1 when payload_ is not a shard or it is damaged
+	static int Index(const std::vector<byte>& payload_);
+	/// Message of the intact shards among payloads_ of any order, shards of another message are skipped.
+	/// Throws std::runtime_error, when fewer shards than the message is split into are left.
+	static std::vector<byte> Join(const std::vector<std::vector<byte>>& payloads_);
+};
\ No newline at end of file
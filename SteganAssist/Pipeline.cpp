@@ -0,0 +1,172 @@
+#include "Pipeline.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <algorithm>
+
+Pipeline::Settings::Settings()
+	: _loader(FileLoader::Backend::Auto)
+	, _readers(2)
+	, _workers(0)
+	, _writers(1)
+	, _queue_capacity(64)
+{
+}
+
+Pipeline::Pipeline(const Settings& settings_)
+	: _settings(settings_)
+{
+	if (_settings._workers <= 0)
+	{
+		_settings._workers = std::max(1u, std::thread::hardware_concurrency());
+	}
+	_settings._readers = std::max(1, _settings._readers);
+	_settings._writers = std::max(1, _settings._writers);
+	_settings._queue_capacity = std::max(2, _settings._queue_capacity);
+	_loader = FileLoader::Create(_settings._loader, _settings._readers);
+}
+
+Pipeline::~Pipeline()
+{
+}
+
+const char* Pipeline::LoaderName() const
+{
+	return _loader->Name();
+}
+
+void Pipeline::Run(const std::vector<std::string>& files_, const Process& process_, const Complete& complete_)
+{
+	typedef std::unique_ptr<Job> JobPointer;
+	BoundedQueue<JobPointer> read_queue(_settings._queue_capacity);
+	BoundedQueue<JobPointer> write_queue(_settings._queue_capacity);
+	// every job in flight holds at most two buffers, so this many free ones is enough to stop allocating
+	BoundedQueue<std::vector<byte>> free_buffers(4 * _settings._queue_capacity + 2 * _settings._workers);
+
+	auto take_buffer = [&free_buffers]()
+	{
+		std::vector<byte> buffer;
+		free_buffers.TryPop(buffer);
+		return buffer;
+	};
+	auto give_buffer = [&free_buffers](std::vector<byte>& buffer_)
+	{
+		// unneeded buffer is freed, when the pool is full
+		free_buffers.TryPush(buffer_);
+		buffer_ = std::vector<byte>();
+	};
+
+	std::atomic<int> active_workers(_settings._workers);
+	std::mutex complete_mutex;
+
+	auto reader = [&]()
+	{
+		// a loader, which fails as a whole, fails the files it has not passed on, the batch goes on without them
+		std::vector<char> passed(files_.size(), 0);
+		std::string failure;
+		try
+		{
+			_loader->Load(files_, take_buffer, [&read_queue, &files_, &passed](size_t index_, std::vector<byte>&& content_, const std::string& error_)
+			{
+				JobPointer job(new Job());
+				job->_file = files_[index_];
+				job->_content = std::move(content_);
+				job->_error = error_;
+				read_queue.Push(std::move(job));
+				passed[index_] = 1;
+			});
+		}
+		catch (const std::exception& e)
+		{
+			failure = std::string("Can't load: ") + e.what();
+		}
+		catch (...)
+		{
+			failure = "Can't load";
+		}
+		try
+		{
+			for (size_t i = 0; i < files_.size() && !failure.empty(); i++)
+			{
+				if (!passed[i])
+				{
+					JobPointer job(new Job());
+					job->_file = files_[i];
+					job->_error = failure;
+					read_queue.Push(std::move(job));
+				}
+			}
+		}
+		catch (...)
+		{
+			// out of memory even for the error reports, the files stay unreported
+		}
+		read_queue.Close();
+	};
+
+	auto worker = [&]()
+	{
+		JobPointer job;
+		while (read_queue.Pop(job))
+		{
+			if (job->_error.empty())
+			{
+				job->_output = take_buffer();
+				try
+				{
+					process_(*job);
+				}
+				catch (const std::exception& e)
+				{
+					job->_error = e.what();
+				}
+			}
+			give_buffer(job->_content);
+			write_queue.Push(std::move(job));
+		}
+		if (--active_workers == 0)
+		{
+			write_queue.Close();
+		}
+	};
+
+	auto writer = [&]()
+	{
+		JobPointer job;
+		while (write_queue.Pop(job))
+		{
+			if (job->_error.empty() && !job->_output_path.empty())
+			{
+				std::ofstream file(job->_output_path.c_str(), std::ios::binary);
+				file.write(reinterpret_cast<const char*>(job->_output.data()), job->_output.size());
+				if (!file)
+				{
+					job->_error = "Can't write " + job->_output_path;
+				}
+			}
+			{
+				std::lock_guard<std::mutex> lock(complete_mutex);
+				complete_(*job);
+			}
+			give_buffer(job->_output);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.emplace_back(reader);
+	for (int i = 0; i < _settings._workers; i++)
+	{
+		threads.emplace_back(worker);
+	}
+	for (int i = 0; i < _settings._writers; i++)
+	{
+		threads.emplace_back(writer);
+	}
+	for (int i = 0; i < threads.size(); i++)
+	{
+		threads[i].join();
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<functional>
+#include"BitStream.h"
+#include"BoundedQueue.h"
+#include"FileLoader.h"
+#include"Json.h"
+
+/// Pipeline class, that runs batch processing in three stages: the loader prefetches files into memory,
+/// workers decode and process them, writers store the results. Stages are connected by bounded lock-free
+/// queues, so a slow stage holds back the previous one instead of letting the files pile up in memory,
+/// and byte buffers travel back from writers to readers to be reused for the next files.
+class Pipeline
+{
+public:
+
+	struct Job
+	{
+		std::string _file;
+		std::vector<byte> _content;     // the whole input file, filled by the loader, Process should leave the storage here
+		std::vector<byte> _output;      // recycled storage, written by writers into _output_path, when the path is not empty
+		std::string _output_path;
+		JsonObject _result;             // fields reported for the file
+		std::string _error;             // the first failure of any stage, later stages are skipped
+	};
+
+	/// Work of the worker stage, exceptions are reported as the error of the job
+	typedef std::function<void(Job& job_)> Process;
+	/// Receives every job in the order of completion, called from writer threads one at a time, the output is still there
+	typedef std::function<void(const Job& job_)> Complete;
+
+	struct Settings
+	{
+		FileLoader::Backend _loader;
+		int _readers;           // threads of the blocking loader, or finishing big files of io_uring
+		int _workers;           // 0 means hardware concurrency
+		int _writers;
+		int _queue_capacity;    // jobs, which may wait between two stages
+
+		Settings();
+	};
+
+	Pipeline(const Settings& settings_);
+	~Pipeline();
+	/// Backend actually used for reading, which may differ from the requested one
+	const char* LoaderName() const;
+
+	/// Processes files_ in the given order of reading, returns when every job is completed
+	void Run(const std::vector<std::string>& files_, const Process& process_, const Complete& complete_);
+
+private:
+
+	Settings _settings;
+	std::unique_ptr<FileLoader> _loader;
+};
\ No newline at end of file
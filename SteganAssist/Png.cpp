@@ -0,0 +1,694 @@
+#include "Png.h"
+#include "Kernels.h"
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+
+namespace
+{
+	const byte signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+
+	constexpr unsigned int chunk_type(const char (&name_)[5])
+	{
+		return unsigned(byte(name_[0])) << 24 | unsigned(byte(name_[1])) << 16 | unsigned(byte(name_[2])) << 8 | byte(name_[3]);
+	}
+
+	unsigned int read_u32(const byte* data_)
+	{
+		return unsigned(data_[0]) << 24 | data_[1] << 16 | data_[2] << 8 | data_[3];
+	}
+
+	void append_u32(std::vector<byte>& output_, unsigned int value_)
+	{
+		for (int shift = 24; shift >= 0; shift -= 8)
+		{
+			output_.push_back(byte(value_ >> shift));
+		}
+	}
+
+	/// [5.3] Length, type, data and CRC of type and data
+	void append_chunk(std::vector<byte>& output_, const char (&type_)[5], const byte* data_, std::size_t size_)
+	{
+		append_u32(output_, unsigned(size_));
+		std::size_t start = output_.size();
+		output_.insert(output_.end(), type_, type_ + 4);
+		output_.insert(output_.end(), data_, data_ + size_);
+		append_u32(output_, Deflate::Crc32(output_.data() + start, size_ + 4));
+	}
+
+	/// [8.2] Adam7 passes: first column and row, then distances between them
+	struct Pass
+	{
+		int _x;
+		int _y;
+		int _dx;
+		int _dy;
+	};
+
+	const Pass passes[7] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+
+	int channels_of(Png::ColorType color_type_)
+	{
+		switch (color_type_)
+		{
+		case Png::TRUECOLOR: return 3;
+		case Png::GRAYSCALE_ALPHA: return 2;
+		case Png::TRUECOLOR_ALPHA: return 4;
+		default: return 1;
+		}
+	}
+
+	/// [11.2.2] Allowed bit depths of every color type
+	bool valid_format(int color_type_, int bit_depth_)
+	{
+		switch (color_type_)
+		{
+		case Png::GRAYSCALE: return bit_depth_ == 1 || bit_depth_ == 2 || bit_depth_ == 4 || bit_depth_ == 8 || bit_depth_ == 16;
+		case Png::INDEXED: return bit_depth_ == 1 || bit_depth_ == 2 || bit_depth_ == 4 || bit_depth_ == 8;
+		case Png::TRUECOLOR:
+		case Png::GRAYSCALE_ALPHA:
+		case Png::TRUECOLOR_ALPHA: return bit_depth_ == 8 || bit_depth_ == 16;
+		default: return false;
+		}
+	}
+
+	std::size_t row_size_of(int width_, int bits_per_pixel_)
+	{
+		return (std::size_t(width_) * bits_per_pixel_ + 7) / 8;
+	}
+
+	/// Sample of bit_depth_ bits below 8, packed most significant bits first
+	int packed_sample(const byte* row_, int x_, int bit_depth_)
+	{
+		int bit = x_ * bit_depth_;
+		return row_[bit / 8] >> (8 - bit_depth_ - bit % 8) & ((1 << bit_depth_) - 1);
+	}
+
+	/// [9.2] Filter filter_ of a row of size_ bytes into output_, prior_ is the row above
+	void filter_row(int filter_, const byte* row_, const byte* prior_, std::size_t size_, std::size_t left_, byte* output_)
+	{
+		for (std::size_t i = 0; i < size_; i++)
+		{
+			int a = i >= left_ ? row_[i - left_] : 0;
+			int b = prior_[i];
+			int c = i >= left_ ? prior_[i - left_] : 0;
+			int predictor = 0;
+			switch (filter_)
+			{
+			case 1: predictor = a; break;
+			case 2: predictor = b; break;
+			case 3: predictor = (a + b) >> 1; break;
+			case 4:
+			{
+				int pa = std::abs(b - c);
+				int pb = std::abs(a - c);
+				int pc = std::abs(a + b - 2 * c);
+				predictor = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+				break;
+			}
+			}
+			output_[i] = byte(row_[i] - predictor);
+		}
+	}
+
+	/// Signature, header, chunks and image data of rows_ in stride_ bytes, palette_position_ is where PLTE
+	/// goes among the chunks before the image data
+	std::vector<byte> encode(const byte* rows_, std::size_t stride_, int width_, int height_, Png::ColorType color_type_, int bit_depth_,
+		const std::vector<Png::Color>& palette_, const std::vector<byte>& chunks_before_, std::size_t palette_position_,
+		const std::vector<byte>& chunks_after_, int level_)
+	{
+		const int bits_per_pixel = channels_of(color_type_) * bit_depth_;
+		const std::size_t row_size = row_size_of(width_, bits_per_pixel);
+		const std::size_t left = std::max(1, bits_per_pixel / 8);
+		// libpng leaves palettes and low bit depths unfiltered, they rarely gain from it
+		const bool adaptive = level_ > 0 && color_type_ != Png::INDEXED && bit_depth_ >= 8;
+
+		std::vector<byte> filtered((row_size + 1) * height_);
+		std::vector<byte> zeros(row_size), candidate(row_size);
+		for (int y = 0; y < height_; y++)
+		{
+			const byte* row = rows_ + y * stride_;
+			const byte* prior = y ? row - stride_ : zeros.data();
+			byte* output = filtered.data() + y * (row_size + 1);
+			output[0] = 0;
+			std::memcpy(output + 1, row, row_size);
+			if (!adaptive)
+			{
+				continue;
+			}
+			// [12.8] filtered bytes as signed values, the smallest sum of magnitudes wins
+			auto cost = [row_size](const byte* bytes_)
+			{
+				unsigned long long sum = 0;
+				for (std::size_t i = 0; i < row_size; i++)
+				{
+					sum += std::abs(int(static_cast<signed char>(bytes_[i])));
+				}
+				return sum;
+			};
+			unsigned long long best = cost(output + 1);
+			for (int filter = 1; filter <= 4; filter++)
+			{
+				filter_row(filter, row, prior, row_size, left, candidate.data());
+				unsigned long long sum = cost(candidate.data());
+				if (sum < best)
+				{
+					best = sum;
+					output[0] = byte(filter);
+					std::memcpy(output + 1, candidate.data(), row_size);
+				}
+			}
+		}
+		std::vector<byte> compressed = Deflate::CompressZlib(filtered.data(), filtered.size(), level_);
+
+		std::vector<byte> output(signature, signature + 8);
+		byte header[13];
+		for (int i = 0; i < 4; i++)
+		{
+			header[i] = byte(unsigned(width_) >> (24 - 8 * i));
+			header[4 + i] = byte(unsigned(height_) >> (24 - 8 * i));
+		}
+		header[8] = byte(bit_depth_);
+		header[9] = byte(color_type_);
+		header[10] = header[11] = header[12] = 0; // deflate, adaptive filtering, no interlace
+		append_chunk(output, "IHDR", header, sizeof(header));
+		output.insert(output.end(), chunks_before_.begin(), chunks_before_.begin() + palette_position_);
+		if (!palette_.empty())
+		{
+			std::vector<byte> entries;
+			for (const Png::Color& color : palette_)
+			{
+				entries.insert(entries.end(), { color._red, color._green, color._blue });
+			}
+			append_chunk(output, "PLTE", entries.data(), entries.size());
+		}
+		output.insert(output.end(), chunks_before_.begin() + palette_position_, chunks_before_.end());
+		append_chunk(output, "IDAT", compressed.data(), compressed.size());
+		output.insert(output.end(), chunks_after_.begin(), chunks_after_.end());
+		append_chunk(output, "IEND", nullptr, 0);
+		return output;
+	}
+}
+
+Png::Png(std::vector<byte>&& file_content_)
+	: _file_content(std::move(file_content_))
+	, _width(0)
+	, _height(0)
+	, _bit_depth(0)
+	, _color_type(GRAYSCALE)
+	, _interlaced(false)
+	, _row_size(0)
+	, _palette_position(0)
+{
+	DecodeStatus status = this->parse();
+	if (!status.Ok())
+	{
+		throw DecodeException(status);
+	}
+}
+
+Png::Png(std::vector<byte>&& file_content_, DecodeStatus& status_)
+	: _file_content(std::move(file_content_))
+	, _width(0)
+	, _height(0)
+	, _bit_depth(0)
+	, _color_type(GRAYSCALE)
+	, _interlaced(false)
+	, _row_size(0)
+	, _palette_position(0)
+{
+	status_ = this->parse();
+}
+
+DecodeStatus Png::parse()
+{
+	const std::size_t size = _file_content.size();
+	const byte* data = _file_content.data();
+	if (!IsPng(_file_content))
+	{
+		return DecodeStatus(DecodeError::InvalidPngChunk, 0, "signature");
+	}
+
+	bool header_seen = false, palette_seen = false, data_seen = false, data_ended = false;
+	std::vector<std::pair<const byte*, std::size_t>> image_data;
+	std::size_t image_data_offset = 0;
+	for (std::size_t offset = signature_size;; )
+	{
+		if (size - offset < chunk_overhead)
+		{
+			return DecodeStatus(DecodeError::TruncatedData, int(size), "chunk");
+		}
+		const unsigned int length = read_u32(data + offset);
+		const unsigned int type = read_u32(data + offset + 4);
+		const byte* body = data + offset + 8;
+		if (length > 0x7FFFFFFF)
+		{
+			return DecodeStatus(DecodeError::InvalidPngChunk, int(offset), "chunk");
+		}
+		if (length > size - offset - chunk_overhead)
+		{
+			return DecodeStatus(DecodeError::TruncatedData, int(size), "chunk");
+		}
+		if (Deflate::Crc32(data + offset + 4, length + 4) != read_u32(body + length))
+		{
+			return DecodeStatus(DecodeError::ChecksumMismatch, int(offset + 8 + length), "chunk");
+		}
+		if (!header_seen && type != chunk_type("IHDR"))
+		{
+			return DecodeStatus(DecodeError::InvalidPngChunk, int(offset), "IHDR");
+		}
+		data_ended = data_ended || (data_seen && type != chunk_type("IDAT"));
+		const std::size_t next = offset + chunk_overhead + length;
+
+		switch (type)
+		{
+		case chunk_type("IHDR"):
+		{
+			// [11.2.2] width, height, bit depth, color type, compression, filter and interlace methods
+			unsigned int width = read_u32(body), height = read_u32(body + 4);
+			if (header_seen || length != 13 || !width || !height || width > 0x7FFFFFFF || height > 0x7FFFFFFF ||
+				!valid_format(body[9], body[8]) || body[10] || body[11] || body[12] > 1)
+			{
+				return DecodeStatus(DecodeError::InvalidPngChunk, int(offset), "IHDR");
+			}
+			header_seen = true;
+			_width = int(width);
+			_height = int(height);
+			_bit_depth = body[8];
+			_color_type = ColorType(body[9]);
+			_interlaced = body[12] == 1;
+			break;
+		}
+		case chunk_type("PLTE"):
+		{
+			// [11.2.3] not allowed for grayscale, at most as many entries as indices can address
+			std::size_t entries = length / 3;
+			if (palette_seen || data_seen || length % 3 || !entries || entries > 256 || !(_color_type & 2) ||
+				(_color_type == INDEXED && entries > std::size_t(1) << _bit_depth))
+			{
+				return DecodeStatus(DecodeError::InvalidPngChunk, int(offset), "PLTE");
+			}
+			palette_seen = true;
+			_palette_position = _chunks_before.size();
+			_palette.resize(entries);
+			for (std::size_t i = 0; i < entries; i++)
+			{
+				_palette[i] = Color{ body[3 * i], body[3 * i + 1], body[3 * i + 2], 255 };
+			}
+			break;
+		}
+		case chunk_type("IDAT"):
+			if (data_ended || (_color_type == INDEXED && !palette_seen))
+			{
+				return DecodeStatus(DecodeError::InvalidPngChunk, int(offset), "IDAT");
+			}
+			if (!data_seen)
+			{
+				image_data_offset = offset;
+			}
+			data_seen = true;
+			image_data.push_back(std::make_pair(body, std::size_t(length)));
+			break;
+		case chunk_type("IEND"):
+		{
+			if (!data_seen)
+			{
+				return DecodeStatus(DecodeError::InvalidPngChunk, int(offset), "IEND");
+			}
+			if (image_data.size() == 1)
+			{
+				return this->decode_pixels(image_data[0].first, image_data[0].second, image_data_offset);
+			}
+			// chunks are usually 8K or 64K, so the stream is put together once instead of feeding the inflater piece by piece
+			std::vector<byte> stream;
+			for (const auto& chunk : image_data)
+			{
+				stream.insert(stream.end(), chunk.first, chunk.first + chunk.second);
+			}
+			return this->decode_pixels(stream.data(), stream.size(), image_data_offset);
+		}
+		default:
+		{
+			// [5.4] unknown critical chunks make the image undecodable, ancillary ones are kept as they are
+			if (!(type >> 29 & 1))
+			{
+				return DecodeStatus(DecodeError::InvalidPngChunk, int(offset), "chunk");
+			}
+			if (type == chunk_type("tRNS") && _color_type == INDEXED)
+			{
+				for (std::size_t i = 0; i < length && i < _palette.size(); i++)
+				{
+					_palette[i]._alpha = body[i];
+				}
+			}
+			if (type == chunk_type("iCCP"))
+			{
+				// [11.3.3.3] profile name of 1-79 bytes, zero, compression method 0 and zlib data,
+				// a broken profile is dropped, as it is not needed to decode the image
+				const byte* name_end = std::find(body, body + std::min<std::size_t>(length, 80), 0);
+				std::size_t start = name_end - body + 2;
+				if (name_end != body && start <= length && name_end[1] == 0 &&
+					Deflate::InflateZlib(body + start, length - start, _profile, 0, std::size_t(64) << 20) != DecodeError::None)
+				{
+					_profile.clear();
+				}
+			}
+			std::vector<byte>& kept = data_seen ? _chunks_after : _chunks_before;
+			kept.insert(kept.end(), data + offset, data + next);
+			break;
+		}
+		}
+		offset = next;
+	}
+}
+
+DecodeStatus Png::decode_pixels(const byte* data_, std::size_t size_, std::size_t offset_)
+{
+	const int bits_per_pixel = this->GetChannels() * _bit_depth;
+	_row_size = row_size_of(_width, bits_per_pixel);
+	const std::size_t stride = _row_size + 1;
+	if (stride > (std::size_t(1) << 40) / _height)
+	{
+		return DecodeStatus(DecodeError::InvalidPngChunk, signature_size, "IHDR");
+	}
+
+	// rows of every pass with their filter bytes, passes without pixels have no rows at all
+	std::size_t pass_sizes[7] = {};
+	std::size_t expected = stride * _height;
+	if (_interlaced)
+	{
+		expected = 0;
+		for (int p = 0; p < 7; p++)
+		{
+			int width = (_width - passes[p]._x + passes[p]._dx - 1) / passes[p]._dx;
+			int height = (_height - passes[p]._y + passes[p]._dy - 1) / passes[p]._dy;
+			pass_sizes[p] = width > 0 && height > 0 ? (row_size_of(width, bits_per_pixel) + 1) * height : 0;
+			expected += pass_sizes[p];
+		}
+	}
+	// deflate does not compress better than 1032:1, so an image this large can't be in the data
+	if (expected / 1032 > size_ + 1)
+	{
+		return DecodeStatus(DecodeError::TruncatedData, int(offset_), "IDAT");
+	}
+
+	std::vector<byte> interlaced;
+	std::vector<byte>& inflated = _interlaced ? interlaced : _pixels;
+	DecodeError error = Deflate::InflateZlib(data_, size_, inflated, expected);
+	if (error != DecodeError::None)
+	{
+		return DecodeStatus(error, int(offset_), "IDAT");
+	}
+	if (!_interlaced)
+	{
+		return this->unfilter(_pixels.data(), _height, _row_size) ? DecodeStatus() : DecodeStatus(DecodeError::InvalidPngChunk, int(offset_), "IDAT");
+	}
+
+	// [8.2] every pass is unfiltered on its own, then its pixels go to their places
+	_pixels.assign(stride * _height, 0);
+	const byte* pass = interlaced.data();
+	for (int p = 0; p < 7; pass += pass_sizes[p], p++)
+	{
+		if (!pass_sizes[p])
+		{
+			continue;
+		}
+		int width = (_width - passes[p]._x + passes[p]._dx - 1) / passes[p]._dx;
+		int height = (_height - passes[p]._y + passes[p]._dy - 1) / passes[p]._dy;
+		std::size_t row_size = row_size_of(width, bits_per_pixel);
+		byte* rows = interlaced.data() + (pass - interlaced.data());
+		if (!this->unfilter(rows, height, row_size))
+		{
+			return DecodeStatus(DecodeError::InvalidPngChunk, int(offset_), "IDAT");
+		}
+		for (int r = 0; r < height; r++)
+		{
+			const byte* source = rows + r * (row_size + 1) + 1;
+			byte* destination = this->Row(passes[p]._y + r * passes[p]._dy);
+			for (int i = 0; i < width; i++)
+			{
+				int x = passes[p]._x + i * passes[p]._dx;
+				if (bits_per_pixel >= 8)
+				{
+					std::memcpy(destination + std::size_t(x) * (bits_per_pixel / 8), source + std::size_t(i) * (bits_per_pixel / 8), bits_per_pixel / 8);
+					continue;
+				}
+				int bit = x * _bit_depth;
+				destination[bit / 8] |= byte(packed_sample(source, i, _bit_depth) << (8 - _bit_depth - bit % 8));
+			}
+		}
+	}
+	return DecodeStatus();
+}
+
+bool Png::unfilter(byte* rows_, int height_, std::size_t row_size_) const
+{
+	const KernelTable& kernels = Kernels::Get();
+	const int bytes_per_pixel = std::max(1, this->GetChannels() * _bit_depth / 8);
+	std::vector<byte> zeros(row_size_);
+	for (int y = 0; y < height_; y++)
+	{
+		byte* row = rows_ + y * (row_size_ + 1);
+		if (row[0] > 4)
+		{
+			return false;
+		}
+		if (row[0])
+		{
+			const byte* prior = y ? row - row_size_ : zeros.data();
+			kernels._unfilter_row(row[0], row + 1, prior, row_size_, bytes_per_pixel);
+		}
+	}
+	return true;
+}
+
+bool Png::IsPng(const std::vector<byte>& file_content_)
+{
+	return file_content_.size() >= signature_size && std::equal(signature, signature + signature_size, file_content_.begin());
+}
+
+std::vector<byte> Png::ReleaseFileContent()
+{
+	return std::move(_file_content);
+}
+
+int Png::GetWidth() const
+{
+	return _width;
+}
+
+int Png::GetHeight() const
+{
+	return _height;
+}
+
+int Png::GetBitDepth() const
+{
+	return _bit_depth;
+}
+
+Png::ColorType Png::GetColorType() const
+{
+	return _color_type;
+}
+
+bool Png::IsInterlaced() const
+{
+	return _interlaced;
+}
+
+int Png::GetChannels() const
+{
+	return channels_of(_color_type);
+}
+
+bool Png::IsPalettized() const
+{
+	return _color_type == INDEXED;
+}
+
+bool Png::IsGrayscale() const
+{
+	return _color_type == GRAYSCALE || _color_type == GRAYSCALE_ALPHA;
+}
+
+const std::vector<Png::Color>& Png::GetPalette() const
+{
+	return _palette;
+}
+
+int Png::GetBytesPerPixel() const
+{
+	return this->GetChannels() * _bit_depth / 8;
+}
+
+std::size_t Png::GetRowSize() const
+{
+	return _row_size;
+}
+
+const byte* Png::Row(int y_) const
+{
+	return _pixels.data() + std::size_t(y_) * (_row_size + 1) + 1;
+}
+
+byte* Png::Row(int y_)
+{
+	return _pixels.data() + std::size_t(y_) * (_row_size + 1) + 1;
+}
+
+IccProfile Png::GetIccProfile() const
+{
+	return _profile.empty() ? IccProfile() : IccProfile(_profile.data(), _profile.size());
+}
+
+void Png::read_rgb(const byte* row_, int x_, byte* rgb_) const
+{
+	if (_color_type == INDEXED)
+	{
+		// indices outside of the palette are black
+		std::size_t index = _bit_depth == 8 ? row_[x_] : packed_sample(row_, x_, _bit_depth);
+		Color color = index < _palette.size() ? _palette[index] : Color{ 0, 0, 0, 255 };
+		rgb_[0] = color._red;
+		rgb_[1] = color._green;
+		rgb_[2] = color._blue;
+		return;
+	}
+	if (_bit_depth < 8)
+	{
+		rgb_[0] = rgb_[1] = rgb_[2] = byte(packed_sample(row_, x_, _bit_depth) * 255 / ((1 << _bit_depth) - 1));
+		return;
+	}
+	const int sample_size = _bit_depth / 8;
+	const byte* pixel = row_ + std::size_t(x_) * this->GetChannels() * sample_size;
+	for (int c = 0; c < 3; c++)
+	{
+		rgb_[c] = this->IsGrayscale() ? pixel[0] : pixel[c * sample_size];
+	}
+}
+
+int Png::component_offset(int component_) const
+{
+	if (_color_type == INDEXED || _bit_depth < 8)
+	{
+		return -1;
+	}
+	return component_ * _bit_depth / 8;
+}
+
+std::vector<byte> Png::ConvertToRgb() const
+{
+	std::vector<byte> rgb(std::size_t(_width) * _height * 3);
+	for (int y = 0; y < _height; y++)
+	{
+		const byte* row = this->Row(y);
+		byte* output = rgb.data() + std::size_t(y) * _width * 3;
+		for (int x = 0; x < _width; x++, output += 3)
+		{
+			this->read_rgb(row, x, output);
+		}
+	}
+	return rgb;
+}
+
+int Png::GetComponentsCount() const
+{
+	return this->IsGrayscale() ? 1 : 3;
+}
+
+int Png::GetComponentWidth(int component_) const
+{
+	return _width;
+}
+
+int Png::GetComponentHeight(int component_) const
+{
+	return _height;
+}
+
+PlaneView<const byte> Png::GetSampleTile(int component_, int x_, int y_, int width_, int height_, std::vector<byte>& scratch_) const
+{
+	int offset = this->component_offset(component_);
+	if (offset >= 0)
+	{
+		int step = this->GetBytesPerPixel();
+		return PlaneView<const byte>(this->Row(y_) + std::ptrdiff_t(x_) * step + offset, width_, height_, std::ptrdiff_t(_row_size + 1), step);
+	}
+	scratch_.resize(std::size_t(width_) * height_);
+	for (int y = 0; y < height_; y++)
+	{
+		const byte* row = this->Row(y_ + y);
+		for (int x = 0; x < width_; x++)
+		{
+			byte rgb[3];
+			this->read_rgb(row, x_ + x, rgb);
+			scratch_[std::size_t(y) * width_ + x] = rgb[component_];
+		}
+	}
+	return PlaneView<const byte>(scratch_.data(), width_, height_, width_);
+}
+
+PlaneView<byte> Png::GetWritableSampleTile(int component_, int x_, int y_, int width_, int height_)
+{
+	int offset = this->component_offset(component_);
+	if (offset < 0 || _bit_depth != 8)
+	{
+		return PlaneView<byte>();
+	}
+	int step = this->GetBytesPerPixel();
+	return PlaneView<byte>(this->Row(y_) + std::ptrdiff_t(x_) * step + offset, width_, height_, std::ptrdiff_t(_row_size + 1), step);
+}
+
+std::vector<byte> Png::Encode(int level_) const
+{
+	return encode(this->Row(0), _row_size + 1, _width, _height, _color_type, _bit_depth, _palette,
+		_chunks_before, _palette_position, _chunks_after, level_);
+}
+
+std::vector<byte> Png::Write(const byte* pixels_, int width_, int height_, ColorType color_type_, int bit_depth_,
+	const std::vector<Color>& palette_, int level_)
+{
+	if (!valid_format(color_type_, bit_depth_))
+	{
+		throw std::invalid_argument("Bit depth " + std::to_string(bit_depth_) + " is not allowed for color type " + std::to_string(int(color_type_)));
+	}
+	if (width_ <= 0 || height_ <= 0)
+	{
+		throw std::invalid_argument("PNG must have at least one pixel");
+	}
+	if ((color_type_ == INDEXED) != !palette_.empty() || palette_.size() > std::min<std::size_t>(256, std::size_t(1) << bit_depth_))
+	{
+		throw std::invalid_argument("Palette must be given for indexed color only, with at most 2^bits colors");
+	}
+	if (level_ < 0 || level_ > Deflate::max_level)
+	{
+		throw std::invalid_argument("Compression level must be from 0 to " + std::to_string(Deflate::max_level));
+	}
+	// [11.3.2.1] tRNS of a palette stops at the last entry, which is not opaque
+	std::vector<byte> transparency;
+	for (std::size_t i = 0; i < palette_.size(); i++)
+	{
+		if (palette_[i]._alpha != 255)
+		{
+			transparency.resize(i + 1, 255);
+			transparency[i] = palette_[i]._alpha;
+		}
+	}
+	std::vector<byte> chunks_before;
+	if (!transparency.empty())
+	{
+		append_chunk(chunks_before, "tRNS", transparency.data(), transparency.size());
+	}
+	return encode(pixels_, row_size_of(width_, channels_of(color_type_) * bit_depth_), width_, height_, color_type_, bit_depth_,
+		palette_, chunks_before, 0, std::vector<byte>(), level_);
+}
+
+std::vector<byte> Png::WriteRgb(const std::vector<byte>& rgb_, int width_, int height_, int level_)
+{
+	if (rgb_.size() < std::size_t(width_) * height_ * 3)
+	{
+		throw std::invalid_argument("RGB data is smaller than the image");
+	}
+	return Write(rgb_.data(), width_, height_, TRUECOLOR, 8, std::vector<Color>(), level_);
+}
\ No newline at end of file
@@ -0,0 +1,127 @@
+#pragma once
+#include<vector>
+#include<string>
+#include"BitStream.h"
+#include"ImageFileBuffer.h"
+#include"Image.h"
+#include"DecodeStatus.h"
+#include"Deflate.h"
+#include"Icc.h"
+
+// [PNG] Portable Network Graphics (Second Edition): signature, then chunks of length, type, data and CRC.
+// Data of all IDAT chunks is one zlib stream of filtered rows, each row starts with its filter type.
+// Rows are unfiltered right in the inflated buffer and stay there, the filter bytes between them included.
+class Png : public Image
+{
+public:
+
+	/// [11.2.2] Color types, bits 1 palette, 2 color, 4 alpha
+	enum ColorType
+	{
+		GRAYSCALE = 0,
+		TRUECOLOR = 2,
+		INDEXED = 3,
+		GRAYSCALE_ALPHA = 4,
+		TRUECOLOR_ALPHA = 6,
+	};
+
+	/// [11.2.3] PLTE entry, alpha comes from tRNS and is 255 without it
+	struct Color
+	{
+		byte _red;
+		byte _green;
+		byte _blue;
+		byte _alpha;
+	};
+
+private:
+
+	static const int signature_size = 8;
+	static const int chunk_overhead = 12; // length, type and CRC
+
+	std::vector<byte> _file_content;
+	int _width;
+	int _height;
+	int _bit_depth;
+	ColorType _color_type;
+	bool _interlaced;
+	std::vector<Color> _palette;
+	std::vector<byte> _pixels;        // every row is its filter byte followed by row_size bytes
+	std::size_t _row_size;
+	std::vector<byte> _chunks_before; // ancillary chunks before and after the image data, kept for Encode
+	std::vector<byte> _chunks_after;
+	std::size_t _palette_position;    // where PLTE was among the chunks before the image data
+	std::vector<byte> _profile;       // iCCP inflated
+
+	DecodeStatus parse();
+	/// Inflates and unfilters the image data, Adam7 passes are put together into the rows
+	DecodeStatus decode_pixels(const byte* data_, std::size_t size_, std::size_t offset_);
+	/// Unfilters height_ rows of row_size_ bytes, each after its filter byte
+	bool unfilter(byte* rows_, int height_, std::size_t row_size_) const;
+	void read_rgb(const byte* row_, int x_, byte* rgb_) const;
+	int component_offset(int component_) const;
+
+public:
+
+	Png(const std::string& file_path_)
+		: Png(ImageFileBuffer(file_path_).Get())
+	{
+	}
+
+	/// Throws DecodeException for malformed files
+	explicit Png(std::vector<byte>&& file_content_);
+	/// Non-throwing, malformed files are reported by status_
+	Png(std::vector<byte>&& file_content_, DecodeStatus& status_);
+
+	/// [5.2] PNG signature, the file is not parsed
+	static bool IsPng(const std::vector<byte>& file_content_);
+
+	/// The file as it was read, pixels do not live in it, so changes are written by Encode
+	std::vector<byte> ReleaseFileContent();
+
+	int GetWidth() const override;
+	int GetHeight() const override;
+	int GetBitDepth() const;
+	ColorType GetColorType() const;
+	bool IsInterlaced() const;
+	/// Samples per pixel, 1 for indices
+	int GetChannels() const;
+	bool IsPalettized() const;
+	bool IsGrayscale() const;
+	const std::vector<Color>& GetPalette() const;
+	/// Bytes per pixel, 0 for bit depths below 8
+	int GetBytesPerPixel() const;
+	/// Bytes of pixel data per row, samples of 16 bits are big-endian
+	std::size_t GetRowSize() const;
+
+	/// Row y_ counted from the top, interlaced images are already put together
+	const byte* Row(int y_) const;
+	byte* Row(int y_);
+
+	/// [11.3.3.3] Embedded ICC profile, inflated on parsing
+	IccProfile GetIccProfile() const;
+
+	/// Interleaved RGB, rows top-down, as Jpeg::ConvertToRgb. 16-bit samples give their high byte,
+	/// samples below 8 bits are scaled to 8 bits, alpha is dropped.
+	std::vector<byte> ConvertToRgb() const;
+
+	/// 1 for grayscale images, red, green and blue otherwise
+	int GetComponentsCount() const override;
+	int GetComponentWidth(int component_) const override;
+	int GetComponentHeight(int component_) const override;
+	/// Views into the rows for 8-bit and 16-bit samples, the high bytes of the latter,
+	/// palettes and lower bit depths are converted into scratch_
+	PlaneView<const byte> GetSampleTile(int component_, int x_, int y_, int width_, int height_, std::vector<byte>& scratch_) const override;
+	/// 8-bit samples only
+	PlaneView<byte> GetWritableSampleTile(int component_, int x_, int y_, int width_, int height_) override;
+
+	/// The image with its pixels as they are now, not interlaced, ancillary chunks kept where they were.
+	/// Rows of 8 and 16-bit samples get the filter, which gives the smallest sum of absolute differences,
+	/// palettes and lower bit depths are not filtered, level_ is passed to Deflate.
+	std::vector<byte> Encode(int level_ = Deflate::default_level) const;
+	/// Writes pixels_, rows top-down without filter bytes, packed as PNG packs them
+	static std::vector<byte> Write(const byte* pixels_, int width_, int height_, ColorType color_type_, int bit_depth_,
+		const std::vector<Color>& palette_ = std::vector<Color>(), int level_ = Deflate::default_level);
+	/// Truecolor file of 8 bits from interleaved RGB
+	static std::vector<byte> WriteRgb(const std::vector<byte>& rgb_, int width_, int height_, int level_ = Deflate::default_level);
+};
\ No newline at end of file
@@ -0,0 +1,246 @@
+#include "ReedSolomon.h"
+#include "Kernels.h"
+#include <stdexcept>
+#include <algorithm>
+
+namespace
+{
+	/// Powers of the generator 2 and their logarithms
+	struct Logarithms
+	{
+		byte _exp[512];
+		int _log[256];
+
+		Logarithms()
+		{
+			int value = 1;
+			for (int i = 0; i < 255; i++)
+			{
+				_exp[i] = _exp[i + 255] = byte(value);
+				_log[value] = i;
+				value <<= 1;
+				if (value & 0x100)
+				{
+					value ^= 0x11D;
+				}
+			}
+			_log[0] = 0;
+		}
+	};
+
+	const Logarithms& logarithms()
+	{
+		static const Logarithms instance;
+		return instance;
+	}
+
+	/// Tables of GfMultiplyAdd for coefficient_: its products with the low nibbles, then with the high ones
+	void append_tables(byte coefficient_, std::vector<byte>& tables_)
+	{
+		for (int x = 0; x < 16; x++)
+		{
+			tables_.push_back(ReedSolomon::Multiply(coefficient_, byte(x)));
+		}
+		for (int x = 0; x < 16; x++)
+		{
+			tables_.push_back(ReedSolomon::Multiply(coefficient_, byte(x << 4)));
+		}
+	}
+}
+
+byte ReedSolomon::Multiply(byte a_, byte b_)
+{
+	if (a_ == 0 || b_ == 0)
+	{
+		return 0;
+	}
+	const Logarithms& tables = logarithms();
+	return tables._exp[tables._log[a_] + tables._log[b_]];
+}
+
+byte ReedSolomon::Inverse(byte a_)
+{
+	const Logarithms& tables = logarithms();
+	return tables._exp[255 - tables._log[a_]];
+}
+
+ReedSolomon::ReedSolomon(int data_shards_, int total_shards_)
+	: _data_shards(data_shards_)
+	, _total_shards(total_shards_)
+{
+	if (data_shards_ <= 0 || total_shards_ < data_shards_ || total_shards_ > max_shards)
+	{
+		throw std::invalid_argument("Reed-Solomon code needs 0 < data shards <= total shards <= 255");
+	}
+	// [Cauchy] element i, j is 1 / (x_i + y_j) for distinct x_i = data + i and y_j = j, addition is XOR
+	const int parity_shards = total_shards_ - data_shards_;
+	_parity_rows.resize(std::size_t(parity_shards) * data_shards_);
+	for (int i = 0; i < parity_shards; i++)
+	{
+		for (int j = 0; j < data_shards_; j++)
+		{
+			_parity_rows[std::size_t(i) * data_shards_ + j] = Inverse(byte((data_shards_ + i) ^ j));
+		}
+	}
+	_parity_tables.reserve(_parity_rows.size() * 32);
+	for (byte coefficient : _parity_rows)
+	{
+		append_tables(coefficient, _parity_tables);
+	}
+}
+
+int ReedSolomon::DataShards() const
+{
+	return _data_shards;
+}
+
+int ReedSolomon::TotalShards() const
+{
+	return _total_shards;
+}
+
+void ReedSolomon::multiply(const std::vector<byte>& tables_, const std::vector<const byte*>& inputs_,
+	const std::vector<byte*>& outputs_, std::size_t size_)
+{
+	const KernelTable& kernels = Kernels::Get();
+	// a slice of every input and output stays in the cache, while all the products of it are added
+	const std::size_t slice_size = 16 * 1024;
+	for (std::size_t offset = 0; offset < size_; offset += slice_size)
+	{
+		const std::size_t length = std::min(slice_size, size_ - offset);
+		for (std::size_t i = 0; i < outputs_.size(); i++)
+		{
+			std::fill(outputs_[i] + offset, outputs_[i] + offset + length, byte(0));
+			for (std::size_t j = 0; j < inputs_.size(); j++)
+			{
+				kernels._gf_multiply_add(tables_.data() + (i * inputs_.size() + j) * 32, inputs_[j] + offset, outputs_[i] + offset, length);
+			}
+		}
+	}
+}
+
+void ReedSolomon::Encode(const std::vector<const byte*>& data_, const std::vector<byte*>& parity_, std::size_t size_) const
+{
+	if (data_.size() != std::size_t(_data_shards) || parity_.size() != std::size_t(_total_shards - _data_shards))
+	{
+		throw std::invalid_argument("Number of shards differs from the code");
+	}
+	multiply(_parity_tables, data_, parity_, size_);
+}
+
+void ReedSolomon::Reconstruct(const std::vector<byte*>& shards_, const std::vector<bool>& present_, std::size_t size_) const
+{
+	if (shards_.size() != std::size_t(_total_shards) || present_.size() != shards_.size())
+	{
+		throw std::invalid_argument("Number of shards differs from the code");
+	}
+	const int k = _data_shards;
+
+	// rows of the code matrix for the first k present shards, identity rows for the data ones
+	std::vector<int> rows;
+	for (int i = 0; i < _total_shards && int(rows.size()) < k; i++)
+	{
+		if (present_[i])
+		{
+			rows.push_back(i);
+		}
+	}
+	if (int(rows.size()) < k)
+	{
+		throw std::runtime_error("Fewer shards left, than the data is split into");
+	}
+	std::vector<int> missing_data;
+	for (int i = 0; i < k; i++)
+	{
+		if (!present_[i])
+		{
+			missing_data.push_back(i);
+		}
+	}
+
+	if (!missing_data.empty())
+	{
+		// Gauss-Jordan elimination of [A | I], A is k x k, so the right half becomes its inverse
+		std::vector<byte> matrix(std::size_t(k) * 2 * k, 0);
+		auto element = [&](int row_, int column_) -> byte&
+		{
+			return matrix[std::size_t(row_) * 2 * k + column_];
+		};
+		for (int r = 0; r < k; r++)
+		{
+			if (rows[r] < k)
+			{
+				element(r, rows[r]) = 1;
+			}
+			else
+			{
+				std::copy_n(_parity_rows.begin() + std::size_t(rows[r] - k) * k, k, &element(r, 0));
+			}
+			element(r, k + r) = 1;
+		}
+		for (int column = 0; column < k; column++)
+		{
+			int pivot = column;
+			while (element(pivot, column) == 0)
+			{
+				pivot++; // every square submatrix of the code is invertible, a pivot always exists
+			}
+			for (int c = 0; c < 2 * k; c++)
+			{
+				std::swap(element(pivot, c), element(column, c));
+			}
+			const byte scale = Inverse(element(column, column));
+			for (int c = 0; c < 2 * k; c++)
+			{
+				element(column, c) = Multiply(element(column, c), scale);
+			}
+			for (int r = 0; r < k; r++)
+			{
+				const byte factor = element(r, column);
+				if (r == column || factor == 0)
+				{
+					continue;
+				}
+				for (int c = 0; c < 2 * k; c++)
+				{
+					element(r, c) ^= Multiply(factor, element(column, c));
+				}
+			}
+		}
+
+		// data shard d is row d of the inverse applied to the present shards
+		std::vector<byte> tables;
+		tables.reserve(missing_data.size() * k * 32);
+		std::vector<byte*> outputs;
+		for (int d : missing_data)
+		{
+			for (int j = 0; j < k; j++)
+			{
+				append_tables(element(d, k + j), tables);
+			}
+			outputs.push_back(shards_[d]);
+		}
+		std::vector<const byte*> inputs;
+		for (int r : rows)
+		{
+			inputs.push_back(shards_[r]);
+		}
+		multiply(tables, inputs, outputs, size_);
+	}
+
+	// the data is whole now, missing parity is encoded again
+	std::vector<byte> tables;
+	std::vector<byte*> outputs;
+	for (int i = k; i < _total_shards; i++)
+	{
+		if (!present_[i])
+		{
+			tables.insert(tables.end(), _parity_tables.begin() + std::size_t(i - k) * k * 32, _parity_tables.begin() + std::size_t(i - k + 1) * k * 32);
+			outputs.push_back(shards_[i]);
+		}
+	}
+	if (!outputs.empty())
+	{
+		multiply(tables, std::vector<const byte*>(shards_.begin(), shards_.begin() + k), outputs, size_);
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include<vector>
+#include<cstddef>
+#include"BitStream.h"
+
+/// ReedSolomon class, that erasure codes data_shards equal shards into total_shards ones over GF(2^8), so any
+/// data_shards of them give back the data. The code is systematic: the first shards are the data itself, parity rows
+/// are a Cauchy matrix, whose every square submatrix is invertible, so any choice of surviving shards is decodable.
+/// Every product of a row by a shard is GfMultiplyAdd of the kernel table, the 32-byte tables of the coefficients
+/// are made once, and shards are coded in slices of 16 KB, that keep all of them in the cache at once.
+class ReedSolomon
+{
+	int _data_shards;
+	int _total_shards;
+	std::vector<byte> _parity_rows;        // (total - data) x data coefficients
+	std::vector<byte> _parity_tables;      // 32 bytes of GfMultiplyAdd for every coefficient of _parity_rows
+
+	/// Output i becomes the sum over j of coefficient i, j times input j, tables_ hold 32 bytes of GfMultiplyAdd
+	/// for every coefficient, row by row
+	static void multiply(const std::vector<byte>& tables_, const std::vector<const byte*>& inputs_,
+		const std::vector<byte*>& outputs_, std::size_t size_);
+
+public:
+
+	static const int max_shards = 255;
+
+	/// [Plank, A tutorial on Reed-Solomon coding for fault-tolerance in RAID-like systems] Throws std::invalid_argument,
+	/// unless 0 < data_shards_ <= total_shards_ <= max_shards
+	ReedSolomon(int data_shards_, int total_shards_);
+
+	int DataShards() const;
+	int TotalShards() const;
+
+	/// Writes total - data parity shards of size_ bytes from the data shards
+	void Encode(const std::vector<const byte*>& data_, const std::vector<byte*>& parity_, std::size_t size_) const;
+	/// Restores the shards, which are not present_, in place from the rest, all TotalShards of size_ bytes.
+	/// Throws std::runtime_error, when fewer than DataShards are present.
+	void Reconstruct(const std::vector<byte*>& shards_, const std::vector<bool>& present_, std::size_t size_) const;
+
+	/// Product in GF(2^8) of the polynomial 0x11D
+	static byte Multiply(byte a_, byte b_);
+	/// Inverse of a non-zero element
+	static byte Inverse(byte a_);
+};
@@ -1,25 +1,896 @@
 #include<iostream>
-#include<iomanip>
+#include<fstream>
+#include<filesystem>
+#include<algorithm>
+#include<stdexcept>
+#include<cctype>
+#include<string>
+#include<vector>
+#include<map>
+#include<set>
+#include<memory>
 #include"Jpeg.h"
-#include"BitStream.h"
+#include"JpegDecoder.h"
+#include"JpegWriter.h"
+#include"Bmp.h"
+#include"Png.h"
+#include"Payload.h"
+#include"Steganalysis.h"
 #include"ImageFileBuffer.h"
+#include"Pipeline.h"
+#include"Json.h"
+#include"Benchmark.h"
+#include"Instrumentation.h"
+#include"Kernels.h"
+#include"DecoderSelfTest.h"
+#include"ReedSolomon.h"
 
-int main()
+namespace fs = std::filesystem;
+
+struct Options
+{
+	std::string _command;
+	int _threads = 0;
+	int _readers = 2;
+	FileLoader::Backend _loader = FileLoader::Backend::Auto;
+	int _writers = 1;
+	std::string _message_file;
+	std::string _key;
+	int _data_shards = 0;
+	std::string _join_file;
+	std::string _output_directory;
+	int _scale = 8;
+	std::string _baseline_file;
+	std::string _save_baseline_file;
+	double _tolerance = 0.1;
+	bool _counters = false;
+	bool _stream = false;
+	Allocator::Kind _allocator = Allocator::Kind::Default;
+	std::size_t _memory_budget = 0;
+	Kernels::Level _cpu = Kernels::Level::Avx512; // lowered to what the host supports
+	std::string _trace_file;
+	std::vector<std::string> _inputs;
+};
+
+void PrintUsage()
+{
+	std::cerr <<
+		"Usage: SteganAssist <probe|embed|extract|analyze|index|thumbnail> [options] <file|directory|@list>...\n"
+		"       SteganAssist bench [--output DIR] [--baseline FILE] [--save-baseline FILE] [--tolerance X]\n"
+		"       SteganAssist generate --output DIR\n"
+		"       SteganAssist selftest\n"
+		"  probe     dimensions and sequential payload capacity, no block is stored\n"
+		"  embed     writes the message into every image, needs --message and --output, bitmaps carry it\n"
+		"            in the least significant bits of their pixels\n"
+		"  extract   reads sequential payload, writes it into --output when given\n"
+		"  analyze   chi-square, RS and sample pairs detectors\n"
+		"  index     checkpoints of the entropy decoder for region decoding, written next to every JPEG image\n"
+		"            as FILE.idx, or into --output when given\n"
+		"  thumbnail JPEG image scaled down by --scale (8 by default), written into --output as FILE.png\n"
+		"  bench     times every decoding stage over the synthetic corpus, written into --output or a temporary\n"
+		"            directory, and fails when a stage is slower than --baseline by more than --tolerance (0.1)\n"
+		"  generate  writes the synthetic corpus\n"
+		"  selftest  checks the vector kernels of every instruction set the host supports against the scalar ones,\n"
+		"            the decoder on malformed files and the writers on embedded images\n"
+		"Options:\n"
+		"  --threads N         number of decoding workers, 0 means hardware concurrency\n"
+		"  --readers N         number of threads prefetching files by blocking reads, 2 by default, with io_uring\n"
+		"                      the threads finishing the files bigger than 128 KB\n"
+		"  --loader NAME       auto, threads or io_uring, auto takes io_uring when the kernel allows it and threads\n"
+		"                      otherwise, io_uring fails when the kernel does not allow it\n"
+		"  --writers N         number of threads writing results, 1 by default\n"
+		"  --message FILE      message to embed\n"
+		"  --key KEY           embed and extract JPEG payload in the order of blocks derived from KEY instead of scan order\n"
+		"  --data-shards K     embed splits the message into K shards and Reed-Solomon parity up to one shard per image,\n"
+		"                      so any K of the images give the message back\n"
+		"  --join FILE         extract joins the shards found in the images into FILE, the exit code is that of the join\n"
+		"  --output DIR        directory for embedded images or extracted payloads\n"
+		"  --scale N           1, 2, 4 or 8, 8 decodes DC coefficients alone\n"
+		"  --allocator NAME    default, arena or pool, where the memory of every image comes from\n"
+		"  --memory-budget MB  hard limit of memory per image, decoding fails instead of going over it\n"
+		"  --counters          adds decoder counters (bits, Huffman lookups, EOB positions, stage times) to every result\n"
+		"  --stream            embed re-encodes JPEG images a row of MCUs at a time straight into the output file,\n"
+		"                      so memory grows with the width of the image only\n"
+		"  --trace FILE        writes per-segment and per-image spans in Chrome trace format\n"
+		"  --cpu LEVEL         scalar, sse4.2, avx2 or avx512, the highest kernels to use, the best supported by default\n"
+		"Directories are walked recursively for .jpg, .jpeg, .bmp and .png files, @list is a file with one path per line.\n"
+		"One JSON object per image is written to stdout as soon as the image is done.\n";
+}
+
+Options ParseArguments(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		throw std::invalid_argument("No command given");
+	}
+	Options options;
+	options._command = argv[1];
+	for (int i = 2; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		if (argument == "--threads" || argument == "--readers" || argument == "--writers" ||
+			argument == "--loader" || argument == "--message" || argument == "--output" ||
+			argument == "--baseline" || argument == "--save-baseline" || argument == "--tolerance" ||
+			argument == "--trace" || argument == "--allocator" || argument == "--memory-budget" ||
+			argument == "--cpu" || argument == "--scale" || argument == "--key" || argument == "--data-shards" ||
+			argument == "--join")
+		{
+			if (i + 1 == argc)
+			{
+				throw std::invalid_argument("No value given for " + argument);
+			}
+			std::string value = argv[++i];
+			if (argument == "--threads")
+			{
+				options._threads = std::stoi(value);
+			}
+			else if (argument == "--readers")
+			{
+				options._readers = std::stoi(value);
+			}
+			else if (argument == "--writers")
+			{
+				options._writers = std::stoi(value);
+			}
+			else if (argument == "--loader")
+			{
+				options._loader = FileLoader::ParseBackend(value);
+			}
+			else if (argument == "--message")
+			{
+				options._message_file = value;
+			}
+			else if (argument == "--key")
+			{
+				if (value.empty())
+				{
+					throw std::invalid_argument("--key must not be empty");
+				}
+				options._key = value;
+			}
+			else if (argument == "--data-shards")
+			{
+				options._data_shards = std::stoi(value);
+				if (options._data_shards <= 0)
+				{
+					throw std::invalid_argument("--data-shards must be positive");
+				}
+			}
+			else if (argument == "--join")
+			{
+				options._join_file = value;
+			}
+			else if (argument == "--baseline")
+			{
+				options._baseline_file = value;
+			}
+			else if (argument == "--save-baseline")
+			{
+				options._save_baseline_file = value;
+			}
+			else if (argument == "--tolerance")
+			{
+				options._tolerance = std::stod(value);
+			}
+			else if (argument == "--trace")
+			{
+				options._trace_file = value;
+			}
+			else if (argument == "--allocator")
+			{
+				options._allocator = Allocator::ParseKind(value);
+			}
+			else if (argument == "--memory-budget")
+			{
+				options._memory_budget = std::size_t(std::stod(value) * 1024 * 1024);
+			}
+			else if (argument == "--cpu")
+			{
+				options._cpu = Kernels::ParseLevel(value);
+			}
+			else if (argument == "--scale")
+			{
+				options._scale = std::stoi(value);
+				if (options._scale != 1 && options._scale != 2 && options._scale != 4 && options._scale != 8)
+				{
+					throw std::invalid_argument("--scale must be 1, 2, 4 or 8");
+				}
+			}
+			else
+			{
+				options._output_directory = value;
+			}
+		}
+		else if (argument == "--counters")
+		{
+			options._counters = true;
+		}
+		else if (argument == "--stream")
+		{
+			options._stream = true;
+		}
+		else
+		{
+			options._inputs.push_back(argument);
+		}
+	}
+	if (options._command == "bench" || options._command == "selftest")
+	{
+		return options;
+	}
+	if (options._command == "generate")
+	{
+		if (options._output_directory.empty())
+		{
+			throw std::invalid_argument("generate needs --output");
+		}
+		return options;
+	}
+	if (options._command != "probe" && options._command != "embed" &&
+		options._command != "extract" && options._command != "analyze" && options._command != "index" &&
+		options._command != "thumbnail")
+	{
+		throw std::invalid_argument("Unknown command " + options._command);
+	}
+	if (options._command == "embed" && (options._message_file.empty() || options._output_directory.empty()))
+	{
+		throw std::invalid_argument("embed needs --message and --output");
+	}
+	if (!options._key.empty() && options._stream)
+	{
+		throw std::invalid_argument("--key needs the whole image, it can't be used with --stream");
+	}
+	if (options._data_shards && options._command != "embed")
+	{
+		throw std::invalid_argument("--data-shards is for embed, extract joins the shards with --join");
+	}
+	if (!options._join_file.empty() && options._command != "extract")
+	{
+		throw std::invalid_argument("--join is for extract");
+	}
+	if (options._command == "thumbnail" && options._output_directory.empty())
+	{
+		throw std::invalid_argument("thumbnail needs --output");
+	}
+	if (options._inputs.empty())
+	{
+		throw std::invalid_argument("No input given");
+	}
+	return options;
+}
+
+bool IsImageFile(const fs::path& path_)
+{
+	std::string extension = path_.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+	return extension == ".jpg" || extension == ".jpeg" || extension == ".bmp" || extension == ".png";
+}
+
+/// Expands directories and @lists into the list of files. Explicitly named files are taken
+/// whatever their extension is, broken ones get their error line like any other image.
+void CollectFiles(const std::string& input_, std::vector<std::string>& files_)
+{
+	if (!input_.empty() && input_[0] == '@')
+	{
+		std::ifstream list(input_.substr(1));
+		if (!list)
+		{
+			throw std::invalid_argument("Can't open list " + input_.substr(1));
+		}
+		std::string line;
+		while (std::getline(list, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+			{
+				line.pop_back();
+			}
+			if (!line.empty())
+			{
+				CollectFiles(line, files_);
+			}
+		}
+		return;
+	}
+	if (fs::is_directory(input_))
+	{
+		for (const fs::directory_entry& entry : fs::recursive_directory_iterator(input_, fs::directory_options::skip_permission_denied))
+		{
+			if (entry.is_regular_file() && IsImageFile(entry.path()))
+			{
+				files_.push_back(entry.path().string());
+			}
+		}
+		return;
+	}
+	files_.push_back(input_);
+}
+
+/// Output file for the image, named after it, so images from different directories
+/// with the same name overwrite each other
+std::string OutputPath(const Options& options_, const std::string& file_, const std::string& extension_)
+{
+	fs::path name = fs::path(file_).filename();
+	if (!extension_.empty())
+	{
+		name += extension_;
+	}
+	return (fs::path(options_._output_directory) / name).string();
+}
+
+/// Corrupt files are common in a batch, so they are reported by status without unwinding
+bool ReportDecodeError(const DecodeStatus& status_, Pipeline::Job& job_)
+{
+	if (status_.Ok())
+	{
+		return false;
+	}
+	job_._error = status_.ToString();
+	job_._result.Add("error_code", status_.Name())
+		.Add("error_segment", status_._segment)
+		.Add("error_offset", status_._offset);
+	return true;
+}
+
+/// Profile header alone, its tags are not read
+void AddProfile(const IccProfile& profile_, JsonObject& result_)
 {
+	if (profile_)
+	{
+		result_.Add("icc_bytes", static_cast<unsigned long long>(profile_.Size()))
+			.Add("icc_color_space", IccProfile::SignatureName(profile_.GetColorSpace()));
+	}
+}
 
-	Jpeg jpeg("D:\\Users\\Loki\\Desktop\\favicon.jpg");
+/// Extracted message goes into its own file when --output is given, into the result otherwise.
+/// Shards to join are kept in the output without a path, so the completion gets them and nothing is written.
+void StoreMessage(const Options& options_, const std::vector<byte>& message_, Pipeline::Job& job_)
+{
+	job_._result.Add("length", static_cast<unsigned long long>(message_.size()));
+	if (!options_._join_file.empty())
+	{
+		job_._output.assign(message_.begin(), message_.end());
+		job_._result.Add("shard", PayloadShards::Index(message_));
+	}
+	else if (!options_._output_directory.empty())
+	{
+		job_._output.assign(message_.begin(), message_.end());
+		job_._output_path = OutputPath(options_, job_._file, ".bin");
+		job_._result.Add("output", job_._output_path);
+	}
+	else
+	{
+		job_._result.Add("message", std::string(message_.begin(), message_.end()));
+	}
+}
+
+/// Bitmaps are changed right inside of the file buffer, so the embedded image is the buffer itself
+void ProcessBitmapJob(const Options& options_, const std::vector<byte>& message_, Pipeline::Job& job_)
+{
+	JsonObject& result = job_._result;
+	if (options_._command == "analyze")
+	{
+		job_._error = "The detectors need DCT coefficients, bitmaps are not analyzed";
+		return;
+	}
+	DecodeStatus status;
+	Bmp bmp(std::move(job_._content), status);
+	if (ReportDecodeError(status, job_))
+	{
+		job_._content = bmp.ReleaseFileContent();
+		return;
+	}
+	if (options_._command == "probe")
+	{
+		result.Add("width", bmp.GetWidth())
+			.Add("height", bmp.GetHeight())
+			.Add("bits_per_pixel", bmp.GetBitsPerPixel())
+			.Add("capacity", PayloadEmbedder::Capacity(bmp));
+		AddProfile(bmp.GetIccProfile(), result);
+		job_._content = bmp.ReleaseFileContent();
+	}
+	else if (options_._command == "embed")
+	{
+		PayloadEmbedder::Embed(bmp, message_);
+		// the buffer of the previous output is read into next
+		job_._content = std::move(job_._output);
+		job_._output = bmp.ReleaseFileContent();
+		job_._output_path = OutputPath(options_, job_._file, "");
+		result.Add("output", job_._output_path)
+			.Add("embedded", static_cast<unsigned long long>(message_.size()))
+			.Add("bytes", static_cast<unsigned long long>(job_._output.size()));
+	}
+	else
+	{
+		std::vector<byte> message = PayloadExtractor::Extract(bmp);
+		job_._content = bmp.ReleaseFileContent();
+		StoreMessage(options_, message, job_);
+	}
+}
+
+/// PNG pixels live apart from the file, so the embedded image is encoded again, ancillary chunks kept
+void ProcessPngJob(const Options& options_, const std::vector<byte>& message_, Pipeline::Job& job_)
+{
+	JsonObject& result = job_._result;
+	if (options_._command == "analyze")
+	{
+		job_._error = "The detectors need DCT coefficients, PNG images are not analyzed";
+		return;
+	}
+	DecodeStatus status;
+	Png png(std::move(job_._content), status);
+	if (ReportDecodeError(status, job_))
+	{
+		job_._content = png.ReleaseFileContent();
+		return;
+	}
+	if (options_._command == "probe")
+	{
+		result.Add("width", png.GetWidth())
+			.Add("height", png.GetHeight())
+			.Add("bit_depth", png.GetBitDepth())
+			.Add("color_type", static_cast<int>(png.GetColorType()))
+			.Add("interlaced", png.IsInterlaced())
+			.Add("capacity", PayloadEmbedder::Capacity(png));
+		AddProfile(png.GetIccProfile(), result);
+	}
+	else if (options_._command == "embed")
+	{
+		PayloadEmbedder::Embed(png, message_);
+		job_._output = png.Encode();
+		job_._output_path = OutputPath(options_, job_._file, "");
+		result.Add("output", job_._output_path)
+			.Add("embedded", static_cast<unsigned long long>(message_.size()))
+			.Add("bytes", static_cast<unsigned long long>(job_._output.size()));
+	}
+	else
+	{
+		StoreMessage(options_, PayloadExtractor::Extract(png), job_);
+	}
+	job_._content = png.ReleaseFileContent();
+}
+
+/// Runs on the worker stage, the file is already in job_._content and the output is stored by the writer stage
+void ProcessJob(const Options& options_, const std::vector<byte>& message_, Pipeline::Job& job_)
+{
+	if (options_._command == "index" && (Bmp::IsBmp(job_._content) || Png::IsPng(job_._content)))
+	{
+		job_._error = "Only JPEG images are indexed, rows of bitmaps and PNG images are at hand already";
+		return;
+	}
+	if (options_._command == "thumbnail" && (Bmp::IsBmp(job_._content) || Png::IsPng(job_._content)))
+	{
+		job_._error = "Only JPEG images have scaled decoding";
+		return;
+	}
+	if (!options_._key.empty() && (options_._command == "embed" || options_._command == "extract") &&
+		(Bmp::IsBmp(job_._content) || Png::IsPng(job_._content)))
+	{
+		job_._error = "Only JPEG images carry payload in keyed order";
+		return;
+	}
+	if (Bmp::IsBmp(job_._content))
+	{
+		ProcessBitmapJob(options_, message_, job_);
+		return;
+	}
+	if (Png::IsPng(job_._content))
+	{
+		ProcessPngJob(options_, message_, job_);
+		return;
+	}
+	JsonObject& result = job_._result;
+	DecodeStatus status;
+	// every worker thread decodes its images with its own context, so steady-state decoding does not allocate
+	thread_local JpegDecoder decoder(std::make_shared<Allocator>(options_._allocator, options_._memory_budget));
+	if (options_._command == "probe")
+	{
+		Jpeg::CapacityEstimate estimate;
+		Jpeg& jpeg = decoder.Decode(std::move(job_._content), estimate, status);
+		if (ReportDecodeError(status, job_))
+		{
+			job_._content = jpeg.ReleaseFileContent();
+			return;
+		}
+		result.Add("peak_bytes", static_cast<unsigned long long>(jpeg.GetPeakBytes()))
+			.Add("width", jpeg.GetWidth())
+			.Add("height", jpeg.GetHeight())
+			.Add("components", jpeg.GetComponentsCount())
+			.Add("blocks", estimate._blocks)
+			.Add("usable_ac", estimate._usable_ac)
+			.Add("capacity", estimate.PayloadCapacity());
+		AddProfile(jpeg.GetIccProfile(), result);
+		job_._content = jpeg.ReleaseFileContent();
+	}
+	else if (options_._command == "embed" && options_._stream)
+	{
+		// written by the worker itself, the writer stage would need the whole file in memory
+		std::string output_path = OutputPath(options_, job_._file, "");
+		std::ofstream file(output_path.c_str(), std::ios::binary);
+		if (!file)
+		{
+			throw std::runtime_error("Can't write " + output_path);
+		}
+		try
+		{
+			PayloadEmbedder::Embed(job_._content, message_, file);
+		}
+		catch (...)
+		{
+			// nothing is left of an image, which does not carry the message
+			file.close();
+			std::error_code error;
+			fs::remove(output_path, error);
+			throw;
+		}
+		file.close();
+		if (!file)
+		{
+			throw std::runtime_error("Can't write " + output_path);
+		}
+		result.Add("output", output_path)
+			.Add("embedded", static_cast<unsigned long long>(message_.size()))
+			.Add("bytes", static_cast<unsigned long long>(fs::file_size(output_path)));
+	}
+	else if (options_._command == "embed")
+	{
+		Jpeg& jpeg = decoder.Decode(std::move(job_._content), status);
+		job_._content = jpeg.ReleaseFileContent();
+		if (ReportDecodeError(status, job_))
+		{
+			return;
+		}
+		result.Add("peak_bytes", static_cast<unsigned long long>(jpeg.GetPeakBytes()));
+		if (options_._key.empty())
+		{
+			PayloadEmbedder::Embed(jpeg, message_);
+		}
+		else
+		{
+			PayloadEmbedder::Embed(jpeg, message_, options_._key);
+		}
+		// intervals without payload and the metadata are copied from the file
+		JpegWriter writer(jpeg, job_._content, std::move(job_._output));
+		job_._output = writer.Release();
+		job_._output_path = OutputPath(options_, job_._file, "");
+		result.Add("output", job_._output_path)
+			.Add("embedded", static_cast<unsigned long long>(message_.size()))
+			.Add("bytes", static_cast<unsigned long long>(job_._output.size()));
+	}
+	else if (options_._command == "extract")
+	{
+		// the file buffer is given back to the job by Extract, failed or not
+		std::vector<byte> message = options_._key.empty() ? PayloadExtractor::Extract(job_._content, decoder, status) :
+			PayloadExtractor::Extract(job_._content, decoder, options_._key, status);
+		if (ReportDecodeError(status, job_))
+		{
+			return;
+		}
+		StoreMessage(options_, message, job_);
+	}
+	else if (options_._command == "index")
+	{
+		JpegIndex index;
+		Jpeg jpeg(std::move(job_._content), index, status, std::make_shared<Allocator>(options_._allocator, options_._memory_budget));
+		job_._content = jpeg.ReleaseFileContent();
+		if (ReportDecodeError(status, job_))
+		{
+			return;
+		}
+		job_._output = index.Serialize();
+		job_._output_path = options_._output_directory.empty() ? JpegIndex::PathFor(job_._file) : OutputPath(options_, job_._file, ".idx");
+		result.Add("output", job_._output_path)
+			.Add("scans", static_cast<int>(index.GetScans().size()))
+			.Add("interval", index.GetInterval())
+			.Add("bytes", static_cast<unsigned long long>(job_._output.size()));
+	}
+	else if (options_._command == "thumbnail")
+	{
+		Jpeg jpeg(std::move(job_._content), options_._scale, status, std::make_shared<Allocator>(options_._allocator, options_._memory_budget));
+		job_._content = jpeg.ReleaseFileContent();
+		if (ReportDecodeError(status, job_))
+		{
+			return;
+		}
+		const int width = (jpeg.GetWidth() + options_._scale - 1) / options_._scale;
+		const int height = (jpeg.GetHeight() + options_._scale - 1) / options_._scale;
+		job_._output = Png::WriteRgb(jpeg.GetRgb(options_._scale), width, height);
+		job_._output_path = OutputPath(options_, job_._file, ".png");
+		result.Add("peak_bytes", static_cast<unsigned long long>(jpeg.GetPeakBytes()))
+			.Add("output", job_._output_path)
+			.Add("width", width)
+			.Add("height", height)
+			.Add("bytes", static_cast<unsigned long long>(job_._output.size()));
+	}
+	else
+	{
+		// every image runs on its own worker, so the detectors stay single-threaded
+		Jpeg& jpeg = decoder.Decode(std::move(job_._content), status);
+		job_._content = jpeg.ReleaseFileContent();
+		if (ReportDecodeError(status, job_))
+		{
+			return;
+		}
+		result.Add("peak_bytes", static_cast<unsigned long long>(jpeg.GetPeakBytes()));
+		Steganalysis::Report report = Steganalysis::Analyze(jpeg, 4096, 1024, 1);
+		result.Add("chi_square_probability", report._chi_square_probability)
+			.Add("rs_estimate", report._rs_estimate)
+			.Add("sample_pairs_estimate", report._sample_pairs_estimate)
+			.Add("score", report._score)
+			.Add("chi_square_profile", report._chi_square_profile);
+	}
+}
+
+/// Prints a JSON line per stage, returns 1 when some stage fell below the baseline
+int RunBenchmark(const Options& options_)
+{
+	std::string directory = options_._output_directory.empty() ?
+		(fs::temp_directory_path() / "SteganAssist-bench").string() : options_._output_directory;
+	std::vector<Benchmark::Result> results = Benchmark::Run(directory);
+	std::map<std::string, double> baseline;
+	if (!options_._baseline_file.empty())
+	{
+		baseline = Benchmark::LoadBaseline(options_._baseline_file);
+	}
+
+	int regressions = 0;
+	for (int i = 0; i < results.size(); i++)
+	{
+		const Benchmark::Result& result = results[i];
+		JsonObject line;
+		line.Add("stage", result._stage)
+			.Add("seconds", result._seconds)
+			.Add("mb_per_s", result.MegabytesPerSecond())
+			.Add("mpix_per_s", result.MegapixelsPerSecond());
+		std::map<std::string, double>::const_iterator expected = baseline.find(result._stage);
+		if (expected != baseline.end())
+		{
+			double change = result.MegapixelsPerSecond() / expected->second - 1;
+			bool regression = change < -options_._tolerance;
+			regressions += regression;
+			line.Add("baseline_mpix_per_s", expected->second)
+				.Add("change", change)
+				.Add("status", regression ? "regression" : "ok");
+		}
+		std::cout << line.Str() << "\n";
+	}
+	if (!options_._save_baseline_file.empty())
+	{
+		Benchmark::SaveBaseline(options_._save_baseline_file, results);
+	}
+	if (regressions)
+	{
+		std::cerr << regressions << " stages are slower than the baseline\n";
+	}
+	return regressions ? 1 : 0;
+}
+
+int RunSelfTest()
+{
+	std::vector<Kernels::SelfTestResult> results = Kernels::SelfTest();
+	int mismatches = 0;
+	for (int i = 0; i < results.size(); i++)
+	{
+		const Kernels::SelfTestResult& result = results[i];
+		mismatches += !result._passed;
+		std::cout << JsonObject()
+			.Add("kernel", result._kernel)
+			.Add("level", Kernels::LevelName(result._level))
+			.Add("status", result._passed ? "ok" : "mismatch")
+			.Add("max_difference", result._max_difference)
+			.Str() << "\n";
+	}
+	std::cerr << results.size() << " kernels checked, " << mismatches << " differ from scalar, host supports "
+		<< Kernels::LevelName(Kernels::Detect()) << "\n";
+
+	std::vector<DecoderSelfTest::Result> cases = DecoderSelfTest::Run();
+	int failures = 0;
+	for (int i = 0; i < cases.size(); i++)
+	{
+		failures += !cases[i]._passed;
+		JsonObject line;
+		line.Add("case", cases[i]._case).Add("status", cases[i]._passed ? "ok" : "failed");
+		if (!cases[i]._passed)
+		{
+			line.Add("detail", cases[i]._detail);
+		}
+		std::cout << line.Str() << "\n";
+	}
+	std::cerr << cases.size() << " decoder cases checked, " << failures << " failed\n";
+	return mismatches || failures ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	std::vector<std::string> files;
+	std::vector<byte> message;
+	std::map<std::string, int> shard_of_file;
+	std::vector<std::vector<byte>> shards;
+	try
+	{
+		options = ParseArguments(argc, argv);
+		for (int i = 0; i < options._inputs.size(); i++)
+		{
+			CollectFiles(options._inputs[i], files);
+		}
+		if (!options._message_file.empty())
+		{
+			message = ImageFileBuffer(options._message_file).Get();
+		}
+		if (options._data_shards)
+		{
+			// a shard per image in the order of the command line, the outputs are named after the images, so they must differ
+			std::set<std::string> outputs;
+			for (int i = 0; i < files.size(); i++)
+			{
+				if (!outputs.insert(OutputPath(options, files[i], "")).second)
+				{
+					throw std::invalid_argument("Images carrying shards must have different names, " + files[i] + " repeats");
+				}
+				shard_of_file[files[i]] = i;
+			}
+			if (int(files.size()) < options._data_shards || files.size() > ReedSolomon::max_shards)
+			{
+				throw std::invalid_argument("--data-shards needs from K to 255 images, one shard per image");
+			}
+			shards = PayloadShards::Split(message, options._data_shards, int(files.size()));
+		}
+		if (!options._output_directory.empty())
+		{
+			fs::create_directories(options._output_directory);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		PrintUsage();
+		return 2;
+	}
+	Kernels::Bind(options._cpu);
+	if (options._command == "selftest")
+	{
+		return RunSelfTest();
+	}
 
-	//std::vector<unsigned char> vec = ImageFileBuffer("D:\\Users\\Loki\\Desktop\\favicon.jpg").Get();
+	if (options._command == "bench" || options._command == "generate")
+	{
+		try
+		{
+			if (options._command == "bench")
+			{
+				return RunBenchmark(options);
+			}
+			std::vector<std::string> corpus = Benchmark::WriteCorpus(options._output_directory);
+			for (int i = 0; i < corpus.size(); i++)
+			{
+				std::cout << corpus[i] << "\n";
+			}
+			return 0;
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << "\n";
+			return 1;
+		}
+	}
 
-	//// std::vector<unsigned char> vec = { 1, 2, 3 };
-	//
-	//InputBitStream bs(vec);
+	// largest images start first, so the batch does not end waiting for one of them
+	std::vector<std::pair<std::uintmax_t, std::string>> jobs;
+	for (int i = 0; i < files.size(); i++)
+	{
+		std::error_code error;
+		std::uintmax_t size = fs::file_size(files[i], error);
+		jobs.emplace_back(error ? 0 : size, files[i]);
+	}
+	std::stable_sort(jobs.begin(), jobs.end(), [](const std::pair<std::uintmax_t, std::string>& a_, const std::pair<std::uintmax_t, std::string>& b_)
+	{
+		return a_.first > b_.first;
+	});
 
-	//byte q;
-	//while(bs >> q)
-	//{
-	//	std::cout << q << " ";
-	//}
+	std::vector<std::string> ordered_files;
+	for (int i = 0; i < jobs.size(); i++)
+	{
+		ordered_files.push_back(jobs[i].second);
+	}
 
+	Pipeline::Settings settings;
+	settings._loader = options._loader;
+	settings._readers = options._readers;
+	settings._workers = options._threads;
+	settings._writers = options._writers;
+	int failed = 0;
+	std::vector<std::vector<byte>> found_shards;
+	std::unique_ptr<Pipeline> pipeline;
+	try
+	{
+		pipeline.reset(new Pipeline(settings));
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 2;
+	}
+	if (!options._trace_file.empty())
+	{
+		Trace::Start();
+	}
+	pipeline->Run(ordered_files, [&options, &message, &shard_of_file, &shards](Pipeline::Job& job_)
+	{
+		Trace::Span span("image");
+		// extract decodes inside of PayloadExtractor, so the counters are taken from the worker thread
+		DecodeCounters before = DecodeCounters::Current();
+		if (shards.empty())
+		{
+			ProcessJob(options, message, job_);
+		}
+		else
+		{
+			const int shard = shard_of_file.at(job_._file);
+			job_._result.Add("shard", shard);
+			ProcessJob(options, shards[shard], job_);
+		}
+		if (options._counters)
+		{
+			job_._result.AddRaw("counters", (DecodeCounters::Current() - before).ToJson());
+		}
+	},
+	[&failed, &options, &found_shards](const Pipeline::Job& job_)
+	{
+		JsonObject result;
+		result.Add("file", job_._file);
+		if (job_._error.empty())
+		{
+			result.Add("status", "ok").Append(job_._result);
+			if (!options._join_file.empty())
+			{
+				found_shards.push_back(job_._output);
+			}
+		}
+		else
+		{
+			failed++;
+			result.Add("status", "error").Add("error", job_._error).Append(job_._result);
+		}
+		std::cout << result.Str() << "\n";
+	});
+	std::cout.flush();
+	if (!options._trace_file.empty())
+	{
+		Trace::Save(options._trace_file);
+	}
 
-}
\ No newline at end of file
+	std::cerr << jobs.size() << " files, " << failed << " failed, read by " << pipeline->LoaderName() << "\n";
+	if (!options._join_file.empty())
+	{
+		// lost carriers are what the parity is for, so only the join decides the exit code
+		JsonObject result;
+		result.Add("file", options._join_file);
+		bool joined_ok = false;
+		try
+		{
+			std::vector<byte> joined = PayloadShards::Join(found_shards);
+			std::ofstream file(options._join_file.c_str(), std::ios::binary);
+			file.write(reinterpret_cast<const char*>(joined.data()), joined.size());
+			file.close();
+			if (!file)
+			{
+				throw std::runtime_error("Can't write " + options._join_file);
+			}
+			const int intact = int(std::count_if(found_shards.begin(), found_shards.end(), [](const std::vector<byte>& payload_)
+			{
+				return PayloadShards::Index(payload_) >= 0;
+			}));
+			result.Add("status", "ok")
+				.Add("length", static_cast<unsigned long long>(joined.size()))
+				.Add("intact_shards", intact);
+			joined_ok = true;
+		}
+		catch (const std::exception& e)
+		{
+			result.Add("status", "error").Add("error", e.what());
+		}
+		std::cout << result.Str() << "\n";
+		return joined_ok ? 0 : 1;
+	}
+	return failed ? 1 : 0;
+}
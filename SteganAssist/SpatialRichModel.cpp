@@ -0,0 +1,297 @@
+#include "SpatialRichModel.h"
+#include "Parallel.h"
+#include "Kernels.h"
+#include <algorithm>
+#include <memory>
+
+struct Tap
+{
+	int _dy;
+	int _dx;
+	int _weight;
+};
+
+struct Residual
+{
+	Tap _taps[25];
+	int _taps_count;
+};
+
+// base linear residuals, centered on the current sample
+enum
+{
+	FIRST_RIGHT, FIRST_LEFT, FIRST_DOWN, FIRST_UP,
+	SECOND_HORIZONTAL, SECOND_VERTICAL, SECOND_DIAGONAL, SECOND_ANTIDIAGONAL,
+	THIRD_RIGHT, THIRD_DOWN,
+	EDGE_UP, EDGE_DOWN, EDGE_LEFT, EDGE_RIGHT,
+	SQUARE_3x3, SQUARE_5x5,
+	BASE_RESIDUALS
+};
+
+static const Residual base_residuals[BASE_RESIDUALS] =
+{
+	{ { { 0, 1, 1 }, { 0, 0, -1 } }, 2 },
+	{ { { 0, -1, 1 }, { 0, 0, -1 } }, 2 },
+	{ { { 1, 0, 1 }, { 0, 0, -1 } }, 2 },
+	{ { { -1, 0, 1 }, { 0, 0, -1 } }, 2 },
+	{ { { 0, -1, 1 }, { 0, 1, 1 }, { 0, 0, -2 } }, 3 },
+	{ { { -1, 0, 1 }, { 1, 0, 1 }, { 0, 0, -2 } }, 3 },
+	{ { { -1, -1, 1 }, { 1, 1, 1 }, { 0, 0, -2 } }, 3 },
+	{ { { -1, 1, 1 }, { 1, -1, 1 }, { 0, 0, -2 } }, 3 },
+	{ { { 0, -1, 1 }, { 0, 0, -3 }, { 0, 1, 3 }, { 0, 2, -1 } }, 4 },
+	{ { { -1, 0, 1 }, { 0, 0, -3 }, { 1, 0, 3 }, { 2, 0, -1 } }, 4 },
+	// halves of SQUARE 3x3 including the central line
+	{ { { -1, -1, -1 }, { -1, 0, 2 }, { -1, 1, -1 }, { 0, -1, 2 }, { 0, 0, -4 }, { 0, 1, 2 } }, 6 },
+	{ { { 1, -1, -1 }, { 1, 0, 2 }, { 1, 1, -1 }, { 0, -1, 2 }, { 0, 0, -4 }, { 0, 1, 2 } }, 6 },
+	{ { { -1, -1, -1 }, { 0, -1, 2 }, { 1, -1, -1 }, { -1, 0, 2 }, { 0, 0, -4 }, { 1, 0, 2 } }, 6 },
+	{ { { -1, 1, -1 }, { 0, 1, 2 }, { 1, 1, -1 }, { -1, 0, 2 }, { 0, 0, -4 }, { 1, 0, 2 } }, 6 },
+	{ { { -1, -1, -1 }, { -1, 0, 2 }, { -1, 1, -1 }, { 0, -1, 2 }, { 0, 0, -4 }, { 0, 1, 2 }, { 1, -1, -1 }, { 1, 0, 2 }, { 1, 1, -1 } }, 9 },
+	{ {
+		{ -2, -2, -1 }, { -2, -1, 2 }, { -2, 0, -2 }, { -2, 1, 2 }, { -2, 2, -1 },
+		{ -1, -2, 2 }, { -1, -1, -6 }, { -1, 0, 8 }, { -1, 1, -6 }, { -1, 2, 2 },
+		{ 0, -2, -2 }, { 0, -1, 8 }, { 0, 0, -12 }, { 0, 1, 8 }, { 0, 2, -2 },
+		{ 1, -2, 2 }, { 1, -1, -6 }, { 1, 0, 8 }, { 1, 1, -6 }, { 1, 2, 2 },
+		{ 2, -2, -1 }, { 2, -1, 2 }, { 2, 0, -2 }, { 2, 1, 2 }, { 2, 2, -1 } }, 25 },
+};
+
+enum SubmodelType { LINEAR, MINIMUM, MAXIMUM };
+
+struct Submodel
+{
+	SubmodelType _type;
+	int _bases[4];
+	int _bases_count;
+	int _quantization;
+};
+
+static const Submodel submodels_description[SpatialRichModel::submodels] =
+{
+	{ LINEAR, { FIRST_RIGHT }, 1, 1 },
+	{ LINEAR, { FIRST_DOWN }, 1, 1 },
+	{ LINEAR, { SECOND_HORIZONTAL }, 1, 2 },
+	{ LINEAR, { SECOND_VERTICAL }, 1, 2 },
+	{ LINEAR, { THIRD_RIGHT }, 1, 3 },
+	{ LINEAR, { THIRD_DOWN }, 1, 3 },
+	{ LINEAR, { SQUARE_3x3 }, 1, 4 },
+	{ LINEAR, { SQUARE_5x5 }, 1, 12 },
+	{ MINIMUM, { FIRST_RIGHT, FIRST_LEFT, FIRST_DOWN, FIRST_UP }, 4, 1 },
+	{ MAXIMUM, { FIRST_RIGHT, FIRST_LEFT, FIRST_DOWN, FIRST_UP }, 4, 1 },
+	{ MINIMUM, { FIRST_RIGHT, FIRST_LEFT }, 2, 1 },
+	{ MAXIMUM, { FIRST_RIGHT, FIRST_LEFT }, 2, 1 },
+	{ MINIMUM, { FIRST_DOWN, FIRST_UP }, 2, 1 },
+	{ MAXIMUM, { FIRST_DOWN, FIRST_UP }, 2, 1 },
+	{ MINIMUM, { SECOND_HORIZONTAL, SECOND_VERTICAL }, 2, 2 },
+	{ MAXIMUM, { SECOND_HORIZONTAL, SECOND_VERTICAL }, 2, 2 },
+	{ MINIMUM, { SECOND_HORIZONTAL, SECOND_VERTICAL, SECOND_DIAGONAL, SECOND_ANTIDIAGONAL }, 4, 2 },
+	{ MAXIMUM, { SECOND_HORIZONTAL, SECOND_VERTICAL, SECOND_DIAGONAL, SECOND_ANTIDIAGONAL }, 4, 2 },
+	{ MINIMUM, { THIRD_RIGHT, THIRD_DOWN }, 2, 3 },
+	{ MAXIMUM, { THIRD_RIGHT, THIRD_DOWN }, 2, 3 },
+	{ MINIMUM, { EDGE_UP, EDGE_DOWN, EDGE_LEFT, EDGE_RIGHT }, 4, 4 },
+	{ MAXIMUM, { EDGE_UP, EDGE_DOWN, EDGE_LEFT, EDGE_RIGHT }, 4, 4 },
+};
+
+static const int border = 2;        // the widest filter is 5x5
+static const int cooccurrence = 4;  // samples in one co-occurrence
+static const int tile_width = 64;
+static const int tile_height = 32;
+static const int extended_width = tile_width + cooccurrence - 1;
+static const int extended_height = tile_height + cooccurrence - 1;
+
+/// Buffers of one tile, small enough to stay in L2 cache
+struct TileBuffers
+{
+	short _samples[(extended_height + 2 * border) * (extended_width + 2 * border + 16)];
+	short _residuals[BASE_RESIDUALS][extended_height * extended_width];
+	signed char _quantized[SpatialRichModel::submodels][extended_height * extended_width];
+};
+
+static void compute_residual(const short* samples_, int samples_stride_, const Residual& residual_, short* output_, int width_, int height_)
+{
+	const KernelTable& kernels = Kernels::Get();
+	short weights[25];
+	for (int t = 0; t < residual_._taps_count; t++)
+	{
+		weights[t] = short(residual_._taps[t]._weight);
+	}
+	for (int y = 0; y < height_; y++)
+	{
+		const short* row = samples_ + (y + border) * samples_stride_ + border;
+		const short* rows[25];
+		for (int t = 0; t < residual_._taps_count; t++)
+		{
+			rows[t] = row + residual_._taps[t]._dy * samples_stride_ + residual_._taps[t]._dx;
+		}
+		kernels._residual(rows, weights, residual_._taps_count, output_ + y * extended_width, width_);
+	}
+}
+
+/// round(value / q) truncated to [-2, 2] is found by comparing value with ceil(q / 2) and ceil(3q / 2),
+/// which is exact for integers and does not need division
+static void quantize_submodel(const TileBuffers& buffers_, const Submodel& submodel_, signed char* output_, int width_, int height_)
+{
+	const short first_threshold = short((submodel_._quantization + 1) / 2);
+	const short second_threshold = short((3 * submodel_._quantization + 1) / 2);
+	const KernelTable& kernels = Kernels::Get();
+	for (int y = 0; y < height_; y++)
+	{
+		int offset = y * extended_width;
+		const short* bases[4];
+		for (int b = 0; b < submodel_._bases_count; b++)
+		{
+			bases[b] = buffers_._residuals[submodel_._bases[b]] + offset;
+		}
+		kernels._quantize_residual(bases, submodel_._bases_count, submodel_._type == MINIMUM, first_threshold, second_threshold,
+			output_ + offset, width_);
+	}
+}
+
+namespace
+{
+	/// Samples of the caller seen as an image of one component
+	class SampleBuffer : public Image
+	{
+		const byte* _samples;
+		int _width;
+		int _height;
+		int _stride;
+
+	public:
+
+		SampleBuffer(const byte* samples_, int width_, int height_, int stride_)
+			: _samples(samples_), _width(width_), _height(height_), _stride(stride_)
+		{
+		}
+
+		int GetWidth() const override { return _width; }
+		int GetHeight() const override { return _height; }
+		int GetComponentsCount() const override { return 1; }
+		int GetComponentWidth(int component_) const override { return _width; }
+		int GetComponentHeight(int component_) const override { return _height; }
+
+		PlaneView<const byte> GetSampleTile(int component_, int x_, int y_, int width_, int height_, std::vector<byte>& scratch_) const override
+		{
+			return PlaneView<const byte>(_samples + std::ptrdiff_t(y_) * _stride + x_, width_, height_, _stride);
+		}
+	};
+}
+
+std::vector<float> SpatialRichModel::Extract(const byte* samples_, int width_, int height_, int stride_, int threads_)
+{
+	return Extract(SampleBuffer(samples_, width_, height_, stride_), threads_);
+}
+
+std::vector<float> SpatialRichModel::Extract(const Image& image_, int threads_, int component_)
+{
+	const int image_width = image_.GetComponentWidth(component_);
+	const int image_height = image_.GetComponentHeight(component_);
+	std::vector<float> features(size);
+	// residuals are defined only where the whole 5x5 neighbourhood is inside of image
+	const int first = border;
+	const int last_x = image_width - border; // exclusive
+	const int last_y = image_height - border;
+	if (last_x - first < cooccurrence || last_y - first < cooccurrence)
+	{
+		return features;
+	}
+
+	const int tiles_per_line = (last_x - first + tile_width - 1) / tile_width;
+	const int tiles_per_column = (last_y - first + tile_height - 1) / tile_height;
+	const int tiles = tiles_per_line * tiles_per_column;
+
+	int threads = Parallel::ThreadsFor(threads_, size_t(image_width) * image_height);
+	std::vector<std::vector<unsigned int>> histograms(threads, std::vector<unsigned int>(size));
+
+	Parallel::Run(threads, [&](int thread_)
+	{
+		std::vector<unsigned int>& histogram = histograms[thread_];
+		std::unique_ptr<TileBuffers> buffers(new TileBuffers());
+		std::vector<byte> scratch;
+		const int samples_stride = extended_width + 2 * border + 16;
+
+		for (int tile = tiles * thread_ / threads; tile < tiles * (thread_ + 1) / threads; tile++)
+		{
+			// co-occurrences start inside of tile, but may reach up to 3 samples beyond it
+			int x0 = first + (tile % tiles_per_line) * tile_width;
+			int y0 = first + (tile / tiles_per_line) * tile_height;
+			int x1 = std::min(x0 + tile_width, last_x);
+			int y1 = std::min(y0 + tile_height, last_y);
+			int width = std::min(x1 + cooccurrence - 1, last_x) - x0;
+			int height = std::min(y1 + cooccurrence - 1, last_y) - y0;
+
+			PlaneView<const byte> samples = image_.GetSampleTile(component_, x0 - border, y0 - border,
+				width + 2 * border, height + 2 * border, scratch);
+			if (!samples)
+			{
+				continue;
+			}
+			for (int y = 0; y < samples._height; y++)
+			{
+				const byte* row = samples.Row(y);
+				short* destination = buffers->_samples + y * samples_stride;
+				if (samples._step == 1)
+				{
+					std::copy(row, row + samples._width, destination);
+					continue;
+				}
+				for (int x = 0; x < samples._width; x++)
+				{
+					destination[x] = row[x * samples._step];
+				}
+			}
+			for (int r = 0; r < BASE_RESIDUALS; r++)
+			{
+				compute_residual(buffers->_samples, samples_stride, base_residuals[r], buffers->_residuals[r], width, height);
+			}
+			for (int s = 0; s < submodels; s++)
+			{
+				quantize_submodel(*buffers, submodels_description[s], buffers->_quantized[s], width, height);
+			}
+
+			for (int s = 0; s < submodels; s++)
+			{
+				const signed char* quantized = buffers->_quantized[s];
+				unsigned int* horizontal = histogram.data() + (2 * s) * cooccurrence_bins;
+				unsigned int* vertical = histogram.data() + (2 * s + 1) * cooccurrence_bins;
+				for (int y = 0; y < y1 - y0; y++)
+				{
+					const signed char* row = quantized + y * extended_width;
+					bool vertical_fits = y + cooccurrence <= height;
+					for (int x = 0; x < x1 - x0; x++)
+					{
+						if (x + cooccurrence <= width)
+						{
+							horizontal[(row[x] + 2) * 125 + (row[x + 1] + 2) * 25 + (row[x + 2] + 2) * 5 + row[x + 3] + 2]++;
+						}
+						if (vertical_fits)
+						{
+							vertical[(row[x] + 2) * 125 + (row[x + extended_width] + 2) * 25
+								+ (row[x + 2 * extended_width] + 2) * 5 + row[x + 3 * extended_width] + 2]++;
+						}
+					}
+				}
+			}
+		}
+	});
+
+	for (int i = 0; i < threads; i++)
+	{
+		for (int j = 0; j < size; j++)
+		{
+			features[j] += histograms[i][j];
+		}
+	}
+	for (int i = 0; i < size; i += cooccurrence_bins)
+	{
+		float sum = 0;
+		for (int j = 0; j < cooccurrence_bins; j++)
+		{
+			sum += features[i + j];
+		}
+		for (int j = 0; sum > 0 && j < cooccurrence_bins; j++)
+		{
+			features[i + j] /= sum;
+		}
+	}
+	return features;
+}
+
@@ -0,0 +1,25 @@
+#pragma once
+#include<vector>
+#include"BitStream.h"
+#include"Image.h"
+
+/// SpatialRichModel class, that extracts SRM-style features of 8-bit samples
+/// [Fridrich, Kodovsky: Rich models for steganalysis of digital images].
+/// 16 linear residuals (1st, 2nd, 3rd order, EDGE 3x3, SQUARE 3x3 and 5x5) give 22 submodels, linear ones
+/// and min/max over several directions. Every submodel is quantized with its central coefficient, truncated
+/// to 2 and described by horizontal and vertical 4-D co-occurrences: 22 * 2 * 625 = 27500 features.
+/// Image is processed tile by tile, all filters share one pass over the tile while it stays in cache,
+/// tiles are split between threads with their own histograms, threads_ equal to 0 means hardware concurrency.
+class SpatialRichModel
+{
+public:
+
+	static std::vector<float> Extract(const byte* samples_, int width_, int height_, int stride_, int threads_ = 0);
+	/// Features of the component, luminance of JPEG, the gray level or red of bitmaps by default.
+	/// Samples are taken tile by tile, so JPEG is never decoded as a whole.
+	static std::vector<float> Extract(const Image& image_, int threads_ = 0, int component_ = 0);
+
+	static const int submodels = 22;
+	static const int cooccurrence_bins = 625;
+	static const int size = submodels * 2 * cooccurrence_bins;
+};
\ No newline at end of file
@@ -0,0 +1,302 @@
+#include "Steganalysis.h"
+#include "Jpeg.h"
+#include "Parallel.h"
+#include "Kernels.h"
+#include <cmath>
+#include <algorithm>
+
+/// Regularized upper incomplete gamma function Q(a, x) [Numerical Recipes 6.2]
+static double gamma_q(double a_, double x_)
+{
+	if (x_ <= 0)
+	{
+		return 1.0;
+	}
+	double log_prefix = -x_ + a_ * std::log(x_) - std::lgamma(a_);
+	if (x_ < a_ + 1)
+	{
+		// series for P(a, x)
+		double term = 1.0 / a_, sum = term;
+		for (int n = 1; n < 1000 && std::fabs(term) > std::fabs(sum) * 1e-15; n++)
+		{
+			term *= x_ / (a_ + n);
+			sum += term;
+		}
+		return 1.0 - sum * std::exp(log_prefix);
+	}
+	// continued fraction for Q(a, x), modified Lentz's method
+	const double tiny = 1e-300;
+	double b = x_ + 1 - a_, c = 1 / tiny, d = 1 / b, h = d;
+	for (int i = 1; i < 1000; i++)
+	{
+		double an = -i * (i - a_);
+		b += 2;
+		d = an * d + b;
+		d = std::fabs(d) < tiny ? tiny : d;
+		c = b + an / c;
+		c = std::fabs(c) < tiny ? tiny : c;
+		d = 1 / d;
+		double delta = d * c;
+		h *= delta;
+		if (std::fabs(delta - 1) < 1e-15)
+		{
+			break;
+		}
+	}
+	return std::exp(log_prefix) * h;
+}
+
+std::vector<short> Steganalysis::EmbeddingOrder(const Jpeg& jpeg_)
+{
+	std::vector<short> sequence;
+	const KernelTable& kernels = Kernels::Get();
+	jpeg_.ForEachBlockInScanOrder([&sequence, &kernels](const Jpeg::BlockPosition& position_, const short* coefficients_)
+	{
+		for (unsigned long long usable = kernels._usable_mask(coefficients_); usable; usable &= usable - 1)
+		{
+			sequence.push_back(coefficients_[LowestSetBit(usable)]);
+		}
+	});
+	return sequence;
+}
+
+std::vector<unsigned long long> Steganalysis::Histogram(const std::vector<short>& sequence_, int threads_)
+{
+	int threads = Parallel::ThreadsFor(threads_, sequence_.size());
+	std::vector<std::vector<unsigned long long>> histograms(threads, std::vector<unsigned long long>(histogram_size));
+	Parallel::Run(threads, [&](int thread_)
+	{
+		size_t begin = sequence_.size() * thread_ / threads;
+		size_t end = sequence_.size() * (thread_ + 1) / threads;
+		Kernels::Get()._histogram(sequence_.data() + begin, end - begin, histogram_offset, histogram_size, histograms[thread_].data());
+	});
+	for (int i = 1; i < threads; i++)
+	{
+		for (int j = 0; j < histogram_size; j++)
+		{
+			histograms[0][j] += histograms[i][j];
+		}
+	}
+	return histograms[0];
+}
+
+double Steganalysis::ChiSquareProbability(const std::vector<unsigned long long>& histogram_)
+{
+	// histogram_offset is even, so bins 2i and 2i + 1 hold the values, which differ only in LSB
+	double chi_square = 0;
+	int categories = 0;
+	for (int i = 0; i + 1 < histogram_size; i += 2)
+	{
+		double expected = (histogram_[i] + histogram_[i + 1]) / 2.0;
+		if (expected < 5)
+		{
+			continue; // too few observations for chi-square approximation
+		}
+		chi_square += (histogram_[i] - expected) * (histogram_[i] - expected) / expected;
+		categories++;
+	}
+	if (categories < 2)
+	{
+		return 0;
+	}
+	return gamma_q((categories - 1) / 2.0, chi_square / 2);
+}
+
+std::vector<double> Steganalysis::ChiSquareProfile(const std::vector<short>& sequence_, int window_, int step_, int threads_)
+{
+	if (window_ <= 0 || step_ <= 0 || sequence_.size() < window_)
+	{
+		return std::vector<double>();
+	}
+	std::vector<double> profile((sequence_.size() - window_) / step_ + 1);
+	int threads = Parallel::ThreadsFor(threads_, profile.size() * step_);
+	Parallel::Run(threads, [&](int thread_)
+	{
+		size_t begin = profile.size() * thread_ / threads;
+		size_t end = profile.size() * (thread_ + 1) / threads;
+		if (begin == end)
+		{
+			return;
+		}
+		// every thread slides its own histogram over its range of windows
+		std::vector<unsigned long long> histogram(histogram_size);
+		auto bin = [](short value_) { return std::min(std::max(value_ + histogram_offset, 0), histogram_size - 1); };
+		for (size_t i = begin * step_; i < begin * step_ + window_; i++)
+		{
+			histogram[bin(sequence_[i])]++;
+		}
+		for (size_t w = begin; w < end; w++)
+		{
+			if (w != begin)
+			{
+				for (size_t i = (w - 1) * step_; i < w * step_; i++)
+				{
+					histogram[bin(sequence_[i])]--;
+					histogram[bin(sequence_[i + window_])]++;
+				}
+			}
+			profile[w] = ChiSquareProbability(histogram);
+		}
+	});
+	return profile;
+}
+
+double Steganalysis::RsEstimate(const byte* samples_, int width_, int height_, int stride_, int threads_)
+{
+	// counters of regular and singular groups for masks M and -M, for original and for LSB flipped samples
+	enum { RM, SM, R_M, S_M, RM_FLIPPED, SM_FLIPPED, R_M_FLIPPED, S_M_FLIPPED, COUNTERS };
+	int threads = Parallel::ThreadsFor(threads_, size_t(width_) * height_);
+	std::vector<std::vector<long long>> counters(threads, std::vector<long long>(COUNTERS));
+
+	Parallel::Run(threads, [&](int thread_)
+	{
+		std::vector<long long>& counter = counters[thread_];
+		int begin = height_ * thread_ / threads;
+		int end = height_ * (thread_ + 1) / threads;
+		static const int mask[4] = { 0, 1, 1, 0 };
+		for (int y = begin; y < end; y++)
+		{
+			const byte* row = samples_ + y * stride_;
+			for (int x = 0; x + 4 <= width_; x += 4)
+			{
+				for (int flipped = 0; flipped < 2; flipped++)
+				{
+					int group[4], positive[4], negative[4];
+					for (int i = 0; i < 4; i++)
+					{
+						group[i] = flipped ? row[x + i] ^ 1 : row[x + i];
+						positive[i] = mask[i] ? group[i] ^ 1 : group[i];                   // F1: 2i <-> 2i + 1
+						negative[i] = mask[i] ? ((group[i] + 1) ^ 1) - 1 : group[i];       // F-1: 2i - 1 <-> 2i
+					}
+					int f = 0, f_positive = 0, f_negative = 0;
+					for (int i = 0; i < 3; i++)
+					{
+						f += std::abs(group[i + 1] - group[i]);
+						f_positive += std::abs(positive[i + 1] - positive[i]);
+						f_negative += std::abs(negative[i + 1] - negative[i]);
+					}
+					int base = flipped ? RM_FLIPPED : RM;
+					counter[base + 0] += f_positive > f;
+					counter[base + 1] += f_positive < f;
+					counter[base + 2] += f_negative > f;
+					counter[base + 3] += f_negative < f;
+				}
+			}
+		}
+	});
+	for (int i = 1; i < threads; i++)
+	{
+		for (int j = 0; j < COUNTERS; j++)
+		{
+			counters[0][j] += counters[i][j];
+		}
+	}
+	const std::vector<long long>& c = counters[0];
+	double groups = double(height_) * (width_ / 4);
+	if (groups == 0)
+	{
+		return 0;
+	}
+
+	double d0 = (c[RM] - c[SM]) / groups;
+	double d1 = (c[RM_FLIPPED] - c[SM_FLIPPED]) / groups;
+	double d_0 = (c[R_M] - c[S_M]) / groups;
+	double d_1 = (c[R_M_FLIPPED] - c[S_M_FLIPPED]) / groups;
+
+	// 2 (d1 + d0) x^2 + (d-0 - d-1 - d1 - 3 d0) x + d0 - d-0 = 0, the root with smaller absolute value
+	double a = 2 * (d1 + d0), b = d_0 - d_1 - d1 - 3 * d0, cc = d0 - d_0;
+	double x;
+	if (std::fabs(a) < 1e-12)
+	{
+		if (std::fabs(b) < 1e-12)
+		{
+			return 0;
+		}
+		x = -cc / b;
+	}
+	else
+	{
+		double discriminant = b * b - 4 * a * cc;
+		if (discriminant < 0)
+		{
+			return 0;
+		}
+		double root_1 = (-b + std::sqrt(discriminant)) / (2 * a);
+		double root_2 = (-b - std::sqrt(discriminant)) / (2 * a);
+		x = std::fabs(root_1) < std::fabs(root_2) ? root_1 : root_2;
+	}
+	if (std::fabs(x - 0.5) < 1e-12)
+	{
+		return 0;
+	}
+	return std::min(std::max(x / (x - 0.5), 0.0), 1.0);
+}
+
+double Steganalysis::SamplePairsEstimate(const byte* samples_, int width_, int height_, int stride_, int threads_)
+{
+	int threads = Parallel::ThreadsFor(threads_, size_t(width_) * height_);
+	std::vector<std::vector<long long>> counters(threads, std::vector<long long>(3));
+
+	Parallel::Run(threads, [&](int thread_)
+	{
+		long long x = 0, y = 0, k = 0;
+		int begin = height_ * thread_ / threads;
+		int end = height_ * (thread_ + 1) / threads;
+		for (int row = begin; row < end; row++)
+		{
+			const byte* samples = samples_ + row * stride_;
+			for (int i = 0; i + 1 < width_; i++)
+			{
+				int r = samples[i], s = samples[i + 1];
+				bool even = (s & 1) == 0;
+				x += (even && r < s) || (!even && r > s);
+				y += (even && r > s) || (!even && r < s);
+				k += (r >> 1) == (s >> 1);
+			}
+		}
+		counters[thread_][0] = x;
+		counters[thread_][1] = y;
+		counters[thread_][2] = k;
+	});
+	long long x = 0, y = 0, k = 0;
+	for (int i = 0; i < threads; i++)
+	{
+		x += counters[i][0];
+		y += counters[i][1];
+		k += counters[i][2];
+	}
+	if (k == 0)
+	{
+		return 0;
+	}
+	double pairs = double(height_) * (width_ - 1);
+	double a = 2.0 * k, b = 2 * (2.0 * x - pairs), c = double(y - x);
+	double discriminant = b * b - 4 * a * c;
+	if (discriminant < 0)
+	{
+		return 0;
+	}
+	// beta is the share of changed samples, every embedded bit changes the sample with probability 1/2
+	double beta = std::min((-b + std::sqrt(discriminant)) / (2 * a), (-b - std::sqrt(discriminant)) / (2 * a));
+	return std::min(std::max(2 * beta, 0.0), 1.0);
+}
+
+Steganalysis::Report Steganalysis::Analyze(const Jpeg& jpeg_, int window_, int step_, int threads_)
+{
+	Report report;
+	std::vector<short> sequence = EmbeddingOrder(jpeg_);
+	report._chi_square_probability = ChiSquareProbability(Histogram(sequence, threads_));
+	report._chi_square_profile = ChiSquareProfile(sequence, window_, step_, threads_);
+
+	std::vector<byte> luminance = jpeg_.GetSamples(0);
+	int width = jpeg_.GetComponentWidth(0), height = jpeg_.GetComponentHeight(0);
+	report._rs_estimate = RsEstimate(luminance.data(), width, height, width, threads_);
+	report._sample_pairs_estimate = SamplePairsEstimate(luminance.data(), width, height, width, threads_);
+
+	report._score = std::max(report._chi_square_probability, std::max(report._rs_estimate, report._sample_pairs_estimate));
+	for (int i = 0; i < report._chi_square_profile.size(); i++)
+	{
+		report._score = std::max(report._score, report._chi_square_profile[i]);
+	}
+	return report;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include<vector>
+#include"BitStream.h"
+
+class Jpeg;
+
+/// Steganalysis class, that screens images for LSB-style embedding.
+/// All histograms are built per thread and merged, threads_ equal to 0 means hardware concurrency.
+class Steganalysis
+{
+public:
+
+	struct Report
+	{
+		double _chi_square_probability;          // over all usable AC coefficients
+		std::vector<double> _chi_square_profile; // over sliding windows along the embedding order
+		double _rs_estimate;                     // estimated embedding rate of luminance LSBs
+		double _sample_pairs_estimate;           // estimated embedding rate of luminance LSBs
+		double _score;                           // the strongest of all detectors, from 0 to 1
+	};
+
+	/// Runs all detectors over the decoded image
+	static Report Analyze(const Jpeg& jpeg_, int window_ = 4096, int step_ = 1024, int threads_ = 0);
+
+	/// Usable AC coefficients in the order of sequential embedding
+	static std::vector<short> EmbeddingOrder(const Jpeg& jpeg_);
+
+	/// Westfeld-Pfitzmann attack: probability of embedding, pairs of values 2i and 2i+1 are
+	/// equalized by LSB replacement, so chi-square statistic over them becomes small
+	static double ChiSquareProbability(const std::vector<unsigned long long>& histogram_);
+	static std::vector<double> ChiSquareProfile(const std::vector<short>& sequence_, int window_, int step_, int threads_ = 0);
+
+	/// Fridrich-Goljan-Du RS analysis over groups of 4 horizontally adjacent samples with mask [0 1 1 0]
+	static double RsEstimate(const byte* samples_, int width_, int height_, int stride_, int threads_ = 0);
+	/// Dumitrescu-Wu-Wang sample pairs analysis over horizontally adjacent samples
+	static double SamplePairsEstimate(const byte* samples_, int width_, int height_, int stride_, int threads_ = 0);
+
+	/// Histogram of coefficient values, value v is counted in bin v + histogram_offset
+	static std::vector<unsigned long long> Histogram(const std::vector<short>& sequence_, int threads_ = 0);
+	static const int histogram_offset = 2048;
+	static const int histogram_size = 4096;
+};
\ No newline at end of file
@@ -0,0 +1,213 @@
+#include "SyntheticJpeg.h"
+#include "Jpeg.h"
+#include "JpegWriter.h"
+#include "Dct.h"
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	/// SplitMix64, the whole sequence is defined by the seed
+	class Random
+	{
+		unsigned long long _state;
+	public:
+		explicit Random(unsigned long long seed_) : _state(seed_) {}
+		unsigned long long Next()
+		{
+			unsigned long long z = (_state += 0x9E3779B97F4A7C15ull);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			return z ^ (z >> 31);
+		}
+		/// Uniform in [0, bound_)
+		int Below(int bound_)
+		{
+			return int(Next() % unsigned(bound_));
+		}
+	};
+
+	/// Triangle wave with period 256 and values from 0 to 128
+	int triangle(int phase_)
+	{
+		phase_ &= 0xFF;
+		return phase_ < 128 ? phase_ : 256 - phase_;
+	}
+
+	struct Rectangle
+	{
+		int _left, _top, _right, _bottom, _offset;
+	};
+
+	/// Samples of one component, width_ x height_ without padding
+	std::vector<int> make_samples(int width_, int height_, int component_, Random& random_)
+	{
+		int horizontal_frequency = 1 + random_.Below(6);
+		int vertical_frequency = 1 + random_.Below(6);
+		int gradient_x = random_.Below(128) - 64;
+		int gradient_y = random_.Below(128) - 64;
+		int texture_amplitude = component_ == 0 ? 24 + random_.Below(24) : 8 + random_.Below(8);
+		int noise = component_ == 0 ? 6 : 3;
+
+		std::vector<Rectangle> rectangles(4 + random_.Below(8));
+		for (int i = 0; i < rectangles.size(); i++)
+		{
+			Rectangle& rectangle = rectangles[i];
+			rectangle._left = random_.Below(width_);
+			rectangle._top = random_.Below(height_);
+			rectangle._right = rectangle._left + 1 + random_.Below(std::max(1, width_ / 3));
+			rectangle._bottom = rectangle._top + 1 + random_.Below(std::max(1, height_ / 3));
+			rectangle._offset = random_.Below(96) - 48;
+		}
+
+		std::vector<int> samples(size_t(width_) * height_);
+		for (int y = 0; y < height_; y++)
+		{
+			for (int x = 0; x < width_; x++)
+			{
+				int value = 128;
+				value += gradient_x * x / std::max(1, width_) + gradient_y * y / std::max(1, height_);
+				value += (triangle(x * horizontal_frequency + y) - 64) * texture_amplitude / 64 *
+					(triangle(y * vertical_frequency) - 32) / 64;
+				for (int i = 0; i < rectangles.size(); i++)
+				{
+					const Rectangle& rectangle = rectangles[i];
+					if (x >= rectangle._left && x < rectangle._right && y >= rectangle._top && y < rectangle._bottom)
+					{
+						value += rectangle._offset;
+					}
+				}
+				value += random_.Below(2 * noise + 1) - noise;
+				samples[size_t(y) * width_ + x] = std::min(std::max(value, 0), 255);
+			}
+		}
+		return samples;
+	}
+}
+
+std::string SyntheticJpeg::Parameters::Name() const
+{
+	return "synthetic_" + std::to_string(_width) + "x" + std::to_string(_height) +
+		"_c" + std::to_string(_components) +
+		"_h" + std::to_string(_horizontal_sampling) + "v" + std::to_string(_vertical_sampling) +
+		"_ri" + std::to_string(_restart_interval) +
+		"_q" + std::to_string(_quality) +
+		"_s" + std::to_string(_seed) + ".jpg";
+}
+
+std::vector<byte> SyntheticJpeg::Generate(const Parameters& parameters_)
+{
+	if (parameters_._width <= 0 || parameters_._height <= 0 || parameters_._width > 0xFFFF || parameters_._height > 0xFFFF ||
+		(parameters_._components != 1 && parameters_._components != 3) ||
+		parameters_._horizontal_sampling < 1 || parameters_._horizontal_sampling > 4 ||
+		parameters_._vertical_sampling < 1 || parameters_._vertical_sampling > 4)
+	{
+		throw std::invalid_argument("Invalid parameters of synthetic image " + parameters_.Name());
+	}
+
+	Random random(parameters_._seed * 0x2545F4914F6CDD1Dull + 1);
+
+	Jpeg jpeg;
+	jpeg._picture_width = parameters_._width;
+	jpeg._picture_height = parameters_._height;
+	jpeg._restart_interval = parameters_._restart_interval;
+	bool gray = parameters_._components == 1;
+	jpeg._max_horizontal_thinning = gray ? 1 : parameters_._horizontal_sampling;
+	jpeg._max_vertical_thinning = gray ? 1 : parameters_._vertical_sampling;
+
+	jpeg.calculating_zigzag_order_traversal(0, 8);
+	for (int i = 0; i < jpeg._zigzag_order_traversal_indices.size(); i++)
+	{
+		jpeg._zigzag_to_natural.push_back(jpeg._zigzag_order_traversal_indices[i].first * 8 + jpeg._zigzag_order_traversal_indices[i].second);
+	}
+
+	jpeg._quantization_tables.resize(0x10);
+	const int* standard_tables[2] = { JpegWriter::standard_luminance_quantization, JpegWriter::standard_chrominance_quantization };
+	for (int t = 0; t < 2; t++)
+	{
+		std::vector<int> table = JpegWriter::ScaledQuantizationTable(standard_tables[t], parameters_._quality);
+		jpeg._quantization_tables[t].assign(8, std::pmr::vector<int>(8));
+		for (int i = 0; i < 64; i++)
+		{
+			jpeg._quantization_tables[t][i / 8][i % 8] = table[i];
+		}
+	}
+
+	int mcus_per_line = (parameters_._width + 8 * jpeg._max_horizontal_thinning - 1) / (8 * jpeg._max_horizontal_thinning);
+	int mcus_per_column = (parameters_._height + 8 * jpeg._max_vertical_thinning - 1) / (8 * jpeg._max_vertical_thinning);
+	std::vector<Jpeg::ScanComponent> scan;
+	for (int c = 0; c < parameters_._components; c++)
+	{
+		Jpeg::Frame frame;
+		frame._id = byte(c + 1);
+		frame._horizontal_thinning = c == 0 ? jpeg._max_horizontal_thinning : 1;
+		frame._vertical_thinning = c == 0 ? jpeg._max_vertical_thinning : 1;
+		frame._id_of_quantization_table = c == 0 ? 0 : 1;
+		frame._blocks_per_line = mcus_per_line * frame._horizontal_thinning;
+		frame._blocks_per_column = mcus_per_column * frame._vertical_thinning;
+		jpeg._frames.push_back(frame);
+
+		Jpeg::ScanComponent component;
+		component._frame_index = c;
+		component._id_of_DC_table = c == 0 ? 0 : 1;
+		component._id_of_AC_table = c == 0 ? 0 : 1;
+		scan.push_back(component);
+	}
+	jpeg._scans.push_back(scan);
+	jpeg._dc_predictors.resize(parameters_._components);
+
+	// [A.3.3] level shift, forward DCT and [A.3.4] quantization of every block, padding repeats the edge samples
+	jpeg._coefficients.resize(parameters_._components);
+	for (int c = 0; c < parameters_._components; c++)
+	{
+		const Jpeg::Frame& frame = jpeg._frames[c];
+		int width = jpeg.GetComponentWidth(c);
+		int height = jpeg.GetComponentHeight(c);
+		std::vector<int> samples = make_samples(width, height, c, random);
+		const std::pmr::vector<std::pmr::vector<int>>& table = jpeg._quantization_tables[frame._id_of_quantization_table];
+
+		std::pmr::vector<short>& coefficients = jpeg._coefficients[c];
+		coefficients.resize(size_t(frame._blocks_per_line) * frame._blocks_per_column * 64);
+		float block[64], transformed[64];
+		for (int row = 0; row < frame._blocks_per_column; row++)
+		{
+			for (int column = 0; column < frame._blocks_per_line; column++)
+			{
+				for (int i = 0; i < 64; i++)
+				{
+					int y = std::min(row * 8 + i / 8, height - 1);
+					int x = std::min(column * 8 + i % 8, width - 1);
+					block[i] = float(samples[size_t(y) * width + x] - 128);
+				}
+				Dct::Forward(block, transformed);
+				short* output = coefficients.data() + (size_t(row) * frame._blocks_per_line + column) * 64;
+				for (int i = 0; i < 64; i++)
+				{
+					output[i] = short(std::lround(transformed[i] / table[i / 8][i % 8]));
+				}
+			}
+		}
+	}
+
+	return JpegWriter(jpeg).Release();
+}
+
+std::vector<SyntheticJpeg::Parameters> SyntheticJpeg::Corpus()
+{
+	// width, height, components, sampling, restart interval, quality, seed
+	return
+	{
+		{ 16, 16, 1, 1, 1, 0, 75, 1 },
+		{ 64, 48, 3, 1, 1, 0, 90, 2 },
+		{ 333, 251, 3, 2, 2, 0, 75, 3 },
+		{ 333, 251, 3, 2, 1, 5, 50, 4 },
+		{ 640, 480, 3, 1, 1, 8, 95, 5 },
+		{ 640, 480, 1, 1, 1, 0, 75, 6 },
+		{ 1024, 768, 3, 2, 2, 0, 75, 7 },
+		{ 1024, 768, 3, 2, 2, 16, 30, 8 },
+		{ 1024, 768, 3, 1, 2, 0, 85, 9 },
+		{ 2048, 1536, 3, 2, 2, 0, 80, 10 },
+		{ 2048, 1536, 1, 1, 1, 64, 60, 11 },
+	};
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include<vector>
+#include<string>
+#include"BitStream.h"
+
+/// SyntheticJpeg class, that generates deterministic baseline JPEG files for benchmarks.
+/// Content is gradients with texture, edges and noise, so the coefficient statistics resemble photographs.
+/// Samples are made by integer arithmetic and own random numbers instead of std distributions,
+/// so the same parameters give the same image everywhere.
+class SyntheticJpeg
+{
+public:
+
+	struct Parameters
+	{
+		int _width;
+		int _height;
+		int _components;            // 1 or 3
+		int _horizontal_sampling;   // of luminance, chroma is always 1x1
+		int _vertical_sampling;
+		int _restart_interval;      // in MCUs, 0 means no restart markers
+		int _quality;               // IJG quality of the standard tables
+		unsigned _seed;
+
+		/// File name, which tells all parameters, e.g. "synthetic_640x480_c3_h2v2_ri0_q75_s1.jpg"
+		std::string Name() const;
+	};
+
+	static std::vector<byte> Generate(const Parameters& parameters_);
+
+	/// The benchmark corpus: every size, sampling, restart interval and quality is met at least once
+	static std::vector<Parameters> Corpus();
+};
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace
+{
+	// pool and index of the worker, which runs on the current thread
+	thread_local const ThreadPool* current_pool = nullptr;
+	thread_local int current_worker = -1;
+}
+
+ThreadPool::ThreadPool(int threads_)
+	: _queued(0)
+	, _pending(0)
+	, _stopping(false)
+	, _next_worker(0)
+{
+	if (threads_ <= 0)
+	{
+		threads_ = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (int i = 0; i < threads_; i++)
+	{
+		_workers.emplace_back(new Worker());
+	}
+	for (int i = 0; i < threads_; i++)
+	{
+		_threads.emplace_back(&ThreadPool::worker_loop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_work_available.notify_all();
+	for (int i = 0; i < _threads.size(); i++)
+	{
+		_threads[i].join();
+	}
+}
+
+void ThreadPool::Submit(Task task_)
+{
+	// counters go first, so a worker never takes a task, which is not counted yet
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_pending++;
+		_queued++;
+	}
+	int worker = current_pool == this ? current_worker : int(_next_worker++ % _workers.size());
+	{
+		std::lock_guard<std::mutex> lock(_workers[worker]->_mutex);
+		_workers[worker]->_tasks.push_back(std::move(task_));
+	}
+	_work_available.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_all_done.wait(lock, [this] { return _pending == 0; });
+	if (_error)
+	{
+		std::exception_ptr error = _error;
+		_error = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+int ThreadPool::Size() const
+{
+	return _workers.size();
+}
+
+bool ThreadPool::try_pop(int worker_, Task& task_)
+{
+	Worker& worker = *_workers[worker_];
+	std::lock_guard<std::mutex> lock(worker._mutex);
+	if (worker._tasks.empty())
+	{
+		return false;
+	}
+	task_ = std::move(worker._tasks.back());
+	worker._tasks.pop_back();
+	return true;
+}
+
+bool ThreadPool::try_steal(int worker_, Task& task_)
+{
+	for (int i = 1; i < _workers.size(); i++)
+	{
+		Worker& victim = *_workers[(worker_ + i) % _workers.size()];
+		std::unique_lock<std::mutex> lock(victim._mutex, std::try_to_lock);
+		if (!lock.owns_lock() || victim._tasks.empty())
+		{
+			continue;
+		}
+		task_ = std::move(victim._tasks.front());
+		victim._tasks.pop_front();
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::worker_loop(int worker_)
+{
+	current_pool = this;
+	current_worker = worker_;
+	while (true)
+	{
+		Task task;
+		if (this->try_pop(worker_, task) || this->try_steal(worker_, task))
+		{
+			_queued--;
+			try
+			{
+				task();
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (!_error)
+				{
+					_error = std::current_exception();
+				}
+			}
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (--_pending == 0)
+			{
+				_all_done.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (_stopping && _queued == 0)
+		{
+			return;
+		}
+		_work_available.wait(lock, [this] { return _stopping || _queued > 0; });
+		if (_stopping && _queued == 0)
+		{
+			return;
+		}
+	}
+}
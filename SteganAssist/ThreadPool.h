@@ -0,0 +1,57 @@
+#pragma once
+#include<deque>
+#include<mutex>
+#include<atomic>
+#include<thread>
+#include<vector>
+#include<memory>
+#include<exception>
+#include<functional>
+#include<condition_variable>
+
+/// ThreadPool class, that runs long-living workers with work stealing.
+/// Every worker has its own deque: it takes the newest task from the back of its own deque and,
+/// when that one is empty, steals the oldest task from the front of the others, so a worker stuck
+/// on a huge image never holds back the tasks queued behind it.
+class ThreadPool
+{
+public:
+	typedef std::function<void()> Task;
+
+private:
+	struct Worker
+	{
+		std::deque<Task> _tasks;
+		std::mutex _mutex;
+	};
+
+	std::vector<std::unique_ptr<Worker>> _workers;
+	std::vector<std::thread> _threads;
+
+	std::mutex _mutex;
+	std::condition_variable _work_available;
+	std::condition_variable _all_done;
+	std::atomic<long long> _queued;  // tasks lying in deques
+	long long _pending;              // tasks submitted and not finished yet, guarded by _mutex
+	bool _stopping;
+	std::atomic<unsigned> _next_worker;
+	std::exception_ptr _error;
+
+	bool try_pop(int worker_, Task& task_);
+	bool try_steal(int worker_, Task& task_);
+	void worker_loop(int worker_);
+
+public:
+
+	/// threads_ equal to 0 means hardware concurrency
+	explicit ThreadPool(int threads_ = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/// Tasks submitted from the worker go to its own deque, others are spread round-robin
+	void Submit(Task task_);
+	/// Blocks until every submitted task is finished, rethrows the first exception thrown by a task
+	void Wait();
+	int Size() const;
+};
\ No newline at end of file